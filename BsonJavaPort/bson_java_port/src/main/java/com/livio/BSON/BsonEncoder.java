@@ -43,6 +43,9 @@ public class BsonEncoder {
             } else if (value instanceof List){
                 long arrayRef = buildBsonArray((List<Object>) value);
                 bson_object_put_array(bsonRef, key, arrayRef);
+            } else if (isPrimitiveArray(value)) {
+                long arrayRef = buildBsonPrimitiveArray(value);
+                bson_object_put_array(bsonRef, key, arrayRef);
             } else if (value instanceof Integer) {
                 bson_object_put_int32(bsonRef, key, (Integer) value);
             } else if (value instanceof Long) {
@@ -69,6 +72,9 @@ public class BsonEncoder {
             } else if (value instanceof List){
                 long arrayRef = buildBsonArray((List<Object>) value);
                 bson_array_add_array(bsonRef, arrayRef);
+            } else if (isPrimitiveArray(value)) {
+                long arrayRef = buildBsonPrimitiveArray(value);
+                bson_array_add_array(bsonRef, arrayRef);
             } else if (value instanceof Integer) {
                 bson_array_add_int32(bsonRef, (Integer) value);
             } else if (value instanceof Long) {
@@ -85,6 +91,34 @@ public class BsonEncoder {
         return bsonRef;
     }
 
+    private static boolean isPrimitiveArray(Object value) {
+        return value instanceof int[] || value instanceof long[] || value instanceof double[]
+                || value instanceof boolean[] || value instanceof String[];
+    }
+
+    // Java arrays of a single type are added in bulk
+    private static long buildBsonPrimitiveArray(Object values) {
+        long bsonRef;
+        if (values instanceof int[]) {
+            bsonRef = initializeBsonArray(((int[]) values).length);
+            bson_array_add_int32_n(bsonRef, (int[]) values);
+        } else if (values instanceof long[]) {
+            bsonRef = initializeBsonArray(((long[]) values).length);
+            bson_array_add_int64_n(bsonRef, (long[]) values);
+        } else if (values instanceof double[]) {
+            bsonRef = initializeBsonArray(((double[]) values).length);
+            bson_array_add_double_n(bsonRef, (double[]) values);
+        } else if (values instanceof boolean[]) {
+            bsonRef = initializeBsonArray(((boolean[]) values).length);
+            bson_array_add_bool_n(bsonRef, (boolean[]) values);
+        } else {
+            bsonRef = initializeBsonArray(((String[]) values).length);
+            bson_array_add_string_n(bsonRef, (String[]) values);
+        }
+
+        return bsonRef;
+    }
+
     // BSON Object Methods
 
     private static native long initializeBsonObject();
@@ -132,6 +166,16 @@ public class BsonEncoder {
     private static native boolean bson_array_add_bool(long bsonRef, boolean value);
 
     private static native boolean bson_array_add_double(long bsonRef, double value);
+
+    private static native boolean bson_array_add_int32_n(long bsonRef, int[] values);
+
+    private static native boolean bson_array_add_int64_n(long bsonRef, long[] values);
+
+    private static native boolean bson_array_add_string_n(long bsonRef, String[] values);
+
+    private static native boolean bson_array_add_bool_n(long bsonRef, boolean[] values);
+
+    private static native boolean bson_array_add_double_n(long bsonRef, double[] values);
 }
 
 
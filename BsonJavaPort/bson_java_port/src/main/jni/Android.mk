@@ -1,6 +1,6 @@
 LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 LOCAL_MODULE := bson-c-lib
-LOCAL_SRC_FILES := bson_jni.c ../../../../../src/bson_object.c ../../../../../src/emhashmap/emhashmap.c ../../../../../src/bson_array.c ../../../../../src/bson_util.c
+LOCAL_SRC_FILES := bson_jni.c ../../../../../src/bson_object.c ../../../../../src/emhashmap/emhashmap.c ../../../../../src/bson_array.c ../../../../../src/bson_util.c ../../../../../src/bson_writer.c ../../../../../src/bson_iovec.c ../../../../../src/bson_template.c ../../../../../src/bson_cache.c
 LOCAL_LDFLAGS += -Wl,--exclude-libs,libunwind.a
 include $(BUILD_SHARED_LIBRARY)
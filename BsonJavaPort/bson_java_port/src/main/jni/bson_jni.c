@@ -102,13 +102,11 @@ Java_com_livio_BSON_BsonEncoder_bson_1object_1put_1object(
     JNIEnv *env, jclass type, jlong bsonRef, jstring key_, jlong value) {
   const char *key = (*env)->GetStringUTFChars(env, key_, 0);
 
-  jboolean tf = (jboolean)bson_object_put_object((BsonObject *)bsonRef, key,
-                                                 (BsonObject *)value);
+  // The root object takes ownership of the BsonObject struct
+  jboolean tf = (jboolean)bson_object_put_object_owned((BsonObject *)bsonRef, key,
+                                                       (BsonObject *)value);
 
   (*env)->ReleaseStringUTFChars(env, key_, key);
-  // The BsonObject struct has been copied into the root object, no need to keep
-  // the original version
-  free((BsonObject *)value);
 
   return tf;
 }
@@ -117,13 +115,11 @@ Java_com_livio_BSON_BsonEncoder_bson_1object_1put_1array(
     JNIEnv *env, jclass type, jlong bsonRef, jstring key_, jlong value) {
   const char *key = (*env)->GetStringUTFChars(env, key_, 0);
 
-  jboolean tf = (jboolean)bson_object_put_array((BsonObject *)bsonRef, key,
-                                                (BsonArray *)value);
+  // The object takes ownership of the BsonArray struct
+  jboolean tf = (jboolean)bson_object_put_array_owned((BsonObject *)bsonRef, key,
+                                                      (BsonArray *)value);
 
   (*env)->ReleaseStringUTFChars(env, key_, key);
-  // The BsonArray struct has been copied into the object, no need to keep the
-  // original version
-  free((BsonArray *)value);
 
   return tf;
 }
@@ -253,11 +249,9 @@ Java_com_livio_BSON_BsonEncoder_bson_1array_1add_1object(JNIEnv *env,
                                                          jlong bsonRef,
                                                          jlong value) {
 
-  jboolean tf = (jboolean)bson_array_add_object((BsonArray *)bsonRef,
-                                                (BsonObject *)value);
-  // The BsonObject struct has been copied into the array, no need to keep the
-  // original version
-  free((BsonObject *)value);
+  // The array takes ownership of the BsonObject struct
+  jboolean tf = (jboolean)bson_array_add_object_owned((BsonArray *)bsonRef,
+                                                      (BsonObject *)value);
 
   return tf;
 }
@@ -268,11 +262,135 @@ Java_com_livio_BSON_BsonEncoder_bson_1array_1add_1array(JNIEnv *env,
                                                         jlong bsonRef,
                                                         jlong value) {
 
-  jboolean tf =
-      (jboolean)bson_array_add_array((BsonArray *)bsonRef, (BsonArray *)value);
-  // The BsonArray struct has been copied into the root array, no need to keep
-  // the original version
-  free((BsonArray *)value);
+  // The root array takes ownership of the BsonArray struct
+  jboolean tf = (jboolean)bson_array_add_array_owned((BsonArray *)bsonRef,
+                                                     (BsonArray *)value);
+
+  return tf;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_livio_BSON_BsonEncoder_bson_1array_1add_1int32_1n(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong bsonRef,
+                                                          jintArray values_) {
+  jsize count = (*env)->GetArrayLength(env, values_);
+  jint *values = (*env)->GetIntArrayElements(env, values_, NULL);
+  if (values == NULL) {
+    return false;
+  }
+
+  jboolean tf = (jboolean)bson_array_add_int32_n((BsonArray *)bsonRef,
+                                                 (const int32_t *)values, count);
+
+  (*env)->ReleaseIntArrayElements(env, values_, values, JNI_ABORT);
+
+  return tf;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_livio_BSON_BsonEncoder_bson_1array_1add_1int64_1n(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong bsonRef,
+                                                          jlongArray values_) {
+  jsize count = (*env)->GetArrayLength(env, values_);
+  jlong *values = (*env)->GetLongArrayElements(env, values_, NULL);
+  if (values == NULL) {
+    return false;
+  }
+
+  jboolean tf = (jboolean)bson_array_add_int64_n((BsonArray *)bsonRef,
+                                                 (const int64_t *)values, count);
+
+  (*env)->ReleaseLongArrayElements(env, values_, values, JNI_ABORT);
+
+  return tf;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_livio_BSON_BsonEncoder_bson_1array_1add_1double_1n(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong bsonRef,
+                                                           jdoubleArray values_) {
+  jsize count = (*env)->GetArrayLength(env, values_);
+  jdouble *values = (*env)->GetDoubleArrayElements(env, values_, NULL);
+  if (values == NULL) {
+    return false;
+  }
+
+  jboolean tf = (jboolean)bson_array_add_double_n((BsonArray *)bsonRef,
+                                                  (const double *)values, count);
+
+  (*env)->ReleaseDoubleArrayElements(env, values_, values, JNI_ABORT);
+
+  return tf;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_livio_BSON_BsonEncoder_bson_1array_1add_1bool_1n(JNIEnv *env,
+                                                         jclass type,
+                                                         jlong bsonRef,
+                                                         jbooleanArray values_) {
+  jsize count = (*env)->GetArrayLength(env, values_);
+  // jboolean and bson_boolean differ in size, so the values are converted first
+  bson_boolean *bsonBooleans = malloc(count * sizeof(bson_boolean) + 1);
+  jboolean *values = (*env)->GetBooleanArrayElements(env, values_, NULL);
+  if (bsonBooleans == NULL || values == NULL) {
+    free(bsonBooleans);
+    if (values != NULL) {
+      (*env)->ReleaseBooleanArrayElements(env, values_, values, JNI_ABORT);
+    }
+    return false;
+  }
+
+  jsize i;
+  for (i = 0; i < count; i++) {
+    bsonBooleans[i] = values[i] ? BOOLEAN_TRUE : BOOLEAN_FALSE;
+  }
+  (*env)->ReleaseBooleanArrayElements(env, values_, values, JNI_ABORT);
+
+  jboolean tf = (jboolean)bson_array_add_bool_n((BsonArray *)bsonRef,
+                                                bsonBooleans, count);
+
+  free(bsonBooleans);
+
+  return tf;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_livio_BSON_BsonEncoder_bson_1array_1add_1string_1n(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong bsonRef,
+                                                           jobjectArray values_) {
+  jsize count = (*env)->GetArrayLength(env, values_);
+  // Every string stays referenced until the values have been added
+  if ((*env)->PushLocalFrame(env, count) != 0) {
+    return false;
+  }
+  jstring *strings = malloc(count * sizeof(jstring) + 1);
+  const char **values = malloc(count * sizeof(const char *) + 1);
+  jboolean tf = false;
+  jsize i = 0;
+  if (strings != NULL && values != NULL) {
+    for (i = 0; i < count; i++) {
+      strings[i] = (jstring)(*env)->GetObjectArrayElement(env, values_, i);
+      values[i] = (*env)->GetStringUTFChars(env, strings[i], 0);
+      if (values[i] == NULL) {
+        break;
+      }
+    }
+    if (i == count) {
+      tf = (jboolean)bson_array_add_string_n((BsonArray *)bsonRef, values, NULL, count);
+    }
+  }
+
+  while (i > 0) {
+    i--;
+    (*env)->ReleaseStringUTFChars(env, strings[i], values[i]);
+  }
+  free(strings);
+  free(values);
+  (*env)->PopLocalFrame(env, NULL);
 
   return tf;
 }
@@ -329,7 +447,7 @@ jobject bson_object_to_hashmap(JNIEnv *env, BsonObject *bsonRef) {
 
       (*env)->CallObjectMethod(env, hashMap, put, key, obj);
     } else if (element->type == TYPE_STRING) {
-      jstring obj = (*env)->NewStringUTF(env, (char *)element->value);
+      jstring obj = (*env)->NewStringUTF(env, bson_element_get_string(element));
       (*env)->CallObjectMethod(env, hashMap, put, key, obj);
     } else if (element->type == TYPE_BOOLEAN) {
       bson_boolean bb = *(bson_boolean *)element->value;
@@ -375,9 +493,14 @@ jobject bson_array_to_list(JNIEnv *env, BsonArray *bsonRef) {
       (*env)->GetMethodID(env, listClass, "add", "(Ljava/lang/Object;)Z");
 
   size_t i;
+  //Values of packed and columnar arrays are read without converting the array
+  BsonElementSlot slot;
+  bson_element_slot_initialize(&slot);
   for (i = 0; i < bsonRef->count; i++) {
-    BsonElement *element = bson_array_get(bsonRef, (size_t)i);
-    if (element->type == TYPE_DOCUMENT) {
+    const BsonElement *element = bson_array_get_element(bsonRef, (size_t)i, &slot);
+    if (element == NULL) {
+      continue;
+    } else if (element->type == TYPE_DOCUMENT) {
       BsonObject *ref = (BsonObject *)element->value;
 
       jobject obj = bson_object_to_hashmap(env, ref);
@@ -407,7 +530,7 @@ jobject bson_array_to_list(JNIEnv *env, BsonArray *bsonRef) {
 
       (*env)->CallBooleanMethod(env, list, add, obj);
     } else if (element->type == TYPE_STRING) {
-      jstring obj = (*env)->NewStringUTF(env, (char *)element->value);
+      jstring obj = (*env)->NewStringUTF(env, bson_element_get_string(element));
       (*env)->CallBooleanMethod(env, list, add, obj);
     } else if (element->type == TYPE_BOOLEAN) {
       bson_boolean bb = *(bson_boolean *)element->value;
@@ -435,6 +558,7 @@ jobject bson_array_to_list(JNIEnv *env, BsonArray *bsonRef) {
       (*env)->CallBooleanMethod(env, list, add, obj);
     }
   }
+  bson_element_slot_deinitialize(&slot);
   return list;
 }
 
@@ -0,0 +1,61 @@
+#include "../src/bson_object.h"
+#include <stdio.h>
+#include <time.h>
+
+#define ARRAY_LENGTH 1000000
+#define ITERATIONS 20
+
+double elapsed_seconds(clock_t start) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void print_throughput(const char *name, size_t bytes, double seconds) {
+  printf("%-16s %8.3f GB/s\n", name, (double)bytes * ITERATIONS / seconds / 1e9);
+}
+
+void benchmark_array(const char *name, BsonArray *array) {
+  size_t size = bson_array_size(array);
+  uint8_t *bytes = NULL;
+  int i = 0;
+
+  clock_t start = clock();
+  for (i = 0; i < ITERATIONS; i++) {
+    free(bytes);
+    bytes = bson_array_to_bytes(array);
+  }
+  char label[64];
+  sprintf(label, "%s encode", name);
+  print_throughput(label, size, elapsed_seconds(start));
+
+  start = clock();
+  for (i = 0; i < ITERATIONS; i++) {
+    BsonArray parsed;
+    if (bson_array_from_bytes_len(&parsed, bytes, size) != size) {
+      printf("Failed to parse %s array\n", name);
+      break;
+    }
+    bson_array_deinitialize(&parsed);
+  }
+  sprintf(label, "%s decode", name);
+  print_throughput(label, size, elapsed_seconds(start));
+  free(bytes);
+}
+
+int main() {
+  BsonArray int32Array;
+  bson_array_initialize_typed(&int32Array, TYPE_INT32, ARRAY_LENGTH);
+  BsonArray doubleArray;
+  bson_array_initialize_typed(&doubleArray, TYPE_DOUBLE, ARRAY_LENGTH);
+  int32_t i = 0;
+  for (i = 0; i < ARRAY_LENGTH; i++) {
+    bson_array_add_int32(&int32Array, i * 31);
+    bson_array_add_double(&doubleArray, i * 0.25);
+  }
+
+  benchmark_array("int32", &int32Array);
+  benchmark_array("double", &doubleArray);
+
+  bson_array_deinitialize(&int32Array);
+  bson_array_deinitialize(&doubleArray);
+  return 0;
+}
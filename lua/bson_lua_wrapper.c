@@ -8,6 +8,7 @@
 
 static int table_to_bson_object(lua_State *L, BsonObject *obj, char *errorMessage);
 static int table_to_bson_array(lua_State *L, BsonArray *arr, char *errorMessage);
+static int list_to_bson_array(lua_State *L, BsonArray *arr, element_type itemType, char *errorMessage);
 static int bson_put_map_value(lua_State *L, void *bson, const char *key, char *errorMessage);
 
 static int bson_object_to_table(lua_State *L, BsonObject *obj, char *errorMessage);
@@ -23,6 +24,12 @@ static int bson_element_to_table(lua_State *L, const BsonElement *element, char
             type = element_type,
             value = val
           }
+        Arrays of a single type may instead hold a plain list of values, such as
+          map[key] = {
+            type = 0x04,
+            item_type = element_type,
+            value = {val1, val2, ...}
+          }
     Lua return values:
       1 (string) - Byte string containing the BSON representation of the map
 
@@ -165,6 +172,110 @@ static int table_to_bson_array(lua_State *L, BsonArray *arr, char *errorMessage)
   return 0;
 }
 
+/*
+  @brief Convert a Lua list of values sharing a single type into a BSON array.
+    The values are collected into a C array and added in bulk.
+    Lua arguments:
+      1 (table) - Lua list of plain values, such as {1, 2, 3}
+
+  @param L - Lua state, used to modify the Lua stack
+  @param arr - The array where the converted list is stored
+  @param itemType - The BSON type of every value in the list
+  @param errorMessage - To be populated with an error message if an error occurs
+
+  @return 0 on success, non-zero on failure
+*/
+static int list_to_bson_array(lua_State *L, BsonArray *arr, element_type itemType, char *errorMessage) {
+  //Verifies that the object at the top of the stack is a table
+  if (lua_istable(L, -1) == 0) {
+    snprintf(errorMessage, 255, "Expected array, but value was of type: %s", 
+         lua_typename(L, lua_type(L, -1)));
+    return -1;
+  }
+
+  //Stack: [bson_list]
+  const size_t len = (size_t)luaL_len(L, -1);
+  size_t valueSize;
+  switch (itemType) {
+    case TYPE_INT32: valueSize = sizeof(int32_t); break;
+    case TYPE_INT64: valueSize = sizeof(int64_t); break;
+    case TYPE_DOUBLE: valueSize = sizeof(double); break;
+    case TYPE_BOOLEAN: valueSize = sizeof(bson_boolean); break;
+    case TYPE_STRING: valueSize = sizeof(const char *) + sizeof(size_t); break;
+    default: {
+      snprintf(errorMessage, 255, "Error parsing table, unsupported item type: %i", (int)itemType);
+      return -1;
+    }
+  }
+  if (!bson_array_initialize(arr, len)) {
+    snprintf(errorMessage, 255, "Failed to initialize BSON array");
+    return -1;
+  }
+
+  uint8_t *values = malloc(len * valueSize + 1);
+  if (values == NULL) {
+    snprintf(errorMessage, 255, "Failed to allocate memory for array values");
+    bson_array_deinitialize(arr);
+    return -1;
+  }
+  const char **strings = (const char **)values;
+  size_t *lengths = (size_t *)(values + len * sizeof(const char *));
+
+  size_t index;
+  for (index = 0; index < len; index++) {
+    lua_rawgeti(L, -1, (int)index + 1); //Stack: [bson_list, value]
+    switch (itemType) {
+      case TYPE_INT32:
+        ((int32_t *)values)[index] = (int32_t)luaL_checkinteger(L, -1);
+        break;
+      case TYPE_INT64:
+        ((int64_t *)values)[index] = (int64_t)luaL_checkinteger(L, -1);
+        break;
+      case TYPE_DOUBLE:
+        ((double *)values)[index] = (double)luaL_checknumber(L, -1);
+        break;
+      case TYPE_BOOLEAN:
+        if (lua_isboolean(L, -1) == 0) {
+          snprintf(errorMessage, 255, "Expected boolean, but value was of type: %s", 
+               lua_typename(L, lua_type(L, -1)));
+          free(values);
+          bson_array_deinitialize(arr);
+          return -1;
+        }
+        ((bson_boolean *)values)[index] = (bson_boolean)lua_toboolean(L, -1);
+        break;
+      default:
+        //Strings stay referenced by the list, so their pointers remain valid after popping them
+        if (lua_type(L, -1) != LUA_TSTRING) {
+          snprintf(errorMessage, 255, "Expected string, but value was of type: %s", 
+               lua_typename(L, lua_type(L, -1)));
+          free(values);
+          bson_array_deinitialize(arr);
+          return -1;
+        }
+        strings[index] = lua_tolstring(L, -1, &lengths[index]);
+        break;
+    }
+    lua_pop(L, 1); //Stack: [bson_list]
+  }
+
+  bool added;
+  switch (itemType) {
+    case TYPE_INT32: added = bson_array_add_int32_n(arr, (int32_t *)values, len); break;
+    case TYPE_INT64: added = bson_array_add_int64_n(arr, (int64_t *)values, len); break;
+    case TYPE_DOUBLE: added = bson_array_add_double_n(arr, (double *)values, len); break;
+    case TYPE_BOOLEAN: added = bson_array_add_bool_n(arr, (bson_boolean *)values, len); break;
+    default: added = bson_array_add_string_n(arr, strings, lengths, len); break;
+  }
+  free(values);
+  if (!added) {
+    snprintf(errorMessage, 255, "Failed to add values to BSON array");
+    bson_array_deinitialize(arr);
+    return -1;
+  }
+  return 0;
+}
+
 /*
   @brief Convert a Lua table into a BSON object.
     Lua arguments:
@@ -193,34 +304,45 @@ static int bson_put_map_value(lua_State *L, void *bson, const char *key, char *e
   lua_getfield(L, -1, "value"); //Stack: [{type, value}, value]
   switch ((const element_type)type) {
     case TYPE_DOCUMENT: {
-      BsonObject value;
-      const int result = table_to_bson_object(L, &value, errorMessage);
+      BsonObject *value = malloc(sizeof(BsonObject));
+      const int result = table_to_bson_object(L, value, errorMessage);
       if (result != 0) {
+        free(value);
         return result;
       }
 
+      //The parent takes ownership of value
       //Assume array if no key is provided
       if (key == NULL) {
-        bson_array_add_object((BsonArray *)bson, &value);
+        bson_array_add_object_owned((BsonArray *)bson, value);
       }
       else {
-        bson_object_put_object((BsonObject *)bson, key, &value);
+        bson_object_put_object_owned((BsonObject *)bson, key, value);
       }
       break;
     }
     case TYPE_ARRAY: {
-      BsonArray value;
-      const int result = table_to_bson_array(L, &value, errorMessage);
+      //Arrays with an item type contain plain values rather than {type, value} entries
+      lua_getfield(L, -2, "item_type"); //Stack: [{type, item_type, value}, value, item_type]
+      const int hasItemType = !lua_isnil(L, -1);
+      const lua_Integer itemType = hasItemType ? luaL_checkinteger(L, -1) : 0;
+      lua_pop(L, 1); //Stack: [{type, item_type, value}, value]
+
+      BsonArray *value = malloc(sizeof(BsonArray));
+      const int result = hasItemType ? list_to_bson_array(L, value, (element_type)itemType, errorMessage)
+                                     : table_to_bson_array(L, value, errorMessage);
       if (result != 0) {
+        free(value);
         return result;
       }
 
+      //The parent takes ownership of value
       //Assume array if no key is provided
       if (key == NULL) {
-        bson_array_add_array((BsonArray *)bson, &value);
+        bson_array_add_array_owned((BsonArray *)bson, value);
       }
       else {
-        bson_object_put_array((BsonObject *)bson, key, &value);
+        bson_object_put_array_owned((BsonObject *)bson, key, value);
       }
       break;
     }
@@ -249,16 +371,17 @@ static int bson_put_map_value(lua_State *L, void *bson, const char *key, char *e
       break;
     }
     case TYPE_STRING: {
-      char *value = strdup(luaL_checkstring(L, -1));
+      //Lua strings may contain null characters, so the length is passed along
+      size_t length;
+      const char *value = luaL_checklstring(L, -1, &length);
 
       //Assume array if no key is provided
       if (key == NULL) {
-        bson_array_add_string((BsonArray *)bson, value);
+        bson_array_add_string_len((BsonArray *)bson, value, length);
       }
       else {
-        bson_object_put_string((BsonObject *)bson, key, value);
+        bson_object_put_string_len((BsonObject *)bson, key, value, length);
       }
-      free(value);
       break;
     }
     case TYPE_DOUBLE: {
@@ -403,16 +526,26 @@ static int bson_object_to_table(lua_State *L, BsonObject *obj, char *errorMessag
 static int bson_array_to_table(lua_State *L, BsonArray *arr, char *errorMessage) {
   lua_newtable(L); //Stack: [table]
   int index;
+  //Values of packed and columnar arrays are read without converting the array
+  BsonElementSlot slot;
+  bson_element_slot_initialize(&slot);
   for (index = 0; index < arr->count; index++) {
-    const BsonElement *element = bson_array_get(arr, index);
+    const BsonElement *element = bson_array_get_element(arr, index, &slot);
+    if (element == NULL) {
+      bson_element_slot_deinitialize(&slot);
+      sprintf(errorMessage, "Failed to read array element");
+      return 1;
+    }
     
     const int result = bson_element_to_table(L, element, errorMessage); //Stack: [table, {type, value}]
     if (result != 0) {
+      bson_element_slot_deinitialize(&slot);
       return result;
     }
 
     lua_rawseti(L, -2, index + 1 /*Lua indexing*/); //Stack: [table]
   }
+  bson_element_slot_deinitialize(&slot);
   return 0;
 }
 
@@ -466,8 +599,8 @@ static int bson_element_to_table(lua_State *L, const BsonElement *element, char
       break;
     }
     case TYPE_STRING: {
-      char *value = (char *)element->value;
-      lua_pushstring(L, value); //Stack: [{type}, value]
+      char *value = bson_element_get_string(element);
+      lua_pushlstring(L, value, element->size - STRING_OVERHEAD_BYTES); //Stack: [{type}, value]
       break;
     }
     case TYPE_DOUBLE: {
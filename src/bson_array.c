@@ -1,220 +1,2443 @@
 #include "bson_array.h"
 
+//File-backed arrays map temporary files into memory and large arrays are converted
+//by worker threads, both of which require POSIX
+#if defined(__unix__) || defined(__APPLE__)
+#define BSON_FILE_BACKED_ARRAYS
+#define BSON_PARALLEL_ARRAYS
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+//Packed values are encoded and decoded with SSE4.1 on x86 hosts which support it,
+//which is detected at run time so that the library still runs on older processors
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BSON_PACKED_SSE41
+#include <immintrin.h>
+#endif
+
+//Number of packed values encoded at a time when an array is written to a stream
+#define BSON_STREAM_BATCH_SIZE 64
+//Number of short strings stored by the first block of a string pool, later blocks are twice as large
+#define BSON_STRING_BLOCK_MIN_CELLS 4
+//Maximum number of short strings stored by a single block of a string pool
+#define BSON_STRING_BLOCK_MAX_CELLS 1024
+
+//Block of storage for short strings, which is never moved or resized
+struct BsonStringBlock {
+  //Block allocated before this one, NULL for the first block
+  struct BsonStringBlock *previous;
+  //Number of cells in this block
+  size_t capacity;
+  //Number of cells which have been handed out
+  size_t used;
+  //Storage for one string value shorter than SHORT_STRING_SIZE per cell
+  char cells[][SHORT_STRING_SIZE];
+};
+typedef struct BsonStringBlock BsonStringBlock;
+
+//Storage of the short string values of an array (see BsonArray)
+struct BsonStringPool {
+  //Most recently allocated block, NULL until a string is stored
+  BsonStringBlock *blocks;
+  //Cells of removed values, each holding a pointer to the next free cell
+  char *freeCells;
+};
+typedef struct BsonStringPool BsonStringPool;
+
+/*
+  @brief Get the size of a value stored in a packed array
+
+  @param type - The type of the value
+
+  @return - The size in bytes of a packed value of the given type, 0 if values of this type cannot be packed
+*/
+static size_t bson_packed_value_size(element_type type) {
+  switch (type) {
+    case TYPE_INT32:
+      return sizeof(int32_t);
+    case TYPE_INT64:
+      return sizeof(int64_t);
+    case TYPE_DOUBLE:
+      return sizeof(double);
+    case TYPE_BOOLEAN:
+      return sizeof(bson_boolean);
+    default:
+      return 0;
+  }
+}
+
+/*
+  @brief Get the size of a packed value when converted to BSON
+
+  @param type - The type of the value, which must be a type that can be packed
+
+  @return - The size in bytes of the BSON representation of the value
+*/
+static size_t bson_packed_element_size(element_type type) {
+  switch (type) {
+    case TYPE_INT32:
+      return SIZE_INT32;
+    case TYPE_INT64:
+      return SIZE_INT64;
+    case TYPE_DOUBLE:
+      return SIZE_DOUBLE;
+    default:
+      return SIZE_BOOLEAN;
+  }
+}
+
+/*
+  @brief Take a cell for a short string value from the storage of an array
+
+  @param array - The array which will hold the value
+
+  @return - Storage of SHORT_STRING_SIZE bytes, NULL if it could not be allocated
+*/
+static char *bson_string_pool_take(BsonArray *array) {
+  BsonStringPool *pool = array->strings;
+  if (pool == NULL) {
+    pool = malloc(sizeof(BsonStringPool));
+    if (pool == NULL) {
+      return NULL;
+    }
+    pool->blocks = NULL;
+    pool->freeCells = NULL;
+    array->strings = pool;
+  }
+  if (pool->freeCells != NULL) {
+    char *cell = pool->freeCells;
+    memcpy(&pool->freeCells, cell, sizeof(char *));
+    return cell;
+  }
+
+  BsonStringBlock *block = pool->blocks;
+  if (block == NULL || block->used == block->capacity) {
+    size_t capacity = BSON_STRING_BLOCK_MIN_CELLS;
+    if (block != NULL) {
+      capacity = (block->capacity * 2 < BSON_STRING_BLOCK_MAX_CELLS) ? block->capacity * 2 : BSON_STRING_BLOCK_MAX_CELLS;
+    }
+    block = malloc(sizeof(BsonStringBlock) + capacity * SHORT_STRING_SIZE);
+    if (block == NULL) {
+      return NULL;
+    }
+    block->previous = pool->blocks;
+    block->capacity = capacity;
+    block->used = 0;
+    pool->blocks = block;
+  }
+  return block->cells[block->used++];
+}
+
+/*
+  @brief Return the cell of a short string value to the storage of an array, so that it can be reused
+
+  @param array - The array which held the value
+  @param cell - The cell, taken with bson_string_pool_take()
+*/
+static void bson_string_pool_release(BsonArray *array, char *cell) {
+  memcpy(cell, &array->strings->freeCells, sizeof(char *));
+  array->strings->freeCells = cell;
+}
+
+/*
+  @brief Move the short string storage of an array to another array, whose values
+  may then refer to it. The storage of both arrays stays where it is
+
+  @param array - The array receiving the storage
+  @param other - The array whose storage is moved, which no longer has any
+*/
+static void bson_string_pool_merge(BsonArray *array, BsonArray *other) {
+  BsonStringPool *pool = other->strings;
+  other->strings = NULL;
+  if (pool == NULL) {
+    return;
+  }
+  if (array->strings == NULL) {
+    array->strings = pool;
+    return;
+  }
+  BsonStringBlock *first = pool->blocks;
+  while (first != NULL && first->previous != NULL) {
+    first = first->previous;
+  }
+  if (first != NULL) {
+    first->previous = array->strings->blocks;
+    array->strings->blocks = pool->blocks;
+  }
+  while (pool->freeCells != NULL) {
+    char *cell = pool->freeCells;
+    memcpy(&pool->freeCells, cell, sizeof(char *));
+    bson_string_pool_release(array, cell);
+  }
+  free(pool);
+}
+
+/*
+  @brief Free the short string storage of an array
+
+  @param array - The array whose storage is freed
+*/
+static void bson_string_pool_free(BsonArray *array) {
+  if (array->strings == NULL) {
+    return;
+  }
+  BsonStringBlock *block = array->strings->blocks;
+  while (block != NULL) {
+    BsonStringBlock *previous = block->previous;
+    free(block);
+    block = previous;
+  }
+  free(array->strings);
+  array->strings = NULL;
+}
+
+/*
+  @brief Initialize a string element of an array with a copy of a given value,
+  storing short values in the storage of the array
+
+  @param array - The array which will hold the element
+  @param element - The element to be initialized
+  @param value - The string value to be copied, may contain null characters
+  @param length - The length of value in bytes, not including a terminating null character
+
+  @return - true if the element was initialized successfully, false if not
+*/
+static bool bson_array_initialize_string(BsonArray *array, BsonElement *element, const char *value, size_t length) {
+  char *shortString = NULL;
+  if (length < SHORT_STRING_SIZE) {
+    shortString = bson_string_pool_take(array);
+    if (shortString == NULL) {
+      return false;
+    }
+  }
+  //Short values are copied without allocating, so the cell is never left unused
+  return bson_element_initialize_string(element, value, length, shortString);
+}
+
+/*
+  @brief Initialize an element of an array with a copy of another element,
+  storing short string values in the storage of the array
+
+  @param array - The array which will hold the element
+  @param output - The element to be initialized
+  @param element - The element to be copied
+  @param deep - true to clone sub-objects and sub-arrays, false to share them
+
+  @return - true if the element was copied successfully, false if not
+*/
+static bool bson_array_copy_element(BsonArray *array, BsonElement *output, BsonElement *element, bool deep) {
+  char *shortString = NULL;
+  if (bson_element_is_short_string(element)) {
+    shortString = bson_string_pool_take(array);
+    if (shortString == NULL) {
+      return false;
+    }
+  }
+  if (!(deep ? bson_element_clone(output, element, shortString) : bson_element_share(output, element, shortString))) {
+    if (shortString != NULL) {
+      bson_string_pool_release(array, shortString);
+    }
+    return false;
+  }
+  return true;
+}
+
+/*
+  @brief Free the value of an element of an array, returning the storage of a short string
+  value to the array
+
+  @param array - The array holding the element
+  @param element - The element whose value is to be freed
+*/
+static void bson_array_release_element(BsonArray *array, BsonElement *element) {
+  if (bson_element_is_short_string(element)) {
+    bson_string_pool_release(array, (char *)element->value);
+  }
+  bson_element_deinitialize(element);
+}
+
 bool bson_array_initialize(BsonArray *array, size_t initialCapacity) {
   array->count = 0;
   array->maxCount = initialCapacity;
-  array->elements = malloc(sizeof(BsonElement *) * initialCapacity);
+  array->elements = malloc(sizeof(BsonElement) * initialCapacity);
+  array->strings = NULL;
+  array->refCount = NULL;
+  array->packedType = TYPE_NULL;
+  array->packedSize = 0;
+  array->packedValues = NULL;
+  array->packedFile = -1;
+  array->columns = NULL;
+  array->version = bson_next_version();
+  return array->elements != NULL || initialCapacity == 0;
+}
+
+bool bson_array_initialize_typed(BsonArray *array, element_type type, size_t initialCapacity) {
+  size_t packedSize = bson_packed_value_size(type);
+  if (packedSize == 0) {
+    printf("Values of BSON type %i cannot be packed\n", type);
+    return false;
+  }
+  array->count = 0;
+  array->maxCount = initialCapacity;
+  array->elements = NULL;
+  array->strings = NULL;
+  array->refCount = NULL;
+  array->packedType = type;
+  array->packedSize = packedSize;
+  array->packedValues = malloc(packedSize * initialCapacity);
+  array->packedFile = -1;
+  array->columns = NULL;
+  array->version = bson_next_version();
+  return array->packedValues != NULL || initialCapacity == 0;
+}
+
+/*
+  @brief Map the values of a file-backed packed array into memory with a given capacity,
+  resizing the file to match. The previous mapping is released
+
+  @param array - The file-backed packed array
+  @param capacity - The number of values the new mapping holds
+
+  @return - true if the values were mapped, false if not, in which case the previous mapping is kept
+*/
+static bool bson_packed_file_map(BsonArray *array, size_t capacity) {
+#ifdef BSON_FILE_BACKED_ARRAYS
+  size_t oldLength = array->packedSize * array->maxCount;
+  size_t length = array->packedSize * capacity;
+  //The file is grown before mapping it, but only shrunk after the old mapping is released
+  if (length > oldLength && ftruncate(array->packedFile, (off_t)length) != 0) {
+    return false;
+  }
+  void *values = NULL;
+  if (length > 0) {
+    values = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, array->packedFile, 0);
+    if (values == MAP_FAILED) {
+      return false;
+    }
+  }
+  if (array->packedValues != NULL) {
+    munmap(array->packedValues, oldLength);
+  }
+  if (length < oldLength) {
+    ftruncate(array->packedFile, (off_t)length);
+  }
+  array->packedValues = values;
+  array->maxCount = capacity;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*
+  @brief Store the values of a packed array in a new temporary file, which is deleted when it is closed
+
+  @param array - The packed array without values
+  @param capacity - The number of values the file holds initially
+
+  @return - true if the file was created and mapped, false if not
+*/
+static bool bson_packed_file_open(BsonArray *array, size_t capacity) {
+#ifdef BSON_FILE_BACKED_ARRAYS
+  FILE *file = tmpfile();
+  if (file == NULL) {
+    printf("Failed to create a temporary file for a file-backed array\n");
+    return false;
+  }
+  //The file stays open through the duplicate descriptor, and has no name once tmpfile() created it
+  array->packedFile = dup(fileno(file));
+  fclose(file);
+  array->packedValues = NULL;
+  array->maxCount = 0;
+  if (array->packedFile < 0) {
+    return false;
+  }
+  if (!bson_packed_file_map(array, capacity)) {
+    close(array->packedFile);
+    array->packedFile = -1;
+    return false;
+  }
+  return true;
+#else
+  printf("File-backed arrays are not supported on this platform\n");
+  return false;
+#endif
+}
+
+/*
+  @brief Free the values of a packed array, unmapping and closing the file if they are file-backed
+
+  @param array - The packed array whose values are freed
+*/
+static void bson_packed_free(BsonArray *array) {
+  if (array->packedFile < 0) {
+    free(array->packedValues);
+  }
+#ifdef BSON_FILE_BACKED_ARRAYS
+  else {
+    if (array->packedValues != NULL) {
+      munmap(array->packedValues, array->packedSize * array->maxCount);
+    }
+    close(array->packedFile);
+  }
+#endif
+  array->packedValues = NULL;
+  array->packedFile = -1;
+}
+
+bool bson_array_initialize_file_backed(BsonArray *array, element_type type, size_t initialCapacity) {
+  if (!bson_array_initialize_typed(array, type, 0)) {
+    return false;
+  }
+  free(array->packedValues);
+  if (!bson_packed_file_open(array, initialCapacity)) {
+    return false;
+  }
+  return true;
+}
+
+/*
+  @brief Free the keys and columns of columnar storage. The storage itself is not freed
+
+  @param columns - The storage to be deinitialized
+*/
+static void bson_columns_deinitialize(BsonColumns *columns) {
+  size_t i = 0;
+  for (i = 0; i < columns->keyCount; i++) {
+    free(columns->keys[i]);
+    bson_array_deinitialize(&columns->columns[i]);
+  }
+  for (i = 0; i < columns->rowCount; i++) {
+    if (columns->rows[i] != NULL) {
+      bson_object_deinitialize(columns->rows[i]);
+      free(columns->rows[i]);
+    }
+  }
+  free(columns->keys);
+  free(columns->columns);
+  free(columns->rows);
+}
+
+/*
+  @brief Get the type of the values in a column
+
+  @param column - The column, which is packed unless its values are strings
+
+  @return - The type of the values in the column
+*/
+static element_type bson_column_type(BsonArray *column) {
+  return (column->packedSize != 0) ? column->packedType : TYPE_STRING;
+}
+
+/*
+  @brief Create empty columnar storage
+
+  @param keys - The keys of each object
+  @param types - The type of the value of each key, TYPE_STRING or a type that can be packed
+  @param keyCount - The number of keys in each object
+  @param initialCapacity - The initial maximum number of values in each column
+
+  @return - The malloc()-ed storage, NULL if it could not be created
+*/
+static BsonColumns *bson_columns_create(const char *const *keys, const element_type *types, 
+                                        size_t keyCount, size_t initialCapacity) {
+  BsonColumns *columns = malloc(sizeof(BsonColumns));
+  if (columns == NULL) {
+    return NULL;
+  }
+  columns->keyCount = 0;
+  columns->rows = NULL;
+  columns->rowCount = 0;
+  columns->detachedCount = 0;
+  columns->keys = malloc(sizeof(char *) * keyCount);
+  columns->columns = malloc(sizeof(BsonArray) * keyCount);
+  if ((columns->keys == NULL || columns->columns == NULL) && keyCount > 0) {
+    bson_columns_deinitialize(columns);
+    free(columns);
+    return NULL;
+  }
+  size_t i = 0;
+  for (i = 0; i < keyCount; i++) {
+    size_t keyLength = strlen(keys[i]);
+    char *key = malloc(keyLength + 1);
+    bool initialized = (types[i] == TYPE_STRING) ? 
+      bson_array_initialize(&columns->columns[i], initialCapacity) : 
+      (bson_packed_value_size(types[i]) != 0 && 
+       bson_array_initialize_typed(&columns->columns[i], types[i], initialCapacity));
+    if (key == NULL || !initialized) {
+      free(key);
+      if (initialized) {
+        bson_array_deinitialize(&columns->columns[i]);
+      }
+      bson_columns_deinitialize(columns);
+      free(columns);
+      return NULL;
+    }
+    memcpy(key, keys[i], keyLength + 1);
+    columns->keys[i] = key;
+    columns->keyCount++;
+  }
+  return columns;
+}
+
+/*
+  @brief Copy columnar storage
+
+  @param columns - The storage to be copied
+  @param deep - true to clone the columns, false to share them
+
+  @return - The malloc()-ed copy, NULL if it could not be created
+*/
+static BsonColumns *bson_columns_copy(BsonColumns *columns, bool deep) {
+  BsonColumns *copy = malloc(sizeof(BsonColumns));
+  if (copy == NULL) {
+    return NULL;
+  }
+  copy->keyCount = 0;
+  copy->rows = NULL;
+  copy->rowCount = 0;
+  copy->detachedCount = 0;
+  copy->keys = malloc(sizeof(char *) * columns->keyCount);
+  copy->columns = malloc(sizeof(BsonArray) * columns->keyCount);
+  if ((copy->keys == NULL || copy->columns == NULL) && columns->keyCount > 0) {
+    bson_columns_deinitialize(copy);
+    free(copy);
+    return NULL;
+  }
+  if (columns->rows != NULL) {
+    copy->rows = calloc(columns->rowCount, sizeof(BsonObject *));
+    if (copy->rows == NULL) {
+      bson_columns_deinitialize(copy);
+      free(copy);
+      return NULL;
+    }
+    copy->rowCount = columns->rowCount;
+  }
+  size_t i = 0;
+  for (i = 0; i < columns->keyCount; i++) {
+    size_t keyLength = strlen(columns->keys[i]);
+    char *key = malloc(keyLength + 1);
+    if (key == NULL || 
+        !(deep ? bson_array_clone(&copy->columns[i], &columns->columns[i]) :
+                 bson_array_share(&copy->columns[i], &columns->columns[i]))) {
+      free(key);
+      bson_columns_deinitialize(copy);
+      free(copy);
+      return NULL;
+    }
+    memcpy(key, columns->keys[i], keyLength + 1);
+    copy->keys[i] = key;
+    copy->keyCount++;
+  }
+  for (i = 0; i < columns->rowCount; i++) {
+    if (columns->rows[i] == NULL) {
+      continue;
+    }
+    BsonObject *row = malloc(sizeof(BsonObject));
+    if (row == NULL || 
+        !(deep ? bson_object_clone(row, columns->rows[i]) : bson_object_share(row, columns->rows[i]))) {
+      free(row);
+      bson_columns_deinitialize(copy);
+      free(copy);
+      return NULL;
+    }
+    copy->rows[i] = row;
+    copy->detachedCount++;
+  }
+  return copy;
+}
+
+/*
+  @brief Initialize a columnar array with existing columns
+
+  @param array - The uninitialized array
+  @param columns - The malloc()-ed columns, which the array takes ownership of
+  @param count - The number of values in each column
+*/
+static void bson_array_initialize_with_columns(BsonArray *array, BsonColumns *columns, size_t count) {
+  array->count = count;
+  array->maxCount = 0;
+  array->elements = NULL;
+  array->strings = NULL;
+  array->refCount = NULL;
+  array->packedType = TYPE_NULL;
+  array->packedSize = 0;
+  array->packedValues = NULL;
+  array->packedFile = -1;
+  array->columns = columns;
+  array->version = bson_next_version();
+}
+
+bool bson_array_initialize_columnar(BsonArray *array, const char *const *keys, const element_type *types, 
+                                    size_t keyCount, size_t initialCapacity) {
+  BsonColumns *columns = bson_columns_create(keys, types, keyCount, initialCapacity);
+  if (columns == NULL) {
+    return false;
+  }
+  bson_array_initialize_with_columns(array, columns, 0);
+  return true;
+}
+void bson_array_deinitialize(BsonArray *array) {
+  if (array->refCount != NULL) {
+    //Elements are still used by another array
+    if (--(*array->refCount) > 0) {
+      return;
+    }
+    free(array->refCount);
+  }
+
+  if (array->columns != NULL) {
+    bson_columns_deinitialize(array->columns);
+    free(array->columns);
+  }
+  size_t i = 0;
+  for (i = 0; i < array->count && array->packedSize == 0 && array->columns == NULL; i++) {
+    bson_element_deinitialize(&array->elements[i]);
+  }
+
+  free(array->elements);
+  bson_string_pool_free(array);
+  bson_packed_free(array);
+}
+
+bool bson_array_share(BsonArray *output, BsonArray *array) {
+  if (array->refCount == NULL) {
+    array->refCount = malloc(sizeof(size_t));
+    if (array->refCount == NULL) {
+      return false;
+    }
+    *array->refCount = 1;
+  }
+  (*array->refCount)++;
+  *output = *array;
+  return true;
+}
+
+/*
+  @brief Copy the values of an array into a new array with the same capacity
+
+  @param output - The uninitialized array to be created
+  @param array - The array whose values are copied
+  @param deep - true to clone sub-objects and sub-arrays, false to share them
+
+  @return - true if the values were copied successfully, false if not
+*/
+static bool bson_array_copy(BsonArray *output, BsonArray *array, bool deep) {
+  *output = *array;
+  output->refCount = NULL;
+  output->strings = NULL;
+  output->version = bson_next_version();
+  if (array->columns != NULL) {
+    output->columns = bson_columns_copy(array->columns, deep);
+    return output->columns != NULL;
+  }
+  if (array->packedFile >= 0) {
+    if (!bson_packed_file_open(output, array->maxCount)) {
+      return false;
+    }
+    memcpy(output->packedValues, array->packedValues, array->packedSize * array->count);
+    return true;
+  }
+  if (array->packedSize != 0) {
+    output->packedValues = malloc(array->packedSize * array->maxCount);
+    if (output->packedValues == NULL && array->maxCount > 0) {
+      return false;
+    }
+    memcpy(output->packedValues, array->packedValues, array->packedSize * array->count);
+    return true;
+  }
+
+  output->elements = malloc(sizeof(BsonElement) * array->maxCount);
+  if (output->elements == NULL && array->maxCount > 0) {
+    return false;
+  }
+  size_t i = 0;
+  for (i = 0; i < array->count; i++) {
+    if (!bson_array_copy_element(output, &output->elements[i], &array->elements[i], deep)) {
+      while (i > 0) {
+        i--;
+        bson_element_deinitialize(&output->elements[i]);
+      }
+      free(output->elements);
+      bson_string_pool_free(output);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool bson_array_clone(BsonArray *output, BsonArray *array) {
+  return bson_array_copy(output, array, true);
+}
+
+/*
+  @brief Give an array its own copy of its elements if they are shared with other arrays,
+  so that they can be modified. Sub-objects and sub-arrays remain shared.
+
+  @param array - The array to be modified
+
+  @return - true if the array can be modified, false if its elements could not be copied
+*/
+static bool bson_array_unshare(BsonArray *array) {
+  //Every modification starts here, so encodings of the previous contents are no longer up to date
+  array->version = bson_next_version();
+  if (array->refCount == NULL || *array->refCount == 1) {
+    return true;
+  }
+
+  BsonArray copy;
+  if (!bson_array_copy(&copy, array, false)) {
+    return false;
+  }
+
+  (*array->refCount)--;
+  *array = copy;
+  return true;
+}
+
+/*
+  @brief Add the value of a column at a given row to an object
+
+  @param row - The object to be modified
+  @param key - The key of the column
+  @param column - The column containing the value
+  @param index - The index of the value within the column
+
+  @return - true if the value was added, false if not
+*/
+static bool bson_column_put_value(BsonObject *row, const char *key, BsonArray *column, size_t index) {
+  switch (bson_column_type(column)) {
+    case TYPE_INT32:
+      return bson_object_put_int32(row, key, ((int32_t *)column->packedValues)[index]);
+    case TYPE_INT64:
+      return bson_object_put_int64(row, key, ((int64_t *)column->packedValues)[index]);
+    case TYPE_DOUBLE:
+      return bson_object_put_double(row, key, ((double *)column->packedValues)[index]);
+    case TYPE_BOOLEAN:
+      return bson_object_put_bool(row, key, ((bson_boolean *)column->packedValues)[index]);
+    default: {
+      BsonElement *element = &column->elements[index];
+      return bson_object_put_string_len(row, key, bson_element_get_string(element), element->size - STRING_OVERHEAD_BYTES);
+    }
+  }
+}
+
+/*
+  @brief Create an object from the values of the columns at a given index
+
+  @param columns - The columnar storage
+  @param index - The index of the object
+  @param row - The uninitialized object to be created
+
+  @return - true if the object was created, false if not
+*/
+static bool bson_columns_build_row(BsonColumns *columns, size_t index, BsonObject *row) {
+  if (!bson_object_initialize_default(row)) {
+    return false;
+  }
+  size_t k = 0;
+  for (k = 0; k < columns->keyCount; k++) {
+    if (!bson_column_put_value(row, columns->keys[k], &columns->columns[k], index)) {
+      bson_object_deinitialize(row);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  @brief Check whether an object has the keys and value types of the columns of columnar storage
+
+  @param columns - The columnar storage
+  @param row - The object to be checked
+
+  @return - true if the values of the object can be stored in the columns, false if not
+*/
+static bool bson_columns_match_row(BsonColumns *columns, BsonObject *row) {
+  if ((size_t)emhashmap_size(row->data) != columns->keyCount) {
+    return false;
+  }
+  size_t k = 0;
+  for (k = 0; k < columns->keyCount; k++) {
+    BsonElement *element = bson_object_get(row, columns->keys[k]);
+    if (element == NULL || element->type != bson_column_type(&columns->columns[k])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  @brief Replace the value of a column at a given index with the value of an element,
+  unless they are already equal
+
+  @param column - The column to be modified
+  @param index - The index of the value within the column
+  @param element - The element holding the new value, of the type of the column
+
+  @return - true if the column holds the value, false if it could not be replaced
+*/
+static bool bson_column_set_value(BsonArray *column, size_t index, BsonElement *element) {
+  if (column->packedSize != 0) {
+    uint8_t *target = (uint8_t *)column->packedValues + index * column->packedSize;
+    if (memcmp(target, element->value, column->packedSize) == 0) {
+      return true;
+    }
+    if (!bson_array_unshare(column)) {
+      return false;
+    }
+    memcpy((uint8_t *)column->packedValues + index * column->packedSize, element->value, column->packedSize);
+    return true;
+  }
+  BsonElement *target = &column->elements[index];
+  size_t length = element->size - STRING_OVERHEAD_BYTES;
+  if (target->size == element->size && 
+      memcmp(bson_element_get_string(target), bson_element_get_string(element), length) == 0) {
+    return true;
+  }
+  BsonElement value;
+  if (!bson_array_unshare(column) || 
+      !bson_array_initialize_string(column, &value, bson_element_get_string(element), length)) {
+    return false;
+  }
+  target = &column->elements[index];
+  bson_array_release_element(column, target);
+  *target = value;
+  return true;
+}
+
+/*
+  @brief Copy the values of the objects created by bson_array_get_object() back into the columns,
+  so that the columns reflect any modification made to them. The objects are kept, since they
+  may still be referenced
+
+  @param columns - The columnar storage
+  @param count - The number of objects in the storage
+
+  @return - true if the columns hold the values of every object, false if an object no longer
+  has the keys and value types of the columns or a value could not be copied
+*/
+static bool bson_columns_absorb_rows(BsonColumns *columns, size_t count) {
+  size_t i = 0;
+  for (i = 0; i < columns->rowCount && i < count; i++) {
+    if (columns->rows[i] != NULL && !bson_columns_match_row(columns, columns->rows[i])) {
+      return false;
+    }
+  }
+  for (i = 0; i < columns->rowCount && i < count; i++) {
+    if (columns->rows[i] == NULL) {
+      continue;
+    }
+    size_t k = 0;
+    for (k = 0; k < columns->keyCount; k++) {
+      BsonElement *element = bson_object_get(columns->rows[i], columns->keys[k]);
+      if (!bson_column_set_value(&columns->columns[k], i, element)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+  @brief Get the object which replaces the values of the columns at a given index
+
+  @param columns - The columnar storage
+  @param index - The index of the object
+
+  @return - The object created by bson_array_get_object(), NULL if the values of the object
+  are still only stored in the columns
+*/
+static BsonObject *bson_columns_detached_row(BsonColumns *columns, size_t index) {
+  return (index < columns->rowCount) ? columns->rows[index] : NULL;
+}
+
+/*
+  @brief Create the object at a given index of columnar storage, which replaces the values
+  of the columns at that index from then on. The columns themselves are kept
+
+  @param columns - The columnar storage, which must not be shared
+  @param index - The index of the object
+  @param count - The number of objects in the storage
+
+  @return - The object, which belongs to the storage. NULL if it could not be created
+*/
+static BsonObject *bson_columns_detach_row(BsonColumns *columns, size_t index, size_t count) {
+  BsonObject *row = bson_columns_detached_row(columns, index);
+  if (row != NULL) {
+    return row;
+  }
+  if (index >= columns->rowCount) {
+    BsonObject **rows = realloc(columns->rows, sizeof(BsonObject *) * count);
+    if (rows == NULL) {
+      return NULL;
+    }
+    memset(&rows[columns->rowCount], 0, sizeof(BsonObject *) * (count - columns->rowCount));
+    columns->rows = rows;
+    columns->rowCount = count;
+  }
+  row = malloc(sizeof(BsonObject));
+  if (row == NULL || !bson_columns_build_row(columns, index, row)) {
+    free(row);
+    return NULL;
+  }
+  columns->rows[index] = row;
+  columns->detachedCount++;
+  return row;
+}
+
+/*
+  @brief Convert a columnar array into an array of separate objects
+
+  @param array - The columnar array to be converted, which must not be shared
+
+  @return - true if the array was converted, false if not
+*/
+static bool bson_array_unpack_columns(BsonArray *array) {
+  BsonColumns *columns = array->columns;
+  BsonArray rows;
+  if (!bson_array_initialize(&rows, array->count)) {
+    return false;
+  }
+  size_t i = 0;
+  for (i = 0; i < array->count; i++) {
+    //Objects which were already created are shared rather than built again
+    BsonObject *detached = bson_columns_detached_row(columns, i);
+    BsonObject *row = malloc(sizeof(BsonObject));
+    bool created = (row != NULL) && 
+      ((detached != NULL) ? bson_object_share(row, detached) : bson_columns_build_row(columns, i, row));
+    if (!created) {
+      free(row);
+      bson_array_deinitialize(&rows);
+      return false;
+    }
+    if (!bson_array_add_object_owned(&rows, row)) {
+      bson_array_deinitialize(&rows);
+      return false;
+    }
+  }
+
+  bson_columns_deinitialize(columns);
+  free(columns);
+  array->columns = NULL;
+  array->elements = rows.elements;
+  array->maxCount = rows.maxCount;
+  return true;
+}
+
+/*
+  @brief Convert a packed or columnar array into an array of separate elements
+
+  @param array - The array to be converted
+
+  @return - true if the array was converted or was not packed, false if not
+*/
+static bool bson_array_unpack(BsonArray *array) {
+  if (array->packedSize == 0 && array->columns == NULL) {
+    return true;
+  }
+  if (!bson_array_unshare(array)) {
+    return false;
+  }
+  if (array->columns != NULL) {
+    return bson_array_unpack_columns(array);
+  }
+
+  BsonElement *elements = malloc(sizeof(BsonElement) * array->maxCount);
+  if (elements == NULL && array->maxCount > 0) {
+    return false;
+  }
+  size_t i = 0;
+  for (i = 0; i < array->count; i++) {
+    elements[i].type = array->packedType;
+    elements[i].dirty = true;
+    elements[i].size = bson_packed_element_size(array->packedType);
+    elements[i].value = malloc(array->packedSize);
+    if (elements[i].value == NULL) {
+      while (i > 0) {
+        i--;
+        free(elements[i].value);
+      }
+      free(elements);
+      return false;
+    }
+    memcpy(elements[i].value, (uint8_t *)array->packedValues + i * array->packedSize, array->packedSize);
+  }
+
+  bson_packed_free(array);
+  array->packedSize = 0;
+  array->packedType = TYPE_NULL;
+  array->elements = elements;
+  return true;
+}
+
+/*
+  @brief Convert an empty array into a packed array
+
+  @param array - The empty array to be converted
+  @param type - The type of the values that will be stored in the array
+
+  @return - true if the array was converted, false if values of this type cannot be packed
+*/
+static bool bson_array_pack(BsonArray *array, element_type type) {
+  size_t packedSize = bson_packed_value_size(type);
+  if (packedSize == 0 || array->count > 0 || array->packedSize != 0 || array->columns != NULL) {
+    return false;
+  }
+  void *packedValues = malloc(packedSize * array->maxCount);
+  if (packedValues == NULL && array->maxCount > 0) {
+    return false;
+  }
+  free(array->elements);
+  array->elements = NULL;
+  array->packedType = type;
+  array->packedSize = packedSize;
+  array->packedValues = packedValues;
+  return true;
+}
+
+/*
+  @brief Get the element at a specified index without converting a packed array
+
+  @param array - The array to be accessed
+  @param index - The index of the element, which must be within bounds
+  @param packedElement - Storage for a temporary element describing a packed value
+
+  @return - The element at the given index. For packed arrays this is packedElement,
+  which points to the packed value and is only valid until the array is modified
+*/
+static BsonElement *bson_array_element_at(BsonArray *array, size_t index, BsonElement *packedElement) {
+  if (array->packedSize == 0) {
+    return &array->elements[index];
+  }
+  packedElement->type = array->packedType;
+  packedElement->dirty = true;
+  packedElement->size = bson_packed_element_size(array->packedType);
+  packedElement->value = (uint8_t *)array->packedValues + index * array->packedSize;
+  return packedElement;
+}
+
+/*
+  @brief Get the value at a specified index if it has a given type, without converting a packed array
+
+  @param array - The array to be accessed
+  @param index - The index of the value
+  @param type - The expected type of the value
+
+  @return - Pointer to the value if it exists and has the given type, NULL otherwise
+*/
+static void *bson_array_get_value(BsonArray *array, size_t index, element_type type) {
+  //Columnar arrays only contain objects, which are retrieved by bson_array_get_object()
+  if (index >= array->count || array->columns != NULL) {
+    return NULL;
+  }
+  BsonElement packedElement;
+  BsonElement *element = bson_array_element_at(array, index, &packedElement);
+  if (element->type != type) {
+    return NULL;
+  }
+  //Strings are never packed, so short strings are stored inside the element of the array
+  return (type == TYPE_STRING) ? bson_element_get_string(element) : element->value;
+}
+
+bool bson_array_resize(BsonArray *array, size_t newSize) {
+  if (array->count > newSize) {
+    printf("Attempted to resize an array smaller than the number of elements it contains\n");
+    return false;
+  }
+  if (!bson_array_unshare(array) || (array->columns != NULL && !bson_array_unpack(array))) {
+    return false;
+  }
+  if (array->packedFile >= 0) {
+    return bson_packed_file_map(array, newSize);
+  }
+  if (array->packedSize != 0) {
+    void *newValues = realloc(array->packedValues, array->packedSize * newSize);
+    if (newValues == NULL && newSize > 0) {
+      return false;
+    }
+    array->packedValues = newValues;
+    array->maxCount = newSize;
+    return true;
+  }
+  BsonElement *newArray = realloc(array->elements, sizeof(BsonElement) * newSize);
+  if (newArray == NULL && newSize > 0) {
+    return false;
+  }
+  array->elements = newArray;
+  array->maxCount = newSize;
+  return true;
+}
+
+/*
+  @brief Make sure there is room for more values at the end of a given array
+
+  @param array - The array to be modified
+  @param additional - The number of values to be added
+
+  @return - true if the array can hold the additional values, false if it could not be grown
+*/
+static bool bson_array_reserve(BsonArray *array, size_t additional) {
+  if (additional <= array->maxCount - array->count) {
+    return true;
+  }
+  size_t newSize = (array->maxCount == 0) ? 1 : array->maxCount * 2;
+  if (newSize < array->count + additional) {
+    newSize = array->count + additional;
+  }
+  return bson_array_resize(array, newSize);
+}
+
+/*
+  @brief Advance a decimal array key to the next index
+
+  @param key - The ASCII digits of the key, with room for one more digit
+  @param keyLength - The number of digits in key, increased if the next index has one more digit
+*/
+static void bson_packed_next_key(uint8_t *key, size_t *keyLength) {
+  size_t i = *keyLength;
+  while (i > 0) {
+    i--;
+    if (key[i] != '9') {
+      key[i]++;
+      return;
+    }
+    key[i] = '0';
+  }
+  //All digits rolled over, e.g. 99 -> 100
+  memmove(&key[1], key, *keyLength);
+  key[0] = '1';
+  (*keyLength)++;
+}
+
+#ifdef BSON_PACKED_SSE41
+//Largest packed element which is encoded and decoded as a single vector, in bytes
+#define BSON_PACKED_VECTOR_SIZE 16
+
+/*
+  @brief Check whether packed values can be converted with SSE4.1 on this processor
+
+  @return - true if the processor supports SSE4.1, false if not
+*/
+static bool bson_packed_sse41_supported(void) {
+  return __builtin_cpu_supports("sse4.1");
+}
+
+/*
+  @brief Prepare the vectors describing packed elements whose keys have a given number of digits
+
+  @param type - The type byte of the elements
+  @param key - The digits of the key of the next element
+  @param keyLength - The number of digits in key
+  @param valueSize - The size of each value in bytes
+  @param header - Set to the type, key and terminating null byte of the next element, followed by zeros
+  @param headerMask - Set to 0xFF at every byte of the header and 0 after it
+  @param lastDigit - Set to 1 at the position of the last digit of the key in the header and 0 elsewhere
+  @param valueShuffle - Set to the shuffle moving the bytes of a value from the start of
+                        a vector to their position in an element
+  @param valueExtract - Set to the shuffle moving the bytes of a value from their position
+                        in an element to the start of a vector
+*/
+__attribute__((target("sse4.1")))
+static void bson_packed_sse41_prepare(uint8_t type, const uint8_t *key, size_t keyLength, size_t valueSize,
+                                      __m128i *header, __m128i *headerMask, __m128i *lastDigit,
+                                      __m128i *valueShuffle, __m128i *valueExtract) {
+  uint8_t bytes[BSON_PACKED_VECTOR_SIZE] = { 0 };
+  uint8_t mask[BSON_PACKED_VECTOR_SIZE] = { 0 };
+  uint8_t digit[BSON_PACKED_VECTOR_SIZE] = { 0 };
+  uint8_t shuffle[BSON_PACKED_VECTOR_SIZE];
+  uint8_t extract[BSON_PACKED_VECTOR_SIZE];
+  size_t valueStart = keyLength + 2;
+  size_t i = 0;
+  bytes[0] = type;
+  memcpy(&bytes[1], key, keyLength);
+  memset(mask, 0xFF, valueStart);
+  digit[keyLength] = 1;
+  //Shuffle indices with the high bit set produce zero bytes
+  memset(shuffle, 0x80, sizeof(shuffle));
+  memset(extract, 0x80, sizeof(extract));
+  for (i = 0; i < valueSize; i++) {
+    shuffle[valueStart + i] = (uint8_t)i;
+    extract[i] = (uint8_t)(valueStart + i);
+  }
+  *header = _mm_loadu_si128((const __m128i *)bytes);
+  *headerMask = _mm_loadu_si128((const __m128i *)mask);
+  *lastDigit = _mm_loadu_si128((const __m128i *)digit);
+  *valueShuffle = _mm_loadu_si128((const __m128i *)shuffle);
+  *valueExtract = _mm_loadu_si128((const __m128i *)extract);
+}
+
+/*
+  @brief Advance the key held by the header of a packed element to the next index
+
+  @param key - The digits of the key, advanced along with the header
+  @param keyLength - The number of digits in key, increased if the next index has one more digit
+  @param header - The header of the element (see bson_packed_sse41_prepare())
+  @param lastDigit - The position of the last digit of the key in the header (see bson_packed_sse41_prepare())
+
+  @return - true if the key still has the same number of digits, false if the header
+  must be prepared again
+*/
+__attribute__((target("sse4.1")))
+static inline bool bson_packed_sse41_next_key(uint8_t *key, size_t *keyLength, __m128i *header, __m128i lastDigit) {
+  size_t last = *keyLength - 1;
+  if (key[last] != '9') {
+    key[last]++;
+    *header = _mm_add_epi8(*header, lastDigit);
+    return true;
+  }
+  bson_packed_next_key(key, keyLength);
+  if (*keyLength != last + 1) {
+    return false;
+  }
+  uint8_t bytes[BSON_PACKED_VECTOR_SIZE];
+  _mm_storeu_si128((__m128i *)bytes, *header);
+  memcpy(&bytes[1], key, *keyLength);
+  *header = _mm_loadu_si128((const __m128i *)bytes);
+  return true;
+}
+
+/*
+  @brief Encode packed values whose keys have the same number of digits with one vector store
+  per element. Each store writes a whole vector, whose bytes past the element are overwritten
+  by the following elements, so encoding stops once fewer bytes than a vector remain to be written
+
+  @param out - Pointer to the position at which the first element is written, advanced past the last element
+  @param values - The little endian values to be encoded
+  @param valueSize - The size of each value in bytes, 4 or 8
+  @param count - The number of values which remain to be encoded
+  @param type - The type byte of the elements
+  @param key - The digits of the key of the first element, advanced past the last element
+  @param keyLength - The number of digits in key, increased if the next index has one more digit
+
+  @return - The number of elements written, 0 if the elements do not fit in a vector
+*/
+__attribute__((target("sse4.1")))
+static size_t bson_packed_sse41_encode(uint8_t **out, const uint8_t *values, size_t valueSize, size_t count,
+                                       uint8_t type, uint8_t *key, size_t *keyLength) {
+  size_t stride = *keyLength + 2 + valueSize;
+  if (stride > BSON_PACKED_VECTOR_SIZE) {
+    return 0;
+  }
+  __m128i header, headerMask, lastDigit, valueShuffle, valueExtract;
+  bson_packed_sse41_prepare(type, key, *keyLength, valueSize, &header, &headerMask, &lastDigit, 
+                            &valueShuffle, &valueExtract);
+  uint8_t *current = *out;
+  size_t i = 0;
+  while (i < count && (count - i) * stride >= BSON_PACKED_VECTOR_SIZE) {
+    __m128i value;
+    if (valueSize == SIZE_INT32) {
+      int32_t value32;
+      memcpy(&value32, &values[i * SIZE_INT32], SIZE_INT32);
+      value = _mm_cvtsi32_si128(value32);
+    } else {
+      value = _mm_loadl_epi64((const __m128i *)&values[i * SIZE_INT64]);
+    }
+    _mm_storeu_si128((__m128i *)current, _mm_or_si128(header, _mm_shuffle_epi8(value, valueShuffle)));
+    current += stride;
+    i++;
+    if (!bson_packed_sse41_next_key(key, keyLength, &header, lastDigit)) {
+      break;
+    }
+  }
+  *out = current;
+  return i;
+}
+
+/*
+  @brief Decode packed values whose keys have the same number of digits with one vector load
+  per element, which checks the type, key and terminating null byte of the element at once.
+  Decoding stops at the first element which does not match, or once fewer bytes than a vector remain
+
+  @param data - Pointer to the type byte of the first element, advanced past the last element decoded
+  @param dataSize - The number of bytes remaining in data, decreased by the number of bytes consumed
+  @param out - The storage of the decoded values, which must have room for count values
+  @param valueSize - The size of each value in bytes, 4 or 8
+  @param count - The maximum number of values to be decoded
+  @param type - The type byte of the elements
+  @param key - The digits of the expected key of the first element, advanced past the last element decoded
+  @param keyLength - The number of digits in key, increased if the next index has one more digit
+
+  @return - The number of values decoded
+*/
+__attribute__((target("sse4.1")))
+static size_t bson_packed_sse41_decode(const uint8_t **data, size_t *dataSize, uint8_t *out, size_t valueSize,
+                                       size_t count, uint8_t type, uint8_t *key, size_t *keyLength) {
+  size_t stride = *keyLength + 2 + valueSize;
+  if (stride > BSON_PACKED_VECTOR_SIZE) {
+    return 0;
+  }
+  __m128i header, headerMask, lastDigit, valueShuffle, valueExtract;
+  bson_packed_sse41_prepare(type, key, *keyLength, valueSize, &header, &headerMask, &lastDigit, 
+                            &valueShuffle, &valueExtract);
+  const uint8_t *current = *data;
+  size_t remainBytes = *dataSize;
+  size_t i = 0;
+  while (i < count && remainBytes >= BSON_PACKED_VECTOR_SIZE) {
+    __m128i element = _mm_loadu_si128((const __m128i *)current);
+    if (!_mm_testz_si128(_mm_xor_si128(element, header), headerMask)) {
+      break;
+    }
+    __m128i value = _mm_shuffle_epi8(element, valueExtract);
+    if (valueSize == SIZE_INT32) {
+      int32_t value32 = _mm_cvtsi128_si32(value);
+      memcpy(&out[i * SIZE_INT32], &value32, SIZE_INT32);
+    } else {
+      _mm_storel_epi64((__m128i *)&out[i * SIZE_INT64], value);
+    }
+    current += stride;
+    remainBytes -= stride;
+    i++;
+    if (!bson_packed_sse41_next_key(key, keyLength, &header, lastDigit)) {
+      break;
+    }
+  }
+  *data = current;
+  *dataSize = remainBytes;
+  return i;
+}
+#endif
+
+/*
+  @brief Encode all values of a packed array in bulk. Values of the same size are
+  written in one tight loop, and keys are advanced in place instead of being converted
+  from each index separately. The byte-wise stores of each value are combined into
+  single stores by the compiler on little endian hosts, and 32-bit and 64-bit values
+  are written with one vector store per element on x86 hosts supporting SSE4.1.
+
+  @param array - The packed array to be encoded
+  @param start - The index of the first value to be encoded
+  @param count - The number of values to be encoded
+  @param firstKey - The key with which the first value is written
+  @param bytes - The output buffer
+  @param position - The position in bytes at which the first element is written,
+                    advanced past the last element
+
+  @return - The number of elements written
+*/
+static size_t bson_array_encode_packed(BsonArray *array, size_t start, size_t count, size_t firstKey, 
+                                       uint8_t *bytes, size_t *position) {
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  size_t keyLength = 0;
+  const char *keyDigits = index_key(firstKey, keyBuffer, &keyLength);
+  //Room for one more digit, see bson_packed_next_key()
+  uint8_t key[INDEX_KEY_BUFFER_SIZE + 1];
+  memcpy(key, keyDigits, keyLength);
+  uint8_t type = (uint8_t)array->packedType;
+  uint8_t *out = &bytes[*position];
+  size_t i = 0;
+#ifdef BSON_PACKED_SSE41
+  bool vectorized = bson_packed_sse41_supported();
+#endif
+  switch (array->packedType) {
+    case TYPE_INT32: {
+      const int32_t *values = (const int32_t *)array->packedValues + start;
+      for (i = 0; i < count; i++) {
+#ifdef BSON_PACKED_SSE41
+        if (vectorized) {
+          i += bson_packed_sse41_encode(&out, (const uint8_t *)&values[i], SIZE_INT32, count - i, 
+                                        type, key, &keyLength);
+          if (i == count) {
+            break;
+          }
+        }
+#endif
+        *out++ = type;
+        memcpy(out, key, keyLength);
+        out += keyLength;
+        *out++ = 0x00;
+        out = store_int32_le(out, values[i]);
+        bson_packed_next_key(key, &keyLength);
+      }
+      break;
+    }
+    case TYPE_INT64:
+    case TYPE_DOUBLE: {
+      //Both are 64 bits wide, doubles are written with the same bit pattern
+      const uint8_t *values = (const uint8_t *)array->packedValues + start * SIZE_INT64;
+      for (i = 0; i < count; i++) {
+#ifdef BSON_PACKED_SSE41
+        if (vectorized) {
+          i += bson_packed_sse41_encode(&out, &values[i * SIZE_INT64], SIZE_INT64, count - i, 
+                                        type, key, &keyLength);
+          if (i == count) {
+            break;
+          }
+        }
+#endif
+        uint64_t value;
+        memcpy(&value, &values[i * SIZE_INT64], SIZE_INT64);
+        *out++ = type;
+        memcpy(out, key, keyLength);
+        out += keyLength;
+        *out++ = 0x00;
+        out = store_int64_le(out, (int64_t)value);
+        bson_packed_next_key(key, &keyLength);
+      }
+      break;
+    }
+    case TYPE_BOOLEAN: {
+      const bson_boolean *values = (const bson_boolean *)array->packedValues + start;
+      for (i = 0; i < count; i++) {
+        *out++ = type;
+        memcpy(out, key, keyLength);
+        out += keyLength;
+        *out++ = 0x00;
+        *out++ = (uint8_t)values[i];
+        bson_packed_next_key(key, &keyLength);
+      }
+      break;
+    }
+    default:
+      return 0;
+  }
+  *position = (size_t)(out - bytes);
+  return count;
+}
+
+/*
+  @brief Decode a run of values into a packed array in bulk. The run ends at the first
+  element with a different type or an unexpected key, which is left for the caller to parse.
+  32-bit and 64-bit values are read with one vector load per element on x86 hosts supporting SSE4.1.
+
+  @param array - The packed array to which the values are added
+  @param data - Pointer to the key of the first element, whose type byte was already read
+                and matches the type of the array. Advanced to the type byte of the first
+                element which was not decoded
+  @param dataSize - The number of bytes remaining in data, decreased by the number of bytes consumed
+  @param firstIndex - The index in the encoded array of the first value in array
+  @param maxCount - The maximum number of values to be decoded
+
+  @return - The number of values decoded
+*/
+static size_t bson_array_decode_packed(BsonArray *array, const uint8_t **data, size_t *dataSize, 
+                                       size_t firstIndex, size_t maxCount) {
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  size_t keyLength = 0;
+  const char *firstKey = index_key(firstIndex + array->count, keyBuffer, &keyLength);
+  //Room for one more digit, see bson_packed_next_key()
+  uint8_t key[INDEX_KEY_BUFFER_SIZE + 1];
+  memcpy(key, firstKey, keyLength);
+  size_t valueSize = bson_packed_element_size(array->packedType);
+  uint8_t type = (uint8_t)array->packedType;
+
+  const uint8_t *current = *data;
+  size_t remainBytes = *dataSize;
+  size_t decoded = 0;
+#ifdef BSON_PACKED_SSE41
+  bool vectorized = array->packedType != TYPE_BOOLEAN && bson_packed_sse41_supported();
+#endif
+  if (maxCount == 0 || remainBytes < keyLength + 1 + valueSize || 
+      memcmp(current, key, keyLength) != 0 || current[keyLength] != 0x00 || 
+      !bson_array_reserve(array, 1)) {
+    return 0;
+  }
+  while (true) {
+    const uint8_t *in = current + keyLength + 1;
+    uint8_t *out = (uint8_t *)array->packedValues + array->count * array->packedSize;
+    switch (array->packedType) {
+      case TYPE_INT32: {
+        int32_t value = 0;
+        load_int32_le(in, &value);
+        memcpy(out, &value, SIZE_INT32);
+        break;
+      }
+      case TYPE_INT64:
+      case TYPE_DOUBLE: {
+        int64_t value = 0;
+        load_int64_le(in, &value);
+        memcpy(out, &value, SIZE_INT64);
+        break;
+      }
+      default: {
+        bson_boolean value = (bson_boolean)in[0];
+        memcpy(out, &value, sizeof(bson_boolean));
+      }
+    }
+    array->count++;
+    decoded++;
+    current = in + valueSize;
+    remainBytes -= keyLength + 1 + valueSize;
+    bson_packed_next_key(key, &keyLength);
+#ifdef BSON_PACKED_SSE41
+    if (vectorized) {
+      //Only the room already allocated is filled, the array grows one value at a time below
+      size_t limit = maxCount - decoded;
+      if (limit > array->maxCount - array->count) {
+        limit = array->maxCount - array->count;
+      }
+      size_t count = bson_packed_sse41_decode(&current, &remainBytes, 
+                                              (uint8_t *)array->packedValues + array->count * array->packedSize,
+                                              valueSize, limit, type, key, &keyLength);
+      array->count += count;
+      decoded += count;
+    }
+#endif
+
+    //The run continues if the next element has the same type and the expected key.
+    //Its type byte is only consumed once there is room for its value, so that the caller
+    //can parse the element if the array cannot grow
+    if (decoded == maxCount || remainBytes < 1 + keyLength + 1 + valueSize || current[0] != type || 
+        memcmp(&current[1], key, keyLength) != 0 || current[1 + keyLength] != 0x00 || 
+        !bson_array_reserve(array, 1)) {
+      break;
+    }
+    current++;
+    remainBytes--;
+  }
+  *data = current;
+  *dataSize = remainBytes;
+  return decoded;
+}
+
+/*
+  @brief Get the size of the parts of each object in columnar storage which are the same for every object,
+  which excludes the contents of string values
+
+  @param columns - The columnar storage
+
+  @return - The size in bytes of each object when converted to BSON, apart from its strings
+*/
+static size_t bson_columns_fixed_row_size(BsonColumns *columns) {
+  size_t rowSize = OBJECT_OVERHEAD_BYTES;
+  size_t k = 0;
+  for (k = 0; k < columns->keyCount; k++) {
+    BsonArray *column = &columns->columns[k];
+    rowSize += object_key_size(columns->keys[k]) + ELEMENT_OVERHEAD_BYTES;
+    if (column->packedSize != 0) {
+      rowSize += bson_packed_element_size(column->packedType);
+    }
+  }
+  return rowSize;
+}
+
+/*
+  @brief Get the size of an object in columnar storage when converted to BSON
+
+  @param columns - The columnar storage
+  @param fixedRowSize - The size of each object apart from its strings (see bson_columns_fixed_row_size())
+  @param index - The index of the object
+
+  @return - The size in bytes of the BSON representation of the object
+*/
+static size_t bson_columns_row_size(BsonColumns *columns, size_t fixedRowSize, size_t index) {
+  BsonObject *detached = bson_columns_detached_row(columns, index);
+  if (detached != NULL) {
+    return bson_object_size(detached);
+  }
+  size_t rowSize = fixedRowSize;
+  size_t k = 0;
+  for (k = 0; k < columns->keyCount; k++) {
+    BsonArray *column = &columns->columns[k];
+    if (column->packedSize == 0) {
+      rowSize += column->elements[index].size;
+    }
+  }
+  return rowSize;
+}
+
+/*
+  @brief Encode the objects of a columnar array, reading the value of each key from its column
+
+  @param array - The columnar array to be encoded
+  @param start - The index of the first object to be encoded
+  @param count - The number of objects to be encoded
+  @param firstKey - The key with which the first object is written
+  @param keyOrder - The order in which the keys of each object are written, as pointers into
+                    the keys of the columns. NULL to write them in the order of the columns
+  @param bytes - The output buffer
+  @param position - The position in bytes at which the first element is written,
+                    advanced past the last element
+
+  @return - The number of elements written
+*/
+static size_t bson_array_encode_columns(BsonArray *array, size_t start, size_t count, size_t firstKey, 
+                                        char **const *keyOrder, uint8_t *bytes, size_t *position) {
+  BsonColumns *columns = array->columns;
+  size_t fixedRowSize = bson_columns_fixed_row_size(columns);
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  size_t i = 0;
+  for (i = 0; i < count; i++) {
+    size_t index = start + i;
+    bytes[(*position)++] = (uint8_t)TYPE_DOCUMENT;
+    size_t keyLength = 0;
+    const char *key = index_key(firstKey + i, keyBuffer, &keyLength);
+    memcpy(&bytes[*position], key, keyLength + 1);
+    *position += keyLength + 1;
+
+    size_t rowSize = bson_columns_row_size(columns, fixedRowSize, index);
+    BsonObject *detached = bson_columns_detached_row(columns, index);
+    if (detached != NULL) {
+      size_t written = 0;
+      if (keyOrder != NULL) {
+        bson_object_to_buffer_canonical(detached, &bytes[*position], rowSize, &written);
+      }
+      else {
+        bson_object_to_buffer(detached, &bytes[*position], rowSize, &written);
+      }
+      *position += written;
+      continue;
+    }
+    write_int32_le(bytes, (int32_t)rowSize, position);
+    size_t n = 0;
+    for (n = 0; n < columns->keyCount; n++) {
+      size_t k = (keyOrder != NULL) ? (size_t)(keyOrder[n] - columns->keys) : n;
+      BsonArray *column = &columns->columns[k];
+      element_type type = bson_column_type(column);
+      bytes[(*position)++] = (uint8_t)type;
+      size_t columnKeyLength = strlen(columns->keys[k]);
+      memcpy(&bytes[*position], columns->keys[k], columnKeyLength + 1);
+      *position += columnKeyLength + 1;
+
+      switch (type) {
+        case TYPE_INT32:
+          store_int32_le(&bytes[*position], ((int32_t *)column->packedValues)[index]);
+          *position += SIZE_INT32;
+          break;
+        case TYPE_INT64:
+          store_int64_le(&bytes[*position], ((int64_t *)column->packedValues)[index]);
+          *position += SIZE_INT64;
+          break;
+        case TYPE_DOUBLE:
+          store_double_le(&bytes[*position], ((double *)column->packedValues)[index]);
+          *position += SIZE_DOUBLE;
+          break;
+        case TYPE_BOOLEAN:
+          bytes[(*position)++] = (uint8_t)((bson_boolean *)column->packedValues)[index];
+          break;
+        default: {
+          BsonElement *element = &column->elements[index];
+          size_t stringLength = element->size - STRING_OVERHEAD_BYTES;
+          write_int32_le(bytes, (int32_t)(stringLength + 1), position);
+          memcpy(&bytes[*position], bson_element_get_string(element), stringLength);
+          *position += stringLength;
+          bytes[(*position)++] = 0x00;
+        }
+      }
+    }
+    bytes[(*position)++] = DOCUMENT_END;
+  }
+  return count;
+}
+
+/*
+  @brief Get the total number of digits in the keys of a run of sequential indices
+
+  @param firstKey - The index of the first key
+  @param count - The number of keys
+
+  @return - The sum of the lengths of the keys, excluding their null characters
+*/
+static size_t bson_index_keys_length(size_t firstKey, size_t count) {
+  size_t keysLength = 0;
+  size_t keyLength = 1;
+  size_t decadeEnd = 10;
+  size_t index = firstKey;
+  size_t end = firstKey + count;
+  //Count the key digits per decade
+  while (index < end) {
+    if (index < decadeEnd) {
+      size_t runEnd = (end < decadeEnd) ? end : decadeEnd;
+      keysLength += (runEnd - index) * keyLength;
+      index = runEnd;
+    }
+    if (decadeEnd > SIZE_MAX / 10) {
+      keysLength += (end - index) * (keyLength + 1);
+      break;
+    }
+    decadeEnd *= 10;
+    keyLength++;
+  }
+  return keysLength;
+}
+
+/*
+  @brief Get the size of the elements in a range of an array when converted to BSON,
+  excluding the array length and terminator
+
+  @param array - The array to be measured
+  @param start - The index of the first element in the range
+  @param count - The number of elements in the range, which must be within bounds
+  @param firstKey - The key with which the first element is written
+
+  @return - The size in bytes of the BSON representation of the elements
+*/
+static size_t bson_array_elements_size(BsonArray *array, size_t start, size_t count, size_t firstKey) {
+  size_t elementsSize = 0;
+  size_t i = 0;
+  if (array->columns != NULL) {
+    size_t fixedRowSize = bson_columns_fixed_row_size(array->columns);
+    for (i = 0; i < count; i++) {
+      elementsSize += array_key_size(firstKey + i) + ELEMENT_OVERHEAD_BYTES + 
+                      bson_columns_row_size(array->columns, fixedRowSize, start + i);
+    }
+    return elementsSize;
+  }
+  if (array->packedSize != 0) {
+    //Every element has the same size apart from its key
+    return count * (ELEMENT_OVERHEAD_BYTES + 1 + bson_packed_element_size(array->packedType)) + 
+           bson_index_keys_length(firstKey, count);
+  }
+  BsonElement packedElement;
+  for (i = 0; i < count; i++) {
+    BsonElement *element = bson_array_element_at(array, start + i, &packedElement);
+    elementsSize += array_key_size(firstKey + i) + ELEMENT_OVERHEAD_BYTES;
+    if (element->type == TYPE_DOCUMENT) {
+      elementsSize += bson_object_size((BsonObject *)element->value);
+    }
+    else if (element->type == TYPE_ARRAY) {
+      elementsSize += bson_array_size((BsonArray *)element->value);
+    }
+    else {
+      elementsSize += element->size;
+    }
+  }
+  return elementsSize;
+}
+
+/*
+  @brief Get the size of a range of an array when converted to BSON, with keys numbered from 0
+
+  @param array - The array to be measured
+  @param start - The index of the first element in the range
+  @param count - The number of elements in the range, which must be within bounds
+
+  @return - The size in bytes of the BSON representation of the range
+*/
+static size_t bson_array_range_size(BsonArray *array, size_t start, size_t count) {
+  return ARRAY_OVERHEAD_BYTES + bson_array_elements_size(array, start, count, 0);
+}
+
+size_t bson_array_size(BsonArray *array) {
+  return bson_array_range_size(array, 0, array->count);
+}
+
+/*
+  @brief Order two keys of columnar storage, comparing bytes as unsigned values
+
+  @param first - Pointer to a pointer to the first key
+  @param second - Pointer to a pointer to the second key
+
+  @return - Negative, zero or positive as first sorts before, equal to or after second
+*/
+static int bson_columns_compare_keys(const void *first, const void *second) {
+  return strcmp(**(char **const *)first, **(char **const *)second);
+}
+
+/*
+  @brief Encode the objects of a columnar array with their keys in sorted order. The keys are
+  sorted once for the whole range, since every object has the same keys
+
+  @param array - The columnar array to be encoded
+  @param start - The index of the first object to be encoded
+  @param count - The number of objects to be encoded
+  @param firstKey - The key with which the first object is written
+  @param bytes - The output buffer, which must be large enough for the objects
+  @param position - The position in bytes at which the first element is written,
+                    advanced past the last element. Set to 0 if the keys could not be sorted
+
+  @return - true if the objects were written, false if not
+*/
+static bool bson_array_encode_columns_sorted(BsonArray *array, size_t start, size_t count, size_t firstKey, 
+                                             uint8_t *bytes, size_t *position) {
+  BsonColumns *columns = array->columns;
+  char **stackOrder[CANONICAL_STACK_KEYS];
+  char ***keyOrder = (columns->keyCount <= CANONICAL_STACK_KEYS) ? stackOrder : malloc(sizeof(char **) * columns->keyCount);
+  if (keyOrder == NULL) {
+    *position = 0;
+    return false;
+  }
+  size_t k = 0;
+  for (k = 0; k < columns->keyCount; k++) {
+    keyOrder[k] = &columns->keys[k];
+  }
+  qsort(keyOrder, columns->keyCount, sizeof(char **), bson_columns_compare_keys);
+  bson_array_encode_columns(array, start, count, firstKey, keyOrder, bytes, position);
+  if (keyOrder != stackOrder) {
+    free(keyOrder);
+  }
+  return true;
+}
+
+/*
+  @brief Write the elements in a range of an array as BSON, without the array length and terminator.
+  The array is only read, so separate ranges of one array can be written concurrently
+
+  @param array - The array to be converted
+  @param start - The index of the first element in the range
+  @param count - The number of elements in the range, which must be within bounds
+  @param firstKey - The key with which the first element is written
+  @param canonical - Whether the keys of objects are written in sorted order
+                     (see bson_object_to_bytes_canonical())
+  @param bytes - The output buffer
+  @param capacity - The size of the output buffer in bytes
+  @param position - The position in bytes at which the first element is written, advanced past
+                    the last element. If the buffer is too small, set to the position the last
+                    element would end at. Set to 0 if an element cannot be converted
+
+  @return - true if every element was written, false if not
+*/
+static bool bson_array_write_elements(BsonArray *array, size_t start, size_t count, size_t firstKey, bool canonical, 
+                                      uint8_t *bytes, size_t capacity, size_t *position) {
+  if (array->packedSize != 0 || array->columns != NULL) {
+    //Packed and columnar values are cheap to measure, so they are checked once and written in bulk
+    size_t end = *position + bson_array_elements_size(array, start, count, firstKey);
+    if (end > capacity) {
+      *position = end;
+      return false;
+    }
+    if (array->packedSize != 0) {
+      bson_array_encode_packed(array, start, count, firstKey, bytes, position);
+    }
+    else if (canonical) {
+      return bson_array_encode_columns_sorted(array, start, count, firstKey, bytes, position);
+    }
+    else {
+      bson_array_encode_columns(array, start, count, firstKey, NULL, bytes, position);
+    }
+    return true;
+  }
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  size_t i = 0;
+  for (i = 0; i < count; i++) {
+    BsonElement *element = &array->elements[start + i];
+    //Key is copied along with its null character
+    size_t keyLength = 0;
+    const char *key = index_key(firstKey + i, keyBuffer, &keyLength);
+    size_t valueStart = *position + ELEMENT_OVERHEAD_BYTES + keyLength + 1;
+    size_t valueSize = 0;
+    bool fits = (valueStart <= capacity) && 
+                (canonical ? bson_element_to_buffer_canonical(element, &bytes[valueStart], capacity - valueStart, &valueSize) : 
+                             bson_element_to_buffer(element, &bytes[valueStart], capacity - valueStart, &valueSize));
+    if (!fits) {
+      if (valueStart <= capacity && valueSize == 0) {
+        printf("An error occured while parsing the object with index \"%i\"\n", (int)(firstKey + i));
+        *position = 0;
+        return false;
+      }
+      //Once the buffer is full, the rest of the range is only measured
+      *position += bson_array_elements_size(array, start + i, count - i, firstKey + i);
+      return false;
+    }
+    bytes[*position] = (uint8_t)element->type;
+    memcpy(&bytes[*position + ELEMENT_OVERHEAD_BYTES], key, keyLength + 1);
+    *position = valueStart + valueSize;
+  }
+  return true;
+}
+
+/*
+  @brief Write a range of an array as BSON into a given buffer, with keys numbered from 0
+
+  @param array - The array to be converted
+  @param start - The index of the first element in the range
+  @param count - The number of elements in the range, which must be within bounds
+  @param canonical - Whether the keys of objects are written in sorted order
+  @param buffer - The buffer into which the range is written
+  @param capacity - The size of the buffer in bytes
+  @param written - Set as described for bson_array_to_buffer()
+
+  @return - true if the range was written, false if not
+*/
+static bool bson_array_range_to_buffer(BsonArray *array, size_t start, size_t count, bool canonical, 
+                                       uint8_t *buffer, size_t capacity, size_t *written) {
+  //The length is written last, once it is known
+  size_t position = SIZE_INT32;
+  bool fits = bson_array_write_elements(array, start, count, 0, canonical, buffer, capacity, &position);
+  if (position == 0) {
+    *written = 0;
+    return false;
+  }
+  *written = position + 1;
+  if (!fits || *written > capacity) {
+    return false;
+  }
+  buffer[position] = DOCUMENT_END;
+  position = 0;
+  write_int32_le(buffer, (int32_t)*written, &position);
+  return true;
+}
+
+/*
+  @brief Convert a range of an array to BSON, with keys numbered from 0
+
+  @param array - The array to be converted
+  @param start - The index of the first element in the range
+  @param count - The number of elements in the range, which must be within bounds
+  @param canonical - Whether the keys of objects are written in sorted order
+
+  @return - The BSON representation of the range, must be freed by the caller after use.
+  NULL if the range could not be converted
+*/
+static uint8_t *bson_array_range_to_bytes(BsonArray *array, size_t start, size_t count, bool canonical) {
+  size_t arraySize = bson_array_range_size(array, start, count);
+  uint8_t *bytes = malloc(arraySize);
+  if (bytes == NULL) {
+    return NULL;
+  }
+  size_t written = 0;
+  if (!bson_array_range_to_buffer(array, start, count, canonical, bytes, arraySize, &written)) {
+    if (written != 0) {
+      printf("Something went horribly wrong. Unexpected size of array in bytes: %i, expected size: %i\n", (int)written, (int)arraySize);
+    }
+    free(bytes);
+    return NULL;
+  }
+  return bytes;
+}
+
+uint8_t *bson_array_to_bytes(BsonArray *array) {
+  return bson_array_range_to_bytes(array, 0, array->count, false);
+}
+
+bool bson_array_to_buffer(BsonArray *array, uint8_t *buffer, size_t capacity, size_t *written) {
+  return bson_array_range_to_buffer(array, 0, array->count, false, buffer, capacity, written);
+}
+
+uint8_t *bson_array_to_bytes_canonical(BsonArray *array) {
+  return bson_array_range_to_bytes(array, 0, array->count, true);
+}
+
+bool bson_array_to_buffer_canonical(BsonArray *array, uint8_t *buffer, size_t capacity, size_t *written) {
+  return bson_array_range_to_buffer(array, 0, array->count, true, buffer, capacity, written);
+}
+
+/*
+  @brief Write an object stored in columns to an open stream, reading the value of each key from its column
+
+  @param array - The columnar array
+  @param index - The index of the object
+  @param fixedRowSize - The size of each object apart from its strings (see bson_columns_fixed_row_size())
+  @param stream - The stream to be written to
+
+  @return - true if the object was written, false if not
+*/
+static bool bson_columns_row_to_stream(BsonArray *array, size_t index, size_t fixedRowSize, BsonStream *stream) {
+  BsonColumns *columns = array->columns;
+  BsonObject *detached = bson_columns_detached_row(columns, index);
+  if (detached != NULL) {
+    return bson_object_to_stream(detached, stream);
+  }
+  uint8_t header[SIZE_INT32];
+  size_t position = 0;
+  write_int32_le(header, (int32_t)bson_columns_row_size(columns, fixedRowSize, index), &position);
+  if (!bson_stream_write(stream, header, SIZE_INT32)) {
+    return false;
+  }
+  size_t k = 0;
+  for (k = 0; k < columns->keyCount; k++) {
+    BsonElement packedElement;
+    BsonElement *element = bson_array_element_at(&columns->columns[k], index, &packedElement);
+    uint8_t type = (uint8_t)element->type;
+    if (!bson_stream_write(stream, &type, ELEMENT_OVERHEAD_BYTES) || 
+        !bson_stream_write(stream, columns->keys[k], strlen(columns->keys[k]) + 1) || 
+        !bson_element_to_stream(element, stream)) {
+      return false;
+    }
+  }
+  uint8_t end = DOCUMENT_END;
+  return bson_stream_write(stream, &end, 1);
+}
+
+bool bson_array_to_stream(BsonArray *array, BsonStream *stream) {
+  uint8_t header[SIZE_INT32];
+  size_t position = 0;
+  write_int32_le(header, (int32_t)bson_array_size(array), &position);
+  if (!bson_stream_write(stream, header, SIZE_INT32)) {
+    return false;
+  }
+
+  size_t i = 0;
+  if (array->packedSize != 0) {
+    //Packed values are encoded in bulk, a batch at a time
+    uint8_t batch[BSON_STREAM_BATCH_SIZE * (ELEMENT_OVERHEAD_BYTES + INDEX_KEY_BUFFER_SIZE + SIZE_INT64)];
+    while (i < array->count) {
+      size_t batchCount = array->count - i;
+      if (batchCount > BSON_STREAM_BATCH_SIZE) {
+        batchCount = BSON_STREAM_BATCH_SIZE;
+      }
+      position = 0;
+      bson_array_encode_packed(array, i, batchCount, i, batch, &position);
+      if (!bson_stream_write(stream, batch, position)) {
+        return false;
+      }
+      i += batchCount;
+    }
+  }
+  size_t fixedRowSize = (array->columns != NULL) ? bson_columns_fixed_row_size(array->columns) : 0;
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  for (; i < array->count; i++) {
+    uint8_t type = (uint8_t)((array->columns != NULL) ? TYPE_DOCUMENT : array->elements[i].type);
+    size_t keyLength = 0;
+    const char *key = index_key(i, keyBuffer, &keyLength);
+    if (!bson_stream_write(stream, &type, ELEMENT_OVERHEAD_BYTES) || 
+        !bson_stream_write(stream, key, keyLength + 1)) {
+      return false;
+    }
+    bool written = (array->columns != NULL) ? 
+      bson_columns_row_to_stream(array, i, fixedRowSize, stream) : 
+      bson_element_to_stream(&array->elements[i], stream);
+    if (!written) {
+      return false;
+    }
+  }
+
+  uint8_t end = DOCUMENT_END;
+  return bson_stream_write(stream, &end, 1);
+}
+
+bool bson_array_write_stream(BsonArray *array, BsonStreamSink sink, void *context, size_t chunkSize) {
+  BsonStream stream;
+  if (!bson_stream_initialize(&stream, sink, context, chunkSize)) {
+    return false;
+  }
+  bool written = bson_array_to_stream(array, &stream) && bson_stream_flush(&stream);
+  bson_stream_deinitialize(&stream);
+  return written;
+}
+
+bool bson_array_slice(BsonArraySlice *output, BsonArray *array, size_t start, size_t count) {
+  if (start > array->count || count > array->count - start) {
+    printf("Attempted to slice elements outside of the array\n");
+    return false;
+  }
+  output->array = array;
+  output->start = start;
+  output->count = count;
   return true;
 }
 
-void bson_array_deinitialize(BsonArray *array) {
-  size_t i = 0;
-  for (i = 0; i < array->count; i++) {
-    BsonElement *element = array->elements[i];
-    if (element->type == TYPE_DOCUMENT) {
-      bson_object_deinitialize((BsonObject *)element->value);
-    }
-    else if (element->type == TYPE_ARRAY) {
-      bson_array_deinitialize((BsonArray *)element->value);
+size_t bson_array_slice_size(BsonArraySlice *slice) {
+  return bson_array_range_size(slice->array, slice->start, slice->count);
+}
+
+uint8_t *bson_array_slice_to_bytes(BsonArraySlice *slice) {
+  return bson_array_range_to_bytes(slice->array, slice->start, slice->count, false);
+}
+
+// DEPRECATED: use bson_array_from_bytes_len() instead
+BsonArray bson_array_from_bytes(uint8_t *data) {
+  uint8_t *p = data;
+  int32_t size = read_int32_le(&p);
+
+  BsonArray array;
+  size_t bytes = bson_array_from_bytes_len(&array, data, (size_t)size);
+  if (bytes <= 0) {
+    bson_array_initialize(&array, 10);
+  }
+  return array;
+}
+
+/*
+  @brief Get the size of a value which can be stored in a column
+
+  @param type - The type of the value
+  @param data - The encoded value
+  @param dataSize - The number of bytes available in data
+
+  @return - The size in bytes of the encoded value, 0 if values of this type cannot be
+  stored in columns or the value does not fit in the data
+*/
+static size_t bson_column_value_size(element_type type, const uint8_t *data, size_t dataSize) {
+  size_t valueSize = 0;
+  if (type == TYPE_STRING) {
+    if (dataSize >= SIZE_INT32) {
+      int32_t bufferLength = 0;
+      load_int32_le(data, &bufferLength);
+      valueSize = (bufferLength >= 1) ? SIZE_INT32 + (size_t)bufferLength : 0;
     }
-    free(element->value);
-    free(element);
   }
+  else if (bson_packed_value_size(type) != 0) {
+    valueSize = bson_packed_element_size(type);
+  }
+  return (valueSize <= dataSize) ? valueSize : 0;
+}
 
-  free(array->elements);
+/*
+  @brief Read the keys and value types of an encoded object whose values can all be stored in columns
+
+  @param data - The contents of the object, after its length
+  @param dataSize - The number of bytes in the contents, including the terminating null character
+  @param keys - Set to the keys of the object, which point into data. May be NULL to only count the keys
+  @param types - Set to the value type of each key. May be NULL to only count the keys
+
+  @return - The number of keys in the object, 0 if it is empty, contains duplicate keys
+  or values which cannot be stored in columns
+*/
+static size_t bson_columns_scan_row(const uint8_t *data, size_t dataSize, const char **keys, element_type *types) {
+  size_t keyCount = 0;
+  while (dataSize > 1) {
+    element_type type = (element_type)*data;
+    data++;
+    dataSize--;
+    const char *key = (const char *)data;
+    if (skip_string_len(&data, &dataSize) == 0) {
+      return 0;
+    }
+    size_t valueSize = bson_column_value_size(type, data, dataSize);
+    if (valueSize == 0) {
+      return 0;
+    }
+    data += valueSize;
+    dataSize -= valueSize;
+    if (keys != NULL) {
+      size_t k = 0;
+      for (k = 0; k < keyCount; k++) {
+        if (strcmp(keys[k], key) == 0) {
+          return 0;
+        }
+      }
+      keys[keyCount] = key;
+      types[keyCount] = type;
+    }
+    keyCount++;
+  }
+  return (dataSize == 1 && *data == DOCUMENT_END) ? keyCount : 0;
 }
 
-size_t bson_array_size(BsonArray *array) {
-  size_t arraySize = ARRAY_OVERHEAD_BYTES;
-  size_t i = 0;
-  for (i = 0; i < array->count; i++) {
-    BsonElement *element = array->elements[i];
-    arraySize += array_key_size(i) + ELEMENT_OVERHEAD_BYTES;
-    if (element->type == TYPE_DOCUMENT) {
-      arraySize += bson_object_size((BsonObject *)element->value);
+/*
+  @brief Check whether an encoded object has the same keys and value types, in the same order,
+  as an object accepted by bson_columns_scan_row()
+
+  @param first - The contents of the accepted object, after its length
+  @param firstSize - The number of bytes in the contents of the accepted object
+  @param row - The contents of the object to be checked, after its length
+  @param rowSize - The number of bytes in the contents of the object to be checked
+
+  @return - true if the objects have the same shape, false if not
+*/
+static bool bson_columns_same_shape(const uint8_t *first, size_t firstSize, const uint8_t *row, size_t rowSize) {
+  while (firstSize > 1) {
+    element_type type = (element_type)*first;
+    if (rowSize < 1 || *row != *first) {
+      return false;
     }
-    else if (element->type == TYPE_ARRAY) {
-      arraySize += bson_array_size((BsonArray *)element->value);
+    //Keys of the accepted object are known to be null-terminated
+    size_t keyLength = strlen((const char *)first + 1);
+    if (rowSize < 1 + keyLength + 1 || memcmp(row + 1, first + 1, keyLength + 1) != 0) {
+      return false;
     }
-    else {
-      arraySize += element->size;
+    first += 1 + keyLength + 1;
+    firstSize -= 1 + keyLength + 1;
+    row += 1 + keyLength + 1;
+    rowSize -= 1 + keyLength + 1;
+    size_t firstValueSize = bson_column_value_size(type, first, firstSize);
+    size_t valueSize = bson_column_value_size(type, row, rowSize);
+    if (valueSize == 0) {
+      return false;
     }
+    first += firstValueSize;
+    firstSize -= firstValueSize;
+    row += valueSize;
+    rowSize -= valueSize;
   }
-  return arraySize;
+  return rowSize == 1 && *row == DOCUMENT_END;
 }
 
-uint8_t *bson_array_to_bytes(BsonArray *array) {
-  size_t arraySize = bson_array_size(array);
-  uint8_t *bytes = malloc(arraySize);
-  size_t position = 0;
-  write_int32_le(bytes, (int32_t)arraySize, &position);
-  size_t i = 0;
-  for (i = 0; i < array->count; i++) {
-    BsonElement *element = array->elements[i];
+/*
+  @brief Count the objects of an encoded array if it can be stored in columns,
+  walking the encoded objects without decoding or allocating anything
 
-    bytes[position++] = (uint8_t)element->type;
+  @param data - Byte buffer that contains the encoded array, starting with its length
+  @param dataSize - Number of bytes of the data stored in the byte buffer
+  @param strict - Whether keys that are not the sequential index of their element are rejected
 
-    uint8_t *keyBytes = index_to_key(i);
-    memcpy(&bytes[position], keyBytes, digits(i));
-    free(keyBytes);
-    position += digits(i);
+  @return - The number of objects in the array, 0 if it is not an array of objects
+  with the same keys and value types
+*/
+static size_t bson_columns_scan(const uint8_t *data, size_t dataSize, bool strict) {
+  const uint8_t *current = data + SIZE_INT32;
+  size_t remainBytes = dataSize - SIZE_INT32;
+  const uint8_t *first = NULL;
+  size_t firstSize = 0;
+  size_t count = 0;
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
 
-    //Null-terminate
-    bytes[position++] = 0x00;
+  while (remainBytes >= 1 && *current == TYPE_DOCUMENT) {
+    current++;
+    remainBytes--;
+    size_t keyLength = 0;
+    const char *expectedKey = index_key(count, keyBuffer, &keyLength);
+    if (remainBytes > keyLength && memcmp(current, expectedKey, keyLength + 1) == 0) {
+      current += keyLength + 1;
+      remainBytes -= keyLength + 1;
+    }
+    else if (strict || skip_string_len(&current, &remainBytes) == 0) {
+      return 0;
+    }
 
-    switch (element->type) {
-      case TYPE_DOCUMENT: {
-        BsonObject *obj = (BsonObject *)element->value;
-        uint8_t *objBytes = bson_object_to_bytes(obj);
-        if (objBytes == NULL) {
-          printf("An error occured while parsing the object with index \"%i\"\n", (int)i);
-          free(bytes);
-          return NULL;
-        }
-        size_t objSize = bson_object_size(obj);
-        memcpy(&bytes[position], objBytes, objSize);
-        free(objBytes);
-        position += objSize;
-        break;
-      }
-      case TYPE_ARRAY: {
-        BsonArray *subArray = (BsonArray *)element->value;
-        uint8_t *subArrayBytes = bson_array_to_bytes(subArray);
-        if (subArrayBytes == NULL) {
-          printf("An error occured while parsing the object with index \"%i\"\n", (int)i);
-          free(bytes);
-          return NULL;
-        }
-        size_t subArraySize = bson_array_size(subArray);
-        memset(&bytes[position], 0, subArraySize);
-        memcpy(&bytes[position], subArrayBytes, subArraySize);
-        free(subArrayBytes);
-        position += subArraySize;
-        break;
-      }
-      case TYPE_INT32: {
-        write_int32_le(bytes, *(int32_t *)element->value, &position);
-        break;
-      }
-      case TYPE_INT64: {
-        write_int64_le(bytes, *(int64_t *)element->value, &position);
-        break;
+    if (remainBytes < SIZE_INT32) {
+      return 0;
+    }
+    int32_t rowSize = 0;
+    load_int32_le(current, &rowSize);
+    if (rowSize < OBJECT_OVERHEAD_BYTES || (size_t)rowSize > remainBytes) {
+      return 0;
+    }
+    const uint8_t *row = current + SIZE_INT32;
+    size_t contentSize = (size_t)rowSize - SIZE_INT32;
+    if (first == NULL) {
+      if (bson_columns_scan_row(row, contentSize, NULL, NULL) == 0) {
+        return 0;
       }
-      case TYPE_STRING: {
-        char *stringVal = (char *)element->value;
-        //String length is written first
-        write_int32_le(bytes, (int32_t)(strlen(stringVal) + 1), &position);
+      first = row;
+      firstSize = contentSize;
+    }
+    else if (!bson_columns_same_shape(first, firstSize, row, contentSize)) {
+      return 0;
+    }
+    current += rowSize;
+    remainBytes -= (size_t)rowSize;
+    count++;
+  }
+  int32_t documentSize = 0;
+  load_int32_le(data, &documentSize);
+  return (remainBytes >= 1 && *current == DOCUMENT_END && 
+          current + 1 == data + documentSize) ? count : 0;
+}
+
+/*
+  @brief Parse BSON data into a columnar array if all of its elements are objects
+  with the same keys and value types (see bson_array_initialize_columnar())
+
+  @param output - Pointer to an uninitialized BsonArray. On success, it is
+                  initialized and stores converted data.
+  @param data - Byte buffer that contains BSON data to be parsed
+  @param dataSize - Number of bytes of the data stored in the byte buffer
+  @param strict - Whether keys that are not the sequential index of their element are rejected
 
-        uint8_t *stringBytes = string_to_byte_array(stringVal);
-        memcpy(&bytes[position], stringBytes, strlen(stringVal));
-        free(stringBytes);
-        position += strlen(stringVal);
+  @return - On success, a positive number indicating number of bytes consumed
+            is returned. 0 is returned if the data is not an array of same-shaped objects,
+            in which case it should be parsed into separate elements instead.
+            This is decided by a scan of the encoded objects before any value is decoded.
+*/
+static size_t bson_array_parse_columns(BsonArray *output, const uint8_t *data, size_t dataSize, bool strict) {
+  size_t rowCount = bson_columns_scan(data, dataSize, strict);
+  if (rowCount == 0) {
+    return 0;
+  }
+  const uint8_t *current = data;
+  int32_t size = read_int32_le((uint8_t **)&current);
+  size_t remainBytes = dataSize - SIZE_INT32;
+  BsonColumns *columns = NULL;
+  size_t count = 0;
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  bool valid = true;
+
+  while (valid && remainBytes >= 1 && *current == TYPE_DOCUMENT) {
+    current++;
+    remainBytes--;
+    size_t keyLength = 0;
+    const char *expectedKey = index_key(count, keyBuffer, &keyLength);
+    if (remainBytes > keyLength && memcmp(current, expectedKey, keyLength + 1) == 0) {
+      current += keyLength + 1;
+      remainBytes -= keyLength + 1;
+    }
+    else if (strict || skip_string_len(&current, &remainBytes) == 0) {
+      valid = false;
+      break;
+    }
 
-        //Null-terminate
-        bytes[position++] = 0x00;
+    if (remainBytes < SIZE_INT32) {
+      valid = false;
+      break;
+    }
+    const uint8_t *rowStart = current;
+    int32_t rowSize = read_int32_le((uint8_t **)&current);
+    if (rowSize < OBJECT_OVERHEAD_BYTES || (size_t)rowSize > remainBytes) {
+      valid = false;
+      break;
+    }
+    const uint8_t *rowEnd = rowStart + rowSize;
+
+    //The first object decides the keys and types of the columns
+    if (columns == NULL) {
+      size_t keyCount = bson_columns_scan_row(current, (size_t)(rowEnd - current), NULL, NULL);
+      const char **keys = malloc(sizeof(char *) * keyCount);
+      element_type *types = malloc(sizeof(element_type) * keyCount);
+      if (keyCount > 0 && keys != NULL && types != NULL) {
+        bson_columns_scan_row(current, (size_t)(rowEnd - current), keys, types);
+        columns = bson_columns_create(keys, types, keyCount, rowCount);
+      }
+      free(keys);
+      free(types);
+      if (columns == NULL) {
+        valid = false;
         break;
       }
-      case TYPE_DOUBLE: {
-        write_double_le(bytes, *(double *)element->value, &position);
+    }
+
+    size_t k = 0;
+    for (k = 0; k < columns->keyCount && valid; k++) {
+      BsonArray *column = &columns->columns[k];
+      element_type type = bson_column_type(column);
+      size_t columnKeyLength = strlen(columns->keys[k]);
+      if ((size_t)(rowEnd - current) < 1 + columnKeyLength + 1 || *current != (uint8_t)type || 
+          memcmp(current + 1, columns->keys[k], columnKeyLength + 1) != 0) {
+        valid = false;
         break;
       }
-      case TYPE_BOOLEAN: {
-        bytes[position++] = (uint8_t)(*(bson_boolean *)element->value);
+      current += 1 + columnKeyLength + 1;
+      size_t valueSize = bson_column_value_size(type, current, (size_t)(rowEnd - current));
+      if (valueSize == 0) {
+        valid = false;
         break;
       }
-      default: {
-        printf("Unrecognized BSON type: %i\n", element->type);
-        position += sizeof(*element->value);
+      switch (type) {
+        case TYPE_INT32: {
+          int32_t value = 0;
+          current = load_int32_le(current, &value);
+          valid = bson_array_add_int32(column, value);
+          break;
+        }
+        case TYPE_INT64: {
+          int64_t value = 0;
+          current = load_int64_le(current, &value);
+          valid = bson_array_add_int64(column, value);
+          break;
+        }
+        case TYPE_DOUBLE: {
+          double value = 0;
+          current = load_double_le(current, &value);
+          valid = bson_array_add_double(column, value);
+          break;
+        }
+        case TYPE_BOOLEAN:
+          valid = bson_array_add_bool(column, (bson_boolean)*current);
+          current++;
+          break;
+        default:
+          valid = bson_array_add_string_len(column, (char *)current + SIZE_INT32, valueSize - SIZE_INT32 - 1);
+          current += valueSize;
       }
     }
+    //Every object must end after the values of the columns
+    if (!valid || current + 1 != rowEnd || *current != DOCUMENT_END) {
+      valid = false;
+      break;
+    }
+    current = rowEnd;
+    remainBytes -= (size_t)rowSize;
+    count++;
   }
 
-  bytes[position++] = DOCUMENT_END;
-  if (position != arraySize) {
-    printf("Something went horribly wrong. Unexpected size of array in bytes: %i, expected size: %i\n", (int)position, (int)arraySize);
-    free(bytes);
-    return NULL;
+  if (!valid || count == 0 || remainBytes < 1 || *current != DOCUMENT_END || current + 1 != data + size) {
+    if (columns != NULL) {
+      bson_columns_deinitialize(columns);
+      free(columns);
+    }
+    return 0;
   }
-  return bytes;
+  bson_array_initialize_with_columns(output, columns, count);
+  return dataSize - remainBytes + 1;
 }
 
-// DEPRECATED: use bson_array_from_bytes_len() instead
-BsonArray bson_array_from_bytes(uint8_t *data) {
-  uint8_t *p = data;
-  int32_t size = read_int32_le(&p);
+//Nested arrays are parsed recursively
+static size_t bson_array_parse(BsonArray *output, const uint8_t *data, size_t dataSize, bool strict);
 
-  BsonArray array;
-  size_t bytes = bson_array_from_bytes_len(&array, data, (size_t)size);
-  if (bytes <= 0) {
-    bson_array_initialize(&array, 10);
-  }
-  return array;
-}
+/*
+  @brief Parse consecutive elements of a BSON array. Element keys are checked against the
+  expected index without being copied
 
-size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t dataSize) {
-  const uint8_t *current = data;
-  size_t remainBytes = dataSize;
-  int32_t size = 0;
+  @param array - The array to which the elements are added
+  @param data - Pointer to the type byte of the first element, advanced to the type byte
+                of the first element which was not parsed
+  @param dataSize - The number of bytes remaining in data, decreased by the number of bytes consumed
+  @param firstIndex - The index in the encoded array of the first element in array
+  @param maxCount - The maximum number of elements to be parsed. Parsing also stops at the
+                    end of the array, leaving data at its terminator
+  @param strict - Whether keys that are not the sequential index of their element are rejected.
+                  Otherwise these keys are skipped
+
+  @return - true if the elements were parsed, false if the data is invalid
+*/
+static bool bson_array_parse_elements(BsonArray *array, const uint8_t **data, size_t *dataSize, 
+                                      size_t firstIndex, size_t maxCount, bool strict) {
+  const uint8_t *current = *data;
+  size_t remainBytes = *dataSize;
   bool parseError = false;
+  size_t parsed = 0;
   size_t ret;
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
 
-  if (output == NULL || data == NULL || dataSize < SIZE_INT32) {
-    return 0;
-  }
-  size = read_int32_le((uint8_t **)&current);
-  remainBytes -= SIZE_INT32;
-  if (size > dataSize) {
-    printf("Unexpected array length %i, data is only %i bytes\n", (int)size, (int)dataSize);
-    return 0;
-  }
-
-  if (remainBytes < 1) {
-    return 0;
-  }
-  uint8_t type = *current;
-  current += 1;
-  remainBytes -= 1;
+  while (parsed < maxCount) {
+    if (remainBytes < 1) {
+      parseError = true;
+      break;
+    }
+    uint8_t type = *current;
+    if (type == DOCUMENT_END) {
+      break;
+    }
+    current += 1;
+    remainBytes -= 1;
 
-  BsonArray array;
-  bson_array_initialize(&array, 10);
+    //Arrays which start with a numeric or boolean value are packed, they are
+    //converted back to separate elements if a value of another type follows
+    if (array->count == 0) {
+      bson_array_pack(array, (element_type)type);
+    }
+    //Runs of packed values with sequential keys are decoded in bulk
+    if (array->packedSize != 0 && (element_type)type == array->packedType) {
+      size_t decoded = bson_array_decode_packed(array, &current, &remainBytes, firstIndex, maxCount - parsed);
+      if (decoded > 0) {
+        parsed += decoded;
+        continue;
+      }
+    }
 
-  while (type != DOCUMENT_END) {
-    char *key = NULL;
-    ret = read_string_len(&key, &current, &remainBytes);
-    if (ret == 0) {
+    //Keys are normally the index of the element, which is checked without allocating a copy
+    size_t keyLength = 0;
+    const char *expectedKey = index_key(firstIndex + array->count, keyBuffer, &keyLength);
+    if (remainBytes > keyLength && memcmp(current, expectedKey, keyLength + 1) == 0) {
+      current += keyLength + 1;
+      remainBytes -= keyLength + 1;
+    }
+    else if (strict) {
+      printf("Unexpected array key, expected index %s\n", expectedKey);
+      parseError = true;
+      break;
+    }
+    else if (skip_string_len(&current, &remainBytes) == 0) {
       parseError = true;
       break;
     }
 
     switch ((element_type)type) {
       case TYPE_DOCUMENT: {
-        BsonObject obj;
-        ret = bson_object_from_bytes_len(&obj, current, remainBytes);
+        BsonObject *obj = malloc(sizeof(BsonObject));
+        ret = (obj != NULL) ? bson_object_from_bytes_len(obj, current, remainBytes) : 0;
         if (ret > 0) {
-          bson_array_add_object(&array, &obj);
+          parseError = !bson_array_add_object_owned(array, obj);
           current += ret;
           remainBytes -= ret;
         } else {
+          free(obj);
           parseError = true;
         }
         break;
       }
       case TYPE_ARRAY: {
-        BsonArray subArray;
-        ret = bson_array_from_bytes_len(&subArray, current, remainBytes);
+        BsonArray *subArray = malloc(sizeof(BsonArray));
+        ret = (subArray != NULL) ? bson_array_parse(subArray, current, remainBytes, strict) : 0;
         if (ret > 0) {
-          bson_array_add_array(&array, &subArray);
+          parseError = !bson_array_add_array_owned(array, subArray);
           current += ret;
           remainBytes -= ret;
         } else {
+          free(subArray);
           parseError = true;
         }
         break;
       }
       case TYPE_INT32:
         if (remainBytes >= SIZE_INT32) {
-          int32_t value = read_int32_le((uint8_t **)&current);
-          bson_array_add_int32(&array, value);
+          int32_t value = 0;
+          current = load_int32_le(current, &value);
+          parseError = !bson_array_add_int32(array, value);
           remainBytes -= SIZE_INT32;
         } else {
           parseError = true;
@@ -222,8 +2445,9 @@ size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t
         break;
       case TYPE_INT64:
         if (remainBytes >= SIZE_INT64) {
-          int64_t value = read_int64_le((uint8_t **)&current);
-          bson_array_add_int64(&array, value);
+          int64_t value = 0;
+          current = load_int64_le(current, &value);
+          parseError = !bson_array_add_int64(array, value);
           remainBytes -= SIZE_INT64;
         } else {
           parseError = true;
@@ -232,13 +2456,12 @@ size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t
       case TYPE_STRING:
         // Buffer length is read first
         if (remainBytes >= SIZE_INT32) {
-          int32_t bufferLength = read_int32_le((uint8_t **)&current);
+          int32_t bufferLength = 0;
+          current = load_int32_le(current, &bufferLength);
           remainBytes -= SIZE_INT32;
 
-          if (bufferLength <= remainBytes) {
-            char *stringVal = byte_array_to_bson_string((uint8_t*)current, (size_t)bufferLength - 1);
-            bson_array_add_string(&array, stringVal);
-            free(stringVal);
+          if (bufferLength >= 1 && bufferLength <= remainBytes) {
+            parseError = !bson_array_add_string_len(array, (char *)current, (size_t)bufferLength - 1);
             current += bufferLength;
             remainBytes -= (size_t)bufferLength;
           } else {
@@ -250,8 +2473,9 @@ size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t
         break;
       case TYPE_DOUBLE:
         if (remainBytes >= SIZE_DOUBLE) {
-          double value = read_double_le((uint8_t **)&current);
-          bson_array_add_double(&array, value);
+          double value = 0;
+          current = load_double_le(current, &value);
+          parseError = !bson_array_add_double(array, value);
           remainBytes -= SIZE_DOUBLE;
         } else {
           parseError = true;
@@ -260,7 +2484,7 @@ size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t
       case TYPE_BOOLEAN:
         if (remainBytes >= 1) {
           uint8_t value = *current;
-          bson_array_add_bool(&array, value);
+          parseError = !bson_array_add_bool(array, value);
           current += 1;
           remainBytes -= 1;
         } else {
@@ -272,32 +2496,398 @@ size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t
         parseError = true;
       }
     }
-    free(key);
 
-    if (parseError) {
-      break;
+    if (parseError) {
+      break;
+    }
+    parsed++;
+  }
+
+  *data = current;
+  *dataSize = remainBytes;
+  return !parseError;
+}
+
+/*
+  @brief Parse BSON data into an array. Element keys are checked against the
+  expected index without being copied
+
+  @param output - Pointer to an uninitialized BsonArray. On success, it is
+                  initialized and stores converted data.
+  @param data - Byte buffer that contains BSON data to be parsed
+  @param dataSize - Number of bytes of the data stored in the byte buffer
+  @param strict - Whether keys that are not the sequential index of their element are rejected.
+                  Otherwise these keys are skipped
+
+  @return - On success, a positive number indicating number of bytes consumed
+            is returned. On error, 0 is returned.
+*/
+static size_t bson_array_parse(BsonArray *output, const uint8_t *data, size_t dataSize, bool strict) {
+  const uint8_t *current = data;
+  size_t remainBytes = dataSize;
+  int32_t size = 0;
+  size_t ret;
+
+  if (output == NULL || data == NULL || dataSize < SIZE_INT32) {
+    return 0;
+  }
+  size = read_int32_le((uint8_t **)&current);
+  remainBytes -= SIZE_INT32;
+  if (size > dataSize) {
+    printf("Unexpected array length %i, data is only %i bytes\n", (int)size, (int)dataSize);
+    return 0;
+  }
+
+  if (remainBytes < 1) {
+    return 0;
+  }
+
+  //Arrays of objects with the same keys and value types are stored in columns
+  if ((element_type)*current == TYPE_DOCUMENT) {
+    ret = bson_array_parse_columns(output, data, dataSize, strict);
+    if (ret > 0) {
+      return ret;
+    }
+  }
+
+  BsonArray array;
+  if (!bson_array_initialize(&array, 10)) {
+    return 0;
+  }
+  if (!bson_array_parse_elements(&array, &current, &remainBytes, 0, SIZE_MAX, strict) || remainBytes < 1) {
+    bson_array_deinitialize(&array);
+    return 0;
+  }
+  //Skip the terminator of the array
+  current += 1;
+  remainBytes -= 1;
+
+  if (data + size != current) {
+    printf("Unexpected parsed array size. Expected %i, got %i\n", (int)size, (int)(current - data));
+  }
+  *output = array;
+  return dataSize - remainBytes;
+}
+
+size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t dataSize) {
+  return bson_array_parse(output, data, dataSize, false);
+}
+
+size_t bson_array_from_bytes_strict(BsonArray *output, const uint8_t *data, size_t dataSize) {
+  return bson_array_parse(output, data, dataSize, true);
+}
+
+#ifdef BSON_PARALLEL_ARRAYS
+//A part of a large array which is converted by one worker thread
+typedef struct BsonArrayChunk {
+  //The array being encoded, or the array to which a decoded chunk is added
+  BsonArray *array;
+  //Index of the first element of the chunk in the whole array
+  size_t start;
+  //Number of elements in the chunk
+  size_t count;
+  //BSON data of the chunk, starting at the type byte of its first element
+  const uint8_t *data;
+  //Size in bytes of the BSON data of the chunk
+  size_t size;
+  //Output buffer of the whole array, which the chunk is written into at position
+  uint8_t *bytes;
+  size_t position;
+  //Whether the chunk was converted successfully
+  bool success;
+} BsonArrayChunk;
+
+/*
+  @brief Run a task on every chunk, using one thread per chunk. The calling thread handles the first chunk,
+  and chunks whose thread could not be started are handled by the calling thread as well
+
+  @param task - The task to be run, which receives a pointer to its chunk
+  @param chunks - The chunks to be processed
+  @param chunkCount - The number of chunks
+*/
+static void bson_parallel_run(void *(*task)(void *), BsonArrayChunk *chunks, size_t chunkCount) {
+  pthread_t *threads = malloc(sizeof(pthread_t) * chunkCount);
+  bool *started = calloc(chunkCount, sizeof(bool));
+  size_t i = 0;
+  if (threads == NULL || started == NULL) {
+    //Without room to track the threads, every chunk is handled by the calling thread
+    for (i = 0; i < chunkCount; i++) {
+      task(&chunks[i]);
+    }
+    free(threads);
+    free(started);
+    return;
+  }
+  for (i = 1; i < chunkCount; i++) {
+    started[i] = (pthread_create(&threads[i], NULL, task, &chunks[i]) == 0);
+    if (!started[i]) {
+      task(&chunks[i]);
+    }
+  }
+  task(&chunks[0]);
+  for (i = 1; i < chunkCount; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+  free(threads);
+  free(started);
+}
+
+/*
+  @brief Get the number of chunks into which work is split
+
+  @param maxChunks - The number of chunks of at least the minimum size that the work can be split into
+  @param threadCount - The number of threads requested by the caller
+
+  @return - The number of chunks to be processed in parallel, 1 or less if the work should not be split
+*/
+static size_t bson_parallel_chunk_count(size_t maxChunks, size_t threadCount) {
+  return (threadCount < maxChunks) ? threadCount : maxChunks;
+}
+
+/*
+  @brief Measure the size of the elements of an encoded chunk (see bson_parallel_run())
+
+  @param context - The chunk to be measured, its size is set to the size of its elements
+*/
+static void *bson_array_chunk_measure(void *context) {
+  BsonArrayChunk *chunk = (BsonArrayChunk *)context;
+  chunk->size = bson_array_elements_size(chunk->array, chunk->start, chunk->count, chunk->start);
+  return NULL;
+}
+
+/*
+  @brief Write the elements of a chunk at its precomputed position (see bson_parallel_run())
+
+  @param context - The chunk to be written
+*/
+static void *bson_array_chunk_write(void *context) {
+  BsonArrayChunk *chunk = (BsonArrayChunk *)context;
+  size_t position = chunk->position;
+  chunk->success = bson_array_write_elements(chunk->array, chunk->start, chunk->count, chunk->start, false, 
+                                             chunk->bytes, chunk->position + chunk->size, &position) && 
+                   position == chunk->position + chunk->size;
+  return NULL;
+}
+
+/*
+  @brief Parse the elements of a chunk into the array of the chunk (see bson_parallel_run())
+
+  @param context - The chunk to be parsed
+*/
+static void *bson_array_chunk_parse(void *context) {
+  BsonArrayChunk *chunk = (BsonArrayChunk *)context;
+  const uint8_t *data = chunk->data;
+  size_t dataSize = chunk->size;
+  chunk->success = bson_array_initialize(chunk->array, chunk->count) && 
+                   bson_array_parse_elements(chunk->array, &data, &dataSize, chunk->start, chunk->count, false) && 
+                   chunk->array->count == chunk->count && dataSize == 0;
+  return NULL;
+}
+
+/*
+  @brief Find the elements at which the chunks of a BSON array start, by skipping over each element
+  using its length prefix or the fixed size of its type. Chunks hold roughly the same number of bytes
+
+  @param data - Byte buffer that contains the BSON array
+  @param dataSize - Number of bytes of the data stored in the byte buffer
+  @param chunks - The chunks to be filled in
+  @param chunkCount - The maximum number of chunks, decreased if there are fewer elements than chunks
+
+  @return - The number of bytes up to and including the terminator of the array,
+  0 if an element could not be skipped
+*/
+static size_t bson_array_split_chunks(const uint8_t *data, size_t dataSize, BsonArrayChunk *chunks, size_t *chunkCount) {
+  const uint8_t *current = data + SIZE_INT32;
+  size_t remainBytes = dataSize - SIZE_INT32;
+  size_t chunkBytes = remainBytes / *chunkCount;
+  size_t chunk = 0;
+  size_t index = 0;
+  while (remainBytes >= 1 && *current != DOCUMENT_END) {
+    if (chunk < *chunkCount && (size_t)(current - data) >= SIZE_INT32 + chunk * chunkBytes) {
+      chunks[chunk].start = index;
+      chunks[chunk].data = current;
+      chunk++;
+    }
+    element_type type = (element_type)*current;
+    current += 1;
+    remainBytes -= 1;
+    if (skip_string_len(&current, &remainBytes) == 0) {
+      return 0;
+    }
+
+    size_t valueSize = 0;
+    if (type == TYPE_DOCUMENT || type == TYPE_ARRAY) {
+      if (remainBytes >= SIZE_INT32) {
+        const uint8_t *lengthBytes = current;
+        int32_t length = read_int32_le((uint8_t **)&lengthBytes);
+        valueSize = (length >= OBJECT_OVERHEAD_BYTES && (size_t)length <= remainBytes) ? (size_t)length : 0;
+      }
+    }
+    else {
+      valueSize = bson_column_value_size(type, current, remainBytes);
     }
+    if (valueSize == 0) {
+      return 0;
+    }
+    current += valueSize;
+    remainBytes -= valueSize;
+    index++;
+  }
+  if (remainBytes < 1) {
+    return 0;
+  }
 
-    if (remainBytes >= 1) {
-      type = *current;
-      current += 1;
-      remainBytes -= 1;
-    } else {
-      parseError = true;
-      break;
+  *chunkCount = chunk;
+  for (chunk = 0; chunk < *chunkCount; chunk++) {
+    const uint8_t *end = (chunk + 1 < *chunkCount) ? chunks[chunk + 1].data : current;
+    size_t nextStart = (chunk + 1 < *chunkCount) ? chunks[chunk + 1].start : index;
+    chunks[chunk].size = (size_t)(end - chunks[chunk].data);
+    chunks[chunk].count = nextStart - chunks[chunk].start;
+  }
+  return (size_t)(current - data) + 1;
+}
+
+/*
+  @brief Move the elements of a parsed chunk to the end of an array
+
+  @param array - The array to which the elements are added
+  @param chunk - The array holding the elements of the chunk, which is deinitialized
+
+  @return - true if the elements were moved, false if the array could not be grown.
+  The chunk is left unchanged on failure
+*/
+static bool bson_array_append_chunk(BsonArray *array, BsonArray *chunk) {
+  if (array->packedSize != 0 && chunk->packedSize != 0 && array->packedType == chunk->packedType) {
+    if (!bson_array_reserve(array, chunk->count)) {
+      return false;
     }
+    memcpy((uint8_t *)array->packedValues + array->count * array->packedSize, 
+           chunk->packedValues, chunk->count * chunk->packedSize);
+    array->count += chunk->count;
+    bson_array_deinitialize(chunk);
+    return true;
   }
+  if (!bson_array_unpack(array) || !bson_array_unpack(chunk) || !bson_array_reserve(array, chunk->count)) {
+    return false;
+  }
+  memcpy(&array->elements[array->count], chunk->elements, sizeof(BsonElement) * chunk->count);
+  array->count += chunk->count;
+  //The elements now belong to the array, along with the storage of their short strings.
+  //Only the element storage of the chunk is freed
+  bson_string_pool_merge(array, chunk);
+  chunk->count = 0;
+  bson_array_deinitialize(chunk);
+  return true;
+}
+#endif
 
-  if (parseError || dataSize - remainBytes == 0) {
-    bson_array_deinitialize(&array);
-    return 0;
+uint8_t *bson_array_to_bytes_parallel(BsonArray *array, size_t threadCount) {
+#ifdef BSON_PARALLEL_ARRAYS
+  size_t chunkCount = bson_parallel_chunk_count(array->count / BSON_PARALLEL_MIN_CHUNK_ELEMENTS, threadCount);
+  BsonArrayChunk *chunks = (chunkCount > 1) ? calloc(chunkCount, sizeof(BsonArrayChunk)) : NULL;
+  if (chunks != NULL) {
+    size_t chunkElements = array->count / chunkCount;
+    size_t i = 0;
+    for (i = 0; i < chunkCount; i++) {
+      chunks[i].array = array;
+      chunks[i].start = i * chunkElements;
+      chunks[i].count = (i + 1 < chunkCount) ? chunkElements : array->count - chunks[i].start;
+    }
+    //Chunk sizes are measured first, so that every chunk knows where it is written
+    bson_parallel_run(bson_array_chunk_measure, chunks, chunkCount);
+    size_t position = SIZE_INT32;
+    for (i = 0; i < chunkCount; i++) {
+      chunks[i].position = position;
+      position += chunks[i].size;
+    }
+    size_t arraySize = position + 1;
+    uint8_t *bytes = malloc(arraySize);
+    bool success = (bytes != NULL);
+    if (success) {
+      for (i = 0; i < chunkCount; i++) {
+        chunks[i].bytes = bytes;
+      }
+      bson_parallel_run(bson_array_chunk_write, chunks, chunkCount);
+      for (i = 0; i < chunkCount; i++) {
+        success = success && chunks[i].success;
+      }
+    }
+    free(chunks);
+    if (!success) {
+      free(bytes);
+      return NULL;
+    }
+    position = 0;
+    write_int32_le(bytes, (int32_t)arraySize, &position);
+    bytes[arraySize - 1] = DOCUMENT_END;
+    return bytes;
   }
+#endif
+  return bson_array_to_bytes(array);
+}
 
-  if (data + size != current) {
-    printf("Unexpected parsed array size. Expected %i, got %i\n", (int)size, (int)(current - data));
+size_t bson_array_from_bytes_parallel(BsonArray *output, const uint8_t *data, size_t dataSize, size_t threadCount) {
+#ifdef BSON_PARALLEL_ARRAYS
+  size_t chunkCount = bson_parallel_chunk_count(dataSize / BSON_PARALLEL_MIN_CHUNK_BYTES, threadCount);
+  const uint8_t *sizeBytes = data;
+  int32_t size = (data != NULL && chunkCount > 1) ? read_int32_le((uint8_t **)&sizeBytes) : 0;
+  //Invalid lengths are reported by the sequential parser
+  if (chunkCount > 1 && output != NULL && size > 0 && (size_t)size <= dataSize) {
+    //Arrays of objects with the same keys and value types are still stored in columns
+    size_t ret = 0;
+    if ((element_type)data[SIZE_INT32] == TYPE_DOCUMENT) {
+      ret = bson_array_parse_columns(output, data, dataSize, false);
+      if (ret > 0) {
+        return ret;
+      }
+    }
+
+    BsonArrayChunk *chunks = calloc(chunkCount, sizeof(BsonArrayChunk));
+    BsonArray *parts = malloc(sizeof(BsonArray) * chunkCount);
+    if (chunks != NULL && parts != NULL) {
+      ret = bson_array_split_chunks(data, dataSize, chunks, &chunkCount);
+    }
+    if (ret > 0 && chunkCount > 1) {
+      size_t i = 0;
+      for (i = 0; i < chunkCount; i++) {
+        chunks[i].array = &parts[i];
+      }
+      bson_parallel_run(bson_array_chunk_parse, chunks, chunkCount);
+      bool success = true;
+      for (i = 0; i < chunkCount; i++) {
+        success = success && chunks[i].success;
+      }
+      //Chunks are joined in order into the first one
+      size_t joined = 1;
+      while (success && joined < chunkCount) {
+        success = bson_array_append_chunk(&parts[0], &parts[joined]);
+        joined += success ? 1 : 0;
+      }
+      if (success) {
+        if (ret != size) {
+          printf("Unexpected parsed array size. Expected %i, got %i\n", (int)size, (int)ret);
+        }
+        *output = parts[0];
+      }
+      else {
+        //Chunks which were not joined still hold their own elements
+        bson_array_deinitialize(&parts[0]);
+        for (i = joined; i < chunkCount; i++) {
+          bson_array_deinitialize(&parts[i]);
+        }
+        ret = 0;
+      }
+      free(chunks);
+      free(parts);
+      return ret;
+    }
+    free(chunks);
+    free(parts);
   }
-  *output = array;
-  return dataSize - remainBytes;
+#endif
+  return bson_array_from_bytes_len(output, data, dataSize);
 }
 
 char *bson_array_to_string(BsonArray *array, char *out) {
@@ -305,17 +2895,35 @@ char *bson_array_to_string(BsonArray *array, char *out) {
   int position = 0;
   position += sprintf(out, "[ ");
   size_t i = 0;
+  BsonElement packedElement;
   for (i = 0; i < array->count; i++) {
-    BsonElement *element = array->elements[i];
+    BsonElement *element = &packedElement;
+    //Objects of columnar arrays are printed from a temporary object unless they were already created
+    BsonObject row;
+    bool temporaryRow = false;
+    if (array->columns != NULL) {
+      packedElement.type = TYPE_DOCUMENT;
+      packedElement.value = bson_columns_detached_row(array->columns, i);
+      if (packedElement.value == NULL) {
+        if (!bson_columns_build_row(array->columns, i, &row)) {
+          break;
+        }
+        packedElement.value = &row;
+        temporaryRow = true;
+      }
+    }
+    else {
+      element = bson_array_element_at(array, i, &packedElement);
+    }
     switch (element->type) {
       case TYPE_DOCUMENT: {
         char docString[512];
-        position += sprintf(&out[position], "%s", bson_object_to_string(bson_array_get_object(array, i), docString));
+        position += sprintf(&out[position], "%s", bson_object_to_string((BsonObject *)element->value, docString));
         break;
       }
       case TYPE_ARRAY: {
         char docString[512];
-        position += sprintf(&out[position], "%s", bson_array_to_string(bson_array_get_array(array, i), docString));
+        position += sprintf(&out[position], "%s", bson_array_to_string((BsonArray *)element->value, docString));
         break;
       }
       case TYPE_INT32: {
@@ -343,6 +2951,9 @@ char *bson_array_to_string(BsonArray *array, char *out) {
         position += sprintf(&out[position], "UNKNOWN_TYPE");
       }
     }
+    if (temporaryRow) {
+      bson_object_deinitialize(&row);
+    }
     if (i != (array->count - 1)) {
       position += sprintf(&out[position], ", ");    
     }
@@ -352,36 +2963,65 @@ char *bson_array_to_string(BsonArray *array, char *out) {
   return out;
 }
 
-bool bson_array_resize(BsonArray *array, size_t newSize) {
-  if (array->count > newSize) {
-    printf("Attempted to resize an array smaller than the number of elements it contains\n");
-    return false;
+/*
+  @brief Append an element to the end of a given array, growing the array if needed
+
+  @param array - The array to be modified
+
+  @return - The new element, which must be initialized by the caller, NULL on failure
+*/
+static BsonElement *bson_array_add_slot(BsonArray *array) {
+  if (!bson_array_unpack(array) || !bson_array_unshare(array) || !bson_array_reserve(array, 1)) {
+    return NULL;
   }
-  int i = 0;
-  BsonElement **newArray = malloc(sizeof(BsonElement *) * newSize);
-  BsonElement **oldArray = array->elements;
-  for (i = 0; i < array->maxCount; i++) {
-    newArray[i] = oldArray[i];
+  return &array->elements[array->count++];
+}
+
+/*
+  @brief Add a new element to the end of a given array, taking ownership of an already allocated value
+
+  @param array - The array to be modified
+  @param type - The type of the element to be added
+  @param value - The malloc()-ed value of the element, freed along with the array.
+                 Ownership stays with the caller if the operation fails
+  @param elementSize - The size, in bytes, of the element when converted to BSON format
+
+  @return - true if the addition was successful, false if not
+*/
+static bool bson_array_add_allocated(BsonArray *array, element_type type, void *value, size_t elementSize) {
+  BsonElement *element = bson_array_add_slot(array);
+  if (element == NULL) {
+    return false;
   }
-  free(oldArray);
-  array->elements = newArray;
-  array->maxCount = newSize;
+  element->type = type;
+  element->dirty = true;
+  element->size = elementSize;
+  element->value = value;
   return true;
 }
 
 bool bson_array_add_element(BsonArray *array, BsonElement *element, size_t allocSize) {
-  if (array->count == array->maxCount) {
-    if (!bson_array_resize(array, array->maxCount * 2)) {
+  if (element->type == TYPE_STRING) {
+    //Short strings must be stored by the array
+    return bson_array_add_string_len(array, (const char *)element->value, element->size - STRING_OVERHEAD_BYTES);
+  }
+  if (array->packedSize != 0 && array->packedType == element->type) {
+    if (!bson_array_unshare(array) || !bson_array_reserve(array, 1)) {
       return false;
     }
+    memcpy((uint8_t *)array->packedValues + array->count * array->packedSize, element->value, array->packedSize);
+    array->count++;
+    return true;
+  }
+  void *value = malloc(allocSize);
+  if (value == NULL) {
+    return false;
+  }
+  memcpy(value, element->value, allocSize);
+  if (!bson_array_add_allocated(array, element->type, value, element->size)) {
+    free(value);
+    return false;
   }
-  BsonElement *allocElement = malloc(sizeof(BsonElement));
-  allocElement->type = element->type;
-  allocElement->size = element->size;
-  allocElement->value = malloc(allocSize);
-  memcpy(allocElement->value, element->value, allocSize);
-  array->elements[array->count] = allocElement;
-  array->count++;
   return true;
 }
 
@@ -404,7 +3044,47 @@ bool bson_array_add(BsonArray *array, element_type type, void *value, size_t all
   return bson_array_add_element(array, &element, allocSize);
 }
 
+/*
+  @brief Add the values of an object to the columns of a columnar array
+  if the object has the same keys and value types as the columns
+
+  @param array - The columnar array to be modified
+  @param row - The object whose values are added
+
+  @return - true if the values were added, false if the object does not match the columns
+  or the values could not be added, in which case the array is unchanged
+*/
+static bool bson_array_add_row(BsonArray *array, BsonObject *row) {
+  if (!bson_columns_match_row(array->columns, row) || !bson_array_unshare(array)) {
+    return false;
+  }
+  BsonColumns *columns = array->columns;
+  size_t k = 0;
+  for (k = 0; k < columns->keyCount; k++) {
+    BsonElement *element = bson_object_get(row, columns->keys[k]);
+    BsonArray *column = &columns->columns[k];
+    bool added = (element->type == TYPE_STRING) ? 
+      bson_array_add_string_len(column, bson_element_get_string(element), element->size - STRING_OVERHEAD_BYTES) : 
+      bson_array_add_element(column, element, column->packedSize);
+    if (!added) {
+      while (k > 0) {
+        k--;
+        bson_array_remove(&columns->columns[k], array->count, 1);
+      }
+      return false;
+    }
+  }
+  array->count++;
+  return true;
+}
+
 bool bson_array_add_object(BsonArray *array, BsonObject *value) {
+  //Objects which match the columns of a columnar array are stored in the columns
+  if (array->columns != NULL && bson_array_add_row(array, value)) {
+    //The array owns the contents of the object from now on, as it does when they are copied
+    bson_object_deinitialize(value);
+    return true;
+  }
   return bson_array_add(array, TYPE_DOCUMENT, value, sizeof(BsonObject), 0);
 }
 
@@ -412,6 +3092,30 @@ bool bson_array_add_array(BsonArray *array, BsonArray *value) {
   return bson_array_add(array, TYPE_ARRAY, value, sizeof(BsonArray), 0);
 }
 
+bool bson_array_add_object_owned(BsonArray *array, BsonObject *value) {
+  //Objects which match the columns of a columnar array are stored in the columns
+  if (array->columns != NULL && bson_array_add_row(array, value)) {
+    bson_object_deinitialize(value);
+    free(value);
+    return true;
+  }
+  if (!bson_array_add_allocated(array, TYPE_DOCUMENT, value, 0)) {
+    bson_object_deinitialize(value);
+    free(value);
+    return false;
+  }
+  return true;
+}
+
+bool bson_array_add_array_owned(BsonArray *array, BsonArray *value) {
+  if (!bson_array_add_allocated(array, TYPE_ARRAY, value, 0)) {
+    bson_array_deinitialize(value);
+    free(value);
+    return false;
+  }
+  return true;
+}
+
 bool bson_array_add_int32(BsonArray *array, int32_t value) {
   return bson_array_add(array, TYPE_INT32, &value, sizeof(int32_t),
                         SIZE_INT32);
@@ -423,8 +3127,49 @@ bool bson_array_add_int64(BsonArray *array, int64_t value) {
 }
 
 bool bson_array_add_string(BsonArray *array, char *value) {
-  return bson_array_add(array, TYPE_STRING, value, (strlen(value) + 1) * sizeof(char),
-                        strlen(value) + STRING_OVERHEAD_BYTES);
+  return bson_array_add_string_len(array, value, strlen(value));
+}
+
+bool bson_array_add_string_len(BsonArray *array, const char *value, size_t length) {
+  if (length < SHORT_STRING_SIZE) {
+    BsonElement *element = bson_array_add_slot(array);
+    if (element == NULL || !bson_array_initialize_string(array, element, value, length)) {
+      if (element != NULL) {
+        array->count--;
+      }
+      return false;
+    }
+    return true;
+  }
+  char *stringVal = malloc((length + 1) * sizeof(char));
+  if (stringVal == NULL) {
+    return false;
+  }
+  memcpy(stringVal, value, length);
+  stringVal[length] = 0x00;
+  return bson_array_add_string_len_owned(array, stringVal, length);
+}
+
+bool bson_array_add_string_owned(BsonArray *array, char *value) {
+  return bson_array_add_string_len_owned(array, value, strlen(value));
+}
+
+bool bson_array_add_string_len_owned(BsonArray *array, char *value, size_t length) {
+  char *shortString = NULL;
+  BsonElement *element = bson_array_add_slot(array);
+  if (element != NULL && length < SHORT_STRING_SIZE) {
+    shortString = bson_string_pool_take(array);
+    if (shortString == NULL) {
+      array->count--;
+      element = NULL;
+    }
+  }
+  if (element == NULL) {
+    free(value);
+    return false;
+  }
+  bson_element_initialize_string_owned(element, value, length, shortString);
+  return true;
 }
 
 bool bson_array_add_bool(BsonArray *array, bson_boolean value) {
@@ -437,48 +3182,324 @@ bool bson_array_add_double(BsonArray *array, double value) {
                         SIZE_DOUBLE);
 }
 
-BsonElement *bson_array_get(BsonArray *array, size_t index) {
-  return (index >= array->count) ? NULL : array->elements[index];
+/*
+  @brief Add multiple values of a type that can be packed to the end of a given array.
+  Empty arrays are packed, and packed arrays of the same type are appended to with a single copy.
+
+  @param array - The array to be modified
+  @param type - The type of the values to be added
+  @param values - The contiguous values to be added
+  @param count - The number of values to be added
+
+  @return - true if all values were added, false if none were
+*/
+static bool bson_array_add_n(BsonArray *array, element_type type, const void *values, size_t count) {
+  size_t valueSize = bson_packed_value_size(type);
+  if (!bson_array_unshare(array)) {
+    return false;
+  }
+  if (array->count == 0) {
+    bson_array_pack(array, type);
+  }
+  if (array->packedSize != 0 && array->packedType == type) {
+    if (!bson_array_reserve(array, count)) {
+      return false;
+    }
+    memcpy((uint8_t *)array->packedValues + array->count * valueSize, values, count * valueSize);
+    array->count += count;
+    return true;
+  }
+
+  if (!bson_array_unpack(array) || !bson_array_reserve(array, count)) {
+    return false;
+  }
+  size_t i = 0;
+  for (i = 0; i < count; i++) {
+    BsonElement *element = &array->elements[array->count + i];
+    element->type = type;
+    element->dirty = true;
+    element->size = bson_packed_element_size(type);
+    element->value = malloc(valueSize);
+    if (element->value == NULL) {
+      while (i > 0) {
+        i--;
+        free(array->elements[array->count + i].value);
+      }
+      return false;
+    }
+    memcpy(element->value, (const uint8_t *)values + i * valueSize, valueSize);
+  }
+  array->count += count;
+  return true;
+}
+
+bool bson_array_add_int32_n(BsonArray *array, const int32_t *values, size_t count) {
+  return bson_array_add_n(array, TYPE_INT32, values, count);
+}
+
+bool bson_array_add_int64_n(BsonArray *array, const int64_t *values, size_t count) {
+  return bson_array_add_n(array, TYPE_INT64, values, count);
+}
+
+bool bson_array_add_double_n(BsonArray *array, const double *values, size_t count) {
+  return bson_array_add_n(array, TYPE_DOUBLE, values, count);
+}
+
+bool bson_array_add_bool_n(BsonArray *array, const bson_boolean *values, size_t count) {
+  return bson_array_add_n(array, TYPE_BOOLEAN, values, count);
+}
+
+bool bson_array_add_string_n(BsonArray *array, const char *const *values, const size_t *lengths, size_t count) {
+  if (!bson_array_unpack(array) || !bson_array_unshare(array) || !bson_array_reserve(array, count)) {
+    return false;
+  }
+  size_t i = 0;
+  for (i = 0; i < count; i++) {
+    size_t length = (lengths == NULL) ? strlen(values[i]) : lengths[i];
+    if (!bson_array_initialize_string(array, &array->elements[array->count + i], values[i], length)) {
+      while (i > 0) {
+        i--;
+        bson_array_release_element(array, &array->elements[array->count + i]);
+      }
+      return false;
+    }
+  }
+  array->count += count;
+  return true;
+}
+
+/*
+  @brief Check whether every value in an array has a given type
+
+  @param array - The array to be checked, may be NULL
+  @param type - The expected type of the values
+
+  @return - true if all values have the given type, or if there are no values
+*/
+static bool bson_array_values_have_type(BsonArray *array, element_type type) {
+  if (array == NULL || (array->packedSize != 0 && array->packedType == type)) {
+    return true;
+  }
+  size_t i = 0;
+  for (i = 0; i < array->count; i++) {
+    if (array->packedSize != 0 || array->elements[i].type != type) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool bson_array_splice(BsonArray *array, size_t index, size_t removeCount, BsonArray *values) {
+  if (index > array->count || removeCount > array->count - index) {
+    printf("Attempted to splice elements outside of the array\n");
+    return false;
+  }
+  //Values taken from the array itself are kept intact by sharing them first,
+  //as are columnar values which are converted to separate objects
+  BsonArray source;
+  if (values == array || (values != NULL && values->columns != NULL)) {
+    if (!bson_array_share(&source, values)) {
+      return false;
+    }
+    if (!bson_array_unpack(&source)) {
+      bson_array_deinitialize(&source);
+      return false;
+    }
+    values = &source;
+  }
+  size_t insertCount = (values == NULL) ? 0 : values->count;
+  size_t tailCount = array->count - index - removeCount;
+  bool spliced = false;
+
+  if (bson_array_unshare(array)) {
+    if (array->count == 0 && insertCount > 0) {
+      bson_array_pack(array, values->packedType);
+    }
+    if (array->packedSize != 0 && bson_array_values_have_type(values, array->packedType)) {
+      //Packed values are moved and copied as raw memory
+      if (bson_array_reserve(array, (insertCount > removeCount) ? insertCount - removeCount : 0)) {
+        uint8_t *packedValues = (uint8_t *)array->packedValues;
+        memmove(&packedValues[(index + insertCount) * array->packedSize], 
+                &packedValues[(index + removeCount) * array->packedSize], tailCount * array->packedSize);
+        size_t i = 0;
+        for (i = 0; i < insertCount && values->packedSize == 0; i++) {
+          memcpy(&packedValues[(index + i) * array->packedSize], values->elements[i].value, array->packedSize);
+        }
+        if (values != NULL && values->packedSize != 0) {
+          memcpy(&packedValues[index * array->packedSize], values->packedValues, insertCount * array->packedSize);
+        }
+        spliced = true;
+      }
+    }
+    else if (bson_array_unpack(array) && 
+             bson_array_reserve(array, (insertCount > removeCount) ? insertCount - removeCount : 0)) {
+      //New elements are copied first, so that the array is unchanged if this fails
+      BsonElement *inserted = malloc(sizeof(BsonElement) * insertCount);
+      size_t i = 0;
+      if (inserted != NULL || insertCount == 0) {
+        BsonElement packedElement;
+        for (i = 0; i < insertCount; i++) {
+          if (!bson_array_copy_element(array, &inserted[i], bson_array_element_at(values, i, &packedElement), false)) {
+            break;
+          }
+        }
+      }
+      if (i == insertCount && (inserted != NULL || insertCount == 0)) {
+        for (i = index; i < index + removeCount; i++) {
+          bson_array_release_element(array, &array->elements[i]);
+        }
+        memmove(&array->elements[index + insertCount], 
+                &array->elements[index + removeCount], sizeof(BsonElement) * tailCount);
+        memcpy(&array->elements[index], inserted, sizeof(BsonElement) * insertCount);
+        spliced = true;
+      }
+      else {
+        while (i > 0) {
+          i--;
+          bson_array_release_element(array, &inserted[i]);
+        }
+      }
+      free(inserted);
+    }
+  }
+
+  if (spliced) {
+    array->count = index + insertCount + tailCount;
+  }
+  if (values == &source) {
+    bson_array_deinitialize(&source);
+  }
+  return spliced;
+}
+
+bool bson_array_insert(BsonArray *array, size_t index, BsonArray *values) {
+  return bson_array_splice(array, index, 0, values);
+}
+
+bool bson_array_remove(BsonArray *array, size_t index, size_t count) {
+  return bson_array_splice(array, index, count, NULL);
+}
+
+BsonArray *bson_array_get_column(BsonArray *array, const char *key) {
+  //Objects retrieved from the array may have been modified since they were created
+  if (array->columns == NULL || 
+      (array->columns->detachedCount > 0 && !bson_columns_absorb_rows(array->columns, array->count))) {
+    return NULL;
+  }
+  size_t k = 0;
+  for (k = 0; k < array->columns->keyCount; k++) {
+    if (strcmp(array->columns->keys[k], key) == 0) {
+      return &array->columns->columns[k];
+    }
+  }
+  return NULL;
+}
+
+void bson_element_slot_initialize(BsonElementSlot *slot) {
+  slot->hasRow = false;
+}
+
+void bson_element_slot_deinitialize(BsonElementSlot *slot) {
+  if (slot->hasRow) {
+    bson_object_deinitialize(&slot->row);
+    slot->hasRow = false;
+  }
+}
+
+const BsonElement *bson_array_get_element(BsonArray *array, size_t index, BsonElementSlot *slot) {
+  bson_element_slot_deinitialize(slot);
+  if (index >= array->count) {
+    return NULL;
+  }
+  if (array->columns == NULL) {
+    return bson_array_element_at(array, index, &slot->element);
+  }
+  //Reading must not modify the array, as other threads may be reading it too
+  BsonObject *row = bson_columns_detached_row(array->columns, index);
+  if (row == NULL) {
+    if (!bson_columns_build_row(array->columns, index, &slot->row)) {
+      return NULL;
+    }
+    slot->hasRow = true;
+    row = &slot->row;
+  }
+  slot->element.type = TYPE_DOCUMENT;
+  slot->element.dirty = true;
+  slot->element.size = 0;
+  slot->element.value = row;
+  return &slot->element;
 }
 
 BsonObject *bson_array_get_object(BsonArray *array, size_t index) {
-  BsonElement *element = bson_array_get(array, index);
-  return (element == NULL || element->type != TYPE_DOCUMENT) ? 
-          NULL : (BsonObject *)element->value;
+  //The returned object may be modified by the caller
+  if (!bson_array_unshare(array)) {
+    return NULL;
+  }
+  if (array->columns != NULL) {
+    //Only the requested object is created, the other objects stay in the columns
+    return (index < array->count) ? bson_columns_detach_row(array->columns, index, array->count) : NULL;
+  }
+  return (BsonObject *)bson_array_get_value(array, index, TYPE_DOCUMENT);
 }
 
 BsonArray *bson_array_get_array(BsonArray *array, size_t index) {
-  BsonElement *element = bson_array_get(array, index);
-  return (element == NULL || element->type != TYPE_ARRAY) ? 
-          NULL : (BsonArray *)element->value;
+  //The returned array may be modified by the caller
+  if (!bson_array_unshare(array)) {
+    return NULL;
+  }
+  return (BsonArray *)bson_array_get_value(array, index, TYPE_ARRAY);
 }
 
 int32_t bson_array_get_int32(BsonArray *array, size_t index) {
-  BsonElement *element = bson_array_get(array, index);
-  return (element == NULL || element->type != TYPE_INT32) ? 
-          -1 : *(int32_t *)element->value;
+  int32_t *value = (int32_t *)bson_array_get_value(array, index, TYPE_INT32);
+  return (value == NULL) ? -1 : *value;
 }
 
 int64_t bson_array_get_int64(BsonArray *array, size_t index) {
-  BsonElement *element = bson_array_get(array, index);
-  return (element == NULL || element->type != TYPE_INT64) ? 
-          -1 : *(int64_t *)element->value;
+  int64_t *value = (int64_t *)bson_array_get_value(array, index, TYPE_INT64);
+  return (value == NULL) ? -1 : *value;
 }
 
 char *bson_array_get_string(BsonArray *array, size_t index) {
-  BsonElement *element = bson_array_get(array, index);
-  return (element == NULL || element->type != TYPE_STRING) ? 
-         NULL : (char *)element->value;
+  return (char *)bson_array_get_value(array, index, TYPE_STRING);
+}
+
+char *bson_array_get_string_len(BsonArray *array, size_t index, size_t *length) {
+  char *value = (char *)bson_array_get_value(array, index, TYPE_STRING);
+  if (value == NULL) {
+    return NULL;
+  }
+  //Packed arrays never contain strings
+  *length = array->elements[index].size - STRING_OVERHEAD_BYTES;
+  return value;
 }
 
 bson_boolean bson_array_get_bool(BsonArray *array, size_t index) {
-  BsonElement *element = bson_array_get(array, index);
-  return (element == NULL || element->type != TYPE_BOOLEAN) ? 
-          BOOLEAN_INVALID : *(bson_boolean *)element->value;
+  bson_boolean *value = (bson_boolean *)bson_array_get_value(array, index, TYPE_BOOLEAN);
+  return (value == NULL) ? BOOLEAN_INVALID : *value;
 }
 
 double bson_array_get_double(BsonArray *array, size_t index) {
-  BsonElement *element = bson_array_get(array, index);
-  return (element == NULL || element->type != TYPE_DOUBLE) ? 
-          -1 : *(double *)element->value;
+  double *value = (double *)bson_array_get_value(array, index, TYPE_DOUBLE);
+  return (value == NULL) ? -1 : *value;
+}
+
+int32_t *bson_array_get_int32_values(BsonArray *array) {
+  return (array->packedSize != 0 && array->packedType == TYPE_INT32) ? 
+          (int32_t *)array->packedValues : NULL;
+}
+
+int64_t *bson_array_get_int64_values(BsonArray *array) {
+  return (array->packedSize != 0 && array->packedType == TYPE_INT64) ? 
+          (int64_t *)array->packedValues : NULL;
+}
+
+bson_boolean *bson_array_get_bool_values(BsonArray *array) {
+  return (array->packedSize != 0 && array->packedType == TYPE_BOOLEAN) ? 
+          (bson_boolean *)array->packedValues : NULL;
+}
+
+double *bson_array_get_double_values(BsonArray *array) {
+  return (array->packedSize != 0 && array->packedType == TYPE_DOUBLE) ? 
+          (double *)array->packedValues : NULL;
 }
@@ -4,22 +4,78 @@
 #include "bson_object.h"
 
 typedef struct BsonElement BsonElement;
+typedef struct BsonElementSlot BsonElementSlot;
 typedef struct BsonObject BsonObject;
 
 typedef enum bson_boolean bson_boolean;
 typedef enum element_type element_type;
 
+//Minimum number of elements encoded by each thread (see bson_array_to_bytes_parallel())
+#define BSON_PARALLEL_MIN_CHUNK_ELEMENTS 4096
+//Minimum number of bytes parsed by each thread (see bson_array_from_bytes_parallel())
+#define BSON_PARALLEL_MIN_CHUNK_BYTES 65536
+
+//Columnar storage for an array of objects which all have the same keys and value types
+struct BsonColumns {
+  //Number of keys in each object
+  size_t keyCount;
+  //Keys of each object, in the order in which they are encoded
+  char **keys;
+  //Values of each key for every object, packed unless the values are strings
+  struct BsonArray *columns;
+  //Objects created by bson_array_get_object(), which replace the values of the columns at their
+  //index since they may be modified. NULL until an object is retrieved
+  BsonObject **rows;
+  //Number of entries in rows
+  size_t rowCount;
+  //Number of entries in rows which are not NULL
+  size_t detachedCount;
+};
+typedef struct BsonColumns BsonColumns;
+
 //Object representing a BSON array
 struct BsonArray {
-  //Array of BSON elements
-  BsonElement **elements;
+  //Contiguous block of BSON elements, which may be moved when the array grows
+  BsonElement *elements;
+  //Storage of the string values shorter than SHORT_STRING_SIZE, which are not moved along with
+  //the elements. Shared along with the elements, NULL until a short string is added
+  struct BsonStringPool *strings;
   //Number of elements currently in the array
   size_t count;
   //The current maximum number of elements in the array
   size_t maxCount;
+  //Number of arrays sharing the elements, NULL if they have never been shared
+  size_t *refCount;
+  //Type of the values in packedValues, only valid if packedSize is not 0
+  element_type packedType;
+  //Size in bytes of each value in packedValues, 0 if the array is not packed
+  size_t packedSize;
+  //Contiguous raw values of a packed array, used instead of elements
+  //(see bson_array_initialize_typed())
+  void *packedValues;
+  //Descriptor of the temporary file mapped to packedValues, -1 if they are stored on the heap
+  //(see bson_array_initialize_file_backed())
+  int packedFile;
+  //Values of an array of same-shaped objects, used instead of elements. NULL if the array is not columnar
+  //(see bson_array_initialize_columnar())
+  BsonColumns *columns;
+  //Replaced with a new version number whenever the array is modified, or an element is
+  //retrieved for modification (see BsonObject)
+  uint64_t version;
 };
 typedef struct BsonArray BsonArray;
 
+//Read-only view of a range of elements in a BSON array (see bson_array_slice())
+struct BsonArraySlice {
+  //The array containing the elements
+  BsonArray *array;
+  //Index of the first element of the range
+  size_t start;
+  //Number of elements in the range
+  size_t count;
+};
+typedef struct BsonArraySlice BsonArraySlice;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,6 +89,52 @@ extern "C" {
   @return - true if the array was initialized successfully, false if not
 */
 bool bson_array_initialize(BsonArray *array, size_t initialCapacity);
+/*
+  @brief Initalize a packed BSON Array, which stores values of a single type contiguously
+  instead of as separate elements. The array is converted to separate elements
+  if a value of another type is added.
+  Arrays parsed from BSON data are packed automatically if all values have a type that can be packed.
+  
+  @param array - The uninitialized BSON Array
+  @param type - The type of the values, one of TYPE_INT32, TYPE_INT64, TYPE_DOUBLE or TYPE_BOOLEAN
+  @param initialCapacity - The initial maximum size of the array
+
+  @return - true if the array was initialized successfully, false if not
+*/
+bool bson_array_initialize_typed(BsonArray *array, element_type type, size_t initialCapacity);
+/*
+  @brief Initalize a packed BSON Array whose values are stored in a memory mapped temporary file
+  instead of on the heap, so that the operating system can write them back to the file rather than
+  keeping them in memory. This suits very large arrays. The array is used like any other packed array
+  (see bson_array_initialize_typed()), copies of it are file-backed as well, and the file is deleted
+  when the array is deinitialized. Only available on POSIX platforms
+  
+  @param array - The uninitialized BSON Array
+  @param type - The type of the values, one of TYPE_INT32, TYPE_INT64, TYPE_DOUBLE or TYPE_BOOLEAN
+  @param initialCapacity - The initial maximum size of the array
+
+  @return - true if the array was initialized successfully, false if not
+*/
+bool bson_array_initialize_file_backed(BsonArray *array, element_type type, size_t initialCapacity);
+/*
+  @brief Initalize a BSON Array of objects which all have the same keys and value types.
+  The values of each key are stored together in a column instead of as an object per element,
+  and are encoded as separate objects. Arrays parsed from BSON data are columnar automatically
+  if all elements are objects with the same keys and value types.
+  Objects retrieved with bson_array_get_object() are created one at a time
+  and kept in place of their values in the columns. The array is converted to separate elements
+  if a value that does not match the columns is added.
+  
+  @param array - The uninitialized BSON Array
+  @param keys - The keys of each object
+  @param types - The type of the value of each key, TYPE_STRING or a type that can be packed
+  @param keyCount - The number of keys in each object
+  @param initialCapacity - The initial maximum number of objects in the array
+
+  @return - true if the array was initialized successfully, false if not
+*/
+bool bson_array_initialize_columnar(BsonArray *array, const char *const *keys, const element_type *types, 
+                                    size_t keyCount, size_t initialCapacity);
 /*
   @brief Deinitalize BSON Array, free all associated memory, 
   and recursively clean up all sub-objects
@@ -40,6 +142,29 @@ bool bson_array_initialize(BsonArray *array, size_t initialCapacity);
   @param array - The BSON Array to be deinitalized
 */
 void bson_array_deinitialize(BsonArray *array);
+/*
+  @brief Share the contents of a BSON Array with a new array without copying them. 
+  The elements are copied the first time either array is modified, and sub-objects and
+  sub-arrays are shared in the same way. Both arrays must be deinitialized separately.
+  See bson_object_share() for the rules that apply to shared data.
+
+  @param output - The uninitialized BSON Array that will share the contents of array
+  @param array - The BSON Array to be shared
+
+  @return - true if the array was shared successfully, false if not
+*/
+bool bson_array_share(BsonArray *output, BsonArray *array);
+/*
+  @brief Create a deep copy of a given array, including all of its sub-objects and sub-arrays.
+  The copy has the same capacity as array
+
+  @param output - The uninitialized BSON Array to be created, it must be deinitalized
+                  separately from array
+  @param array - The BSON Array to be copied
+
+  @return - true if the array was copied successfully, false if not
+*/
+bool bson_array_clone(BsonArray *output, BsonArray *array);
 
 /*
   @brief Calculate the size, in bytes, of a given array when converted to a BSON document
@@ -59,6 +184,67 @@ size_t bson_array_size(BsonArray *array);
   this data must be freed by the caller after use
 */
 uint8_t *bson_array_to_bytes(BsonArray *array);
+/*
+  @brief Write the BSON representation of an array into a given buffer. The whole array,
+  including its sub-objects and sub-arrays, is written in a single pass, and lengths are
+  filled in once each document is complete. No memory is allocated (see bson_object_to_buffer())
+
+  @param array - The array to be converted to BSON
+  @param buffer - The buffer into which the array is written
+  @param capacity - The size of the buffer in bytes
+  @param written - On success, set to the number of bytes written. If the buffer is too small,
+                   set to the size required for the array. Set to 0 if the array contains an
+                   element which cannot be converted
+
+  @return - true if the array was written, false if not. The contents of the buffer
+  are undefined on failure
+*/
+bool bson_array_to_buffer(BsonArray *array, uint8_t *buffer, size_t capacity, size_t *written);
+/*
+  @brief Get the canonical BSON represention of an array, in which the keys of every object
+  in the array are written in sorted order (see bson_object_to_bytes_canonical())
+
+  @param array - The array to be converted to BSON
+
+  @return - A byte array containing the canonical BSON representation of the array,
+  this data must be freed by the caller after use
+*/
+uint8_t *bson_array_to_bytes_canonical(BsonArray *array);
+/*
+  @brief Write the canonical BSON representation of an array into a given buffer
+  (see bson_array_to_bytes_canonical() and bson_array_to_buffer())
+
+  @param array - The array to be converted to BSON
+  @param buffer - The buffer into which the array is written
+  @param capacity - The size of the buffer in bytes
+  @param written - Set as described for bson_array_to_buffer()
+
+  @return - true if the array was written, false if not. The contents of the buffer
+  are undefined on failure
+*/
+bool bson_array_to_buffer_canonical(BsonArray *array, uint8_t *buffer, size_t capacity, size_t *written);
+/*
+  @brief Write the BSON representation of an array in fixed-size chunks, which are passed
+  to a callback as soon as they are full (see bson_object_write_stream())
+
+  @param array - The array to be converted to BSON
+  @param sink - The callback which receives every chunk
+  @param context - Passed to every call of sink
+  @param chunkSize - The size in bytes of every chunk apart from the last one
+
+  @return - true if the whole array was written, false if the callback stopped the stream
+  or the array could not be converted
+*/
+bool bson_array_write_stream(BsonArray *array, BsonStreamSink sink, void *context, size_t chunkSize);
+/*
+  @brief Write the BSON representation of an array to an open stream (see bson_object_to_stream())
+
+  @param array - The array to be converted to BSON
+  @param stream - The stream to be written to, which is not flushed
+
+  @return - true if the array was written, false if not
+*/
+bool bson_array_to_stream(BsonArray *array, BsonStream *stream);
 /*
   @brief Parse BSON data into an array
 
@@ -82,6 +268,79 @@ BsonArray bson_array_from_bytes(uint8_t *data);
             is returned. On error, 0 is returned.
 */
 size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t dataSize);
+/*
+  @brief Parse BSON data into an array, rejecting element keys that are not
+  the sequential indices "0", "1", "2", ... This also applies to arrays nested
+  directly inside the array
+
+  @param output - Pointer to an uninitialized BsonArray. On success, it is
+                  initialized and stores converted data.
+  @param data - Byte buffer that contains BSON data to be parsed
+  @param dataSize - Number of bytes of the data stored in the byte buffer
+
+  @return - On success, a positive number indicating number of bytes consumed
+            is returned. On error, 0 is returned.
+*/
+size_t bson_array_from_bytes_strict(BsonArray *output, const uint8_t *data, size_t dataSize);
+/*
+  @brief Get the BSON representation of an array, splitting large arrays into chunks which
+  are encoded by separate threads. The size of each chunk is measured in parallel first,
+  then every chunk is written in parallel at its offset in the output
+
+  @param array - The array to be converted to BSON, which must not be modified by other threads meanwhile
+  @param threadCount - The maximum number of threads to be used, including the calling thread.
+                       Each thread encodes at least BSON_PARALLEL_MIN_CHUNK_ELEMENTS elements,
+                       smaller arrays are encoded like bson_array_to_bytes()
+
+  @return - A byte array containing the BSON representation of the array,
+  this data must be freed by the caller after use
+*/
+uint8_t *bson_array_to_bytes_parallel(BsonArray *array, size_t threadCount);
+/*
+  @brief Parse BSON data into an array, splitting large arrays into chunks which are parsed
+  by separate threads. Chunks are found by skipping over the length prefix or fixed size of
+  each element, then joined in order once they are parsed
+
+  @param output - Pointer to an uninitialized BsonArray. On success, it is
+                  initialized and stores converted data.
+  @param data - Byte buffer that contains BSON data to be parsed
+  @param dataSize - Number of bytes of the data stored in the byte buffer
+  @param threadCount - The maximum number of threads to be used, including the calling thread.
+                       Each thread parses at least BSON_PARALLEL_MIN_CHUNK_BYTES bytes,
+                       smaller data is parsed like bson_array_from_bytes_len()
+
+  @return - On success, a positive number indicating number of bytes consumed
+            is returned. On error, 0 is returned.
+*/
+size_t bson_array_from_bytes_parallel(BsonArray *output, const uint8_t *data, size_t dataSize, size_t threadCount);
+/*
+  @brief Create a view of a range of elements in an array without copying them.
+  The view is invalidated when the array is modified or deinitialized
+
+  @param output - The slice to be initialized
+  @param array - The array containing the elements
+  @param start - The index of the first element in the range
+  @param count - The number of elements in the range
+
+  @return - true if the slice was created, false if the range is out of bounds
+*/
+bool bson_array_slice(BsonArraySlice *output, BsonArray *array, size_t start, size_t count);
+/*
+  @brief Get the size of a slice when converted to BSON
+
+  @param slice - The slice to be measured
+
+  @return - The size in bytes of the BSON representation of the slice
+*/
+size_t bson_array_slice_size(BsonArraySlice *slice);
+/*
+  @brief Convert a slice to BSON as an array of its own, with keys numbered from "0"
+
+  @param slice - The slice to be converted
+
+  @return - The BSON representation of the slice, must be freed by the caller after use
+*/
+uint8_t *bson_array_slice_to_bytes(BsonArraySlice *slice);
 
 /*
   @brief Get a JSON string representation of a BSON array
@@ -94,7 +353,8 @@ size_t bson_array_from_bytes_len(BsonArray *output, const uint8_t *data, size_t
 char *bson_array_to_string(BsonArray *array, char *out);
 
 /*
-  @brief Add a BSON object to the end of a given array
+  @brief Add a BSON object to the end of a given array. The values of objects added to a columnar
+  array are stored in its columns if they match them (see bson_array_initialize_columnar())
 
   @param array - The array to be modified
   @param value - The pointer to the BSON object to be added
@@ -111,6 +371,30 @@ bool bson_array_add_object(BsonArray *array, BsonObject *value);
   @return - true if the addition was successful, false if not
 */
 bool bson_array_add_array(BsonArray *array, BsonArray *value);
+/*
+  @brief Add a heap-allocated BSON object to the end of a given array without copying it.
+  Objects whose values are stored in the columns of a columnar array are freed immediately
+  (see bson_array_add_object())
+
+  @param array - The array to be modified
+  @param value - The malloc()-ed BSON object to be added. The array takes ownership of value,
+                 which is deinitialized and freed along with array, or immediately if the
+                 addition fails
+
+  @return - true if the addition was successful, false if not
+*/
+bool bson_array_add_object_owned(BsonArray *array, BsonObject *value);
+/*
+  @brief Add a heap-allocated BSON array to the end of a given array without copying it
+
+  @param array - The array to be modified
+  @param value - The malloc()-ed BSON array to be added. The array takes ownership of value,
+                 which is deinitialized and freed along with array, or immediately if the
+                 addition fails
+
+  @return - true if the addition was successful, false if not
+*/
+bool bson_array_add_array_owned(BsonArray *array, BsonArray *value);
 /*
   @brief Add a 32-bit integer value to the end of a given array
 
@@ -138,6 +422,41 @@ bool bson_array_add_int64(BsonArray *array, int64_t value);
   @return - true if the addition was successful, false if not
 */
 bool bson_array_add_string(BsonArray *array, char *value);
+/*
+  @brief Add a string value of a known length to the end of a given array
+
+  @param array - The array to be modified
+  @param value - The string value to be added, may contain null characters
+  @param length - The length of value in bytes, not including a terminating null character
+
+  @return - true if the addition was successful, false if not
+*/
+bool bson_array_add_string_len(BsonArray *array, const char *value, size_t length);
+/*
+  @brief Add a heap-allocated string value to the end of a given array without copying it.
+  Values shorter than SHORT_STRING_SIZE are copied into the storage of the array and freed instead
+
+  @param array - The array to be modified
+  @param value - The malloc()-ed, null-terminated string value to be added. The array takes
+                 ownership of value, which is freed along with array, or immediately if the
+                 addition fails
+
+  @return - true if the addition was successful, false if not
+*/
+bool bson_array_add_string_owned(BsonArray *array, char *value);
+/*
+  @brief Add a heap-allocated string value of a known length to the end of a given array without copying it.
+  Values shorter than SHORT_STRING_SIZE are copied into the storage of the array and freed instead
+
+  @param array - The array to be modified
+  @param value - The malloc()-ed string value to be added, may contain null characters and
+                 must have a null character at value[length]. The array takes ownership of
+                 value, which is freed along with array, or immediately if the addition fails
+  @param length - The length of value in bytes, not including the terminating null character
+
+  @return - true if the addition was successful, false if not
+*/
+bool bson_array_add_string_len_owned(BsonArray *array, char *value, size_t length);
 /*
   @brief Add a boolean value to the end of a given array
 
@@ -156,17 +475,142 @@ bool bson_array_add_bool(BsonArray *array, bson_boolean value);
   @return - true if the addition was successful, false if not
 */
 bool bson_array_add_double(BsonArray *array, double value);
+/*
+  @brief Add multiple 32-bit integer values to the end of a given array.
+  Space is reserved once for all values, and an empty or packed int32 array stores them packed
+  (see bson_array_initialize_typed())
+
+  @param array - The array to be modified
+  @param values - The integer values to be added
+  @param count - The number of values to be added
 
+  @return - true if all values were added, false if none were
+*/
+bool bson_array_add_int32_n(BsonArray *array, const int32_t *values, size_t count);
 /*
-  @brief Retrieve the object at a specified index
+  @brief Add multiple 64-bit integer values to the end of a given array.
+  Space is reserved once for all values, and an empty or packed int64 array stores them packed
+
+  @param array - The array to be modified
+  @param values - The integer values to be added
+  @param count - The number of values to be added
+
+  @return - true if all values were added, false if none were
+*/
+bool bson_array_add_int64_n(BsonArray *array, const int64_t *values, size_t count);
+/*
+  @brief Add multiple floating-point values to the end of a given array.
+  Space is reserved once for all values, and an empty or packed double array stores them packed
+
+  @param array - The array to be modified
+  @param values - The floating-point values to be added
+  @param count - The number of values to be added
+
+  @return - true if all values were added, false if none were
+*/
+bool bson_array_add_double_n(BsonArray *array, const double *values, size_t count);
+/*
+  @brief Add multiple boolean values to the end of a given array.
+  Space is reserved once for all values, and an empty or packed boolean array stores them packed
+
+  @param array - The array to be modified
+  @param values - The boolean values to be added
+  @param count - The number of values to be added
+
+  @return - true if all values were added, false if none were
+*/
+bool bson_array_add_bool_n(BsonArray *array, const bson_boolean *values, size_t count);
+/*
+  @brief Add multiple string values to the end of a given array, reserving space once for all values
+
+  @param array - The array to be modified
+  @param values - The string values to be added
+  @param lengths - The length of each value in bytes, not including a terminating null character.
+                   May be NULL if all values are null-terminated and contain no null characters
+  @param count - The number of values to be added
+
+  @return - true if all values were added, false if none were
+*/
+bool bson_array_add_string_n(BsonArray *array, const char *const *values, const size_t *lengths, size_t count);
+/*
+  @brief Replace a range of elements in an array with the elements of another array.
+  Inserted sub-objects and sub-arrays are shared with bson_object_share() and bson_array_share(),
+  other values are copied. Packed arrays stay packed if all inserted values have the same type
+
+  @param array - The array to be modified
+  @param index - The index of the first element to be replaced, at most the number of elements in the array
+  @param removeCount - The number of elements to be removed, starting at index
+  @param values - The array whose elements are inserted at index, may be NULL to only remove elements
+
+  @return - true if the elements were replaced, false if the range is out of bounds or the
+  array could not be modified, in which case it is left unchanged
+*/
+bool bson_array_splice(BsonArray *array, size_t index, size_t removeCount, BsonArray *values);
+/*
+  @brief Insert the elements of another array into an array, moving later elements back
+  (see bson_array_splice())
+
+  @param array - The array to be modified
+  @param index - The index at which the elements are inserted, at most the number of elements in the array
+  @param values - The array whose elements are inserted
+
+  @return - true if the elements were inserted, false if not
+*/
+bool bson_array_insert(BsonArray *array, size_t index, BsonArray *values);
+/*
+  @brief Remove elements from an array, moving later elements forward
+
+  @param array - The array to be modified
+  @param index - The index of the first element to be removed
+  @param count - The number of elements to be removed
+
+  @return - true if the elements were removed, false if the range is out of bounds
+*/
+bool bson_array_remove(BsonArray *array, size_t index, size_t count);
+
+/*
+  @brief Initialize an empty slot for reading elements of arrays (see bson_array_get_element())
+
+  @param slot - The uninitialized slot
+*/
+void bson_element_slot_initialize(BsonElementSlot *slot);
+/*
+  @brief Free the object held by a slot, if any
+
+  @param slot - The slot to be deinitialized
+*/
+void bson_element_slot_deinitialize(BsonElementSlot *slot);
+/*
+  @brief Retrieve the element at a specified index without modifying the array. Packed arrays are
+  not converted, and objects of columnar arrays which have not been retrieved with
+  bson_array_get_object() are built in the slot instead of in the array. This replaces
+  bson_array_get(), which returned such elements in storage shared by every call on a thread
 
   @param array - The array to be accessed
-  @param index - The index of the object within the array
+  @param index - The index of the element within the array
+  @param slot - Initialized slot, which describes the element if the array is packed or columnar
+                (see bson_element_slot_initialize())
+
+  @return - The BSON element at the given index if it exists, which must not be modified.
+  NULL if the index is out of bounds or the object could not be built. The pointer is invalidated
+  when the array is modified or the slot is used again
+*/
+const BsonElement *bson_array_get_element(BsonArray *array, size_t index, BsonElementSlot *slot);
+/*
+  @brief Retrieve the values of a key for all objects in a columnar array, without converting the array
+  (see bson_array_initialize_columnar())
 
-  @return - The BSON element at the given index if it exists, 
-  NULL if the index is out of bounds
+  @param array - The array to be accessed
+  @param key - The key of the column
+
+  @return - The array containing the value of the key for each object in order. It is packed
+  unless the values are strings, and must not be modified. Objects retrieved with
+  bson_array_get_object() stay in place, and their values are copied into the columns on every call,
+  so the column only reflects later modifications to them once it is retrieved again.
+  NULL if the array is not columnar, its objects do not contain the key, or a retrieved object
+  no longer has the keys and value types of the columns
 */
-BsonElement *bson_array_get(BsonArray *array, size_t index);
+BsonArray *bson_array_get_column(BsonArray *array, const char *key);
 /*
   @brief Retrieve the BSON object at a specified index in an array
 
@@ -174,7 +618,8 @@ BsonElement *bson_array_get(BsonArray *array, size_t index);
   @param index - The index of the BSON object within the array
 
   @return - The pointer to the BSON object at the given index if it exists, 
-  NULL if the index is out of bounds or the value is not a BSON object
+  NULL if the index is out of bounds or the value is not a BSON object.
+  If the contents of array are shared, they are copied first so that the result can be modified
 */
 BsonObject *bson_array_get_object(BsonArray *array, size_t index);
 /*
@@ -184,7 +629,8 @@ BsonObject *bson_array_get_object(BsonArray *array, size_t index);
   @param index - The index of the BSON array within the array
 
   @return - The pointer to the BSON array at the given index if it exists, 
-  NULL if the index is out of bounds or the value is not a BSON array
+  NULL if the index is out of bounds or the value is not a BSON array.
+  If the contents of array are shared, they are copied first so that the result can be modified
 */
 BsonArray *bson_array_get_array(BsonArray *array, size_t index);
 /*
@@ -214,9 +660,22 @@ int64_t bson_array_get_int64(BsonArray *array, size_t index);
   @param index - The index of the string value within the array
 
   @return - The string value at the given index if it exists, 
-  NULL if the index is out of bounds or the value is not a string
+  NULL if the index is out of bounds or the value is not a string.
+  The value is not moved when other values are added to the array, however short it is
 */
 char *bson_array_get_string(BsonArray *array, size_t index);
+/*
+  @brief Retrieve the string value and its length at a specified index in an array
+
+  @param array - The array to be accessed
+  @param index - The index of the string value within the array
+  @param length - Set to the length of the string in bytes, not including the terminating null character
+
+  @return - The string value at the given index if it exists, 
+  NULL if the index is out of bounds or the value is not a string.
+  The value is always null-terminated, but may also contain null characters
+*/
+char *bson_array_get_string_len(BsonArray *array, size_t index, size_t *length);
 /*
   @brief Retrieve the boolean value at a specified index in an array
 
@@ -238,6 +697,43 @@ bson_boolean bson_array_get_bool(BsonArray *array, size_t index);
 */
 double bson_array_get_double(BsonArray *array, size_t index);
 
+/*
+  @brief Retrieve the packed 32-bit integer values of an array
+
+  @param array - The array to be accessed
+
+  @return - Pointer to array->count contiguous values if the array is packed with TYPE_INT32, NULL otherwise.
+  The pointer is invalidated when the array is modified
+*/
+int32_t *bson_array_get_int32_values(BsonArray *array);
+/*
+  @brief Retrieve the packed 64-bit integer values of an array
+
+  @param array - The array to be accessed
+
+  @return - Pointer to array->count contiguous values if the array is packed with TYPE_INT64, NULL otherwise.
+  The pointer is invalidated when the array is modified
+*/
+int64_t *bson_array_get_int64_values(BsonArray *array);
+/*
+  @brief Retrieve the packed boolean values of an array
+
+  @param array - The array to be accessed
+
+  @return - Pointer to array->count contiguous values if the array is packed with TYPE_BOOLEAN, NULL otherwise.
+  The pointer is invalidated when the array is modified
+*/
+bson_boolean *bson_array_get_bool_values(BsonArray *array);
+/*
+  @brief Retrieve the packed floating-point values of an array
+
+  @param array - The array to be accessed
+
+  @return - Pointer to array->count contiguous values if the array is packed with TYPE_DOUBLE, NULL otherwise.
+  The pointer is invalidated when the array is modified
+*/
+double *bson_array_get_double_values(BsonArray *array);
+
 #ifdef __cplusplus
 }
 #endif
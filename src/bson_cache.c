@@ -0,0 +1,225 @@
+#include "bson_cache.h"
+//Initial number of versions allocated when an object is recorded
+#define CACHE_INITIAL_VERSIONS 8
+
+//Versions of an object and its contents, recorded when the object is encoded
+struct BsonCacheRecording {
+  //The recorded versions
+  BsonCacheVersion *versions;
+  //Number of versions recorded
+  size_t count;
+  //The current maximum number of versions
+  size_t capacity;
+};
+typedef struct BsonCacheRecording BsonCacheRecording;
+
+bool bson_encoding_cache_initialize(BsonEncodingCache *cache, size_t capacity) {
+  cache->count = 0;
+  cache->capacity = capacity;
+  cache->clock = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->entries = NULL;
+  if (capacity == 0) {
+    return false;
+  }
+  cache->entries = malloc(sizeof(BsonCacheEntry) * capacity);
+  return cache->entries != NULL;
+}
+
+void bson_encoding_cache_deinitialize(BsonEncodingCache *cache) {
+  bson_encoding_cache_clear(cache);
+  free(cache->entries);
+}
+
+void bson_encoding_cache_clear(BsonEncodingCache *cache) {
+  size_t i = 0;
+  for (i = 0; i < cache->count; i++) {
+    free(cache->entries[i].bytes);
+    free(cache->entries[i].versions);
+  }
+  cache->count = 0;
+}
+
+/*
+  @brief Record the current version of an object or array
+
+  @param recording - The recording to be extended
+  @param field - The version field of the object or array
+
+  @return - true if the version was recorded, false if the recording could not be extended
+*/
+static bool bson_encoding_cache_record_version(BsonCacheRecording *recording, const uint64_t *field) {
+  if (recording->count == recording->capacity) {
+    size_t capacity = (recording->capacity == 0) ? CACHE_INITIAL_VERSIONS : recording->capacity * 2;
+    BsonCacheVersion *versions = realloc(recording->versions, sizeof(BsonCacheVersion) * capacity);
+    if (versions == NULL) {
+      return false;
+    }
+    recording->versions = versions;
+    recording->capacity = capacity;
+  }
+  recording->versions[recording->count].field = field;
+  recording->versions[recording->count].version = *field;
+  recording->count++;
+  return true;
+}
+
+static bool bson_encoding_cache_record_object(BsonCacheRecording *recording, BsonObject *obj);
+
+/*
+  @brief Record the versions of an array and of every object and array within it
+
+  @param recording - The recording to be extended
+  @param array - The array to be recorded
+
+  @return - true if the versions were recorded, false if the recording could not be extended
+*/
+static bool bson_encoding_cache_record_array(BsonCacheRecording *recording, BsonArray *array) {
+  if (!bson_encoding_cache_record_version(recording, &array->version)) {
+    return false;
+  }
+  size_t i = 0;
+  if (array->columns != NULL) {
+    //Only the objects retrieved from the array can be modified apart from it
+    for (i = 0; i < array->columns->rowCount; i++) {
+      if (array->columns->rows[i] != NULL && 
+          !bson_encoding_cache_record_object(recording, array->columns->rows[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (array->packedSize != 0) {
+    return true;
+  }
+  for (i = 0; i < array->count; i++) {
+    BsonElement *element = &array->elements[i];
+    if ((element->type == TYPE_DOCUMENT && !bson_encoding_cache_record_object(recording, (BsonObject *)element->value)) ||
+        (element->type == TYPE_ARRAY && !bson_encoding_cache_record_array(recording, (BsonArray *)element->value))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  @brief Record the versions of an object and of every object and array within it
+
+  @param recording - The recording to be extended
+  @param obj - The object to be recorded
+
+  @return - true if the versions were recorded, false if the recording could not be extended
+*/
+static bool bson_encoding_cache_record_object(BsonCacheRecording *recording, BsonObject *obj) {
+  if (!bson_encoding_cache_record_version(recording, &obj->version)) {
+    return false;
+  }
+  MapIterator iterator = bson_object_iterator(obj);
+  BsonObjectEntry entry = bson_object_iterator_next(&iterator);
+  while (entry.element != NULL) {
+    BsonElement *element = entry.element;
+    if ((element->type == TYPE_DOCUMENT && !bson_encoding_cache_record_object(recording, (BsonObject *)element->value)) ||
+        (element->type == TYPE_ARRAY && !bson_encoding_cache_record_array(recording, (BsonArray *)element->value))) {
+      return false;
+    }
+    entry = bson_object_iterator_next(&iterator);
+  }
+  return true;
+}
+
+/*
+  @brief Check whether a cache entry is still up to date. The versions are compared in the order
+  in which they were recorded, so an object or array is only read once the object or array
+  containing it is known to be unmodified
+
+  @param entry - The entry to be checked
+
+  @return - true if none of the recorded objects and arrays has been modified, false if any has
+*/
+static bool bson_encoding_cache_is_current(const BsonCacheEntry *entry) {
+  size_t i = 0;
+  for (i = 0; i < entry->versionCount; i++) {
+    if (*entry->versions[i].field != entry->versions[i].version) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  @brief Find the entry holding the BSON representation of an object
+
+  @param cache - The cache to be searched
+  @param obj - The object
+
+  @return - The entry, NULL if the cache does not hold one
+*/
+static BsonCacheEntry *bson_encoding_cache_find(BsonEncodingCache *cache, const BsonObject *obj) {
+  size_t i = 0;
+  for (i = 0; i < cache->count; i++) {
+    if (cache->entries[i].object == obj) {
+      return &cache->entries[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+  @brief Get an entry in which a new representation can be stored,
+  evicting the least recently used entry if the cache is full
+
+  @param cache - The cache to be modified
+
+  @return - The entry, whose fields must all be set by the caller
+*/
+static BsonCacheEntry *bson_encoding_cache_reserve(BsonEncodingCache *cache) {
+  if (cache->count < cache->capacity) {
+    return &cache->entries[cache->count++];
+  }
+  BsonCacheEntry *oldest = &cache->entries[0];
+  size_t i = 0;
+  for (i = 1; i < cache->count; i++) {
+    if (cache->entries[i].lastUsed < oldest->lastUsed) {
+      oldest = &cache->entries[i];
+    }
+  }
+  free(oldest->bytes);
+  free(oldest->versions);
+  return oldest;
+}
+
+const uint8_t *bson_encoding_cache_encode(BsonEncodingCache *cache, BsonObject *obj, size_t *size) {
+  cache->clock++;
+  BsonCacheEntry *entry = bson_encoding_cache_find(cache, obj);
+  if (entry != NULL && bson_encoding_cache_is_current(entry)) {
+    cache->hits++;
+    entry->lastUsed = cache->clock;
+    *size = entry->size;
+    return entry->bytes;
+  }
+
+  cache->misses++;
+  BsonCacheRecording recording = { NULL, 0, 0 };
+  uint8_t *bytes = bson_object_to_bytes(obj);
+  if (bytes == NULL || !bson_encoding_cache_record_object(&recording, obj)) {
+    free(bytes);
+    free(recording.versions);
+    return NULL;
+  }
+  if (entry == NULL) {
+    entry = bson_encoding_cache_reserve(cache);
+  } else {
+    free(entry->bytes);
+    free(entry->versions);
+  }
+  entry->object = obj;
+  entry->versions = recording.versions;
+  entry->versionCount = recording.count;
+  entry->bytes = bytes;
+  uint8_t *length = bytes;
+  entry->size = (size_t)read_int32_le(&length);
+  entry->lastUsed = cache->clock;
+  *size = entry->size;
+  return entry->bytes;
+}
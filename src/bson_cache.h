@@ -0,0 +1,106 @@
+#ifndef BSON_CACHE_H
+#define BSON_CACHE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "bson_object.h"
+
+//Version of an object or array at the time it was encoded (see BsonObject)
+struct BsonCacheVersion {
+  //The version field of the object or array
+  const uint64_t *field;
+  //The value of the field when the object was encoded
+  uint64_t version;
+};
+typedef struct BsonCacheVersion BsonCacheVersion;
+
+//The BSON representation of an object kept by an encoding cache
+struct BsonCacheEntry {
+  //The object which was encoded
+  const BsonObject *object;
+  //Versions of the object and of every object and array within it, each recorded before
+  //the objects and arrays it contains
+  BsonCacheVersion *versions;
+  //Number of entries in versions
+  size_t versionCount;
+  //The encoded object
+  uint8_t *bytes;
+  //Size of the encoded object in bytes
+  size_t size;
+  //Value of the clock of the cache when the entry was last used
+  uint64_t lastUsed;
+};
+typedef struct BsonCacheEntry BsonCacheEntry;
+
+//Bounded cache of encoded objects, which keeps the BSON representation of each object until
+//the object is modified. The least recently used entry is evicted once the cache is full
+struct BsonEncodingCache {
+  //Entries currently in use, in no particular order
+  BsonCacheEntry *entries;
+  //Number of entries in use
+  size_t count;
+  //Maximum number of entries
+  size_t capacity;
+  //Incremented on every lookup to order the entries by use
+  uint64_t clock;
+  //Number of lookups which found an entry
+  size_t hits;
+  //Number of lookups which encoded the object
+  size_t misses;
+};
+typedef struct BsonEncodingCache BsonEncodingCache;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  @brief Initialize an empty encoding cache. Entries are searched linearly,
+  so the cache is meant to hold a small set of frequently sent documents
+
+  @param cache - The uninitialized cache
+  @param capacity - The maximum number of encoded objects held by the cache, at least 1
+
+  @return - true if the cache was initialized successfully, false if not
+*/
+bool bson_encoding_cache_initialize(BsonEncodingCache *cache, size_t capacity);
+/*
+  @brief Free every encoded object held by a cache, along with the cache itself
+
+  @param cache - The cache to be deinitialized
+*/
+void bson_encoding_cache_deinitialize(BsonEncodingCache *cache);
+/*
+  @brief Free every encoded object held by a cache, leaving it empty
+
+  @param cache - The cache to be cleared
+*/
+void bson_encoding_cache_clear(BsonEncodingCache *cache);
+/*
+  @brief Get the BSON representation of an object, which is only encoded if the cache does not
+  hold a representation of it that is still up to date. Entries are looked up by the address of
+  the object, and are up to date if neither the object nor any object or array within it has
+  taken a new version since it was encoded (see BsonObject). A hit only compares these versions,
+  without encoding or reading the values of the object.
+  Modifications are noticed when they are made through the functions of this library, including
+  those made to sub-objects and sub-arrays retrieved before the object was encoded. Values written
+  through the pointers returned by bson_object_get() or bson_array_get_int32_values() and similar
+  functions are not noticed. Objects are only cached when encoded through this function,
+  bson_object_to_bytes() always encodes the object.
+  A cache must not be used from multiple threads at the same time.
+
+  @param cache - The cache to be consulted, to which the object is added if it is not found
+  @param obj - The object to be converted to BSON
+  @param size - Set to the size of the BSON representation in bytes
+
+  @return - The BSON representation, which is owned by the cache and valid until the cache
+  is used again. NULL if the object could not be converted
+*/
+const uint8_t *bson_encoding_cache_encode(BsonEncodingCache *cache, BsonObject *obj, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
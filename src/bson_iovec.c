@@ -0,0 +1,286 @@
+#include "bson_iovec.h"
+
+bool bson_iovec_initialize(BsonIovec *iovec, size_t minReferenceSize) {
+  iovec->scratch = NULL;
+  iovec->scratchSize = 0;
+  iovec->scratchCapacity = 0;
+  iovec->segments = NULL;
+  iovec->segmentCount = 0;
+  iovec->maxSegments = 0;
+  iovec->vectors = NULL;
+  iovec->size = 0;
+  iovec->minReferenceSize = minReferenceSize;
+  return true;
+}
+
+void bson_iovec_deinitialize(BsonIovec *iovec) {
+  free(iovec->scratch);
+  free(iovec->segments);
+  free(iovec->vectors);
+}
+
+void bson_iovec_reset(BsonIovec *iovec) {
+  iovec->scratchSize = 0;
+  iovec->segmentCount = 0;
+  iovec->size = 0;
+}
+
+/*
+  @brief Append a segment to the encoded data. Consecutive segments in the scratch buffer are merged
+
+  @param iovec - The encoder to be appended to
+  @param data - The referenced bytes, NULL if the segment is stored at the end of the scratch buffer
+  @param length - The size of the segment in bytes
+
+  @return - true if the segment was added, false if the segments could not be grown
+*/
+static bool bson_iovec_add_segment(BsonIovec *iovec, const uint8_t *data, size_t length) {
+  if (data == NULL && iovec->segmentCount > 0 && iovec->segments[iovec->segmentCount - 1].data == NULL) {
+    iovec->segments[iovec->segmentCount - 1].length += length;
+    return true;
+  }
+  if (iovec->segmentCount == iovec->maxSegments) {
+    size_t newMax = (iovec->maxSegments == 0) ? 8 : iovec->maxSegments * 2;
+    BsonIovecSegment *newSegments = realloc(iovec->segments, sizeof(BsonIovecSegment) * newMax);
+    if (newSegments == NULL) {
+      return false;
+    }
+    iovec->segments = newSegments;
+    iovec->maxSegments = newMax;
+  }
+  BsonIovecSegment *segment = &iovec->segments[iovec->segmentCount++];
+  segment->data = data;
+  segment->offset = iovec->scratchSize;
+  segment->length = length;
+  return true;
+}
+
+/*
+  @brief Append bytes which are copied into the scratch buffer
+
+  @param iovec - The encoder to be appended to
+  @param length - The number of bytes to be copied
+
+  @return - Pointer to where the bytes are to be written, which is only valid until the encoder
+  is modified again. NULL if the buffers could not be grown
+*/
+static uint8_t *bson_iovec_copy_space(BsonIovec *iovec, size_t length) {
+  if (length > iovec->scratchCapacity - iovec->scratchSize) {
+    size_t newCapacity = (iovec->scratchCapacity == 0) ? 256 : iovec->scratchCapacity * 2;
+    if (newCapacity < iovec->scratchSize + length) {
+      newCapacity = iovec->scratchSize + length;
+    }
+    uint8_t *newScratch = realloc(iovec->scratch, newCapacity);
+    if (newScratch == NULL) {
+      return NULL;
+    }
+    iovec->scratch = newScratch;
+    iovec->scratchCapacity = newCapacity;
+  }
+  if (!bson_iovec_add_segment(iovec, NULL, length)) {
+    return NULL;
+  }
+  uint8_t *space = &iovec->scratch[iovec->scratchSize];
+  iovec->scratchSize += length;
+  iovec->size += length;
+  return space;
+}
+
+/*
+  @brief Append bytes which are referenced where they are stored
+
+  @param iovec - The encoder to be appended to
+  @param data - The bytes to be referenced
+  @param length - The number of bytes
+
+  @return - true if the bytes were added, false if the segments could not be grown
+*/
+static bool bson_iovec_reference(BsonIovec *iovec, const uint8_t *data, size_t length) {
+  if (!bson_iovec_add_segment(iovec, data, length)) {
+    return false;
+  }
+  iovec->size += length;
+  return true;
+}
+
+static bool bson_iovec_encode_object(BsonIovec *iovec, BsonObject *obj);
+static bool bson_iovec_encode_array(BsonIovec *iovec, BsonArray *array);
+
+/*
+  @brief Append an element, referencing its value in place if it is a large string
+
+  @param iovec - The encoder to be appended to
+  @param key - The key of the element
+  @param keyLength - The length of the key, not including its null character
+  @param element - The element to be encoded
+
+  @return - true if the element was encoded, false if not
+*/
+static bool bson_iovec_encode_element(BsonIovec *iovec, const char *key, size_t keyLength, BsonElement *element) {
+  uint8_t *header = bson_iovec_copy_space(iovec, ELEMENT_OVERHEAD_BYTES + keyLength + 1);
+  if (header == NULL) {
+    return false;
+  }
+  header[0] = (uint8_t)element->type;
+  //Key is copied along with its null character
+  memcpy(&header[ELEMENT_OVERHEAD_BYTES], key, keyLength + 1);
+
+  if (element->type == TYPE_DOCUMENT) {
+    return bson_iovec_encode_object(iovec, (BsonObject *)element->value);
+  }
+  if (element->type == TYPE_ARRAY) {
+    return bson_iovec_encode_array(iovec, (BsonArray *)element->value);
+  }
+  size_t stringLength = element->size - STRING_OVERHEAD_BYTES;
+  if (element->type == TYPE_STRING && stringLength >= iovec->minReferenceSize) {
+    //Only the length and null character are copied
+    size_t position = 0;
+    uint8_t *length = bson_iovec_copy_space(iovec, SIZE_INT32);
+    if (length == NULL) {
+      return false;
+    }
+    write_int32_le(length, (int32_t)(stringLength + 1), &position);
+    if (!bson_iovec_reference(iovec, (const uint8_t *)bson_element_get_string(element), stringLength)) {
+      return false;
+    }
+    uint8_t *end = bson_iovec_copy_space(iovec, 1);
+    if (end == NULL) {
+      return false;
+    }
+    *end = 0x00;
+    return true;
+  }
+
+  uint8_t *value = bson_iovec_copy_space(iovec, element->size);
+  size_t written = 0;
+  return value != NULL && bson_element_to_buffer(element, value, element->size, &written);
+}
+
+/*
+  @brief Append an object, filling in its length once all of its elements are encoded
+
+  @param iovec - The encoder to be appended to
+  @param obj - The object to be encoded
+
+  @return - true if the object was encoded, false if not
+*/
+static bool bson_iovec_encode_object(BsonIovec *iovec, BsonObject *obj) {
+  size_t start = iovec->size;
+  size_t lengthOffset = iovec->scratchSize;
+  if (bson_iovec_copy_space(iovec, SIZE_INT32) == NULL) {
+    return false;
+  }
+  MapIterator iterator = emhashmap_iterator(obj->data);
+  MapEntry *current = emhashmap_iterator_next(&iterator);
+  while (current != NULL) {
+    if (!bson_iovec_encode_element(iovec, current->key, strlen(current->key), (BsonElement *)current->value)) {
+      return false;
+    }
+    current = emhashmap_iterator_next(&iterator);
+  }
+  uint8_t *end = bson_iovec_copy_space(iovec, 1);
+  if (end == NULL) {
+    return false;
+  }
+  *end = DOCUMENT_END;
+  write_int32_le(iovec->scratch, (int32_t)(iovec->size - start), &lengthOffset);
+  return true;
+}
+
+/*
+  @brief Append an array, filling in its length once all of its elements are encoded.
+  Packed and columnar arrays are copied as a whole
+
+  @param iovec - The encoder to be appended to
+  @param array - The array to be encoded
+
+  @return - true if the array was encoded, false if not
+*/
+static bool bson_iovec_encode_array(BsonIovec *iovec, BsonArray *array) {
+  if (array->packedSize != 0 || array->columns != NULL) {
+    size_t arraySize = bson_array_size(array);
+    uint8_t *bytes = bson_iovec_copy_space(iovec, arraySize);
+    size_t written = 0;
+    return bytes != NULL && bson_array_to_buffer(array, bytes, arraySize, &written);
+  }
+
+  size_t start = iovec->size;
+  size_t lengthOffset = iovec->scratchSize;
+  if (bson_iovec_copy_space(iovec, SIZE_INT32) == NULL) {
+    return false;
+  }
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  size_t i = 0;
+  for (i = 0; i < array->count; i++) {
+    size_t keyLength = 0;
+    const char *key = index_key(i, keyBuffer, &keyLength);
+    if (!bson_iovec_encode_element(iovec, key, keyLength, &array->elements[i])) {
+      return false;
+    }
+  }
+  uint8_t *end = bson_iovec_copy_space(iovec, 1);
+  if (end == NULL) {
+    return false;
+  }
+  *end = DOCUMENT_END;
+  write_int32_le(iovec->scratch, (int32_t)(iovec->size - start), &lengthOffset);
+  return true;
+}
+
+/*
+  @brief Append an object or an array, restoring the encoder if it could not be encoded
+
+  @param iovec - The encoder to be appended to
+  @param element - Element describing the object or array to be encoded
+
+  @return - true if the value was encoded, false if not
+*/
+static bool bson_iovec_add_element(BsonIovec *iovec, BsonElement *element) {
+  size_t scratchSize = iovec->scratchSize;
+  size_t segmentCount = iovec->segmentCount;
+  size_t lastLength = (segmentCount > 0) ? iovec->segments[segmentCount - 1].length : 0;
+  size_t size = iovec->size;
+  bool encoded = (element->type == TYPE_DOCUMENT) ?
+    bson_iovec_encode_object(iovec, (BsonObject *)element->value) :
+    bson_iovec_encode_array(iovec, (BsonArray *)element->value);
+  if (!encoded) {
+    iovec->scratchSize = scratchSize;
+    iovec->segmentCount = segmentCount;
+    if (segmentCount > 0) {
+      iovec->segments[segmentCount - 1].length = lastLength;
+    }
+    iovec->size = size;
+  }
+  return encoded;
+}
+
+bool bson_iovec_add_object(BsonIovec *iovec, BsonObject *obj) {
+  BsonElement element;
+  element.type = TYPE_DOCUMENT;
+  element.value = obj;
+  return bson_iovec_add_element(iovec, &element);
+}
+
+bool bson_iovec_add_array(BsonIovec *iovec, BsonArray *array) {
+  BsonElement element;
+  element.type = TYPE_ARRAY;
+  element.value = array;
+  return bson_iovec_add_element(iovec, &element);
+}
+
+const struct iovec *bson_iovec_get_vectors(BsonIovec *iovec, size_t *count) {
+  //Scratch segments are resolved here, once the scratch buffer can no longer move
+  struct iovec *vectors = realloc(iovec->vectors, sizeof(struct iovec) * (iovec->segmentCount + 1));
+  if (vectors == NULL) {
+    return NULL;
+  }
+  iovec->vectors = vectors;
+  size_t i = 0;
+  for (i = 0; i < iovec->segmentCount; i++) {
+    BsonIovecSegment *segment = &iovec->segments[i];
+    vectors[i].iov_base = (void *)((segment->data != NULL) ? segment->data : &iovec->scratch[segment->offset]);
+    vectors[i].iov_len = segment->length;
+  }
+  *count = iovec->segmentCount;
+  return vectors;
+}
@@ -0,0 +1,114 @@
+#ifndef BSON_IOVEC_H
+#define BSON_IOVEC_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "bson_object.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#else
+//Same layout as the POSIX structure used by writev() and sendmsg()
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#endif
+
+//A contiguous part of the BSON data, either copied into the scratch buffer or referenced in place
+struct BsonIovecSegment {
+  //The referenced bytes, NULL if the segment is stored in the scratch buffer
+  const uint8_t *data;
+  //Position of the segment in the scratch buffer, only used if data is NULL
+  size_t offset;
+  //Size of the segment in bytes
+  size_t length;
+};
+typedef struct BsonIovecSegment BsonIovecSegment;
+
+//Encoder which describes BSON data as a list of buffers for writev() or sendmsg(). Large string
+//values are referenced where they are stored, everything else is copied into a scratch buffer
+struct BsonIovec {
+  //Copied bytes, which may be moved when the buffer grows
+  uint8_t *scratch;
+  //Number of bytes in the scratch buffer
+  size_t scratchSize;
+  //The current maximum number of bytes in the scratch buffer
+  size_t scratchCapacity;
+  //The parts of the BSON data, in order
+  BsonIovecSegment *segments;
+  //Number of segments
+  size_t segmentCount;
+  //The current maximum number of segments
+  size_t maxSegments;
+  //The buffers of every segment, filled in by bson_iovec_get_vectors()
+  struct iovec *vectors;
+  //Total size in bytes of the BSON data
+  size_t size;
+  //Strings of at least this many bytes are referenced instead of copied
+  size_t minReferenceSize;
+};
+typedef struct BsonIovec BsonIovec;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  @brief Initialize an empty scatter-gather encoder
+
+  @param iovec - The uninitialized encoder
+  @param minReferenceSize - The length in bytes from which string values are referenced in place
+
+  @return - true if the encoder was initialized successfully, false if not
+*/
+bool bson_iovec_initialize(BsonIovec *iovec, size_t minReferenceSize);
+/*
+  @brief Free the buffers of a scatter-gather encoder. Referenced values are not freed
+
+  @param iovec - The encoder to be deinitialized
+*/
+void bson_iovec_deinitialize(BsonIovec *iovec);
+/*
+  @brief Discard everything encoded so far, keeping the buffers for the next document
+
+  @param iovec - The encoder to be reset
+*/
+void bson_iovec_reset(BsonIovec *iovec);
+/*
+  @brief Append the BSON representation of an object. Documents may be added one after another
+
+  @param iovec - The encoder to be appended to
+  @param obj - The object to be encoded, which must not be modified or freed while
+               the vectors are in use
+
+  @return - true if the object was encoded, false if not. The encoder is left unchanged on failure
+*/
+bool bson_iovec_add_object(BsonIovec *iovec, BsonObject *obj);
+/*
+  @brief Append the BSON representation of an array (see bson_iovec_add_object())
+
+  @param iovec - The encoder to be appended to
+  @param array - The array to be encoded, which must not be modified or freed while
+                 the vectors are in use
+
+  @return - true if the array was encoded, false if not. The encoder is left unchanged on failure
+*/
+bool bson_iovec_add_array(BsonIovec *iovec, BsonArray *array);
+/*
+  @brief Get the buffers which make up the encoded data, ready to be passed to writev() or sendmsg()
+
+  @param iovec - The encoder
+  @param count - Set to the number of buffers
+
+  @return - The buffers, which are owned by the encoder and valid until it is modified.
+  NULL if they could not be allocated
+*/
+const struct iovec *bson_iovec_get_vectors(BsonIovec *iovec, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
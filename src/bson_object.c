@@ -13,7 +13,19 @@ size_t hash_function(const char* key, size_t maxValue) {
 }
 
 bool bson_object_initialize(BsonObject *obj, size_t capacity, float loadFactor) {
-  return emhashmap_initialize(&obj->data, (int)capacity, loadFactor, &hash_function);
+  obj->refCount = NULL;
+  obj->image = NULL;
+  obj->version = bson_next_version();
+  obj->data = malloc(sizeof(HashMap));
+  if (obj->data == NULL) {
+    return false;
+  }
+  if (!emhashmap_initialize(obj->data, (int)capacity, loadFactor, &hash_function)) {
+    free(obj->data);
+    obj->data = NULL;
+    return false;
+  }
+  return true;
 }
 
 bool bson_object_initialize_default(BsonObject *obj) {
@@ -21,27 +33,191 @@ bool bson_object_initialize_default(BsonObject *obj) {
 }
 
 void bson_object_deinitialize(BsonObject *obj) {
-  MapIterator iterator = emhashmap_iterator(&obj->data);
+  if (obj->image != NULL) {
+    free(obj->image->bytes);
+    free(obj->image);
+  }
+  if (obj->refCount != NULL) {
+    //Contents are still used by another object
+    if (--(*obj->refCount) > 0) {
+      return;
+    }
+    free(obj->refCount);
+  }
+
+  MapIterator iterator = emhashmap_iterator(obj->data);
   MapEntry *current = emhashmap_iterator_next(&iterator);
   while (current != NULL) {
     BsonElement *element = (BsonElement *)current->value;
-    if (element->type == TYPE_DOCUMENT) {
-      bson_object_deinitialize((BsonObject *)element->value);
-    }
-    else if (element->type == TYPE_ARRAY) {
-      bson_array_deinitialize((BsonArray *)element->value);
+    bson_element_deinitialize(element);
+    free(element);
+    current = emhashmap_iterator_next(&iterator);
+  }
+
+  emhashmap_deinitialize(obj->data);
+  free(obj->data);
+}
+
+bool bson_object_share(BsonObject *output, BsonObject *obj) {
+  if (obj->refCount == NULL) {
+    obj->refCount = malloc(sizeof(size_t));
+    if (obj->refCount == NULL) {
+      return false;
     }
-    free(element->value);
+    *obj->refCount = 1;
+  }
+  (*obj->refCount)++;
+  *output = *obj;
+  output->image = NULL;
+  if (obj->image != NULL) {
+    //Shared elements cannot be marked as modified for only one of the objects
+    obj->image->valid = false;
+  }
+  return true;
+}
+
+/*
+  @brief Allocate an element of an object. The value of a short string element is stored
+  right after the element, in the same allocation, so that it is freed along with the element
+
+  @param shortString - Whether the element will hold a string shorter than SHORT_STRING_SIZE
+
+  @return - The malloc()-ed element, NULL on failure
+*/
+static BsonElement *bson_object_allocate_element(bool shortString) {
+  return malloc(sizeof(BsonElement) + (shortString ? SHORT_STRING_SIZE : 0));
+}
+
+/*
+  @brief Get the storage for the short string value of an element of an object
+
+  @param element - The element, allocated with bson_object_allocate_element()
+
+  @return - The storage of SHORT_STRING_SIZE bytes following the element
+*/
+static char *bson_object_short_string(BsonElement *element) {
+  return (char *)(element + 1);
+}
+
+/*
+  @brief Share an element for use in a new map, see emhashmap_initialize_copy()
+
+  @param value - The element to be shared
+  @param context - Unused
+
+  @return - The new element, NULL on failure
+*/
+static void *bson_object_share_element(void *value, void *context) {
+  (void)context;
+  BsonElement *element = bson_object_allocate_element(bson_element_is_short_string((BsonElement *)value));
+  if (element != NULL && !bson_element_share(element, (BsonElement *)value, bson_object_short_string(element))) {
     free(element);
+    return NULL;
+  }
+  return element;
+}
+
+/*
+  @brief Deep copy an element for use in a new map, see emhashmap_initialize_copy()
+
+  @param value - The element to be copied
+  @param context - Unused
+
+  @return - The new element, NULL on failure
+*/
+static void *bson_object_clone_element(void *value, void *context) {
+  (void)context;
+  BsonElement *element = bson_object_allocate_element(bson_element_is_short_string((BsonElement *)value));
+  if (element != NULL && !bson_element_clone(element, (BsonElement *)value, bson_object_short_string(element))) {
+    free(element);
+    return NULL;
+  }
+  return element;
+}
+
+/*
+  @brief Copy the map of an object. The new map has the same capacity and layout as
+  the source, so keys are copied without being hashed again
+
+  @param source - The map to be copied
+  @param copyElement - The function used to copy each element
+
+  @return - The malloc()-ed copy of the map, NULL on failure
+*/
+static HashMap *bson_object_copy_data(HashMap *source, void *(*copyElement)(void *value, void *context)) {
+  HashMap *data = malloc(sizeof(HashMap));
+  if (data == NULL) {
+    return NULL;
+  }
+  if (!emhashmap_initialize_copy(data, source, copyElement, NULL)) {
+    free(data);
+    return NULL;
+  }
+
+  bool copyError = false;
+  MapIterator iterator = emhashmap_iterator(data);
+  MapEntry *current = emhashmap_iterator_next(&iterator);
+  while (current != NULL) {
+    copyError |= (current->value == NULL);
     current = emhashmap_iterator_next(&iterator);
   }
+  if (copyError) {
+    iterator = emhashmap_iterator(data);
+    current = emhashmap_iterator_next(&iterator);
+    while (current != NULL) {
+      if (current->value != NULL) {
+        bson_element_deinitialize((BsonElement *)current->value);
+        free(current->value);
+      }
+      current = emhashmap_iterator_next(&iterator);
+    }
+    emhashmap_deinitialize(data);
+    free(data);
+    return NULL;
+  }
+  return data;
+}
 
-  emhashmap_deinitialize(&obj->data);
+bool bson_object_clone(BsonObject *output, BsonObject *obj) {
+  output->refCount = NULL;
+  output->image = NULL;
+  output->version = bson_next_version();
+  output->data = bson_object_copy_data(obj->data, &bson_object_clone_element);
+  return output->data != NULL;
+}
+
+/*
+  @brief Give an object its own copy of its contents if they are shared with other objects,
+  so that they can be modified. Sub-objects and sub-arrays remain shared.
+
+  @param obj - The object to be modified
+
+  @return - true if the object can be modified, false if its contents could not be copied
+*/
+static bool bson_object_unshare(BsonObject *obj) {
+  //Every modification starts here, so encodings of the previous contents are no longer up to date
+  obj->version = bson_next_version();
+  if (obj->refCount == NULL || *obj->refCount == 1) {
+    return true;
+  }
+
+  HashMap *data = bson_object_copy_data(obj->data, &bson_object_share_element);
+  if (data == NULL) {
+    return false;
+  }
+
+  (*obj->refCount)--;
+  obj->refCount = NULL;
+  obj->data = data;
+  if (obj->image != NULL) {
+    obj->image->valid = false;
+  }
+  return true;
 }
 
 size_t bson_object_size(BsonObject *obj) {
   size_t objSize = OBJECT_OVERHEAD_BYTES;
-  MapIterator iterator = emhashmap_iterator(&obj->data);
+  MapIterator iterator = emhashmap_iterator(obj->data);
   MapEntry *current = emhashmap_iterator_next(&iterator);
   while (current != NULL) {
     BsonElement *element = (BsonElement *)current->value;
@@ -60,105 +236,440 @@ size_t bson_object_size(BsonObject *obj) {
   return objSize;
 }
 
-uint8_t *bson_object_to_bytes(BsonObject *obj) {
-  //TODO just move the pointer rather than keep a position variable
-  MapIterator iterator = emhashmap_iterator(&obj->data);
-  MapEntry *current = emhashmap_iterator_next(&iterator);
+bool bson_object_keep_image(BsonObject *obj) {
+  if (obj->image != NULL) {
+    return true;
+  }
+  obj->image = malloc(sizeof(BsonObjectImage));
+  if (obj->image == NULL) {
+    return false;
+  }
+  obj->image->bytes = NULL;
+  obj->image->size = 0;
+  obj->image->capacity = 0;
+  obj->image->valid = false;
+  obj->image->dirty = false;
+  return true;
+}
+
+/*
+  @brief Encode an object into its image in full, and mark all of its elements as unmodified
+
+  @param obj - The object to be encoded, which must keep an image
+
+  @return - true if the object was encoded, false if not
+*/
+static bool bson_object_image_rebuild(BsonObject *obj) {
+  BsonObjectImage *image = obj->image;
   size_t objSize = bson_object_size(obj);
-  uint8_t *bytes = malloc(objSize);
-  size_t position = 0;
-  write_int32_le(bytes, (int32_t)objSize, &position);
+  if (objSize > image->capacity) {
+    //The previous contents are not needed, so they are not copied
+    free(image->bytes);
+    image->capacity = 0;
+    image->bytes = malloc(objSize);
+    if (image->bytes == NULL) {
+      return false;
+    }
+    image->capacity = objSize;
+  }
+  image->valid = bson_object_to_buffer(obj, image->bytes, image->capacity, &image->size);
+  if (!image->valid) {
+    return false;
+  }
 
+  MapIterator iterator = emhashmap_iterator(obj->data);
+  MapEntry *current = emhashmap_iterator_next(&iterator);
   while (current != NULL) {
-    BsonElement *element = (BsonElement *)current->value;
+    ((BsonElement *)current->value)->dirty = false;
+    current = emhashmap_iterator_next(&iterator);
+  }
+  image->dirty = false;
+  return true;
+}
 
-    bytes[position++] = (uint8_t)element->type;
+/*
+  @brief Get the size of a modified value before it is written into an image.
+  Sub-objects which keep an image of their own are brought up to date
 
-    uint8_t *keyBytes = string_to_byte_array(current->key);
-    memcpy(&bytes[position], keyBytes, strlen(current->key));
-    free(keyBytes);
-    position += strlen(current->key);
+  @param element - The modified element
+  @param valueSize - Set to the size of the value in bytes
 
-    //Null-terminate
-    bytes[position++] = 0x00;
+  @return - true if the value can be written, false if not
+*/
+static bool bson_image_measure_value(BsonElement *element, size_t *valueSize) {
+  if (element->type == TYPE_DOCUMENT) {
+    BsonObject *value = (BsonObject *)element->value;
+    if (value->image != NULL) {
+      return bson_object_get_image(value, valueSize) != NULL;
+    }
+    *valueSize = bson_object_size(value);
+  }
+  else if (element->type == TYPE_ARRAY) {
+    *valueSize = bson_array_size((BsonArray *)element->value);
+  }
+  else {
+    *valueSize = element->size;
+  }
+  return true;
+}
 
-    switch (element->type) {
-      case TYPE_DOCUMENT: {
-        BsonObject *subObject = (BsonObject *)element->value;
-        uint8_t *subObjectBytes = bson_object_to_bytes(subObject);
-        if (subObjectBytes == NULL) {
-          printf("An error occured while parsing the object with key \"%s\"\n", current->key);
-          free(bytes);
-          return NULL;
-        }
-        size_t subObjectSize = bson_object_size(subObject);
-        memcpy(&bytes[position], subObjectBytes, subObjectSize);
-        free(subObjectBytes);
-        position += subObjectSize;
-        break;
-      }
-      case TYPE_ARRAY: {
-        BsonArray *array = (BsonArray *)element->value;
-        uint8_t *arrayBytes = bson_array_to_bytes(array);
-        if (arrayBytes == NULL) {
-          printf("An error occured while parsing the object with key \"%s\"\n", current->key);
-          free(bytes);
-          return NULL;
-        }
-        size_t arraySize = bson_array_size(array);
-        memset(&bytes[position], 0, arraySize);
-        memcpy(&bytes[position], arrayBytes, arraySize);
-        free(arrayBytes);
-        position += arraySize;
-        break;
-      }
-      case TYPE_INT32: {
-        write_int32_le(bytes, *(int32_t *)element->value, &position);
-        break;
-      }
-      case TYPE_INT64: {
-        write_int64_le(bytes, *(int64_t *)element->value, &position);
-        break;
-      }
-      case TYPE_STRING: {
-        char *stringVal = (char *)element->value;
-        //String length is written first
-        write_int32_le(bytes, (int32_t)(strlen(stringVal) + 1), &position);
+/*
+  @brief Write a modified value into an image, copying the image of sub-objects which keep one
+  (see bson_image_measure_value())
 
-        uint8_t *stringBytes = string_to_byte_array(stringVal);
-        memcpy(&bytes[position], stringBytes, strlen(stringVal));
-        free(stringBytes);
-        position += strlen(stringVal);
+  @param element - The modified element
+  @param buffer - The buffer into which the value is written
+  @param capacity - The size of the buffer in bytes
+  @param written - Set to the number of bytes written
 
-        //Null-terminate
-        bytes[position++] = 0x00;
-        break;
+  @return - true if the value was written, false if not
+*/
+static bool bson_image_write_value(BsonElement *element, uint8_t *buffer, size_t capacity, size_t *written) {
+  if (element->type == TYPE_DOCUMENT && ((BsonObject *)element->value)->image != NULL) {
+    BsonObjectImage *valueImage = ((BsonObject *)element->value)->image;
+    if (valueImage->size > capacity) {
+      return false;
+    }
+    memcpy(buffer, valueImage->bytes, valueImage->size);
+    *written = valueImage->size;
+    return true;
+  }
+  return bson_element_to_buffer(element, buffer, capacity, written);
+}
+
+/*
+  @brief Re-encode the modified elements of an object into its image. If every modified value
+  has the same size as before, they are patched into the image in place. Otherwise a new image
+  is written, in which each run of unmodified elements is copied from the old image at once
+
+  @param obj - The object to be encoded, which must keep a valid image
+
+  @return - true if the image was updated, false if not
+*/
+static bool bson_object_image_update(BsonObject *obj) {
+  BsonObjectImage *image = obj->image;
+  size_t newSize = image->size;
+  bool resized = false;
+  size_t position = SIZE_INT32;
+  MapIterator iterator = emhashmap_iterator(obj->data);
+  MapEntry *current = emhashmap_iterator_next(&iterator);
+  while (current != NULL) {
+    BsonElement *element = (BsonElement *)current->value;
+    size_t valueStart = position + ELEMENT_OVERHEAD_BYTES + strlen(current->key) + 1;
+    size_t oldValueSize = encoded_value_size((element_type)image->bytes[position], &image->bytes[valueStart]);
+    if (element->dirty) {
+      size_t valueSize = 0;
+      if (!bson_image_measure_value(element, &valueSize)) {
+        return false;
       }
-      case TYPE_DOUBLE: {
-        write_double_le(bytes, *(double *)element->value, &position);
-        break;
+      resized |= (valueSize != oldValueSize);
+      newSize = newSize - oldValueSize + valueSize;
+    }
+    position = valueStart + oldValueSize;
+    current = emhashmap_iterator_next(&iterator);
+  }
+
+  uint8_t *bytes = resized ? malloc(newSize) : image->bytes;
+  if (bytes == NULL) {
+    return false;
+  }
+  size_t oldPosition = SIZE_INT32;
+  size_t newPosition = SIZE_INT32;
+  //Start of the unmodified elements which have not been copied yet
+  size_t cleanStart = SIZE_INT32;
+  iterator = emhashmap_iterator(obj->data);
+  current = emhashmap_iterator_next(&iterator);
+  while (current != NULL) {
+    BsonElement *element = (BsonElement *)current->value;
+    size_t keySize = strlen(current->key) + 1;
+    size_t valueStart = oldPosition + ELEMENT_OVERHEAD_BYTES + keySize;
+    size_t oldValueSize = encoded_value_size((element_type)image->bytes[oldPosition], &image->bytes[valueStart]);
+    if (element->dirty) {
+      if (resized) {
+        memcpy(&bytes[newPosition], &image->bytes[cleanStart], oldPosition - cleanStart);
+        newPosition += oldPosition - cleanStart;
+        memcpy(&bytes[newPosition + ELEMENT_OVERHEAD_BYTES], current->key, keySize);
       }
-      case TYPE_BOOLEAN: {
-        bytes[position++] = (uint8_t)(*(bson_boolean *)element->value);
-        break;
+      else {
+        newPosition = oldPosition;
       }
-      default: {
-        printf("Unrecognized BSON type: %i\n", element->type);
-        position += sizeof(element->value);
+      bytes[newPosition] = (uint8_t)element->type;
+      newPosition += ELEMENT_OVERHEAD_BYTES + keySize;
+      size_t valueSize = 0;
+      if (!bson_image_write_value(element, &bytes[newPosition], newSize - newPosition, &valueSize)) {
+        if (resized) {
+          free(bytes);
+        }
+        //Some values may already have been patched
+        image->valid = false;
+        return false;
       }
+      newPosition += valueSize;
+      element->dirty = false;
+      cleanStart = valueStart + oldValueSize;
     }
+    oldPosition = valueStart + oldValueSize;
     current = emhashmap_iterator_next(&iterator);
   }
 
-  bytes[position++] = DOCUMENT_END;
-  if (position != objSize) {
-    printf("Something went horribly wrong. Unexpected size of map in bytes: %i, expected size: %i\n", (int)position, (int)objSize);
+  if (resized) {
+    memcpy(&bytes[newPosition], &image->bytes[cleanStart], oldPosition - cleanStart);
+    newPosition += oldPosition - cleanStart;
+    bytes[newPosition] = DOCUMENT_END;
+    position = 0;
+    write_int32_le(bytes, (int32_t)newSize, &position);
+    free(image->bytes);
+    image->bytes = bytes;
+    image->size = newSize;
+    image->capacity = newSize;
+  }
+  image->dirty = false;
+  return true;
+}
+
+const uint8_t *bson_object_get_image(BsonObject *obj, size_t *size) {
+  BsonObjectImage *image = obj->image;
+  if (image == NULL) {
+    return NULL;
+  }
+  if (!image->valid) {
+    if (!bson_object_image_rebuild(obj)) {
+      return NULL;
+    }
+  }
+  else if (image->dirty && !bson_object_image_update(obj)) {
+    return NULL;
+  }
+  *size = image->size;
+  return image->bytes;
+}
+
+/*
+  @brief Convert an object to BSON in a newly allocated buffer of the exact size.
+  Objects which keep an image are copied from it, once it is brought up to date
+
+  @param obj - The object to be converted
+  @param canonical - Whether keys are written in sorted order (see bson_object_to_bytes_canonical())
+
+  @return - The BSON representation of the object, must be freed by the caller after use.
+  NULL if the object could not be converted
+*/
+static uint8_t *bson_object_write_bytes(BsonObject *obj, bool canonical) {
+  size_t imageSize = 0;
+  const uint8_t *image = canonical ? NULL : bson_object_get_image(obj, &imageSize);
+  if (image != NULL) {
+    uint8_t *bytes = malloc(imageSize);
+    if (bytes != NULL) {
+      memcpy(bytes, image, imageSize);
+    }
+    return bytes;
+  }
+
+  size_t objSize = bson_object_size(obj);
+  uint8_t *bytes = malloc(objSize);
+  if (bytes == NULL) {
+    return NULL;
+  }
+  size_t written = 0;
+  bool converted = canonical ? bson_object_to_buffer_canonical(obj, bytes, objSize, &written) : 
+                               bson_object_to_buffer(obj, bytes, objSize, &written);
+  if (!converted) {
+    if (written != 0) {
+      printf("Something went horribly wrong. Unexpected size of map in bytes: %i, expected size: %i\n", (int)written, (int)objSize);
+    }
     free(bytes);
     return NULL;
   }
   return bytes;
 }
 
+uint8_t *bson_object_to_bytes(BsonObject *obj) {
+  return bson_object_write_bytes(obj, false);
+}
+
+uint8_t *bson_object_to_bytes_canonical(BsonObject *obj) {
+  return bson_object_write_bytes(obj, true);
+}
+
+/*
+  @brief Write one element of an object, only measuring it once the buffer is full
+
+  @param key - The key of the element
+  @param element - The element to be written
+  @param canonical - Whether sub-objects are written with sorted keys
+  @param buffer - The buffer into which the object is written
+  @param capacity - The size of the buffer in bytes
+  @param position - The position at which the element is written, advanced past the element
+  @param fits - Whether the object still fits in the buffer, set to false once it does not
+
+  @return - true if the element could be converted, false if not
+*/
+static bool bson_object_write_element(const char *key, BsonElement *element, bool canonical, 
+                                      uint8_t *buffer, size_t capacity, size_t *position, bool *fits) {
+  //Key is copied along with its null character
+  size_t keyLength = strlen(key);
+  size_t valueStart = *position + ELEMENT_OVERHEAD_BYTES + keyLength + 1;
+  size_t valueSize = 0;
+  if (*fits && valueStart <= capacity) {
+    buffer[*position] = (uint8_t)element->type;
+    memcpy(&buffer[*position + ELEMENT_OVERHEAD_BYTES], key, keyLength + 1);
+    *fits = canonical ? bson_element_to_buffer_canonical(element, &buffer[valueStart], capacity - valueStart, &valueSize) : 
+                        bson_element_to_buffer(element, &buffer[valueStart], capacity - valueStart, &valueSize);
+    if (valueSize == 0) {
+      printf("An error occured while parsing the object with key \"%s\"\n", key);
+      return false;
+    }
+  }
+  else {
+    //Once the buffer is full, the rest of the object is only measured
+    *fits = false;
+    valueSize = (element->type == TYPE_DOCUMENT) ? bson_object_size((BsonObject *)element->value) : 
+                (element->type == TYPE_ARRAY) ? bson_array_size((BsonArray *)element->value) : element->size;
+  }
+  *position = valueStart + valueSize;
+  return true;
+}
+
+/*
+  @brief Order two map entries by their keys, comparing bytes as unsigned values
+
+  @param first - Pointer to the first entry
+  @param second - Pointer to the second entry
+
+  @return - Negative, zero or positive as the key of first sorts before, equal to or after second
+*/
+static int bson_object_compare_entries(const void *first, const void *second) {
+  return strcmp((*(MapEntry *const *)first)->key, (*(MapEntry *const *)second)->key);
+}
+
+/*
+  @brief Write the elements of an object in sorted key order. The entries are gathered and sorted
+  once per object, on the stack unless the object has more than CANONICAL_STACK_KEYS keys
+
+  @param obj - The object to be written
+  @param buffer - The buffer into which the object is written
+  @param capacity - The size of the buffer in bytes
+  @param position - The position at which the first element is written, advanced past the last element
+  @param fits - Whether the object still fits in the buffer, set to false once it does not
+
+  @return - true if every element could be converted, false if not
+*/
+static bool bson_object_write_sorted(BsonObject *obj, uint8_t *buffer, size_t capacity, size_t *position, bool *fits) {
+  MapEntry *stackEntries[CANONICAL_STACK_KEYS];
+  size_t count = (size_t)emhashmap_size(obj->data);
+  MapEntry **entries = (count <= CANONICAL_STACK_KEYS) ? stackEntries : malloc(sizeof(MapEntry *) * count);
+  if (entries == NULL) {
+    return false;
+  }
+  size_t i = 0;
+  MapIterator iterator = emhashmap_iterator(obj->data);
+  MapEntry *current = emhashmap_iterator_next(&iterator);
+  while (current != NULL && i < count) {
+    entries[i++] = current;
+    current = emhashmap_iterator_next(&iterator);
+  }
+  qsort(entries, i, sizeof(MapEntry *), bson_object_compare_entries);
+
+  bool converted = true;
+  size_t j = 0;
+  for (j = 0; j < i && converted; j++) {
+    converted = bson_object_write_element(entries[j]->key, (BsonElement *)entries[j]->value, true, 
+                                          buffer, capacity, position, fits);
+  }
+  if (entries != stackEntries) {
+    free(entries);
+  }
+  return converted;
+}
+
+/*
+  @brief Write an object into a given buffer (see bson_object_to_buffer())
+
+  @param obj - The object to be converted
+  @param canonical - Whether keys are written in sorted order (see bson_object_to_buffer_canonical())
+  @param buffer - The buffer into which the object is written
+  @param capacity - The size of the buffer in bytes
+  @param written - Set as described for bson_object_to_buffer()
+
+  @return - true if the object was written, false if not
+*/
+static bool bson_object_write(BsonObject *obj, bool canonical, uint8_t *buffer, size_t capacity, size_t *written) {
+  //The length is written last, once it is known
+  size_t position = SIZE_INT32;
+  bool fits = true;
+  bool converted = true;
+  if (canonical) {
+    converted = bson_object_write_sorted(obj, buffer, capacity, &position, &fits);
+  }
+  else {
+    MapIterator iterator = emhashmap_iterator(obj->data);
+    MapEntry *current = emhashmap_iterator_next(&iterator);
+    while (current != NULL && converted) {
+      converted = bson_object_write_element(current->key, (BsonElement *)current->value, false, 
+                                            buffer, capacity, &position, &fits);
+      current = emhashmap_iterator_next(&iterator);
+    }
+  }
+  if (!converted) {
+    *written = 0;
+    return false;
+  }
+
+  *written = position + 1;
+  if (!fits || *written > capacity) {
+    return false;
+  }
+  buffer[position] = DOCUMENT_END;
+  position = 0;
+  write_int32_le(buffer, (int32_t)*written, &position);
+  return true;
+}
+
+bool bson_object_to_buffer(BsonObject *obj, uint8_t *buffer, size_t capacity, size_t *written) {
+  return bson_object_write(obj, false, buffer, capacity, written);
+}
+
+bool bson_object_to_buffer_canonical(BsonObject *obj, uint8_t *buffer, size_t capacity, size_t *written) {
+  return bson_object_write(obj, true, buffer, capacity, written);
+}
+
+bool bson_object_to_stream(BsonObject *obj, BsonStream *stream) {
+  //The length is measured up front, since the start of the document may already have been passed on
+  uint8_t header[SIZE_INT32];
+  size_t position = 0;
+  write_int32_le(header, (int32_t)bson_object_size(obj), &position);
+  if (!bson_stream_write(stream, header, SIZE_INT32)) {
+    return false;
+  }
+
+  MapIterator iterator = emhashmap_iterator(obj->data);
+  MapEntry *current = emhashmap_iterator_next(&iterator);
+  while (current != NULL) {
+    BsonElement *element = (BsonElement *)current->value;
+    uint8_t type = (uint8_t)element->type;
+    //Key is written along with its null character
+    if (!bson_stream_write(stream, &type, ELEMENT_OVERHEAD_BYTES) || 
+        !bson_stream_write(stream, current->key, strlen(current->key) + 1) || 
+        !bson_element_to_stream(element, stream)) {
+      return false;
+    }
+    current = emhashmap_iterator_next(&iterator);
+  }
+
+  uint8_t end = DOCUMENT_END;
+  return bson_stream_write(stream, &end, 1);
+}
+
+bool bson_object_write_stream(BsonObject *obj, BsonStreamSink sink, void *context, size_t chunkSize) {
+  BsonStream stream;
+  if (!bson_stream_initialize(&stream, sink, context, chunkSize)) {
+    return false;
+  }
+  bool written = bson_object_to_stream(obj, &stream) && bson_stream_flush(&stream);
+  bson_stream_deinitialize(&stream);
+  return written;
+}
+
 // DEPRECATED: use bson_object_from_bytes_len() instead
 BsonObject bson_object_from_bytes(uint8_t *data) {
   uint8_t *p = data;
@@ -197,7 +708,9 @@ size_t bson_object_from_bytes_len(BsonObject *output, const uint8_t *data, size_
   remainBytes -= 1;
 
   BsonObject obj;
-  bson_object_initialize_default(&obj);
+  if (!bson_object_initialize_default(&obj)) {
+    return 0;
+  }
 
   while (type != DOCUMENT_END) {
     char *key = NULL;
@@ -209,33 +722,36 @@ size_t bson_object_from_bytes_len(BsonObject *output, const uint8_t *data, size_
 
     switch ((element_type)type) {
       case TYPE_DOCUMENT: {
-        BsonObject subObject;
-        ret = bson_object_from_bytes_len(&subObject, current, remainBytes);
+        BsonObject *subObject = malloc(sizeof(BsonObject));
+        ret = (subObject != NULL) ? bson_object_from_bytes_len(subObject, current, remainBytes) : 0;
         if (ret > 0) {
-          bson_object_put_object(&obj, key, &subObject);
+          parseError = !bson_object_put_object_owned(&obj, key, subObject);
           current += ret;
           remainBytes -= ret;
         } else {
+          free(subObject);
           parseError = true;
         }
         break;
       }
       case TYPE_ARRAY: {
-        BsonArray array;
-        ret = bson_array_from_bytes_len(&array, current, remainBytes);
+        BsonArray *array = malloc(sizeof(BsonArray));
+        ret = (array != NULL) ? bson_array_from_bytes_len(array, current, remainBytes) : 0;
         if (ret > 0) {
-          bson_object_put_array(&obj, key, &array);
+          parseError = !bson_object_put_array_owned(&obj, key, array);
           current += ret;
           remainBytes -= ret;
         } else {
+          free(array);
           parseError = true;
         }
         break;
       }
       case TYPE_INT32:
         if (remainBytes >= SIZE_INT32) {
-          int32_t value = read_int32_le((uint8_t **)&current);
-          bson_object_put_int32(&obj, key, value);
+          int32_t value = 0;
+          current = load_int32_le(current, &value);
+          parseError = !bson_object_put_int32(&obj, key, value);
           remainBytes -= SIZE_INT32;
         } else {
           parseError = true;
@@ -243,8 +759,9 @@ size_t bson_object_from_bytes_len(BsonObject *output, const uint8_t *data, size_
         break;
       case TYPE_INT64:
         if (remainBytes >= SIZE_INT64) {
-          int64_t value = read_int64_le((uint8_t **)&current);
-          bson_object_put_int64(&obj, key, value);
+          int64_t value = 0;
+          current = load_int64_le(current, &value);
+          parseError = !bson_object_put_int64(&obj, key, value);
           remainBytes -= SIZE_INT64;
         } else {
           parseError = true;
@@ -253,13 +770,12 @@ size_t bson_object_from_bytes_len(BsonObject *output, const uint8_t *data, size_
       case TYPE_STRING:
         // Buffer length is read first
         if (remainBytes >= SIZE_INT32) {
-          int32_t bufferLength = read_int32_le((uint8_t **)&current);
+          int32_t bufferLength = 0;
+          current = load_int32_le(current, &bufferLength);
           remainBytes -= SIZE_INT32;
 
-          if (bufferLength <= remainBytes) {
-            char *stringVal = byte_array_to_bson_string((uint8_t*)current, (size_t)bufferLength - 1);
-            bson_object_put_string(&obj, key, stringVal);
-            free(stringVal);
+          if (bufferLength >= 1 && bufferLength <= remainBytes) {
+            parseError = !bson_object_put_string_len(&obj, key, (char *)current, (size_t)bufferLength - 1);
             current += bufferLength;
             remainBytes -= (size_t)bufferLength;
           } else {
@@ -271,8 +787,9 @@ size_t bson_object_from_bytes_len(BsonObject *output, const uint8_t *data, size_
         break;
       case TYPE_DOUBLE:
         if (remainBytes >= SIZE_DOUBLE) {
-          double value = read_double_le((uint8_t **)&current);
-          bson_object_put_double(&obj, key, value);
+          double value = 0;
+          current = load_double_le(current, &value);
+          parseError = !bson_object_put_double(&obj, key, value);
           remainBytes -= SIZE_DOUBLE;
         } else {
           parseError = true;
@@ -281,7 +798,7 @@ size_t bson_object_from_bytes_len(BsonObject *output, const uint8_t *data, size_
       case TYPE_BOOLEAN:
         if (remainBytes >= 1) {
           uint8_t value = *current;
-          bson_object_put_bool(&obj, key, value);
+          parseError = !bson_object_put_bool(&obj, key, value);
           current += 1;
           remainBytes -= 1;
         } else {
@@ -324,7 +841,7 @@ size_t bson_object_from_bytes_len(BsonObject *output, const uint8_t *data, size_
 char *bson_object_to_string(BsonObject *obj, char *out) {
   //TODO just move the pointer rather than keep a position variable
   int position = 0;
-  MapIterator iterator = emhashmap_iterator(&obj->data);
+  MapIterator iterator = emhashmap_iterator(obj->data);
   MapEntry *current = emhashmap_iterator_next(&iterator);
   position += sprintf(out, "{ ");
   while (current != NULL) {
@@ -333,12 +850,12 @@ char *bson_object_to_string(BsonObject *obj, char *out) {
     switch (element->type) {
       case TYPE_DOCUMENT: {
         char docString[512];
-        position += sprintf(&out[position], "%s", bson_object_to_string(bson_object_get_object(obj, current->key), docString));
+        position += sprintf(&out[position], "%s", bson_object_to_string((BsonObject *)element->value, docString));
         break;
       }
       case TYPE_ARRAY: {
         char docString[512];
-        position += sprintf(&out[position], "%s", bson_array_to_string(bson_object_get_array(obj, current->key), docString));
+        position += sprintf(&out[position], "%s", bson_array_to_string((BsonArray *)element->value, docString));
         break;
       }
       case TYPE_INT32: {
@@ -376,24 +893,83 @@ char *bson_object_to_string(BsonObject *obj, char *out) {
   return out;
 }
 
-bool bson_object_put_element(BsonObject *obj, const char *key, BsonElement *element, size_t allocSize) {
-  BsonElement *allocElement = malloc(sizeof(BsonElement));
-  allocElement->type = element->type;
-  allocElement->size = element->size;
-  allocElement->value = malloc(allocSize);
-  memcpy(allocElement->value, element->value, allocSize);
-  BsonElement *existingElement = emhashmap_remove(&obj->data, key);
-  if (existingElement != NULL) {
-    if (existingElement->type == TYPE_DOCUMENT) {
-      bson_object_deinitialize((BsonObject *)existingElement->value);
-    }
-    else if (existingElement->type == TYPE_ARRAY) {
-      bson_array_deinitialize((BsonArray *)existingElement->value);
-    }
-    free(existingElement->value);
+/*
+  @brief Put an already allocated element into a given object
+
+  @param obj - The object to be modified
+  @param key - The key used to reference the element
+  @param allocElement - The malloc()-ed element, freed along with the object.
+                        Ownership stays with the caller if the operation fails
+
+  @return - true if the element was set successfully, false if not
+*/
+static bool bson_object_put_allocated_element(BsonObject *obj, const char *key, BsonElement *allocElement) {
+  if (!bson_object_unshare(obj)) {
+    return false;
+  }
+
+  allocElement->dirty = true;
+  //Replace the value of an existing entry in place
+  MapEntry *existingEntry = emhashmap_get(obj->data, key);
+  if (existingEntry != NULL) {
+    BsonElement *existingElement = (BsonElement *)existingEntry->value;
+    bson_element_deinitialize(existingElement);
     free(existingElement);
+    existingEntry->value = allocElement;
+    if (obj->image != NULL) {
+      obj->image->dirty = true;
+    }
+    return true;
+  }
+  if (obj->image != NULL) {
+    obj->image->valid = false;
   }
-  return emhashmap_put(&obj->data, key, (void *)allocElement);
+  return emhashmap_put(obj->data, key, (void *)allocElement);
+}
+
+/*
+  @brief Put a new element into a given object, taking ownership of an already allocated value
+
+  @param obj - The object to be modified
+  @param key - The key used to reference the new element
+  @param type - The type of the element to be added
+  @param value - The malloc()-ed value of the element, freed along with the object.
+                 Ownership stays with the caller if the operation fails
+  @param elementSize - The size, in bytes, of the element when converted to BSON format
+
+  @return - true if the value was set successfully, false if not
+*/
+static bool bson_object_put_allocated(BsonObject *obj, const char *key, element_type type, void *value, size_t elementSize) {
+  BsonElement *allocElement = bson_object_allocate_element(false);
+  if (allocElement == NULL) {
+    return false;
+  }
+  allocElement->type = type;
+  allocElement->dirty = true;
+  allocElement->size = elementSize;
+  allocElement->value = value;
+  if (!bson_object_put_allocated_element(obj, key, allocElement)) {
+    free(allocElement);
+    return false;
+  }
+  return true;
+}
+
+bool bson_object_put_element(BsonObject *obj, const char *key, BsonElement *element, size_t allocSize) {
+  if (element->type == TYPE_STRING) {
+    //Short strings must be stored along with their element
+    return bson_object_put_string_len(obj, key, (const char *)element->value, element->size - STRING_OVERHEAD_BYTES);
+  }
+  void *value = malloc(allocSize);
+  if (value == NULL) {
+    return false;
+  }
+  memcpy(value, element->value, allocSize);
+  if (!bson_object_put_allocated(obj, key, element->type, value, element->size)) {
+    free(value);
+    return false;
+  }
+  return true;
 }
 
 bool bson_object_put(BsonObject *obj, const char *key, element_type type, void *value, size_t allocSize, size_t elementSize) {
@@ -412,6 +988,24 @@ bool bson_object_put_array(BsonObject *obj, const char *key, BsonArray *value) {
   return bson_object_put(obj, key, TYPE_ARRAY, value, sizeof(BsonArray), 0);
 }
 
+bool bson_object_put_object_owned(BsonObject *obj, const char *key, BsonObject *value) {
+  if (!bson_object_put_allocated(obj, key, TYPE_DOCUMENT, value, 0)) {
+    bson_object_deinitialize(value);
+    free(value);
+    return false;
+  }
+  return true;
+}
+
+bool bson_object_put_array_owned(BsonObject *obj, const char *key, BsonArray *value) {
+  if (!bson_object_put_allocated(obj, key, TYPE_ARRAY, value, 0)) {
+    bson_array_deinitialize(value);
+    free(value);
+    return false;
+  }
+  return true;
+}
+
 bool bson_object_put_int32(BsonObject *obj, const char *key, int32_t value) {
   return bson_object_put(obj, key, TYPE_INT32, &value, sizeof(int32_t),
                          SIZE_INT32);
@@ -423,8 +1017,48 @@ bool bson_object_put_int64(BsonObject *obj, const char *key, int64_t value) {
 }
 
 bool bson_object_put_string(BsonObject *obj, const char *key, char *value) {
-  return bson_object_put(obj, key, TYPE_STRING, value, (strlen(value) + 1) * sizeof(char),
-                         strlen(value) + STRING_OVERHEAD_BYTES);
+  return bson_object_put_string_len(obj, key, value, strlen(value));
+}
+
+bool bson_object_put_string_len(BsonObject *obj, const char *key, const char *value, size_t length) {
+  if (length < SHORT_STRING_SIZE) {
+    BsonElement *allocElement = bson_object_allocate_element(true);
+    if (allocElement == NULL) {
+      return false;
+    }
+    bson_element_initialize_string(allocElement, value, length, bson_object_short_string(allocElement));
+    if (!bson_object_put_allocated_element(obj, key, allocElement)) {
+      free(allocElement);
+      return false;
+    }
+    return true;
+  }
+  char *stringVal = malloc((length + 1) * sizeof(char));
+  if (stringVal == NULL) {
+    return false;
+  }
+  memcpy(stringVal, value, length);
+  stringVal[length] = 0x00;
+  return bson_object_put_string_len_owned(obj, key, stringVal, length);
+}
+
+bool bson_object_put_string_owned(BsonObject *obj, const char *key, char *value) {
+  return bson_object_put_string_len_owned(obj, key, value, strlen(value));
+}
+
+bool bson_object_put_string_len_owned(BsonObject *obj, const char *key, char *value, size_t length) {
+  BsonElement *allocElement = bson_object_allocate_element(length < SHORT_STRING_SIZE);
+  if (allocElement == NULL) {
+    free(value);
+    return false;
+  }
+  bson_element_initialize_string_owned(allocElement, value, length, bson_object_short_string(allocElement));
+  if (!bson_object_put_allocated_element(obj, key, allocElement)) {
+    bson_element_deinitialize(allocElement);
+    free(allocElement);
+    return false;
+  }
+  return true;
 }
 
 bool bson_object_put_bool(BsonObject *obj, const char *key, bson_boolean value) {
@@ -438,20 +1072,48 @@ bool bson_object_put_double(BsonObject *obj, const char *key, double value) {
 }
 
 BsonElement *bson_object_get(BsonObject *obj, const char *key) {
-  MapEntry *entry = emhashmap_get(&obj->data, key);
+  MapEntry *entry = emhashmap_get(obj->data, key);
   return (entry == NULL) ? NULL : entry->value;
 }
 
+/*
+  @brief Mark an element of an object as modified if the object keeps an image,
+  so that it is re-encoded the next time the object is encoded
+
+  @param obj - The object holding the element
+  @param element - The element which may be modified
+*/
+static void bson_object_mark_modified(BsonObject *obj, BsonElement *element) {
+  if (obj->image != NULL) {
+    element->dirty = true;
+    obj->image->dirty = true;
+  }
+}
+
 BsonObject *bson_object_get_object(BsonObject *obj, const char *key) {
+  //The returned object may be modified by the caller
+  if (!bson_object_unshare(obj)) {
+    return NULL;
+  }
   BsonElement *element = bson_object_get(obj, key);
-  return (element == NULL || element->type != TYPE_DOCUMENT) ? 
-          NULL : (BsonObject *)element->value;
+  if (element == NULL || element->type != TYPE_DOCUMENT) {
+    return NULL;
+  }
+  bson_object_mark_modified(obj, element);
+  return (BsonObject *)element->value;
 }
 
 BsonArray *bson_object_get_array(BsonObject *obj, const char *key) {
+  //The returned array may be modified by the caller
+  if (!bson_object_unshare(obj)) {
+    return NULL;
+  }
   BsonElement *element = bson_object_get(obj, key);
-  return (element == NULL || element->type != TYPE_ARRAY) ? 
-          NULL : (BsonArray *)element->value;
+  if (element == NULL || element->type != TYPE_ARRAY) {
+    return NULL;
+  }
+  bson_object_mark_modified(obj, element);
+  return (BsonArray *)element->value;
 }
 
 int32_t bson_object_get_int32(BsonObject *obj, const char *key) {
@@ -469,7 +1131,16 @@ int64_t bson_object_get_int64(BsonObject *obj, const char *key) {
 char *bson_object_get_string(BsonObject *obj, const char *key) {
   BsonElement *element = bson_object_get(obj, key);
   return (element == NULL || element->type != TYPE_STRING) ? 
-          NULL : (char *)element->value;
+          NULL : bson_element_get_string(element);
+}
+
+char *bson_object_get_string_len(BsonObject *obj, const char *key, size_t *length) {
+  BsonElement *element = bson_object_get(obj, key);
+  if (element == NULL || element->type != TYPE_STRING) {
+    return NULL;
+  }
+  *length = element->size - STRING_OVERHEAD_BYTES;
+  return bson_element_get_string(element);
 }
 
 bson_boolean bson_object_get_bool(BsonObject *obj, const char *key) {
@@ -485,7 +1156,7 @@ double bson_object_get_double(BsonObject *obj, const char *key) {
 }
 
 MapIterator bson_object_iterator(BsonObject *obj) {
-  return emhashmap_iterator(&obj->data);
+  return emhashmap_iterator(obj->data);
 }
 
 BsonObjectEntry bson_object_iterator_next(MapIterator *iterator) {
@@ -501,3 +1172,225 @@ BsonObjectEntry bson_object_iterator_next(MapIterator *iterator) {
   }
   return bsonEntry;
 }
+
+/*
+  @brief Calculate the number of bytes allocated for the value of an element
+
+  @param element - The element, which must not be a document, an array or a string
+
+  @return - The size of the element value in bytes, 0 if the type is not supported
+*/
+static size_t bson_element_value_size(BsonElement *element) {
+  switch (element->type) {
+    case TYPE_INT32:
+      return sizeof(int32_t);
+    case TYPE_INT64:
+      return sizeof(int64_t);
+    case TYPE_DOUBLE:
+      return sizeof(double);
+    case TYPE_BOOLEAN:
+      return sizeof(bson_boolean);
+    default:
+      return 0;
+  }
+}
+
+/*
+  @brief Initialize an element with a copy of the value of another element
+
+  @param output - The element to be initialized
+  @param element - The element to be copied
+  @param deep - true to clone sub-objects and sub-arrays, false to share them
+  @param shortString - Storage for a short string value (see bson_element_initialize_string())
+
+  @return - true if the element was copied successfully, false if not
+*/
+static bool bson_element_copy(BsonElement *output, BsonElement *element, bool deep, char *shortString) {
+  output->type = element->type;
+  output->size = element->size;
+  //Copies are not part of any image yet
+  output->dirty = true;
+  switch (element->type) {
+    case TYPE_DOCUMENT: {
+      BsonObject *value = malloc(sizeof(BsonObject));
+      if (value == NULL || 
+          !(deep ? bson_object_clone(value, (BsonObject *)element->value) :
+                   bson_object_share(value, (BsonObject *)element->value))) {
+        free(value);
+        return false;
+      }
+      output->value = value;
+      return true;
+    }
+    case TYPE_ARRAY: {
+      BsonArray *value = malloc(sizeof(BsonArray));
+      if (value == NULL || 
+          !(deep ? bson_array_clone(value, (BsonArray *)element->value) :
+                   bson_array_share(value, (BsonArray *)element->value))) {
+        free(value);
+        return false;
+      }
+      output->value = value;
+      return true;
+    }
+    case TYPE_STRING: {
+      return bson_element_initialize_string(output, bson_element_get_string(element), 
+                                            element->size - STRING_OVERHEAD_BYTES, shortString);
+    }
+    default: {
+      size_t valueSize = bson_element_value_size(element);
+      if (valueSize == 0) {
+        printf("Unrecognized BSON type: %i\n", element->type);
+        return false;
+      }
+      output->value = malloc(valueSize);
+      if (output->value == NULL) {
+        return false;
+      }
+      memcpy(output->value, element->value, valueSize);
+      return true;
+    }
+  }
+}
+
+bool bson_element_share(BsonElement *output, BsonElement *element, char *shortString) {
+  return bson_element_copy(output, element, false, shortString);
+}
+
+bool bson_element_clone(BsonElement *output, BsonElement *element, char *shortString) {
+  return bson_element_copy(output, element, true, shortString);
+}
+
+bool bson_element_to_buffer_canonical(BsonElement *element, uint8_t *buffer, size_t capacity, size_t *written) {
+  if (element->type == TYPE_DOCUMENT) {
+    return bson_object_to_buffer_canonical((BsonObject *)element->value, buffer, capacity, written);
+  }
+  if (element->type == TYPE_ARRAY) {
+    return bson_array_to_buffer_canonical((BsonArray *)element->value, buffer, capacity, written);
+  }
+  //Other values do not contain keys
+  return bson_element_to_buffer(element, buffer, capacity, written);
+}
+
+bool bson_element_to_buffer(BsonElement *element, uint8_t *buffer, size_t capacity, size_t *written) {
+  switch (element->type) {
+    case TYPE_DOCUMENT:
+      return bson_object_to_buffer((BsonObject *)element->value, buffer, capacity, written);
+    case TYPE_ARRAY:
+      return bson_array_to_buffer((BsonArray *)element->value, buffer, capacity, written);
+    case TYPE_INT32:
+    case TYPE_INT64:
+    case TYPE_STRING:
+    case TYPE_DOUBLE:
+    case TYPE_BOOLEAN:
+      *written = element->size;
+      break;
+    default:
+      printf("Unrecognized BSON type: %i\n", element->type);
+      *written = 0;
+      return false;
+  }
+  if (element->size > capacity) {
+    return false;
+  }
+
+  switch (element->type) {
+    case TYPE_INT32:
+      store_int32_le(buffer, *(int32_t *)element->value);
+      break;
+    case TYPE_INT64:
+      store_int64_le(buffer, *(int64_t *)element->value);
+      break;
+    case TYPE_STRING: {
+      //String length is stored with the element, the value may contain null characters
+      size_t stringLength = element->size - STRING_OVERHEAD_BYTES;
+      uint8_t *string = store_int32_le(buffer, (int32_t)(stringLength + 1));
+      memcpy(string, bson_element_get_string(element), stringLength);
+      string[stringLength] = 0x00;
+      break;
+    }
+    case TYPE_DOUBLE:
+      store_double_le(buffer, *(double *)element->value);
+      break;
+    default:
+      buffer[0] = (uint8_t)(*(bson_boolean *)element->value);
+  }
+  return true;
+}
+
+bool bson_element_to_stream(BsonElement *element, BsonStream *stream) {
+  switch (element->type) {
+    case TYPE_DOCUMENT:
+      return bson_object_to_stream((BsonObject *)element->value, stream);
+    case TYPE_ARRAY:
+      return bson_array_to_stream((BsonArray *)element->value, stream);
+    case TYPE_STRING: {
+      //Strings are passed through the chunk in pieces, however long they are
+      size_t stringLength = element->size - STRING_OVERHEAD_BYTES;
+      uint8_t length[SIZE_INT32];
+      size_t position = 0;
+      write_int32_le(length, (int32_t)(stringLength + 1), &position);
+      uint8_t end = 0x00;
+      return bson_stream_write(stream, length, SIZE_INT32) && 
+             bson_stream_write(stream, (uint8_t *)bson_element_get_string(element), stringLength) && 
+             bson_stream_write(stream, &end, 1);
+    }
+    default: {
+      uint8_t value[SIZE_INT64];
+      size_t written = 0;
+      return bson_element_to_buffer(element, value, sizeof(value), &written) && 
+             bson_stream_write(stream, value, written);
+    }
+  }
+}
+
+bool bson_element_initialize_string(BsonElement *element, const char *value, size_t length, char *shortString) {
+  element->type = TYPE_STRING;
+  element->dirty = true;
+  element->size = length + STRING_OVERHEAD_BYTES;
+  char *string = shortString;
+  if (length >= SHORT_STRING_SIZE) {
+    string = malloc((length + 1) * sizeof(char));
+    if (string == NULL) {
+      return false;
+    }
+  }
+  memcpy(string, value, length);
+  string[length] = 0x00;
+  element->value = string;
+  return true;
+}
+
+void bson_element_initialize_string_owned(BsonElement *element, char *value, size_t length, char *shortString) {
+  element->type = TYPE_STRING;
+  element->dirty = true;
+  element->size = length + STRING_OVERHEAD_BYTES;
+  if (length >= SHORT_STRING_SIZE) {
+    element->value = value;
+    return;
+  }
+  memcpy(shortString, value, length + 1);
+  free(value);
+  element->value = shortString;
+}
+
+bool bson_element_is_short_string(const BsonElement *element) {
+  return element->type == TYPE_STRING && element->size - STRING_OVERHEAD_BYTES < SHORT_STRING_SIZE;
+}
+
+char *bson_element_get_string(const BsonElement *element) {
+  return (char *)element->value;
+}
+
+void bson_element_deinitialize(BsonElement *element) {
+  if (element->type == TYPE_DOCUMENT) {
+    bson_object_deinitialize((BsonObject *)element->value);
+  }
+  else if (element->type == TYPE_ARRAY) {
+    bson_array_deinitialize((BsonArray *)element->value);
+  }
+  //Short strings are stored by the object or array holding the element
+  if (!bson_element_is_short_string(element)) {
+    free(element->value);
+  }
+}
\ No newline at end of file
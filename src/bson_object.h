@@ -13,23 +13,64 @@ typedef struct BsonArray BsonArray;
 typedef enum element_type element_type;
 typedef enum bson_boolean bson_boolean;
 
+//The last BSON representation of an object, kept to re-encode the object incrementally
+//(see bson_object_keep_image())
+struct BsonObjectImage {
+  //The encoded object
+  uint8_t *bytes;
+  //Size of the encoded object in bytes
+  size_t size;
+  //The current maximum number of bytes in the buffer
+  size_t capacity;
+  //Whether the image has the same keys in the same order as the object,
+  //false until the object is first encoded and whenever a key is added
+  bool valid;
+  //Whether any element of the object has been modified since the image was encoded
+  bool dirty;
+};
+typedef struct BsonObjectImage BsonObjectImage;
+
 struct BsonObject {
-  //Internal map implementation
-  HashMap data;
+  //Internal map implementation, may be shared with other objects (see bson_object_share())
+  HashMap *data;
+  //Number of objects sharing data, NULL if data has never been shared
+  size_t *refCount;
+  //Last encoded representation of this object, NULL unless bson_object_keep_image() was called
+  BsonObjectImage *image;
+  //Replaced with a new version number whenever the object is modified, or a sub-object or
+  //sub-array is retrieved for modification (see bson_encoding_cache_encode())
+  uint64_t version;
 };
 typedef struct BsonObject BsonObject;
 
 struct BsonElement {
-  //The value of this element
+  //The value of this element. String values shorter than SHORT_STRING_SIZE are not allocated
+  //separately, but stored by the object or array holding the element (see bson_element_is_short_string())
   void *value;
   //The data type of this element
   element_type type;
+  //Whether the value has been replaced since the image of the object holding it was encoded,
+  //only used by objects which keep an image (see bson_object_keep_image())
+  bool dirty;
   //Size of the element in bytes when converted to BSON 
   //Unused for TYPE_DOCUMENT and TYPE_ARRAY
   size_t size;
 };
 typedef struct BsonElement BsonElement;
 
+//Caller-owned storage for an element read from an array without modifying the array
+//(see bson_array_get_element()). The values of packed arrays and the objects of columnar arrays
+//are not stored as elements, so they are described here instead
+struct BsonElementSlot {
+  //Element describing a packed value or an object of a columnar array
+  BsonElement element;
+  //Object built from the columns of a columnar array, only valid if hasRow is true
+  BsonObject row;
+  //Whether row holds an object, which is freed when the slot is used again or deinitialized
+  bool hasRow;
+};
+typedef struct BsonElementSlot BsonElementSlot;
+
 struct BsonObjectEntry {
   char key[255];
   BsonElement *element;
@@ -66,6 +107,38 @@ bool bson_object_initialize_default(BsonObject *obj);
 */
 void bson_object_deinitialize(BsonObject *obj);
 
+/*
+  @brief Create a new object which shares the contents of a given object.
+  This takes constant time, the contents are only copied when either object is modified.
+  Modifying a shared object copies only the object itself, its sub-objects and
+  sub-arrays stay shared until they are modified in turn. Sub-objects and sub-arrays
+  reached through bson_object_get_object() and bson_object_get_array() can therefore
+  be modified freely, while values reached through bson_object_get() or an iterator
+  must be treated as read-only.
+
+  Shared objects must not be used from multiple threads at the same time.
+  The image kept by obj, if any, is encoded in full the next time and is not shared with output
+  (see bson_object_keep_image()).
+
+  @param output - The uninitialized BSON object to be created, it must be deinitalized
+                  separately from obj
+  @param obj - The BSON object to be shared
+
+  @return - true if the object was shared successfully, false if not
+*/
+bool bson_object_share(BsonObject *output, BsonObject *obj);
+/*
+  @brief Create a deep copy of a given object, including all of its sub-objects and sub-arrays.
+  The copy has the same capacity as obj, and its keys are copied without being hashed again
+
+  @param output - The uninitialized BSON object to be created, it must be deinitalized
+                  separately from obj
+  @param obj - The BSON object to be copied
+
+  @return - true if the object was copied successfully, false if not
+*/
+bool bson_object_clone(BsonObject *output, BsonObject *obj);
+
 /*
   @brief Calculate the size, in bytes, of a given object when converted to a BSON document
 
@@ -84,6 +157,99 @@ size_t bson_object_size(BsonObject *obj);
   this data must be freed by the caller after use
 */
 uint8_t *bson_object_to_bytes(BsonObject *obj);
+/*
+  @brief Write the BSON representation of an object into a given buffer. The whole object,
+  including its sub-objects and sub-arrays, is written in a single pass, and lengths are
+  filled in once each document is complete. No memory is allocated
+
+  @param obj - The object to be converted to BSON
+  @param buffer - The buffer into which the object is written
+  @param capacity - The size of the buffer in bytes
+  @param written - On success, set to the number of bytes written. If the buffer is too small,
+                   set to the size required for the object. Set to 0 if the object contains an
+                   element which cannot be converted
+
+  @return - true if the object was written, false if not. The contents of the buffer
+  are undefined on failure
+*/
+bool bson_object_to_buffer(BsonObject *obj, uint8_t *buffer, size_t capacity, size_t *written);
+/*
+  @brief Keep the BSON representation of an object each time it is encoded, so that
+  later encodings only re-encode the values which have changed since. Replacing the value
+  of an existing key marks only that value as modified, and values of the same size are
+  patched directly into the kept image. Adding a key causes the next encoding to be done
+  in full. bson_object_to_bytes() uses the image once it is kept.
+
+  Sub-objects and sub-arrays are only known to be modified when they are reached through
+  bson_object_get_object() or bson_object_get_array() after the image is encoded, so
+  pointers to them must not be kept across encodings. Sub-objects which keep an image of
+  their own are re-encoded incrementally as well.
+
+  @param obj - The object whose representation is to be kept
+
+  @return - true if the image can be kept, false if it could not be allocated
+*/
+bool bson_object_keep_image(BsonObject *obj);
+/*
+  @brief Get the BSON representation of an object which keeps an image (see bson_object_keep_image()),
+  re-encoding only the values which have been modified since it was last encoded
+
+  @param obj - The object to be converted to BSON
+  @param size - Set to the size of the BSON representation in bytes
+
+  @return - The BSON representation, which is owned by the object and valid until the object
+  is modified or encoded again. NULL if the object does not keep an image or could not be converted
+*/
+const uint8_t *bson_object_get_image(BsonObject *obj, size_t *size);
+/*
+  @brief Get the canonical BSON represention of an object, in which the keys of the object and
+  of every sub-object are written in sorted order. Objects with the same keys and values
+  always produce the same bytes, regardless of the order in which their keys were added,
+  so the result can be hashed or compared directly
+
+  @param obj - The object to be converted to BSON
+
+  @return - A byte array containing the canonical BSON representation of the object,
+  this data must be freed by the caller after use
+*/
+uint8_t *bson_object_to_bytes_canonical(BsonObject *obj);
+/*
+  @brief Write the canonical BSON representation of an object into a given buffer
+  (see bson_object_to_bytes_canonical() and bson_object_to_buffer()). Memory is only allocated
+  to sort the keys of objects with more than CANONICAL_STACK_KEYS keys
+
+  @param obj - The object to be converted to BSON
+  @param buffer - The buffer into which the object is written
+  @param capacity - The size of the buffer in bytes
+  @param written - Set as described for bson_object_to_buffer()
+
+  @return - true if the object was written, false if not. The contents of the buffer
+  are undefined on failure
+*/
+bool bson_object_to_buffer_canonical(BsonObject *obj, uint8_t *buffer, size_t capacity, size_t *written);
+/*
+  @brief Write the BSON representation of an object in fixed-size chunks, which are passed
+  to a callback as soon as they are full. Only one chunk is held in memory at a time
+
+  @param obj - The object to be converted to BSON
+  @param sink - The callback which receives every chunk
+  @param context - Passed to every call of sink
+  @param chunkSize - The size in bytes of every chunk apart from the last one
+
+  @return - true if the whole object was written, false if the callback stopped the stream
+  or the object could not be converted
+*/
+bool bson_object_write_stream(BsonObject *obj, BsonStreamSink sink, void *context, size_t chunkSize);
+/*
+  @brief Write the BSON representation of an object to an open stream (see bson_object_write_stream()).
+  The size of every nested document and array is measured when it is started
+
+  @param obj - The object to be converted to BSON
+  @param stream - The stream to be written to, which is not flushed
+
+  @return - true if the object was written, false if not
+*/
+bool bson_object_to_stream(BsonObject *obj, BsonStream *stream);
 /*
   @brief Parse BSON data into an object
 
@@ -142,6 +308,34 @@ bool bson_object_put_object(BsonObject *obj, const char *key, BsonObject *value)
   @return - true if the value was set successfully, false if not
 */
 bool bson_object_put_array(BsonObject *obj, const char *key, BsonArray *value);
+/*
+  @brief Put a heap-allocated BSON object into a given object without copying it
+
+  @param obj - The object to be modified
+  @param key - The key used to reference the new object 
+               (if it matches an existing key, 
+               the associated value will be overwritten)
+  @param value - The malloc()-ed BSON object to be added to the object. The object takes
+                 ownership of value, which is deinitialized and freed along with obj,
+                 or immediately if the operation fails
+
+  @return - true if the value was set successfully, false if not
+*/
+bool bson_object_put_object_owned(BsonObject *obj, const char *key, BsonObject *value);
+/*
+  @brief Put a heap-allocated BSON array into a given object without copying it
+
+  @param obj - The object to be modified
+  @param key - The key used to reference the new array 
+               (if it matches an existing key, 
+               the associated value will be overwritten)
+  @param value - The malloc()-ed BSON array to be added to the object. The object takes
+                 ownership of value, which is deinitialized and freed along with obj,
+                 or immediately if the operation fails
+
+  @return - true if the value was set successfully, false if not
+*/
+bool bson_object_put_array_owned(BsonObject *obj, const char *key, BsonArray *value);
 /*
   @brief Put a new 32-bit integer value into a given object
 
@@ -178,6 +372,51 @@ bool bson_object_put_int64(BsonObject *obj, const char *key, int64_t value);
   @return - true if the value was set successfully, false if not
 */
 bool bson_object_put_string(BsonObject *obj, const char *key, char *value);
+/*
+  @brief Put a new string value of a known length into a given object
+
+  @param obj - The object to be modified
+  @param key - The key used to reference the new string value 
+               (if it matches an existing key, 
+               the associated value will be overwritten)
+  @param value - The string value to be added to the object, may contain null characters
+  @param length - The length of value in bytes, not including a terminating null character
+
+  @return - true if the value was set successfully, false if not
+*/
+bool bson_object_put_string_len(BsonObject *obj, const char *key, const char *value, size_t length);
+/*
+  @brief Put a heap-allocated string value into a given object without copying it.
+  Values shorter than SHORT_STRING_SIZE are copied next to their element and freed instead
+
+  @param obj - The object to be modified
+  @param key - The key used to reference the new string value 
+               (if it matches an existing key, 
+               the associated value will be overwritten)
+  @param value - The malloc()-ed, null-terminated string value to be added to the object.
+                 The object takes ownership of value, which is freed along with obj,
+                 or immediately if the operation fails
+
+  @return - true if the value was set successfully, false if not
+*/
+bool bson_object_put_string_owned(BsonObject *obj, const char *key, char *value);
+/*
+  @brief Put a heap-allocated string value of a known length into a given object without copying it.
+  Values shorter than SHORT_STRING_SIZE are copied next to their element and freed instead
+
+  @param obj - The object to be modified
+  @param key - The key used to reference the new string value 
+               (if it matches an existing key, 
+               the associated value will be overwritten)
+  @param value - The malloc()-ed string value to be added to the object, may contain null
+                 characters and must have a null character at value[length].
+                 The object takes ownership of value, which is freed along with obj,
+                 or immediately if the operation fails
+  @param length - The length of value in bytes, not including the terminating null character
+
+  @return - true if the value was set successfully, false if not
+*/
+bool bson_object_put_string_len_owned(BsonObject *obj, const char *key, char *value, size_t length);
 /*
   @brief Put a new boolean value into a given object
 
@@ -217,7 +456,9 @@ bool bson_object_put_double(BsonObject *obj, const char *key, double value);
 */
 BsonElement *bson_object_get(BsonObject *obj, const char *key);
 /*
-  @brief Retrieve the BSON object to which the specified key is mapped in an object
+  @brief Retrieve the BSON object to which the specified key is mapped in an object.
+  If obj shares its contents with another object, its contents are copied first 
+  so the returned object can be modified
 
   @param obj - The object to be accessed
   @param key - The key associated with the object to be retrieved
@@ -226,7 +467,9 @@ BsonElement *bson_object_get(BsonObject *obj, const char *key);
 */
 BsonObject *bson_object_get_object(BsonObject *obj, const char *key);
 /*
-  @brief Retrieve the BSON array to which the specified key is mapped in an object
+  @brief Retrieve the BSON array to which the specified key is mapped in an object.
+  If obj shares its contents with another object, its contents are copied first 
+  so the returned array can be modified
 
   @param obj - The object to be accessed
   @param key - The key associated with the array to be retrieved
@@ -258,9 +501,21 @@ int64_t bson_object_get_int64(BsonObject *obj, const char *key);
   @param obj - The object to be accessed
   @param key - The key associated with the string value to be retrieved
 
-  @return - The string value mapped to the given key if it exists, NULL otherwise
+  @return - The string value mapped to the given key if it exists, NULL otherwise.
+  The value is not moved when other values are put into the object, however short it is
 */
 char *bson_object_get_string(BsonObject *obj, const char *key);
+/*
+  @brief Retrieve the string value and its length to which the specified key is mapped in an object
+
+  @param obj - The object to be accessed
+  @param key - The key associated with the string value to be retrieved
+  @param length - Set to the length of the string in bytes, not including the terminating null character
+
+  @return - The string value mapped to the given key if it exists, NULL otherwise.
+            The value is always null-terminated, but may also contain null characters
+*/
+char *bson_object_get_string_len(BsonObject *obj, const char *key, size_t *length);
 /*
   @brief Retrieve the boolean value to which the specified key is mapped in an object
 
@@ -299,6 +554,116 @@ MapIterator bson_object_iterator(BsonObject *obj);
 */
 BsonObjectEntry bson_object_iterator_next(MapIterator *iterator);
 
+/*
+  @brief Initialize an element with a copy of the value of another element.
+  Sub-objects and sub-arrays are not copied, but shared with bson_object_share()
+  and bson_array_share()
+
+  @param output - The element to be initialized
+  @param element - The element to be copied
+  @param shortString - Storage of SHORT_STRING_SIZE bytes for the value if element is a short
+                       string (see bson_element_is_short_string()), unused otherwise
+
+  @return - true if the element was copied successfully, false if not
+*/
+bool bson_element_share(BsonElement *output, BsonElement *element, char *shortString);
+/*
+  @brief Initialize an element with a deep copy of the value of another element,
+  including all of its sub-objects and sub-arrays
+
+  @param output - The element to be initialized
+  @param element - The element to be copied
+  @param shortString - Storage of SHORT_STRING_SIZE bytes for the value if element is a short
+                       string (see bson_element_is_short_string()), unused otherwise
+
+  @return - true if the element was copied successfully, false if not
+*/
+bool bson_element_clone(BsonElement *output, BsonElement *element, char *shortString);
+/*
+  @brief Write the BSON representation of the value of an element into a given buffer,
+  without its type and key (see bson_object_to_buffer())
+
+  @param element - The element whose value is to be converted to BSON
+  @param buffer - The buffer into which the value is written
+  @param capacity - The size of the buffer in bytes
+  @param written - On success, set to the number of bytes written. If the buffer is too small,
+                   set to the size required for the value. Set to 0 if the value cannot be converted
+
+  @return - true if the value was written, false if not
+*/
+bool bson_element_to_buffer(BsonElement *element, uint8_t *buffer, size_t capacity, size_t *written);
+/*
+  @brief Write the value of an element into a given buffer, with the keys of sub-objects
+  in sorted order (see bson_object_to_bytes_canonical())
+
+  @param element - The element to be converted to BSON
+  @param buffer - The buffer into which the value is written
+  @param capacity - The size of the buffer in bytes
+  @param written - Set as described for bson_element_to_buffer()
+
+  @return - true if the value was written, false if not
+*/
+bool bson_element_to_buffer_canonical(BsonElement *element, uint8_t *buffer, size_t capacity, size_t *written);
+/*
+  @brief Write the BSON representation of the value of an element to an open stream,
+  without its type and key (see bson_object_to_stream())
+
+  @param element - The element whose value is to be converted to BSON
+  @param stream - The stream to be written to
+
+  @return - true if the value was written, false if not
+*/
+bool bson_element_to_stream(BsonElement *element, BsonStream *stream);
+/*
+  @brief Initialize a string element with a copy of a given value. Values shorter than
+  SHORT_STRING_SIZE are copied into the given storage instead of a separate allocation
+
+  @param element - The element to be initialized
+  @param value - The string value to be copied, may contain null characters
+  @param length - The length of value in bytes, not including a terminating null character
+  @param shortString - Storage of SHORT_STRING_SIZE bytes, which must not move while the element
+                       is used and is not freed along with it. Unused if length is not shorter
+                       than SHORT_STRING_SIZE
+
+  @return - true if the element was initialized successfully, false if not
+*/
+bool bson_element_initialize_string(BsonElement *element, const char *value, size_t length, char *shortString);
+/*
+  @brief Initialize a string element, taking ownership of an already allocated value.
+  Values shorter than SHORT_STRING_SIZE are copied into the given storage and freed
+
+  @param element - The element to be initialized
+  @param value - The malloc()-ed, null-terminated string value
+  @param length - The length of value in bytes, not including the terminating null character
+  @param shortString - Storage for short values, as described for bson_element_initialize_string()
+*/
+void bson_element_initialize_string_owned(BsonElement *element, char *value, size_t length, char *shortString);
+/*
+  @brief Check whether the value of an element is a string shorter than SHORT_STRING_SIZE,
+  which is stored by the object or array holding the element rather than allocated separately
+
+  @param element - The element to be checked
+
+  @return - true if the element holds a short string, false if not
+*/
+bool bson_element_is_short_string(const BsonElement *element);
+/*
+  @brief Get the value of a string element. The value stays at the same address until
+  the element is removed or replaced, however short it is
+
+  @param element - The string element
+
+  @return - The null-terminated string value
+*/
+char *bson_element_get_string(const BsonElement *element);
+/*
+  @brief Free the value of an element, recursively cleaning up sub-objects and sub-arrays.
+  The element itself is not freed
+
+  @param element - The element whose value is to be freed
+*/
+void bson_element_deinitialize(BsonElement *element);
+
 #ifdef __cplusplus
 }
 #endif
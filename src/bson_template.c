@@ -0,0 +1,262 @@
+#include "bson_template.h"
+
+/*
+  @brief Find the element with a given key in an encoded document
+
+  @param bytes - The encoded message
+  @param document - Position of the document to be searched
+  @param key - The key to be found, which does not need to be null-terminated
+  @param keyLength - The length of key in bytes
+
+  @return - Position of the element, 0 if the key was not found
+*/
+static size_t bson_template_find_key(uint8_t *bytes, size_t document, const char *key, size_t keyLength) {
+  size_t position = document + SIZE_INT32;
+  while (bytes[position] != DOCUMENT_END) {
+    const char *elementKey = (const char *)&bytes[position + ELEMENT_OVERHEAD_BYTES];
+    size_t elementKeyLength = strlen(elementKey);
+    if (elementKeyLength == keyLength && memcmp(elementKey, key, keyLength) == 0) {
+      return position;
+    }
+    size_t valueStart = position + ELEMENT_OVERHEAD_BYTES + elementKeyLength + 1;
+    position = valueStart + encoded_value_size((element_type)bytes[position], &bytes[valueStart]);
+  }
+  return 0;
+}
+
+/*
+  @brief Locate the value designated by a slot key in the message of a template,
+  recording the documents on its path
+
+  @param tmpl - The template, whose parents must have room for every document on the path
+  @param slotKey - The path of the value, with keys separated by '.'
+  @param slot - The slot to be filled in
+
+  @return - true if the value was found and can be replaced, false if not
+*/
+static bool bson_template_locate_slot(BsonTemplate *tmpl, const char *slotKey, BsonTemplateSlot *slot) {
+  slot->firstParent = tmpl->parentCount;
+  slot->parentCount = 0;
+  size_t document = 0;
+  const char *key = slotKey;
+  while (true) {
+    const char *separator = strchr(key, '.');
+    size_t keyLength = (separator != NULL) ? (size_t)(separator - key) : strlen(key);
+    tmpl->parents[tmpl->parentCount++] = document;
+    slot->parentCount++;
+    size_t position = bson_template_find_key(tmpl->bytes, document, key, keyLength);
+    if (position == 0) {
+      printf("The key \"%s\" of a template slot was not found\n", slotKey);
+      return false;
+    }
+    element_type type = (element_type)tmpl->bytes[position];
+    size_t valueStart = position + ELEMENT_OVERHEAD_BYTES + keyLength + 1;
+    if (separator == NULL) {
+      switch (type) {
+        case TYPE_INT32:
+        case TYPE_INT64:
+        case TYPE_DOUBLE:
+        case TYPE_BOOLEAN:
+        case TYPE_STRING:
+          break;
+        default:
+          printf("Values of BSON type %i cannot be used as template slots\n", type);
+          return false;
+      }
+      slot->type = type;
+      slot->offset = valueStart;
+      slot->size = encoded_value_size(type, &tmpl->bytes[valueStart]);
+      return true;
+    }
+    if (type != TYPE_DOCUMENT && type != TYPE_ARRAY) {
+      printf("The key \"%s\" of a template slot was not found\n", slotKey);
+      return false;
+    }
+    document = valueStart;
+    key = separator + 1;
+  }
+}
+
+bool bson_template_initialize(BsonTemplate *tmpl, BsonObject *obj, const char *const *slotKeys, size_t slotCount) {
+  tmpl->slots = NULL;
+  tmpl->slotCount = 0;
+  tmpl->parents = NULL;
+  tmpl->parentCount = 0;
+  tmpl->bytes = bson_object_to_bytes(obj);
+  if (tmpl->bytes == NULL) {
+    return false;
+  }
+  uint8_t *length = tmpl->bytes;
+  tmpl->size = (size_t)read_int32_le(&length);
+  tmpl->capacity = tmpl->size;
+
+  //Every slot needs one parent for each key on its path
+  size_t maxParents = 0;
+  size_t i = 0;
+  for (i = 0; i < slotCount; i++) {
+    const char *separator = slotKeys[i];
+    maxParents++;
+    while ((separator = strchr(separator, '.')) != NULL) {
+      maxParents++;
+      separator++;
+    }
+  }
+  tmpl->slots = malloc(sizeof(BsonTemplateSlot) * (slotCount + 1));
+  tmpl->parents = malloc(sizeof(size_t) * (maxParents + 1));
+  if (tmpl->slots == NULL || tmpl->parents == NULL) {
+    bson_template_deinitialize(tmpl);
+    return false;
+  }
+  for (i = 0; i < slotCount; i++) {
+    if (!bson_template_locate_slot(tmpl, slotKeys[i], &tmpl->slots[i])) {
+      bson_template_deinitialize(tmpl);
+      return false;
+    }
+    //Slots sharing a value would be left at stale offsets when one of them is resized
+    size_t j = 0;
+    for (j = 0; j < i; j++) {
+      if (tmpl->slots[j].offset == tmpl->slots[i].offset) {
+        printf("The key \"%s\" is used by more than one template slot\n", slotKeys[i]);
+        bson_template_deinitialize(tmpl);
+        return false;
+      }
+    }
+    tmpl->slotCount++;
+  }
+  return true;
+}
+
+void bson_template_deinitialize(BsonTemplate *tmpl) {
+  free(tmpl->bytes);
+  free(tmpl->slots);
+  free(tmpl->parents);
+}
+
+/*
+  @brief Get a slot of a template, checking that it holds values of a given type
+
+  @param tmpl - The template
+  @param slot - The number of the slot
+  @param type - The type of value to be written to the slot
+
+  @return - The slot, NULL if it does not exist or has another type
+*/
+static BsonTemplateSlot *bson_template_get_slot(BsonTemplate *tmpl, size_t slot, element_type type) {
+  if (slot >= tmpl->slotCount || tmpl->slots[slot].type != type) {
+    printf("Template slot %i does not hold a value of BSON type %i\n", (int)slot, type);
+    return NULL;
+  }
+  return &tmpl->slots[slot];
+}
+
+bool bson_template_set_int32(BsonTemplate *tmpl, size_t slot, int32_t value) {
+  BsonTemplateSlot *target = bson_template_get_slot(tmpl, slot, TYPE_INT32);
+  if (target == NULL) {
+    return false;
+  }
+  size_t position = target->offset;
+  write_int32_le(tmpl->bytes, value, &position);
+  return true;
+}
+
+bool bson_template_set_int64(BsonTemplate *tmpl, size_t slot, int64_t value) {
+  BsonTemplateSlot *target = bson_template_get_slot(tmpl, slot, TYPE_INT64);
+  if (target == NULL) {
+    return false;
+  }
+  size_t position = target->offset;
+  write_int64_le(tmpl->bytes, value, &position);
+  return true;
+}
+
+bool bson_template_set_double(BsonTemplate *tmpl, size_t slot, double value) {
+  BsonTemplateSlot *target = bson_template_get_slot(tmpl, slot, TYPE_DOUBLE);
+  if (target == NULL) {
+    return false;
+  }
+  size_t position = target->offset;
+  write_double_le(tmpl->bytes, value, &position);
+  return true;
+}
+
+bool bson_template_set_bool(BsonTemplate *tmpl, size_t slot, bson_boolean value) {
+  BsonTemplateSlot *target = bson_template_get_slot(tmpl, slot, TYPE_BOOLEAN);
+  if (target == NULL) {
+    return false;
+  }
+  tmpl->bytes[target->offset] = (uint8_t)value;
+  return true;
+}
+
+bool bson_template_set_string(BsonTemplate *tmpl, size_t slot, const char *value) {
+  return bson_template_set_string_len(tmpl, slot, value, strlen(value));
+}
+
+/*
+  @brief Change the size of a value in the message of a template, moving everything after it
+
+  @param tmpl - The template to be modified
+  @param target - The slot holding the value
+  @param newSize - The new size of the value in bytes
+
+  @return - true if the value was resized, false if the message could not be grown
+*/
+static bool bson_template_resize_slot(BsonTemplate *tmpl, BsonTemplateSlot *target, size_t newSize) {
+  size_t end = target->offset + target->size;
+  size_t newMessageSize = tmpl->size - target->size + newSize;
+  if (newMessageSize > tmpl->capacity) {
+    size_t newCapacity = (tmpl->capacity * 2 > newMessageSize) ? tmpl->capacity * 2 : newMessageSize;
+    uint8_t *newBytes = realloc(tmpl->bytes, newCapacity);
+    if (newBytes == NULL) {
+      return false;
+    }
+    tmpl->bytes = newBytes;
+    tmpl->capacity = newCapacity;
+  }
+  memmove(&tmpl->bytes[target->offset + newSize], &tmpl->bytes[end], tmpl->size - end);
+
+  //The lengths of the enclosing documents come before the value, so they have not moved
+  size_t p = 0;
+  for (p = target->firstParent; p < target->firstParent + target->parentCount; p++) {
+    uint8_t *length = &tmpl->bytes[tmpl->parents[p]];
+    size_t documentSize = (size_t)read_int32_le(&length) - target->size + newSize;
+    size_t position = tmpl->parents[p];
+    write_int32_le(tmpl->bytes, (int32_t)documentSize, &position);
+  }
+  //Values and documents after the modified value have moved
+  size_t i = 0;
+  for (i = 0; i < tmpl->slotCount; i++) {
+    if (tmpl->slots[i].offset > target->offset) {
+      tmpl->slots[i].offset = tmpl->slots[i].offset - target->size + newSize;
+    }
+  }
+  for (p = 0; p < tmpl->parentCount; p++) {
+    if (tmpl->parents[p] > target->offset) {
+      tmpl->parents[p] = tmpl->parents[p] - target->size + newSize;
+    }
+  }
+  tmpl->size = newMessageSize;
+  target->size = newSize;
+  return true;
+}
+
+bool bson_template_set_string_len(BsonTemplate *tmpl, size_t slot, const char *value, size_t length) {
+  BsonTemplateSlot *target = bson_template_get_slot(tmpl, slot, TYPE_STRING);
+  if (target == NULL) {
+    return false;
+  }
+  size_t newSize = STRING_OVERHEAD_BYTES + length;
+  if (newSize != target->size && !bson_template_resize_slot(tmpl, target, newSize)) {
+    return false;
+  }
+  size_t position = target->offset;
+  write_int32_le(tmpl->bytes, (int32_t)(length + 1), &position);
+  memcpy(&tmpl->bytes[position], value, length);
+  tmpl->bytes[position + length] = 0x00;
+  return true;
+}
+
+const uint8_t *bson_template_get_bytes(BsonTemplate *tmpl, size_t *size) {
+  *size = tmpl->size;
+  return tmpl->bytes;
+}
@@ -0,0 +1,148 @@
+#ifndef BSON_TEMPLATE_H
+#define BSON_TEMPLATE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "bson_object.h"
+
+//A value of a template which can be replaced without encoding the rest of the message again
+struct BsonTemplateSlot {
+  //The type of the value, which cannot be changed
+  element_type type;
+  //Position of the value in the encoded message
+  size_t offset;
+  //Size of the value in bytes, including the length and null character of strings
+  size_t size;
+  //Index in the parents of the template of the documents enclosing the value, outermost first
+  size_t firstParent;
+  //Number of documents enclosing the value, including the message itself
+  size_t parentCount;
+};
+typedef struct BsonTemplateSlot BsonTemplateSlot;
+
+//Pre-encoded message in which the values of a few designated keys can be replaced in place
+struct BsonTemplate {
+  //The encoded message, which always holds the latest value of every slot
+  uint8_t *bytes;
+  //Size of the encoded message in bytes
+  size_t size;
+  //The current maximum number of bytes in the buffer
+  size_t capacity;
+  //The replaceable values, in the order their keys were given
+  BsonTemplateSlot *slots;
+  //Number of slots
+  size_t slotCount;
+  //Positions of the lengths of the documents enclosing each slot, which change with string slots
+  size_t *parents;
+  //Number of positions in parents
+  size_t parentCount;
+};
+typedef struct BsonTemplate BsonTemplate;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  @brief Encode an object into a template in which the values of the given keys can be replaced.
+  Slots are numbered in the order of their keys
+
+  @param tmpl - The uninitialized template
+  @param obj - The object holding the fixed structure and the initial value of every slot
+  @param slotKeys - The keys of the replaceable values. Values in sub-objects and sub-arrays
+                    are designated by joining the keys on their path with '.', e.g. "params.id".
+                    Every value must be a 32-bit integer, 64-bit integer, double, boolean or string,
+                    and may only be designated by one key
+  @param slotCount - The number of keys in slotKeys
+
+  @return - true if the template was created, false if a key was not found, designates
+  a value of an unsupported type or designates the same value as another key
+*/
+bool bson_template_initialize(BsonTemplate *tmpl, BsonObject *obj, const char *const *slotKeys, size_t slotCount);
+/*
+  @brief Free the message and slots of a template
+
+  @param tmpl - The template to be deinitialized
+*/
+void bson_template_deinitialize(BsonTemplate *tmpl);
+
+/*
+  @brief Replace the value of a 32-bit integer slot
+
+  @param tmpl - The template to be modified
+  @param slot - The number of the slot
+  @param value - The new value
+
+  @return - true if the value was replaced, false if the slot does not exist or has another type
+*/
+bool bson_template_set_int32(BsonTemplate *tmpl, size_t slot, int32_t value);
+/*
+  @brief Replace the value of a 64-bit integer slot
+
+  @param tmpl - The template to be modified
+  @param slot - The number of the slot
+  @param value - The new value
+
+  @return - true if the value was replaced, false if the slot does not exist or has another type
+*/
+bool bson_template_set_int64(BsonTemplate *tmpl, size_t slot, int64_t value);
+/*
+  @brief Replace the value of a double slot
+
+  @param tmpl - The template to be modified
+  @param slot - The number of the slot
+  @param value - The new value
+
+  @return - true if the value was replaced, false if the slot does not exist or has another type
+*/
+bool bson_template_set_double(BsonTemplate *tmpl, size_t slot, double value);
+/*
+  @brief Replace the value of a boolean slot
+
+  @param tmpl - The template to be modified
+  @param slot - The number of the slot
+  @param value - The new value
+
+  @return - true if the value was replaced, false if the slot does not exist or has another type
+*/
+bool bson_template_set_bool(BsonTemplate *tmpl, size_t slot, bson_boolean value);
+/*
+  @brief Replace the value of a string slot with a null-terminated string
+
+  @param tmpl - The template to be modified
+  @param slot - The number of the slot
+  @param value - The new value
+
+  @return - true if the value was replaced, false if the slot does not exist or has another type
+*/
+bool bson_template_set_string(BsonTemplate *tmpl, size_t slot, const char *value);
+/*
+  @brief Replace the value of a string slot. The rest of the message is moved if the length
+  of the string changes, and the lengths of the enclosing documents are updated
+
+  @param tmpl - The template to be modified
+  @param slot - The number of the slot
+  @param value - The new value, may contain null characters
+  @param length - The length of value in bytes, not including a terminating null character
+
+  @return - true if the value was replaced, false if the slot does not exist, has another type
+  or the message could not be grown
+*/
+bool bson_template_set_string_len(BsonTemplate *tmpl, size_t slot, const char *value, size_t length);
+
+/*
+  @brief Get the message with the current value of every slot
+
+  @param tmpl - The template
+  @param size - Set to the size of the message in bytes
+
+  @return - The BSON data, which is owned by the template and valid until a slot is modified
+*/
+const uint8_t *bson_template_get_bytes(BsonTemplate *tmpl, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,71 +1,40 @@
 #include "bson_util.h"
+#include <stdatomic.h>
+
+//Last version number returned by bson_next_version()
+static atomic_uint_fast64_t lastVersion = 0;
 
 void write_int32_le(uint8_t *bytes, int32_t value, size_t *position) {
-  int i = 0;
-  for (i = 0; i < SIZE_INT32; i++) {
-    bytes[(*position)++] = (uint8_t)value & 0x000000FF;
-    value >>= 8;
-  }
+  store_int32_le(&bytes[*position], value);
+  (*position) += SIZE_INT32;
 }
 
 void write_int64_le(uint8_t *bytes, int64_t value, size_t *position) {
-  int i = 0;
-  for (i = 0; i < SIZE_INT64; i++) {
-    bytes[(*position)++] = (uint8_t)value & 0x000000FFull;
-    value >>= 8;
-  }
+  store_int64_le(&bytes[*position], value);
+  (*position) += SIZE_INT64;
 }
 
 void write_double_le(uint8_t *bytes, double value, size_t *position) {
-  union doubleUnion_t {
-    double value;
-    uint64_t intValue;
-  };
-  union doubleUnion_t unionVal;
-  unionVal.value = value;
-  int i = 0;
-  for (i = 0; i < SIZE_DOUBLE; i++) {
-    bytes[(*position)++] = (uint8_t)unionVal.intValue & 0x000000FFull;
-    unionVal.intValue >>= 8;
-  }
+  store_double_le(&bytes[*position], value);
+  (*position) += SIZE_DOUBLE;
 }
 
 int32_t read_int32_le(uint8_t **bytes) {
   int32_t value = 0;
-  int i = 0;
-  for (i = SIZE_INT32 - 1; i >= 0; i--) {
-    value <<= 8;
-    value += (*bytes)[i];
-  }
-  (*bytes) += SIZE_INT32;
+  *bytes = (uint8_t *)load_int32_le(*bytes, &value);
   return value;
 }
 
 int64_t read_int64_le(uint8_t **bytes) {
   int64_t value = 0;
-  int i = 0;
-  for (i = SIZE_INT64 - 1; i >= 0; i--) {
-    value <<= 8;
-    value += (*bytes)[i];
-  }
-  (*bytes) += SIZE_INT64;
+  *bytes = (uint8_t *)load_int64_le(*bytes, &value);
   return value;
 }
 
 double read_double_le(uint8_t **bytes) {
-  union doubleUnion_t {
-    double value;
-    uint64_t intValue;
-  };
-  union doubleUnion_t unionVal;
-  unionVal.intValue = 0;
-  int i = 0;
-  for (i = SIZE_DOUBLE - 1; i >= 0; i--) {
-    unionVal.intValue <<= 8;
-    unionVal.intValue += (*bytes)[i];
-  }
-  (*bytes) += SIZE_DOUBLE;
-  return unionVal.value;
+  double value = 0;
+  *bytes = (uint8_t *)load_double_le(*bytes, &value);
+  return value;
 }
 
 size_t read_string_len(char **output, const uint8_t **data, size_t *dataSize) {
@@ -81,6 +50,9 @@ size_t read_string_len(char **output, const uint8_t **data, size_t *dataSize) {
   }
 
   *output = byte_array_to_bson_string((uint8_t *)*data, i);
+  if (*output == NULL) {
+    return 0;
+  }
 
   // add 1 since we also consumed '\0' at the end
   size_t bytesRead = i + 1;
@@ -89,9 +61,26 @@ size_t read_string_len(char **output, const uint8_t **data, size_t *dataSize) {
   return bytesRead;
 }
 
+size_t skip_string_len(const uint8_t **data, size_t *dataSize) {
+  const uint8_t *end = memchr(*data, 0x00, *dataSize);
+  if (end == NULL) {
+    // '\0' is not found
+    return 0;
+  }
+
+  // add 1 since we also consumed '\0' at the end
+  size_t bytesRead = (size_t)(end - *data) + 1;
+  (*data) += bytesRead;
+  *dataSize -= bytesRead;
+  return bytesRead;
+}
+
 uint8_t *string_to_byte_array(char *stringVal) {
   size_t length = strlen(stringVal);
   uint8_t *bytes = malloc(length + 1);
+  if (bytes == NULL) {
+    return NULL;
+  }
   int i = 0;
   for (i = 0; i < length; i++) {
     bytes[i] = (uint8_t)stringVal[i];
@@ -115,7 +104,10 @@ char *byte_array_to_string(uint8_t *bytes) {
 
 char *byte_array_to_bson_string(uint8_t *bytes, size_t length) {
   char *stringVal = malloc(sizeof(char) * (length + 1));
-  
+  if (stringVal == NULL) {
+    return NULL;
+  }
+
   int i = 0;
   for (i = 0; i < length; i++) {
     stringVal[i] = (char)(bytes[i] & 0xFF);
@@ -127,6 +119,9 @@ char *byte_array_to_bson_string(uint8_t *bytes, size_t length) {
 uint8_t *index_to_key(size_t index) {
   size_t length = digits(index);
   uint8_t *bytes = malloc(length);
+  if (bytes == NULL) {
+    return NULL;
+  }
   size_t modValue = index;
   int i = 0;
   for (i = (int)length - 1; i >= 0; i--) {
@@ -137,6 +132,42 @@ uint8_t *index_to_key(size_t index) {
   return bytes;
 }
 
+#define INDEX_KEYS_10(prefix) \
+  prefix "0", prefix "1", prefix "2", prefix "3", prefix "4", \
+  prefix "5", prefix "6", prefix "7", prefix "8", prefix "9"
+#define INDEX_KEYS_100(prefix) \
+  INDEX_KEYS_10(prefix "0"), INDEX_KEYS_10(prefix "1"), INDEX_KEYS_10(prefix "2"), \
+  INDEX_KEYS_10(prefix "3"), INDEX_KEYS_10(prefix "4"), INDEX_KEYS_10(prefix "5"), \
+  INDEX_KEYS_10(prefix "6"), INDEX_KEYS_10(prefix "7"), INDEX_KEYS_10(prefix "8"), \
+  INDEX_KEYS_10(prefix "9")
+
+//Keys of the indices 0 to 999
+static const char indexKeyTable[INDEX_KEY_TABLE_SIZE][4] = {
+  INDEX_KEYS_10(""),
+  INDEX_KEYS_10("1"), INDEX_KEYS_10("2"), INDEX_KEYS_10("3"), INDEX_KEYS_10("4"), 
+  INDEX_KEYS_10("5"), INDEX_KEYS_10("6"), INDEX_KEYS_10("7"), INDEX_KEYS_10("8"), 
+  INDEX_KEYS_10("9"),
+  INDEX_KEYS_100("1"), INDEX_KEYS_100("2"), INDEX_KEYS_100("3"), INDEX_KEYS_100("4"), 
+  INDEX_KEYS_100("5"), INDEX_KEYS_100("6"), INDEX_KEYS_100("7"), INDEX_KEYS_100("8"), 
+  INDEX_KEYS_100("9")
+};
+
+const char *index_key(size_t index, char *buffer, size_t *length) {
+  if (index < INDEX_KEY_TABLE_SIZE) {
+    *length = (index < 10) ? 1 : (index < 100) ? 2 : 3;
+    return indexKeyTable[index];
+  }
+  //Write the digits backwards from the end of the buffer
+  char *key = &buffer[INDEX_KEY_BUFFER_SIZE - 1];
+  *key = 0x00;
+  do {
+    *(--key) = (char)('0' + index % 10);
+    index /= 10;
+  } while (index > 0);
+  *length = (size_t)(&buffer[INDEX_KEY_BUFFER_SIZE - 1] - key);
+  return key;
+}
+
 size_t object_key_size(char *key) {
   return strlen(key) + 1;
 }
@@ -146,6 +177,67 @@ size_t array_key_size(size_t index) {
   return digits(index) + 1;
 }
 
+size_t encoded_value_size(element_type type, uint8_t *value) {
+  switch (type) {
+    case TYPE_INT32:
+      return SIZE_INT32;
+    case TYPE_INT64:
+      return SIZE_INT64;
+    case TYPE_DOUBLE:
+      return SIZE_DOUBLE;
+    case TYPE_BOOLEAN:
+      return SIZE_BOOLEAN;
+    case TYPE_STRING:
+      return SIZE_INT32 + (size_t)read_int32_le(&value);
+    case TYPE_DOCUMENT:
+    case TYPE_ARRAY:
+      //Documents and arrays start with their total size
+      return (size_t)read_int32_le(&value);
+    default:
+      return 0;
+  }
+}
+
+bool bson_stream_initialize(BsonStream *stream, BsonStreamSink sink, void *context, size_t chunkSize) {
+  stream->sink = sink;
+  stream->context = context;
+  stream->chunkSize = chunkSize;
+  stream->used = 0;
+  stream->failed = false;
+  stream->chunk = (chunkSize > 0) ? malloc(chunkSize) : NULL;
+  return stream->chunk != NULL;
+}
+
+void bson_stream_deinitialize(BsonStream *stream) {
+  free(stream->chunk);
+}
+
+bool bson_stream_write(BsonStream *stream, const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  while (length > 0 && !stream->failed) {
+    size_t copied = stream->chunkSize - stream->used;
+    if (copied > length) {
+      copied = length;
+    }
+    memcpy(&stream->chunk[stream->used], bytes, copied);
+    stream->used += copied;
+    bytes += copied;
+    length -= copied;
+    if (stream->used == stream->chunkSize) {
+      bson_stream_flush(stream);
+    }
+  }
+  return !stream->failed;
+}
+
+bool bson_stream_flush(BsonStream *stream) {
+  if (stream->used > 0 && !stream->failed) {
+    stream->failed = !stream->sink(stream->context, stream->chunk, stream->used);
+    stream->used = 0;
+  }
+  return !stream->failed;
+}
+
 size_t digits(size_t value) {
   size_t modValue = value;
   size_t numDigits = 1;
@@ -155,3 +247,7 @@ size_t digits(size_t value) {
   }
   return numDigits;
 }
+
+uint64_t bson_next_version(void) {
+  return (uint64_t)atomic_fetch_add_explicit(&lastVersion, 1, memory_order_relaxed) + 1;
+}
@@ -1,6 +1,7 @@
 #ifndef BSON_UTIL_H
 #define BSON_UTIL_H
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -14,6 +15,10 @@
 #define ELEMENT_OVERHEAD_BYTES 1
 //4 bytes for length, one for ending null character
 #define STRING_OVERHEAD_BYTES 5
+//Maximum number of bytes, including the ending null character, of a string value stored
+//along with its element rather than in a separate allocation. Such strings are stored right after
+//the elements of objects, and in storage of their own by arrays, so that they are never moved
+#define SHORT_STRING_SIZE 16
 
 //Sizes in bytes of each primitive type, as defined by the BSON spec
 #define SIZE_INT32 4
@@ -24,6 +29,25 @@
 //Last byte in a BSON document
 #define DOCUMENT_END 0x00
 
+//Whether the host stores the most significant byte of a value first, as reported by the compiler.
+//Can be defined by the build for compilers which do not report it. BSON values are always little endian
+#ifndef BSON_BIG_ENDIAN
+#if defined(__BIG_ENDIAN__) || \
+    (defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define BSON_BIG_ENDIAN 1
+#else
+#define BSON_BIG_ENDIAN 0
+#endif
+#endif
+
+//Number of array indices whose keys are stored in a precomputed table, see index_key()
+#define INDEX_KEY_TABLE_SIZE 1000
+//Size of a buffer that can hold the key of any array index, including the null character
+#define INDEX_KEY_BUFFER_SIZE 21
+//Number of keys which are sorted on the stack when writing canonical BSON,
+//larger documents allocate a single array of keys to be sorted
+#define CANONICAL_STACK_KEYS 16
+
 //Byte which defines the type of a value as defined in the BSON spec
 enum element_type {
   TYPE_DOUBLE = 0x01,
@@ -58,10 +82,166 @@ enum bson_boolean {
 };
 typedef enum bson_boolean bson_boolean;
 
+/*
+  @brief Callback which receives the output of a streaming serializer, one chunk at a time
+
+  @param context - The context given when the stream was initialized
+  @param data - The bytes of the chunk, which are only valid during the call
+  @param length - The number of bytes in the chunk
+
+  @return - true to continue, false to stop serializing
+*/
+typedef bool (*BsonStreamSink)(void *context, const uint8_t *data, size_t length);
+
+//Output of a streaming serializer, which collects bytes into a single fixed-size chunk
+//and passes it to a callback whenever it is full
+struct BsonStream {
+  //Callback which receives every chunk
+  BsonStreamSink sink;
+  //Context passed to the callback
+  void *context;
+  //Bytes which have not been passed to the callback yet
+  uint8_t *chunk;
+  //Size of each chunk in bytes
+  size_t chunkSize;
+  //Number of bytes currently in the chunk
+  size_t used;
+  //Whether the callback stopped the stream, after which nothing more is written
+  bool failed;
+};
+typedef struct BsonStream BsonStream;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if BSON_BIG_ENDIAN
+/*
+  @brief Reverse the bytes of a 32-bit value
+
+  @param value - The value to be converted
+
+  @return - value with its bytes in the opposite order
+*/
+static inline uint32_t bson_bswap32(uint32_t value) {
+  return (value >> 24) | ((value >> 8) & 0x0000FF00u) | ((value << 8) & 0x00FF0000u) | (value << 24);
+}
+/*
+  @brief Reverse the bytes of a 64-bit value
+
+  @param value - The value to be converted
+
+  @return - value with its bytes in the opposite order
+*/
+static inline uint64_t bson_bswap64(uint64_t value) {
+  return ((uint64_t)bson_bswap32((uint32_t)value) << 32) | bson_bswap32((uint32_t)(value >> 32));
+}
+#endif
+
+/*
+  @brief Store a 32-bit integer value in little endian byte order. The value is copied with
+  a single unaligned store, preceded by a byte swap on big endian hosts
+
+  @param bytes - Where the value is written, need not be aligned
+  @param value - The integer value to be written
+
+  @return - Pointer to the byte following the written value
+*/
+static inline uint8_t *store_int32_le(uint8_t *bytes, int32_t value) {
+  uint32_t raw = (uint32_t)value;
+#if BSON_BIG_ENDIAN
+  raw = bson_bswap32(raw);
+#endif
+  memcpy(bytes, &raw, SIZE_INT32);
+  return bytes + SIZE_INT32;
+}
+/*
+  @brief Store a 64-bit integer value in little endian byte order (see store_int32_le())
+
+  @param bytes - Where the value is written, need not be aligned
+  @param value - The integer value to be written
+
+  @return - Pointer to the byte following the written value
+*/
+static inline uint8_t *store_int64_le(uint8_t *bytes, int64_t value) {
+  uint64_t raw = (uint64_t)value;
+#if BSON_BIG_ENDIAN
+  raw = bson_bswap64(raw);
+#endif
+  memcpy(bytes, &raw, SIZE_INT64);
+  return bytes + SIZE_INT64;
+}
+/*
+  @brief Store a 64-bit floating-point value in little endian byte order (see store_int32_le())
+
+  @param bytes - Where the value is written, need not be aligned
+  @param value - The floating-point value to be written
+
+  @return - Pointer to the byte following the written value
+*/
+static inline uint8_t *store_double_le(uint8_t *bytes, double value) {
+  uint64_t raw = 0;
+  memcpy(&raw, &value, SIZE_DOUBLE);
+#if BSON_BIG_ENDIAN
+  raw = bson_bswap64(raw);
+#endif
+  memcpy(bytes, &raw, SIZE_DOUBLE);
+  return bytes + SIZE_DOUBLE;
+}
+
+/*
+  @brief Load a little endian 32-bit integer value. The value is copied with
+  a single unaligned load, followed by a byte swap on big endian hosts
+
+  @param bytes - Where the value is read from, need not be aligned
+  @param value - Set to the value that was read
+
+  @return - Pointer to the byte following the value that was read
+*/
+static inline const uint8_t *load_int32_le(const uint8_t *bytes, int32_t *value) {
+  uint32_t raw = 0;
+  memcpy(&raw, bytes, SIZE_INT32);
+#if BSON_BIG_ENDIAN
+  raw = bson_bswap32(raw);
+#endif
+  *value = (int32_t)raw;
+  return bytes + SIZE_INT32;
+}
+/*
+  @brief Load a little endian 64-bit integer value (see load_int32_le())
+
+  @param bytes - Where the value is read from, need not be aligned
+  @param value - Set to the value that was read
+
+  @return - Pointer to the byte following the value that was read
+*/
+static inline const uint8_t *load_int64_le(const uint8_t *bytes, int64_t *value) {
+  uint64_t raw = 0;
+  memcpy(&raw, bytes, SIZE_INT64);
+#if BSON_BIG_ENDIAN
+  raw = bson_bswap64(raw);
+#endif
+  *value = (int64_t)raw;
+  return bytes + SIZE_INT64;
+}
+/*
+  @brief Load a little endian 64-bit floating-point value (see load_int32_le())
+
+  @param bytes - Where the value is read from, need not be aligned
+  @param value - Set to the value that was read
+
+  @return - Pointer to the byte following the value that was read
+*/
+static inline const uint8_t *load_double_le(const uint8_t *bytes, double *value) {
+  uint64_t raw = 0;
+  memcpy(&raw, bytes, SIZE_DOUBLE);
+#if BSON_BIG_ENDIAN
+  raw = bson_bswap64(raw);
+#endif
+  memcpy(value, &raw, SIZE_DOUBLE);
+  return bytes + SIZE_DOUBLE;
+}
+
 /*
   @brief Write a little endian 32-bit integer value to a given buffer
 
@@ -129,16 +309,32 @@ double read_double_le(uint8_t **bytes);
                     indicate the remaining data size in the buffer.
 
   @return - On success, a positive number of bytes read (including last '\0')
-            is returned. On failure, 0 is returned.
+            is returned. On failure, including failure to allocate the output, 0 is returned.
 */
 size_t read_string_len(char **output, const uint8_t **data, size_t *dataSize);
 
+/*
+  @brief Skip over a string in given buffer without copying it and return number of bytes skipped.
+         Update "data" and "dataSize" parameters on success.
+
+  @param data - Pointer to the byte buffer from which to read. On success, this
+                 value will be advanced past the string.
+  @param dataSize - Pointer to a value that indicates the size of data in the
+                    byte buffer. On success, this value will be decreased to
+                    indicate the remaining data size in the buffer.
+
+  @return - On success, a positive number of bytes skipped (including last '\0')
+            is returned. On failure, 0 is returned.
+*/
+size_t skip_string_len(const uint8_t **data, size_t *dataSize);
+
 /*
   @brief Convert the give UTF-8 string into a byte array
 
   @param stringVal - the string value to be converted
 
-  @return - The byte array representation of the string, must be freed by the caller after use
+  @return - The byte array representation of the string, must be freed by the caller after use.
+  NULL if it could not be allocated
 */
 uint8_t *string_to_byte_array(char *stringVal);
 /*
@@ -146,7 +342,7 @@ uint8_t *string_to_byte_array(char *stringVal);
 
   @param bytes - The byte array to be converted
 
-  @return The converted string
+  @return The converted string, NULL if it could not be allocated
 */
 char *byte_array_to_string(uint8_t *bytes);
 /*
@@ -155,7 +351,7 @@ char *byte_array_to_string(uint8_t *bytes);
   @param bytes - The byte array to be converted
   @param length - The length of the array to be converted
 
-  @return The converted string (may include null characters)
+  @return The converted string (may include null characters), NULL if it could not be allocated
 */
 char *byte_array_to_bson_string(uint8_t *bytes, size_t length);
 
@@ -164,9 +360,22 @@ char *byte_array_to_bson_string(uint8_t *bytes, size_t length);
 
   @param index - The index to be converted
 
-  @return - A byte array containing the BSON key representation of index, must be freed by the caller after use
+  @return - A byte array containing the BSON key representation of index, must be freed by the caller after use.
+  NULL if it could not be allocated
 */
 uint8_t *index_to_key(size_t index);
+/*
+  @brief Get the BSON key of an array index without allocating memory.
+  Keys of the first INDEX_KEY_TABLE_SIZE indices are taken from a precomputed table,
+  others are written to buffer
+
+  @param index - The index to be converted
+  @param buffer - Storage for the key, at least INDEX_KEY_BUFFER_SIZE bytes
+  @param length - Set to the number of digits in the key, not including the null character
+
+  @return - The null-terminated key, which must not be modified
+*/
+const char *index_key(size_t index, char *buffer, size_t *length);
 
 /*
   @brief Calculate the size, in bytes, of a BSON object key
@@ -184,6 +393,51 @@ size_t object_key_size(char *key);
   @return - The size of the BSON array key, in bytes
 */
 size_t array_key_size(size_t index);
+/*
+  @brief Calculate the size, in bytes, of a value which has already been converted to BSON
+
+  @param type - The type of the value
+  @param value - The first byte of the BSON representation of the value
+
+  @return - The size of the value in bytes, 0 if the type is not recognized
+*/
+size_t encoded_value_size(element_type type, uint8_t *value);
+
+/*
+  @brief Initialize a stream with an empty chunk
+
+  @param stream - The uninitialized stream
+  @param sink - The callback which receives every chunk
+  @param context - Passed to every call of sink
+  @param chunkSize - The size in bytes of every chunk apart from the last one
+
+  @return - true if the stream was initialized successfully, false if not
+*/
+bool bson_stream_initialize(BsonStream *stream, BsonStreamSink sink, void *context, size_t chunkSize);
+/*
+  @brief Free the chunk of a stream, discarding any bytes which were not flushed
+
+  @param stream - The stream to be deinitialized
+*/
+void bson_stream_deinitialize(BsonStream *stream);
+/*
+  @brief Append bytes to a stream, passing every chunk that is filled to its callback
+
+  @param stream - The stream to be written to
+  @param data - The bytes to be written
+  @param length - The number of bytes
+
+  @return - true if the bytes were written, false if the callback stopped the stream
+*/
+bool bson_stream_write(BsonStream *stream, const void *data, size_t length);
+/*
+  @brief Pass the bytes remaining in the chunk of a stream to its callback
+
+  @param stream - The stream to be flushed
+
+  @return - true if the stream was flushed, false if the callback stopped the stream
+*/
+bool bson_stream_flush(BsonStream *stream);
 
 /*
   @brief Calculate the number of decimal digits in a given integer value
@@ -194,6 +448,14 @@ size_t array_key_size(size_t index);
 */
 size_t digits(size_t value);
 
+/*
+  @brief Get a version number which has never been returned before, from any thread.
+  Objects and arrays take a new version whenever they may be modified
+
+  @return - The version number, never 0
+*/
+uint64_t bson_next_version(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,290 @@
+#include "bson_writer.h"
+
+bool bson_writer_initialize(BsonWriter *writer, size_t initialCapacity) {
+  writer->size = 0;
+  writer->capacity = initialCapacity;
+  writer->bytes = malloc(initialCapacity);
+  writer->containers = malloc(sizeof(BsonWriterContainer) * BSON_WRITER_INITIAL_DEPTH);
+  writer->depth = 0;
+  writer->maxDepth = (writer->containers != NULL) ? BSON_WRITER_INITIAL_DEPTH : 0;
+  return (writer->bytes != NULL || initialCapacity == 0) && writer->containers != NULL;
+}
+
+void bson_writer_deinitialize(BsonWriter *writer) {
+  free(writer->bytes);
+  free(writer->containers);
+}
+
+void bson_writer_reset(BsonWriter *writer) {
+  writer->size = 0;
+  writer->depth = 0;
+}
+
+/*
+  @brief Make sure there is room for more bytes at the end of the buffer of a writer
+
+  @param writer - The writer to be modified
+  @param additional - The number of bytes to be written
+
+  @return - true if the buffer can hold the additional bytes, false if it could not be grown
+*/
+static bool bson_writer_reserve(BsonWriter *writer, size_t additional) {
+  if (additional <= writer->capacity - writer->size) {
+    return true;
+  }
+  size_t newCapacity = (writer->capacity == 0) ? 64 : writer->capacity * 2;
+  if (newCapacity < writer->size + additional) {
+    newCapacity = writer->size + additional;
+  }
+  uint8_t *newBytes = realloc(writer->bytes, newCapacity);
+  if (newBytes == NULL) {
+    return false;
+  }
+  writer->bytes = newBytes;
+  writer->capacity = newCapacity;
+  return true;
+}
+
+/*
+  @brief Write the type and key of a new value in the current container
+
+  @param writer - The writer to be appended to
+  @param type - The type of the value
+  @param key - The key of the value, ignored inside arrays where the index of the value is used
+  @param valueSize - The number of bytes to be reserved for the value
+
+  @return - true if the value can be written, false if there is no open container
+  or the buffer could not be grown
+*/
+static bool bson_writer_begin_value(BsonWriter *writer, element_type type, const char *key, size_t valueSize) {
+  if (writer->depth == 0) {
+    printf("Values can only be written inside a document\n");
+    return false;
+  }
+  BsonWriterContainer *container = &writer->containers[writer->depth - 1];
+  char keyBuffer[INDEX_KEY_BUFFER_SIZE];
+  size_t keyLength = 0;
+  if (container->isArray) {
+    key = index_key(container->count, keyBuffer, &keyLength);
+  }
+  else if (key != NULL) {
+    keyLength = strlen(key);
+  }
+  else {
+    printf("Values inside a document must have a key\n");
+    return false;
+  }
+  if (!bson_writer_reserve(writer, ELEMENT_OVERHEAD_BYTES + keyLength + 1 + valueSize)) {
+    return false;
+  }
+  writer->bytes[writer->size++] = (uint8_t)type;
+  //Key is copied along with its null character
+  memcpy(&writer->bytes[writer->size], key, keyLength + 1);
+  writer->size += keyLength + 1;
+  container->count++;
+  return true;
+}
+
+/*
+  @brief Open a new container, leaving room for its length
+
+  @param writer - The writer to be appended to
+  @param isArray - Whether the container is an array
+
+  @return - true if the container was opened, false if the writer could not be grown
+*/
+static bool bson_writer_push(BsonWriter *writer, bool isArray) {
+  if (writer->depth == writer->maxDepth) {
+    size_t newDepth = (writer->maxDepth == 0) ? BSON_WRITER_INITIAL_DEPTH : writer->maxDepth * 2;
+    BsonWriterContainer *newContainers = realloc(writer->containers, sizeof(BsonWriterContainer) * newDepth);
+    if (newContainers == NULL) {
+      return false;
+    }
+    writer->containers = newContainers;
+    writer->maxDepth = newDepth;
+  }
+  if (!bson_writer_reserve(writer, SIZE_INT32)) {
+    return false;
+  }
+  BsonWriterContainer *container = &writer->containers[writer->depth++];
+  container->start = writer->size;
+  container->count = 0;
+  container->isArray = isArray;
+  writer->size += SIZE_INT32;
+  return true;
+}
+
+/*
+  @brief Close the current container, filling in its length
+
+  @param writer - The writer to be appended to
+
+  @return - true if the container was closed, false if the writer could not be grown
+*/
+static bool bson_writer_pop(BsonWriter *writer) {
+  if (!bson_writer_reserve(writer, 1)) {
+    return false;
+  }
+  writer->bytes[writer->size++] = DOCUMENT_END;
+  size_t position = writer->containers[--writer->depth].start;
+  write_int32_le(writer->bytes, (int32_t)(writer->size - position), &position);
+  return true;
+}
+
+bool bson_writer_begin_document(BsonWriter *writer) {
+  if (writer->depth != 0) {
+    printf("A document was started before the previous document was ended\n");
+    return false;
+  }
+  return bson_writer_push(writer, false);
+}
+
+bool bson_writer_end_document(BsonWriter *writer) {
+  if (writer->depth != 1) {
+    printf("Attempted to end a document which has not been started or has open containers\n");
+    return false;
+  }
+  return bson_writer_pop(writer);
+}
+
+bool bson_writer_begin_object(BsonWriter *writer, const char *key) {
+  size_t start = writer->size;
+  if (!bson_writer_begin_value(writer, TYPE_DOCUMENT, key, 0)) {
+    return false;
+  }
+  if (!bson_writer_push(writer, false)) {
+    writer->size = start;
+    writer->containers[writer->depth - 1].count--;
+    return false;
+  }
+  return true;
+}
+
+bool bson_writer_end_object(BsonWriter *writer) {
+  if (writer->depth < 2 || writer->containers[writer->depth - 1].isArray) {
+    printf("Attempted to end a nested document which has not been started\n");
+    return false;
+  }
+  return bson_writer_pop(writer);
+}
+
+bool bson_writer_begin_array(BsonWriter *writer, const char *key) {
+  size_t start = writer->size;
+  if (!bson_writer_begin_value(writer, TYPE_ARRAY, key, 0)) {
+    return false;
+  }
+  if (!bson_writer_push(writer, true)) {
+    writer->size = start;
+    writer->containers[writer->depth - 1].count--;
+    return false;
+  }
+  return true;
+}
+
+bool bson_writer_end_array(BsonWriter *writer) {
+  if (writer->depth < 2 || !writer->containers[writer->depth - 1].isArray) {
+    printf("Attempted to end an array which has not been started\n");
+    return false;
+  }
+  return bson_writer_pop(writer);
+}
+
+bool bson_writer_append_int32(BsonWriter *writer, const char *key, int32_t value) {
+  if (!bson_writer_begin_value(writer, TYPE_INT32, key, SIZE_INT32)) {
+    return false;
+  }
+  store_int32_le(&writer->bytes[writer->size], value);
+  writer->size += SIZE_INT32;
+  return true;
+}
+
+bool bson_writer_append_int64(BsonWriter *writer, const char *key, int64_t value) {
+  if (!bson_writer_begin_value(writer, TYPE_INT64, key, SIZE_INT64)) {
+    return false;
+  }
+  store_int64_le(&writer->bytes[writer->size], value);
+  writer->size += SIZE_INT64;
+  return true;
+}
+
+bool bson_writer_append_string(BsonWriter *writer, const char *key, const char *value) {
+  return bson_writer_append_string_len(writer, key, value, strlen(value));
+}
+
+bool bson_writer_append_string_len(BsonWriter *writer, const char *key, const char *value, size_t length) {
+  if (!bson_writer_begin_value(writer, TYPE_STRING, key, SIZE_INT32 + length + 1)) {
+    return false;
+  }
+  write_int32_le(writer->bytes, (int32_t)(length + 1), &writer->size);
+  memcpy(&writer->bytes[writer->size], value, length);
+  writer->size += length;
+  writer->bytes[writer->size++] = 0x00;
+  return true;
+}
+
+bool bson_writer_append_bool(BsonWriter *writer, const char *key, bson_boolean value) {
+  if (!bson_writer_begin_value(writer, TYPE_BOOLEAN, key, SIZE_BOOLEAN)) {
+    return false;
+  }
+  writer->bytes[writer->size++] = (uint8_t)value;
+  return true;
+}
+
+bool bson_writer_append_double(BsonWriter *writer, const char *key, double value) {
+  if (!bson_writer_begin_value(writer, TYPE_DOUBLE, key, SIZE_DOUBLE)) {
+    return false;
+  }
+  store_double_le(&writer->bytes[writer->size], value);
+  writer->size += SIZE_DOUBLE;
+  return true;
+}
+
+/*
+  @brief Append an existing object or array to the current container. It is written into the
+  remaining space of the buffer first, which is only grown if the value does not fit
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param element - Element describing the object or array to be written
+
+  @return - true if the value was written, false if not
+*/
+static bool bson_writer_append_element(BsonWriter *writer, const char *key, BsonElement *element) {
+  size_t start = writer->size;
+  if (!bson_writer_begin_value(writer, element->type, key, 0)) {
+    return false;
+  }
+  size_t written = 0;
+  if (!bson_element_to_buffer(element, &writer->bytes[writer->size], writer->capacity - writer->size, &written) &&
+      (written == 0 || !bson_writer_reserve(writer, written) ||
+       !bson_element_to_buffer(element, &writer->bytes[writer->size], writer->capacity - writer->size, &written))) {
+    writer->size = start;
+    writer->containers[writer->depth - 1].count--;
+    return false;
+  }
+  writer->size += written;
+  return true;
+}
+
+bool bson_writer_append_object(BsonWriter *writer, const char *key, BsonObject *value) {
+  BsonElement element;
+  element.type = TYPE_DOCUMENT;
+  element.value = value;
+  return bson_writer_append_element(writer, key, &element);
+}
+
+bool bson_writer_append_array(BsonWriter *writer, const char *key, BsonArray *value) {
+  BsonElement element;
+  element.type = TYPE_ARRAY;
+  element.value = value;
+  return bson_writer_append_element(writer, key, &element);
+}
+
+const uint8_t *bson_writer_get_bytes(BsonWriter *writer, size_t *size) {
+  if (writer->depth != 0) {
+    printf("Attempted to get the bytes of a writer before its document was ended\n");
+    return NULL;
+  }
+  *size = writer->size;
+  return writer->bytes;
+}
@@ -0,0 +1,217 @@
+#ifndef BSON_WRITER_H
+#define BSON_WRITER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "bson_object.h"
+
+//Number of nested containers a writer has room for when it is initialized, more are added as needed
+#define BSON_WRITER_INITIAL_DEPTH 4
+
+//A document or array which has been started but not yet ended
+struct BsonWriterContainer {
+  //Position of the length of the container, which is filled in when the container ends
+  size_t start;
+  //Number of values written to the container, used as the key of the next value in an array
+  size_t count;
+  //Whether the container is an array
+  bool isArray;
+};
+typedef struct BsonWriterContainer BsonWriterContainer;
+
+//Builder which writes BSON data sequentially, without creating a BsonObject
+struct BsonWriter {
+  //The BSON data written so far, which may be moved when the buffer grows
+  uint8_t *bytes;
+  //Number of bytes written
+  size_t size;
+  //The current maximum number of bytes in the buffer
+  size_t capacity;
+  //Stack of the containers that are open, the last one receives new values
+  BsonWriterContainer *containers;
+  //Number of open containers
+  size_t depth;
+  //The current maximum number of open containers
+  size_t maxDepth;
+};
+typedef struct BsonWriter BsonWriter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  @brief Initialize a BSON writer with an empty buffer. Writing documents which fit in the
+  buffer and have at most BSON_WRITER_INITIAL_DEPTH levels of nesting does not allocate memory
+
+  @param writer - The uninitialized writer
+  @param initialCapacity - The initial size of the buffer in bytes, which grows as needed
+
+  @return - true if the writer was initialized successfully, false if not
+*/
+bool bson_writer_initialize(BsonWriter *writer, size_t initialCapacity);
+/*
+  @brief Free the buffer of a BSON writer
+
+  @param writer - The writer to be deinitialized
+*/
+void bson_writer_deinitialize(BsonWriter *writer);
+/*
+  @brief Discard everything written so far, keeping the buffer for the next document
+
+  @param writer - The writer to be reset
+*/
+void bson_writer_reset(BsonWriter *writer);
+
+/*
+  @brief Start a top-level document. Documents may be written one after another into the same buffer
+
+  @param writer - The writer, which must not have any open containers
+
+  @return - true if the document was started, false if not
+*/
+bool bson_writer_begin_document(BsonWriter *writer);
+/*
+  @brief End the top-level document, filling in its length
+
+  @param writer - The writer, whose only open container must be the top-level document
+
+  @return - true if the document was ended, false if not
+*/
+bool bson_writer_end_document(BsonWriter *writer);
+/*
+  @brief Start a document nested in the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the document, ignored inside arrays where values are keyed by their index
+
+  @return - true if the document was started, false if not
+*/
+bool bson_writer_begin_object(BsonWriter *writer, const char *key);
+/*
+  @brief End the nested document started last, filling in its length
+
+  @param writer - The writer, whose current container must be a nested document
+
+  @return - true if the document was ended, false if not
+*/
+bool bson_writer_end_object(BsonWriter *writer);
+/*
+  @brief Start an array nested in the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the array, ignored inside arrays where values are keyed by their index
+
+  @return - true if the array was started, false if not
+*/
+bool bson_writer_begin_array(BsonWriter *writer, const char *key);
+/*
+  @brief End the array started last, filling in its length
+
+  @param writer - The writer, whose current container must be an array
+
+  @return - true if the array was ended, false if not
+*/
+bool bson_writer_end_array(BsonWriter *writer);
+
+/*
+  @brief Append a 32-bit integer to the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The value to be written
+
+  @return - true if the value was written, false if not
+*/
+bool bson_writer_append_int32(BsonWriter *writer, const char *key, int32_t value);
+/*
+  @brief Append a 64-bit integer to the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The value to be written
+
+  @return - true if the value was written, false if not
+*/
+bool bson_writer_append_int64(BsonWriter *writer, const char *key, int64_t value);
+/*
+  @brief Append a null-terminated string to the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The value to be written
+
+  @return - true if the value was written, false if not
+*/
+bool bson_writer_append_string(BsonWriter *writer, const char *key, const char *value);
+/*
+  @brief Append a string of a given length to the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The value to be written, may contain null characters
+  @param length - The length of value in bytes, not including a terminating null character
+
+  @return - true if the value was written, false if not
+*/
+bool bson_writer_append_string_len(BsonWriter *writer, const char *key, const char *value, size_t length);
+/*
+  @brief Append a boolean to the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The value to be written
+
+  @return - true if the value was written, false if not
+*/
+bool bson_writer_append_bool(BsonWriter *writer, const char *key, bson_boolean value);
+/*
+  @brief Append a double to the current container
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The value to be written
+
+  @return - true if the value was written, false if not
+*/
+bool bson_writer_append_double(BsonWriter *writer, const char *key, double value);
+/*
+  @brief Append an existing object to the current container, writing it directly into the buffer
+  (see bson_object_to_buffer())
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The object to be written
+
+  @return - true if the object was written, false if not
+*/
+bool bson_writer_append_object(BsonWriter *writer, const char *key, BsonObject *value);
+/*
+  @brief Append an existing array to the current container, writing it directly into the buffer
+  (see bson_array_to_buffer())
+
+  @param writer - The writer to be appended to
+  @param key - The key of the value, ignored inside arrays where values are keyed by their index
+  @param value - The array to be written
+
+  @return - true if the array was written, false if not
+*/
+bool bson_writer_append_array(BsonWriter *writer, const char *key, BsonArray *value);
+
+/*
+  @brief Get the documents written so far
+
+  @param writer - The writer, which must not have any open containers
+  @param size - Set to the number of bytes written
+
+  @return - The BSON data, which is owned by the writer and valid until it is modified.
+  NULL if a document has not been ended
+*/
+const uint8_t *bson_writer_get_bytes(BsonWriter *writer, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
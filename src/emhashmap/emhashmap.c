@@ -31,8 +31,12 @@ bool emhashmap_initialize(HashMap* map, int capacity, float load_factor, size_t
     map->bucket_count = ((int)(capacity / load_factor) + 1);
     map->capacity = capacity;
     map->entries = (MapEntry*) malloc(sizeof(MapEntry) * (uint32_t)map->capacity);
-    memset(map->entries, 0, sizeof(MapEntry) * (uint32_t)map->capacity);
     map->buckets = (MapBucketList*) malloc(sizeof(MapBucketList) * (uint32_t)map->bucket_count);
+    if(map->entries == NULL || map->buckets == NULL) {
+        emhashmap_deinitialize(map);
+        return false;
+    }
+    memset(map->entries, 0, sizeof(MapEntry) * (uint32_t)map->capacity);
     memset(map->buckets, 0, sizeof(MapBucketList) * (uint32_t)map->bucket_count);
     map->hash = hash_function;
     int i;
@@ -44,7 +48,47 @@ bool emhashmap_initialize(HashMap* map, int capacity, float load_factor, size_t
     for(i = 0; i < map->capacity; i++) {
         LIST_INSERT_HEAD(&map->free_list, &map->entries[i], entries);
     }
-    return map->buckets != NULL;
+    return true;
+}
+
+bool emhashmap_initialize_copy(HashMap* map, HashMap* source,
+        void* (*copy_value)(void* value, void* context), void* context) {
+    map->bucket_count = source->bucket_count;
+    map->capacity = source->capacity;
+    map->hash = source->hash;
+    map->entries = (MapEntry*) malloc(sizeof(MapEntry) * (uint32_t)map->capacity);
+    map->buckets = (MapBucketList*) malloc(sizeof(MapBucketList) * (uint32_t)map->bucket_count);
+    if(map->entries == NULL || map->buckets == NULL) {
+        emhashmap_deinitialize(map);
+        return false;
+    }
+
+    // Entries are handed out in order, the remaining ones go to the free list
+    int used = 0;
+    int i;
+    for(i = 0; i < map->bucket_count; i++) {
+        LIST_INIT(&map->buckets[i]);
+        MapEntry* last = NULL;
+        MapEntry* entry;
+        LIST_FOREACH(entry, &source->buckets[i], entries) {
+            MapEntry* new_entry = &map->entries[used++];
+            memcpy(new_entry->key, entry->key, strlen(entry->key) + 1);
+            new_entry->value = copy_value != NULL ?
+                    copy_value(entry->value, context) : entry->value;
+            if(last == NULL) {
+                LIST_INSERT_HEAD(&map->buckets[i], new_entry, entries);
+            } else {
+                LIST_INSERT_AFTER(last, new_entry, entries);
+            }
+            last = new_entry;
+        }
+    }
+
+    LIST_INIT(&map->free_list);
+    for(i = used; i < map->capacity; i++) {
+        LIST_INSERT_HEAD(&map->free_list, &map->entries[i], entries);
+    }
+    return true;
 }
 
 MapEntry* emhashmap_get(HashMap* map, const char* key) {
@@ -68,6 +68,26 @@ typedef struct MapIterator MapIterator;
  */
 bool emhashmap_initialize(HashMap* map, int capacity, float load_factor, size_t (*hash_function)(const char*, size_t));
 
+/* Public: Initialize a map as a copy of another map.
+ *
+ * The new map has the same capacity, bucket count and hash function as the
+ * source map. Every key is placed in the same bucket and in the same order as
+ * in the source map, so keys are not rehashed and iteration order is preserved.
+ *
+ * map - a pointer to the map to initialize. It must already be allocated on the
+ *      stack or heap.
+ * source - the map to be copied.
+ * copy_value - called with each value of the source map and context, returns
+ *      the value to be stored in the new map. If NULL, the value pointers are
+ *      copied as they are.
+ * context - passed through to copy_value.
+ *
+ * Returns true if the map was initialized successfully, false if space could
+ * not be allocated for the buckets or entries.
+ */
+bool emhashmap_initialize_copy(HashMap* map, HashMap* source,
+        void* (*copy_value)(void* value, void* context), void* context);
+
 /* Public: De-initialize a map, freeing memory for the buckets and entries.
  *
  * This will *not* free the memory associated with any values stored in the map
@@ -0,0 +1,391 @@
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bson_object.h"
+#include "bson_writer.h"
+
+/*
+  This test is linked with --wrap=malloc, --wrap=calloc and --wrap=realloc, so every
+  allocation made by the library goes through the functions below and can be counted
+*/
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+static bool countAllocations = false;
+static size_t allocationCount = 0;
+//Number of the counted allocation which fails if it is made by malloc(), 0 if none fails
+static size_t failingAllocation = 0;
+//Number of the counted allocation which fails if it is a reallocation, 0 if none fails
+static size_t failingReallocation = 0;
+//Number of the counted allocation which fails if it is made by calloc(), 0 if none fails
+static size_t failingCallocation = 0;
+
+void *__wrap_malloc(size_t size) {
+  allocationCount += countAllocations;
+  if (countAllocations && allocationCount == failingAllocation) {
+    return NULL;
+  }
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocationCount += countAllocations;
+  if (countAllocations && allocationCount == failingCallocation) {
+    return NULL;
+  }
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+  allocationCount += countAllocations;
+  if (countAllocations && allocationCount == failingReallocation) {
+    return NULL;
+  }
+  return __real_realloc(pointer, size);
+}
+
+static void start_counting(void) {
+  allocationCount = 0;
+  countAllocations = true;
+}
+
+static size_t stop_counting(void) {
+  countAllocations = false;
+  return allocationCount;
+}
+
+/*
+  @brief Discard the encoded data, used to stream to nowhere
+*/
+static bool discard_chunk(void *context, const uint8_t *data, size_t length) {
+  *(size_t *)context += length;
+  return true;
+}
+
+/*
+  @brief Build an object holding every type of value and every kind of array storage
+*/
+static void build_corpus(BsonObject *obj) {
+  char large[300];
+  memset(large, 'z', sizeof(large) - 1);
+  large[sizeof(large) - 1] = 0x00;
+  bson_object_initialize_default(obj);
+  bson_object_put_int32(obj, "int32", -12345);
+  bson_object_put_int64(obj, "int64", 1234567890123);
+  bson_object_put_double(obj, "double", 3.25);
+  bson_object_put_bool(obj, "bool", BOOLEAN_TRUE);
+  bson_object_put_string(obj, "short", "short string");
+  bson_object_put_string(obj, "large", large);
+  bson_object_put_string_len(obj, "embedded", "a\0b", 3);
+
+  BsonObject *sub = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(sub);
+  bson_object_put_string(sub, "name", "nested");
+  bson_object_put_double(sub, "ratio", 0.5);
+  bson_object_put_object_owned(obj, "sub", sub);
+
+  BsonArray *mixed = malloc(sizeof(BsonArray));
+  bson_array_initialize(mixed, 4);
+  bson_array_add_int32(mixed, 1);
+  bson_array_add_string(mixed, "two");
+  BsonObject *item = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(item);
+  bson_object_put_bool(item, "flag", BOOLEAN_FALSE);
+  bson_array_add_object_owned(mixed, item);
+  bson_object_put_array_owned(obj, "mixed", mixed);
+
+  // More elements than there are precomputed index keys
+  BsonArray *packed = malloc(sizeof(BsonArray));
+  bson_array_initialize_typed(packed, TYPE_INT32, 4);
+  int32_t i = 0;
+  for (i = 0; i < 2 * INDEX_KEY_TABLE_SIZE; i++) {
+    bson_array_add_int32(packed, i);
+  }
+  bson_object_put_array_owned(obj, "packed", packed);
+
+  BsonArray *strings = malloc(sizeof(BsonArray));
+  bson_array_initialize(strings, 4);
+  for (i = 0; i < 1200; i++) {
+    bson_array_add_string(strings, (i % 2 == 0) ? "even" : large);
+  }
+  bson_object_put_array_owned(obj, "strings", strings);
+
+  const char *keys[] = { "id", "label" };
+  element_type types[] = { TYPE_INT64, TYPE_STRING };
+  BsonArray *rows = malloc(sizeof(BsonArray));
+  bson_array_initialize_columnar(rows, keys, types, 2, 4);
+  for (i = 0; i < 20; i++) {
+    BsonObject *row = malloc(sizeof(BsonObject));
+    bson_object_initialize_default(row);
+    bson_object_put_int64(row, "id", i);
+    bson_object_put_string(row, "label", "row");
+    bson_array_add_object_owned(rows, row);
+  }
+  bson_object_put_array_owned(obj, "rows", rows);
+}
+
+START_TEST(bson_object_to_buffer_no_allocations)
+{
+  BsonObject obj;
+  build_corpus(&obj);
+  size_t size = bson_object_size(&obj);
+  uint8_t *buffer = malloc(size);
+  uint8_t *expected = bson_object_to_bytes(&obj);
+
+  start_counting();
+  size_t measured = bson_object_size(&obj);
+  size_t written = 0;
+  bool converted = bson_object_to_buffer(&obj, buffer, size, &written);
+  ck_assert_uint_eq(stop_counting(), 0);
+  ck_assert_uint_eq(measured, size);
+  ck_assert(converted);
+  ck_assert_uint_eq(written, size);
+  ck_assert_int_eq(memcmp(buffer, expected, size), 0);
+
+  // Measuring the required size when the buffer is too small
+  start_counting();
+  converted = bson_object_to_buffer(&obj, buffer, size / 2, &written);
+  ck_assert_uint_eq(stop_counting(), 0);
+  ck_assert(!converted);
+  ck_assert_uint_eq(written, size);
+
+  // Canonical encoding sorts small objects on the stack
+  start_counting();
+  converted = bson_object_to_buffer_canonical(&obj, buffer, size, &written);
+  ck_assert_uint_eq(stop_counting(), 0);
+  ck_assert(converted);
+  ck_assert_uint_eq(written, size);
+
+  free(expected);
+  free(buffer);
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+START_TEST(bson_array_to_buffer_no_allocations)
+{
+  BsonObject obj;
+  build_corpus(&obj);
+  const char *arrays[] = { "mixed", "packed", "strings", "rows" };
+  size_t a = 0;
+  for (a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++) {
+    BsonArray *array = bson_object_get_array(&obj, arrays[a]);
+    size_t size = bson_array_size(array);
+    uint8_t *buffer = malloc(size);
+    uint8_t *expected = bson_array_to_bytes(array);
+
+    start_counting();
+    size_t written = 0;
+    bool converted = bson_array_to_buffer(array, buffer, size, &written);
+    ck_assert_uint_eq(stop_counting(), 0);
+    ck_assert(converted);
+    ck_assert_uint_eq(written, size);
+    ck_assert_int_eq(memcmp(buffer, expected, size), 0);
+
+    free(expected);
+    free(buffer);
+  }
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+START_TEST(bson_encoders_no_allocations)
+{
+  BsonObject obj;
+  build_corpus(&obj);
+  size_t size = bson_object_size(&obj);
+
+  // A writer with enough capacity does not grow
+  BsonWriter writer;
+  bson_writer_initialize(&writer, 2 * size);
+  start_counting();
+  bool written = bson_writer_begin_document(&writer) &&
+                 bson_writer_append_int32(&writer, "id", 7) &&
+                 bson_writer_append_string(&writer, "name", "writer") &&
+                 bson_writer_begin_array(&writer, "values") &&
+                 bson_writer_append_double(&writer, NULL, 1.5) &&
+                 bson_writer_end_array(&writer) &&
+                 bson_writer_append_object(&writer, "corpus", &obj) &&
+                 bson_writer_end_document(&writer);
+  ck_assert_uint_eq(stop_counting(), 0);
+  ck_assert(written);
+  bson_writer_deinitialize(&writer);
+
+  // A stream only allocates its chunk when it is initialized
+  size_t streamed = 0;
+  BsonStream stream;
+  bson_stream_initialize(&stream, discard_chunk, &streamed, 64);
+  start_counting();
+  written = bson_object_to_stream(&obj, &stream) && bson_stream_flush(&stream);
+  ck_assert_uint_eq(stop_counting(), 0);
+  ck_assert(written);
+  ck_assert_uint_eq(streamed, size);
+  bson_stream_deinitialize(&stream);
+
+  // Values of the same size are patched into a kept image
+  bson_object_keep_image(&obj);
+  size_t imageSize = 0;
+  ck_assert_ptr_ne(bson_object_get_image(&obj, &imageSize), NULL);
+  bson_object_put_int32(&obj, "int32", 54321);
+  bson_object_put_double(&obj, "double", -1.0);
+  start_counting();
+  const uint8_t *image = bson_object_get_image(&obj, &imageSize);
+  ck_assert_uint_eq(stop_counting(), 0);
+  ck_assert_ptr_ne(image, NULL);
+  ck_assert_uint_eq(imageSize, size);
+
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+START_TEST(bson_array_parse_failed_growth)
+{
+  BsonArray values;
+  bson_array_initialize(&values, 4);
+  int32_t i = 0;
+  for (i = 0; i < 40; i++) {
+    bson_array_add_int32(&values, i * 3);
+  }
+  uint8_t *bytes = bson_array_to_bytes(&values);
+  size_t size = bson_array_size(&values);
+  bson_array_deinitialize(&values);
+
+  // A packed run interrupted by a failed reallocation is resumed by the element parser
+  size_t failing = 0;
+  for (failing = 1; failing <= 8; failing++) {
+    BsonArray parsed;
+    failingReallocation = failing;
+    start_counting();
+    size_t ret = bson_array_from_bytes_strict(&parsed, bytes, size);
+    stop_counting();
+    failingReallocation = 0;
+    ck_assert_uint_eq(ret, size);
+    ck_assert_uint_eq(parsed.count, 40);
+    for (i = 0; i < 40; i++) {
+      ck_assert_int_eq(bson_array_get_int32(&parsed, i), i * 3);
+    }
+    bson_array_deinitialize(&parsed);
+  }
+  free(bytes);
+}
+END_TEST
+
+START_TEST(bson_object_parse_failed_allocation)
+{
+  char large[40];
+  memset(large, 'y', sizeof(large) - 1);
+  large[sizeof(large) - 1] = 0x00;
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  bson_object_put_int32(&obj, "int32", 7);
+  bson_object_put_string(&obj, "large", large);
+  BsonObject *sub = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(sub);
+  bson_object_put_string(sub, "name", large);
+  bson_object_put_object_owned(&obj, "sub", sub);
+  BsonArray *mixed = malloc(sizeof(BsonArray));
+  bson_array_initialize(mixed, 2);
+  bson_array_add_string(mixed, large);
+  bson_array_add_int64(mixed, 8);
+  BsonObject *item = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(item);
+  bson_object_put_double(item, "ratio", 0.5);
+  bson_array_add_object_owned(mixed, item);
+  bson_object_put_array_owned(&obj, "mixed", mixed);
+  uint8_t *expected = bson_object_to_bytes(&obj);
+  size_t size = bson_object_size(&obj);
+  bson_object_deinitialize(&obj);
+
+  BsonObject parsed;
+  start_counting();
+  ck_assert_uint_eq(bson_object_from_bytes_len(&parsed, expected, size), size);
+  size_t total = stop_counting();
+  bson_object_deinitialize(&parsed);
+
+  // Parsing fails without leaking the partial object, or produces the whole object
+  size_t failures = 0;
+  size_t failing = 0;
+  for (failing = 1; failing <= total; failing++) {
+    failingAllocation = failing;
+    start_counting();
+    size_t ret = bson_object_from_bytes_len(&parsed, expected, size);
+    stop_counting();
+    failingAllocation = 0;
+    if (ret == 0) {
+      failures++;
+      continue;
+    }
+    ck_assert_uint_eq(ret, size);
+    uint8_t *bytes = bson_object_to_bytes(&parsed);
+    ck_assert_int_eq(memcmp(bytes, expected, size), 0);
+    free(bytes);
+    bson_object_deinitialize(&parsed);
+  }
+  ck_assert_uint_gt(failures, 0);
+  free(expected);
+}
+END_TEST
+
+START_TEST(bson_array_parallel_failed_allocation)
+{
+  BsonArray values;
+  bson_array_initialize(&values, 4);
+  int32_t i = 0;
+  for (i = 0; i < 2 * BSON_PARALLEL_MIN_CHUNK_ELEMENTS; i++) {
+    bson_array_add_string(&values, (i % 2 == 0) ? "even" : "odd");
+  }
+  uint8_t *expected = bson_array_to_bytes(&values);
+  size_t size = bson_array_size(&values);
+
+  // Chunks are encoded by the calling thread when the threads cannot be tracked
+  size_t failing = 0;
+  for (failing = 1; failing <= 3; failing++) {
+    failingCallocation = failing;
+    start_counting();
+    uint8_t *bytes = bson_array_to_bytes_parallel(&values, 2);
+    stop_counting();
+    failingCallocation = 0;
+    ck_assert_ptr_ne(bytes, NULL);
+    ck_assert_int_eq(memcmp(bytes, expected, size), 0);
+    free(bytes);
+  }
+  free(expected);
+  bson_array_deinitialize(&values);
+}
+END_TEST
+
+Suite *suite(void) {
+  Suite *s = suite_create("bson_alloc_test");
+
+  TCase *tc = tcase_create("encoding");
+  tcase_add_test(tc, bson_object_to_buffer_no_allocations);
+  tcase_add_test(tc, bson_array_to_buffer_no_allocations);
+  tcase_add_test(tc, bson_encoders_no_allocations);
+  tcase_add_test(tc, bson_array_parallel_failed_allocation);
+
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("decoding");
+  tcase_add_test(tc, bson_array_parse_failed_growth);
+  tcase_add_test(tc, bson_object_parse_failed_allocation);
+
+  suite_add_tcase(s, tc);
+  return s;
+}
+
+int main(void) {
+  int failed_num = 0;
+  Suite *s = suite();
+  SRunner *sr = srunner_create(s);
+  //Allocations are counted within the test process
+  srunner_set_fork_status(sr, CK_NOFORK);
+
+  srunner_run_all(sr, CK_NORMAL);
+
+  failed_num = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return failed_num == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
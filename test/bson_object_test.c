@@ -2,6 +2,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "bson_object.h"
+#include "bson_writer.h"
+#include "bson_iovec.h"
+#include "bson_template.h"
+#include "bson_cache.h"
 
 #define BSON_TAG_DOUBLE   (0x01)
 #define BSON_TAG_STRING   (0x02)
@@ -284,6 +288,1772 @@ START_TEST(bson_object_from_bytes_corrupted_tag)
 }
 END_TEST
 
+START_TEST(bson_object_string_embedded_null)
+{
+  /*
+     {
+       "str": "ab\0cd"
+     }
+   */
+  uint8_t expected_data[] = {
+      0x14, 0x0, 0x0, 0x0, // overall length
+      BSON_TAG_STRING, 's', 't', 'r', 0x0,
+        0x06, 0x0, 0x0, 0x0, 'a', 'b', 0x0, 'c', 'd', 0x0,
+      0x0 // end of document
+  };
+
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  ck_assert(bson_object_put_string_len(&obj, "str", "ab\0cd", 5));
+  ck_assert_uint_eq(bson_object_size(&obj), sizeof(expected_data));
+
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  ck_assert(bytes);
+  ck_assert(memcmp(bytes, expected_data, sizeof(expected_data)) == 0);
+  free(bytes);
+  bson_object_deinitialize(&obj);
+
+  BsonObject output;
+  size_t ret = bson_object_from_bytes_len(&output, expected_data, sizeof(expected_data));
+  ck_assert_uint_eq(ret, sizeof(expected_data));
+
+  size_t length = 0;
+  char *value = bson_object_get_string_len(&output, "str", &length);
+  ck_assert(value);
+  ck_assert_uint_eq(length, 5);
+  ck_assert(memcmp(value, "ab\0cd", 6) == 0);
+
+  bson_object_deinitialize(&output);
+}
+END_TEST
+
+START_TEST(bson_object_from_bytes_invalid_string_length)
+{
+  /*
+     {
+       "str": (string length of zero, which cannot hold the terminating null)
+   */
+  uint8_t test_data_corrupted[] = {
+      0x0E, 0x0, 0x0, 0x0, // overall length
+      BSON_TAG_STRING, 's', 't', 'r', 0x0,
+        0x0, 0x0, 0x0, 0x0,
+      0x0 // end of document
+  };
+
+  BsonObject output;
+  size_t ret = bson_object_from_bytes_len(&output, test_data_corrupted, sizeof(test_data_corrupted));
+  ck_assert_uint_eq(ret, 0);
+}
+END_TEST
+
+START_TEST(bson_object_put_owned_values)
+{
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+
+  // Strings too long to be stored inside their element are kept as they are
+  char *string_value = strdup("an owned string longer than a short string");
+  ck_assert(bson_object_put_string_owned(&obj, "str", string_value));
+  ck_assert_ptr_eq(bson_object_get_string(&obj, "str"), string_value);
+
+  BsonObject *sub = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(sub);
+  bson_object_put_int32(sub, "value", 42);
+  ck_assert(bson_object_put_object_owned(&obj, "sub", sub));
+  ck_assert_ptr_eq(bson_object_get_object(&obj, "sub"), sub);
+
+  BsonArray *arr = malloc(sizeof(BsonArray));
+  bson_array_initialize(arr, 2);
+  char *array_string = malloc(19);
+  memcpy(array_string, "a\0b very long ones", 19);
+  ck_assert(bson_array_add_string_len_owned(arr, array_string, 18));
+  ck_assert(bson_object_put_array_owned(&obj, "arr", arr));
+
+  size_t length = 0;
+  ck_assert_ptr_eq(bson_array_get_string_len(arr, 0, &length), array_string);
+  ck_assert_uint_eq(length, 18);
+  ck_assert_int_eq(bson_object_get_int32(sub, "value"), 42);
+
+  // Replacing an owned value releases it
+  ck_assert(bson_object_put_int32(&obj, "sub", 1));
+  ck_assert_int_eq(bson_object_get_int32(&obj, "sub"), 1);
+
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+
+START_TEST(bson_object_share_copy_on_write)
+{
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  bson_object_put_string(&obj, "name", "original");
+
+  BsonObject sub;
+  bson_object_initialize_default(&sub);
+  bson_object_put_int32(&sub, "value", 1);
+  bson_object_put_object(&obj, "sub", &sub);
+
+  BsonObject untouched;
+  bson_object_initialize_default(&untouched);
+  bson_object_put_bool(&untouched, "flag", BOOLEAN_TRUE);
+  bson_object_put_object(&obj, "untouched", &untouched);
+
+  BsonArray arr;
+  bson_array_initialize(&arr, 2);
+  bson_array_add_int32(&arr, 10);
+  bson_array_add_int32(&arr, 20);
+  bson_object_put_array(&obj, "arr", &arr);
+
+  uint8_t *originalBytes = bson_object_to_bytes(&obj);
+  size_t originalSize = bson_object_size(&obj);
+
+  BsonObject copy;
+  ck_assert(bson_object_share(&copy, &obj));
+  ck_assert_ptr_eq(copy.data, obj.data);
+
+  uint8_t *copyBytes = bson_object_to_bytes(&copy);
+  ck_assert_int_eq(memcmp(copyBytes, originalBytes, originalSize), 0);
+  free(copyBytes);
+
+  // Modifying a nested value copies only the path to it
+  ck_assert(bson_object_put_int32(bson_object_get_object(&copy, "sub"), "value", 2));
+  ck_assert(bson_array_add_int32(bson_object_get_array(&copy, "arr"), 30));
+  ck_assert(bson_object_put_string(&copy, "name", "copy"));
+  ck_assert_ptr_ne(copy.data, obj.data);
+  // Sub-objects which were not modified are still shared
+  BsonObject *copyUntouched = (BsonObject *)bson_object_get(&copy, "untouched")->value;
+  BsonObject *originalUntouched = (BsonObject *)bson_object_get(&obj, "untouched")->value;
+  ck_assert_ptr_eq(copyUntouched->data, originalUntouched->data);
+
+  ck_assert_int_eq(bson_object_get_int32(bson_object_get_object(&copy, "sub"), "value"), 2);
+  ck_assert_int_eq(bson_array_get_int32(bson_object_get_array(&copy, "arr"), 2), 30);
+  ck_assert_str_eq(bson_object_get_string(&copy, "name"), "copy");
+
+  // The original is unchanged
+  ck_assert_int_eq(bson_object_get_int32(bson_object_get_object(&obj, "sub"), "value"), 1);
+  ck_assert_uint_eq(bson_object_get_array(&obj, "arr")->count, 2);
+  ck_assert_str_eq(bson_object_get_string(&obj, "name"), "original");
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  ck_assert_uint_eq(bson_object_size(&obj), originalSize);
+  ck_assert_int_eq(memcmp(bytes, originalBytes, originalSize), 0);
+  free(bytes);
+  free(originalBytes);
+
+  bson_object_deinitialize(&obj);
+  bson_object_deinitialize(&copy);
+}
+END_TEST
+
+START_TEST(bson_array_share_copy_on_write)
+{
+  BsonArray arr;
+  bson_array_initialize(&arr, 1);
+  bson_array_add_string(&arr, "first");
+
+  BsonArray copy;
+  ck_assert(bson_array_share(&copy, &arr));
+  ck_assert_ptr_eq(copy.elements, arr.elements);
+
+  ck_assert(bson_array_add_string(&copy, "second"));
+  ck_assert_ptr_ne(copy.elements, arr.elements);
+  ck_assert_uint_eq(arr.count, 1);
+  ck_assert_uint_eq(copy.count, 2);
+  ck_assert_str_eq(bson_array_get_string(&copy, 0), "first");
+  ck_assert_str_eq(bson_array_get_string(&copy, 1), "second");
+
+  bson_array_deinitialize(&copy);
+  ck_assert_str_eq(bson_array_get_string(&arr, 0), "first");
+  bson_array_deinitialize(&arr);
+}
+END_TEST
+
+START_TEST(bson_object_clone_deep_copy)
+{
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  bson_object_put_string_len(&obj, "str", "a\0b", 3);
+  bson_object_put_int64(&obj, "int64", 1234567890123LL);
+  bson_object_put_double(&obj, "double", 1.5);
+
+  BsonObject sub;
+  bson_object_initialize_default(&sub);
+  bson_object_put_int32(&sub, "value", 1);
+  bson_object_put_object(&obj, "sub", &sub);
+
+  BsonArray arr;
+  bson_array_initialize(&arr, 2);
+  bson_array_add_bool(&arr, BOOLEAN_TRUE);
+  bson_array_add_string(&arr, "item");
+  bson_object_put_array(&obj, "arr", &arr);
+
+  BsonObject clone;
+  ck_assert(bson_object_clone(&clone, &obj));
+  ck_assert_ptr_ne(clone.data, obj.data);
+  ck_assert_int_eq(clone.data->capacity, obj.data->capacity);
+
+  size_t size = bson_object_size(&obj);
+  ck_assert_uint_eq(bson_object_size(&clone), size);
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  uint8_t *cloneBytes = bson_object_to_bytes(&clone);
+  ck_assert_int_eq(memcmp(bytes, cloneBytes, size), 0);
+  free(bytes);
+  free(cloneBytes);
+
+  // Nothing is shared with the original
+  BsonObject *cloneSub = bson_object_get_object(&clone, "sub");
+  ck_assert_ptr_ne(cloneSub->data, bson_object_get_object(&obj, "sub")->data);
+  BsonArray cloneArr;
+  ck_assert(bson_array_clone(&cloneArr, bson_object_get_array(&clone, "arr")));
+  ck_assert_ptr_ne(cloneArr.elements, bson_object_get_array(&obj, "arr")->elements);
+  ck_assert_str_eq(bson_array_get_string(&cloneArr, 1), "item");
+  bson_array_deinitialize(&cloneArr);
+
+  bson_object_put_int32(cloneSub, "value", 2);
+  ck_assert_int_eq(bson_object_get_int32(bson_object_get_object(&obj, "sub"), "value"), 1);
+
+  bson_object_deinitialize(&obj);
+  ck_assert_int_eq(bson_object_get_int32(cloneSub, "value"), 2);
+  size_t length = 0;
+  ck_assert_int_eq(memcmp(bson_object_get_string_len(&clone, "str", &length), "a\0b", 4), 0);
+  ck_assert_uint_eq(length, 3);
+  bson_object_deinitialize(&clone);
+}
+END_TEST
+
+START_TEST(bson_object_short_strings)
+{
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  size_t i = 0;
+  // Strings shorter than SHORT_STRING_SIZE are stored along with their element, longer ones are not
+  ck_assert_uint_ge(SHORT_STRING_SIZE, 16);
+  char limit[SHORT_STRING_SIZE];
+  memset(limit, 'x', SHORT_STRING_SIZE - 1);
+  limit[SHORT_STRING_SIZE - 1] = 0x00;
+  char tooLong[SHORT_STRING_SIZE + 1];
+  memset(tooLong, 'y', SHORT_STRING_SIZE);
+  tooLong[SHORT_STRING_SIZE] = 0x00;
+  ck_assert(bson_object_put_string(&obj, "short", "FUL"));
+  ck_assert(bson_object_put_string(&obj, "limit", limit));
+  ck_assert(bson_object_put_string(&obj, "long", tooLong));
+  ck_assert(bson_object_put_string_owned(&obj, "owned", strdup("OWN")));
+
+  // Elements are no larger than they were before short strings were stored along with them,
+  // and their value always points to the string
+  ck_assert_uint_le(sizeof(BsonElement), sizeof(void *) + sizeof(element_type) + sizeof(size_t) + sizeof(bool) + 3);
+  BsonElement *element = bson_object_get(&obj, "short");
+  ck_assert(bson_element_is_short_string(element));
+  ck_assert_ptr_eq(bson_object_get_string(&obj, "short"), element->value);
+  ck_assert_ptr_eq(element->value, (char *)(element + 1));
+  element = bson_object_get(&obj, "limit");
+  ck_assert(bson_element_is_short_string(element));
+  ck_assert_str_eq((char *)element->value, limit);
+  element = bson_object_get(&obj, "owned");
+  ck_assert(bson_element_is_short_string(element));
+  ck_assert_str_eq((char *)element->value, "OWN");
+  element = bson_object_get(&obj, "long");
+  ck_assert(!bson_element_is_short_string(element));
+  ck_assert_ptr_eq(bson_element_get_string(element), element->value);
+  char *stable = bson_object_get_string(&obj, "short");
+  for (i = 0; i < 10; i++) {
+    char key[16];
+    sprintf(key, "key%i", (int)i);
+    ck_assert(bson_object_put_string(&obj, key, "X"));
+  }
+  ck_assert_ptr_eq(bson_object_get_string(&obj, "short"), stable);
+
+  BsonArray arr;
+  bson_array_initialize(&arr, 1);
+  ck_assert(bson_array_add_string_len(&arr, "a\0b", 3));
+  ck_assert(bson_array_add_string(&arr, "MAI"));
+  ck_assert(bson_array_add_string_owned(&arr, strdup(tooLong)));
+  ck_assert_ptr_ne(arr.strings, NULL);
+
+  // Short strings of arrays are not moved when the elements are
+  stable = bson_array_get_string(&arr, 1);
+  ck_assert_ptr_eq(stable, arr.elements[1].value);
+  for (i = 0; i < 100; i++) {
+    ck_assert(bson_array_add_string(&arr, "MAIN"));
+  }
+  ck_assert_ptr_eq(bson_array_get_string(&arr, 1), stable);
+  ck_assert(bson_array_remove(&arr, 3, 100));
+  ck_assert_uint_eq(arr.count, 3);
+  ck_assert_ptr_eq(bson_array_get_string(&arr, 1), stable);
+  ck_assert_str_eq(stable, "MAI");
+  bson_object_put_array(&obj, "arr", &arr);
+
+  // Short strings survive encoding, parsing, sharing and cloning
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  BsonObject parsed;
+  ck_assert_uint_eq(bson_object_from_bytes_len(&parsed, bytes, bson_object_size(&obj)), bson_object_size(&obj));
+  free(bytes);
+  BsonObject shared;
+  ck_assert(bson_object_share(&shared, &parsed));
+  ck_assert(bson_object_put_int32(&shared, "other", 1));
+  BsonObject clone;
+  ck_assert(bson_object_clone(&clone, &shared));
+
+  BsonObject *objects[] = { &parsed, &shared, &clone };
+  for (i = 0; i < 3; i++) {
+    element = bson_object_get(objects[i], "short");
+    ck_assert(bson_element_is_short_string(element));
+    ck_assert_ptr_eq(element->value, (char *)(element + 1));
+    ck_assert_str_eq(bson_object_get_string(objects[i], "short"), "FUL");
+    ck_assert_str_eq(bson_object_get_string(objects[i], "limit"), limit);
+    ck_assert_str_eq(bson_object_get_string(objects[i], "long"), tooLong);
+    ck_assert_str_eq(bson_object_get_string(objects[i], "owned"), "OWN");
+    size_t length = 0;
+    BsonArray *subArray = (BsonArray *)bson_object_get(objects[i], "arr")->value;
+    ck_assert_int_eq(memcmp(bson_array_get_string_len(subArray, 0, &length), "a\0b", 4), 0);
+    ck_assert_uint_eq(length, 3);
+    ck_assert_str_eq(bson_array_get_string(subArray, 1), "MAI");
+    ck_assert_str_eq(bson_array_get_string(subArray, 2), tooLong);
+  }
+
+  // Replacing a short string with a long one and back
+  ck_assert(bson_object_put_string(&clone, "short", "no longer a short string"));
+  ck_assert_str_eq(bson_object_get_string(&clone, "short"), "no longer a short string");
+  ck_assert(bson_object_put_string(&clone, "short", "NON"));
+  ck_assert_str_eq(bson_object_get_string(&clone, "short"), "NON");
+
+  bson_object_deinitialize(&obj);
+  bson_object_deinitialize(&parsed);
+  bson_object_deinitialize(&shared);
+  bson_object_deinitialize(&clone);
+}
+END_TEST
+
+START_TEST(bson_array_growth)
+{
+  // Arrays created without any capacity must still grow
+  BsonArray arr;
+  ck_assert(bson_array_initialize(&arr, 0));
+  char value[32];
+  int i = 0;
+  for (i = 0; i < 100; i++) {
+    sprintf(value, (i % 2 == 0) ? "%i" : "long string value %i", i);
+    ck_assert(bson_array_add_string(&arr, value));
+    ck_assert(bson_array_add_int32(&arr, i));
+  }
+  ck_assert_uint_eq(arr.count, 200);
+  ck_assert_uint_ge(arr.maxCount, 200);
+
+  // Short strings stored inside elements are still valid after the elements were moved
+  for (i = 0; i < 100; i++) {
+    sprintf(value, (i % 2 == 0) ? "%i" : "long string value %i", i);
+    ck_assert_str_eq(bson_array_get_string(&arr, i * 2), value);
+    ck_assert_int_eq(bson_array_get_int32(&arr, i * 2 + 1), i);
+  }
+
+  uint8_t *bytes = bson_array_to_bytes(&arr);
+  BsonArray parsed;
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, bytes, bson_array_size(&arr)), bson_array_size(&arr));
+  free(bytes);
+  ck_assert_uint_eq(parsed.count, 200);
+  ck_assert_str_eq(bson_array_get_string(&parsed, 198), "long string value 99");
+  ck_assert_str_eq(bson_array_get_string(&parsed, 196), "98");
+
+  bson_array_deinitialize(&arr);
+  bson_array_deinitialize(&parsed);
+}
+END_TEST
+
+START_TEST(bson_array_packed_values)
+{
+  BsonArray packed;
+  ck_assert(!bson_array_initialize_typed(&packed, TYPE_STRING, 4));
+  ck_assert(bson_array_initialize_typed(&packed, TYPE_INT32, 0));
+  BsonArray generic;
+  bson_array_initialize(&generic, 4);
+  int32_t i = 0;
+  for (i = 0; i < 20; i++) {
+    ck_assert(bson_array_add_int32(&packed, i * 3));
+    ck_assert(bson_array_add_int32(&generic, i * 3));
+  }
+
+  int32_t *values = bson_array_get_int32_values(&packed);
+  ck_assert_ptr_ne(values, NULL);
+  ck_assert_ptr_eq(bson_array_get_int64_values(&packed), NULL);
+  ck_assert_ptr_eq(bson_array_get_int32_values(&generic), NULL);
+  ck_assert_int_eq(values[19], 57);
+  ck_assert_int_eq(bson_array_get_int32(&packed, 5), 15);
+  ck_assert_int_eq(bson_array_get_int64(&packed, 5), -1);
+  ck_assert_ptr_eq(bson_array_get_string(&packed, 5), NULL);
+
+  // Packed arrays are encoded exactly like arrays of separate elements
+  size_t size = bson_array_size(&generic);
+  ck_assert_uint_eq(bson_array_size(&packed), size);
+  uint8_t *bytes = bson_array_to_bytes(&generic);
+  uint8_t *packedBytes = bson_array_to_bytes(&packed);
+  ck_assert_int_eq(memcmp(bytes, packedBytes, size), 0);
+  free(packedBytes);
+
+  // Homogeneous arrays are packed by the parser
+  BsonArray parsed;
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, bytes, size), size);
+  free(bytes);
+  ck_assert_ptr_ne(bson_array_get_int32_values(&parsed), NULL);
+  ck_assert_int_eq(bson_array_get_int32_values(&parsed)[7], 21);
+
+  // Shared and cloned packed arrays are copied on modification
+  BsonArray shared;
+  ck_assert(bson_array_share(&shared, &parsed));
+  ck_assert(bson_array_add_int32(&shared, 100));
+  ck_assert_uint_eq(parsed.count, 20);
+  ck_assert_int_eq(bson_array_get_int32(&shared, 20), 100);
+  BsonArray clone;
+  ck_assert(bson_array_clone(&clone, &shared));
+  ck_assert_ptr_ne(bson_array_get_int32_values(&clone), bson_array_get_int32_values(&shared));
+  ck_assert_int_eq(bson_array_get_int32_values(&clone)[20], 100);
+
+  // Adding a value of another type converts the array to separate elements
+  ck_assert(bson_array_add_string(&packed, "end"));
+  ck_assert_ptr_eq(bson_array_get_int32_values(&packed), NULL);
+  ck_assert_int_eq(bson_array_get_int32(&packed, 19), 57);
+  ck_assert_str_eq(bson_array_get_string(&packed, 20), "end");
+  // Reading elements of a packed array leaves it packed
+  const int32_t *cloneValues = bson_array_get_int32_values(&clone);
+  BsonElementSlot slot;
+  bson_element_slot_initialize(&slot);
+  const BsonElement *element = bson_array_get_element(&clone, 3, &slot);
+  ck_assert_ptr_eq(bson_array_get_int32_values(&clone), cloneValues);
+  ck_assert_int_eq(element->type, TYPE_INT32);
+  ck_assert_int_eq(*(int32_t *)element->value, 9);
+  element = bson_array_get_element(&clone, 20, &slot);
+  ck_assert_ptr_eq(element, &slot.element);
+  ck_assert_ptr_eq(element->value, &cloneValues[20]);
+  ck_assert_uint_eq(element->size, SIZE_INT32);
+  ck_assert_ptr_eq(bson_array_get_element(&clone, 21, &slot), NULL);
+  bson_element_slot_deinitialize(&slot);
+
+  // Mixed arrays are parsed into separate elements
+  BsonArray mixed;
+  bson_array_initialize(&mixed, 2);
+  bson_array_add_double(&mixed, 1.5);
+  bson_array_add_bool(&mixed, BOOLEAN_TRUE);
+  size = bson_array_size(&mixed);
+  bytes = bson_array_to_bytes(&mixed);
+  bson_array_deinitialize(&mixed);
+  ck_assert_uint_eq(bson_array_from_bytes_len(&mixed, bytes, size), size);
+  free(bytes);
+  ck_assert_ptr_eq(bson_array_get_double_values(&mixed), NULL);
+  ck_assert(bson_array_get_double(&mixed, 0) == 1.5);
+  ck_assert_int_eq(bson_array_get_bool(&mixed, 1), BOOLEAN_TRUE);
+
+  bson_array_deinitialize(&packed);
+  bson_array_deinitialize(&generic);
+  bson_array_deinitialize(&parsed);
+  bson_array_deinitialize(&shared);
+  bson_array_deinitialize(&clone);
+  bson_array_deinitialize(&mixed);
+}
+END_TEST
+
+START_TEST(bson_array_packed_bulk_encoding)
+{
+  element_type types[] = { TYPE_INT32, TYPE_INT64, TYPE_DOUBLE, TYPE_BOOLEAN };
+  size_t t = 0;
+  for (t = 0; t < 4; t++) {
+    BsonArray packed;
+    BsonArray generic;
+    ck_assert(bson_array_initialize_typed(&packed, types[t], 16));
+    bson_array_initialize(&generic, 16);
+    // Crosses the 1, 2, 3 and 4 digit key boundaries
+    int32_t i = 0;
+    for (i = 0; i < 1234; i++) {
+      switch (types[t]) {
+        case TYPE_INT32:
+          bson_array_add_int32(&packed, i * -7);
+          bson_array_add_int32(&generic, i * -7);
+          break;
+        case TYPE_INT64:
+          bson_array_add_int64(&packed, (int64_t)i << 40);
+          bson_array_add_int64(&generic, (int64_t)i << 40);
+          break;
+        case TYPE_DOUBLE:
+          bson_array_add_double(&packed, i / 3.0);
+          bson_array_add_double(&generic, i / 3.0);
+          break;
+        default:
+          bson_array_add_bool(&packed, (i % 3 == 0) ? BOOLEAN_TRUE : BOOLEAN_FALSE);
+          bson_array_add_bool(&generic, (i % 3 == 0) ? BOOLEAN_TRUE : BOOLEAN_FALSE);
+      }
+    }
+    size_t size = bson_array_size(&generic);
+    ck_assert_uint_eq(bson_array_size(&packed), size);
+    uint8_t *bytes = bson_array_to_bytes(&generic);
+    uint8_t *packedBytes = bson_array_to_bytes(&packed);
+    ck_assert_int_eq(memcmp(bytes, packedBytes, size), 0);
+    free(packedBytes);
+
+    BsonArray parsed;
+    ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, bytes, size), size);
+    ck_assert_uint_eq(parsed.count, 1234);
+    ck_assert_uint_eq(parsed.packedSize, packed.packedSize);
+    ck_assert_int_eq(memcmp(parsed.packedValues, packed.packedValues, packed.packedSize * 1234), 0);
+    free(bytes);
+
+    bson_array_deinitialize(&packed);
+    bson_array_deinitialize(&generic);
+    bson_array_deinitialize(&parsed);
+  }
+
+  // A run is interrupted by an unexpected key in the middle of an array
+  BsonArray values;
+  ck_assert(bson_array_initialize_typed(&values, TYPE_INT64, 300));
+  int64_t v = 0;
+  for (v = 0; v < 300; v++) {
+    ck_assert(bson_array_add_int64(&values, v * 3));
+  }
+  uint8_t *encoded = bson_array_to_bytes(&values);
+  size_t encodedSize = bson_array_size(&values);
+  // Element 150 starts after the header, 10 one digit, 90 two digit and 50 three digit elements
+  size_t offset = 4 + 10 * 11 + 90 * 12 + 50 * 13;
+  ck_assert_int_eq(encoded[offset], TYPE_INT64);
+  ck_assert_int_eq(memcmp(&encoded[offset + 1], "150", 4), 0);
+  encoded[offset + 3] = '1';
+  BsonArray interrupted;
+  ck_assert_uint_eq(bson_array_from_bytes_len(&interrupted, encoded, encodedSize), encodedSize);
+  ck_assert_uint_eq(interrupted.count, 300);
+  for (v = 0; v < 300; v++) {
+    ck_assert_int_eq(bson_array_get_int64(&interrupted, (size_t)v), v * 3);
+  }
+  bson_array_deinitialize(&interrupted);
+  bson_array_deinitialize(&values);
+  free(encoded);
+
+  // Keys which are not sequential are still parsed one by one
+  uint8_t sparse[] = {
+    0x13, 0x00, 0x00, 0x00,
+    TYPE_INT32, '0', 0x00, 0x01, 0x00, 0x00, 0x00,
+    TYPE_INT32, '5', 0x00, 0x02, 0x00, 0x00, 0x00,
+    0x00
+  };
+  BsonArray parsed;
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, sparse, sizeof(sparse)), sizeof(sparse));
+  ck_assert_uint_eq(parsed.count, 2);
+  ck_assert_int_eq(bson_array_get_int32(&parsed, 0), 1);
+  ck_assert_int_eq(bson_array_get_int32(&parsed, 1), 2);
+  bson_array_deinitialize(&parsed);
+
+  // A run ends at the first value of a different type
+  uint8_t mixed[] = {
+    0x20, 0x00, 0x00, 0x00,
+    TYPE_INT32, '0', 0x00, 0x01, 0x00, 0x00, 0x00,
+    TYPE_INT32, '1', 0x00, 0x02, 0x00, 0x00, 0x00,
+    TYPE_STRING, '2', 0x00, 0x02, 0x00, 0x00, 0x00, 'a', 0x00,
+    TYPE_BOOLEAN, '3', 0x00, 0x01,
+    0x00
+  };
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, mixed, sizeof(mixed)), sizeof(mixed));
+  ck_assert_uint_eq(parsed.count, 4);
+  ck_assert_int_eq(bson_array_get_int32(&parsed, 1), 2);
+  ck_assert_str_eq(bson_array_get_string(&parsed, 2), "a");
+  ck_assert_int_eq(bson_array_get_bool(&parsed, 3), BOOLEAN_TRUE);
+  bson_array_deinitialize(&parsed);
+}
+END_TEST
+
+START_TEST(bson_array_from_bytes_strict_keys)
+{
+  uint8_t sequential[] = {
+    0x19, 0x00, 0x00, 0x00,
+    TYPE_INT32, '0', 0x00, 0x01, 0x00, 0x00, 0x00,
+    TYPE_STRING, '1', 0x00, 0x02, 0x00, 0x00, 0x00, 'a', 0x00,
+    TYPE_BOOLEAN, '2', 0x00, 0x01,
+    0x00
+  };
+  BsonArray parsed;
+  ck_assert_uint_eq(bson_array_from_bytes_strict(&parsed, sequential, sizeof(sequential)), sizeof(sequential));
+  ck_assert_uint_eq(parsed.count, 3);
+  ck_assert_str_eq(bson_array_get_string(&parsed, 1), "a");
+  bson_array_deinitialize(&parsed);
+
+  // Out of order keys are skipped unless parsing is strict
+  uint8_t outOfOrder[] = {
+    0x19, 0x00, 0x00, 0x00,
+    TYPE_INT32, '0', 0x00, 0x01, 0x00, 0x00, 0x00,
+    TYPE_STRING, '2', 0x00, 0x02, 0x00, 0x00, 0x00, 'a', 0x00,
+    TYPE_BOOLEAN, '1', 0x00, 0x01,
+    0x00
+  };
+  ck_assert_uint_eq(bson_array_from_bytes_strict(&parsed, outOfOrder, sizeof(outOfOrder)), 0);
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, outOfOrder, sizeof(outOfOrder)), sizeof(outOfOrder));
+  ck_assert_uint_eq(parsed.count, 3);
+  ck_assert_int_eq(bson_array_get_bool(&parsed, 2), BOOLEAN_TRUE);
+  bson_array_deinitialize(&parsed);
+
+  // Strict parsing also applies to nested arrays
+  uint8_t nested[] = {
+    0x1B, 0x00, 0x00, 0x00,
+    TYPE_ARRAY, '0', 0x00,
+      0x13, 0x00, 0x00, 0x00,
+      TYPE_INT32, '0', 0x00, 0x01, 0x00, 0x00, 0x00,
+      TYPE_INT32, '5', 0x00, 0x02, 0x00, 0x00, 0x00,
+      0x00,
+    0x00
+  };
+  ck_assert_uint_eq(bson_array_from_bytes_strict(&parsed, nested, sizeof(nested)), 0);
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, nested, sizeof(nested)), sizeof(nested));
+  bson_array_deinitialize(&parsed);
+
+  // A key without a terminating null character is an error
+  uint8_t unterminated[] = {
+    0x08, 0x00, 0x00, 0x00,
+    TYPE_BOOLEAN, 'x', 'y', 'z'
+  };
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, unterminated, sizeof(unterminated)), 0);
+}
+END_TEST
+
+START_TEST(bson_array_add_multiple_values)
+{
+  int32_t ints[] = { 1, 2, 3, 4, 5 };
+  BsonArray array;
+  bson_array_initialize(&array, 2);
+  ck_assert(bson_array_add_int32_n(&array, ints, 5));
+  ck_assert(bson_array_add_int32_n(&array, ints, 0));
+  ck_assert(bson_array_add_int32_n(&array, ints, 3));
+  ck_assert_uint_eq(array.count, 8);
+  ck_assert_ptr_ne(bson_array_get_int32_values(&array), NULL);
+  ck_assert_int_eq(bson_array_get_int32(&array, 4), 5);
+  ck_assert_int_eq(bson_array_get_int32(&array, 7), 3);
+
+  // Values of another type are added as separate elements
+  BsonArray shared;
+  ck_assert(bson_array_share(&shared, &array));
+  double doubles[] = { 0.5, 1.5 };
+  ck_assert(bson_array_add_double_n(&shared, doubles, 2));
+  ck_assert_uint_eq(array.count, 8);
+  ck_assert_ptr_ne(bson_array_get_int32_values(&array), NULL);
+  ck_assert_uint_eq(shared.count, 10);
+  ck_assert_ptr_eq(bson_array_get_int32_values(&shared), NULL);
+  ck_assert_int_eq(bson_array_get_int32(&shared, 7), 3);
+  ck_assert(bson_array_get_double(&shared, 9) == 1.5);
+
+  const char *strings[] = { "short", "a string longer than sixteen bytes", "embedded\0null" };
+  size_t lengths[] = { 5, 34, 13 };
+  ck_assert(bson_array_add_string_n(&shared, strings, lengths, 3));
+  ck_assert(bson_array_add_string_n(&shared, strings, NULL, 2));
+  ck_assert_uint_eq(shared.count, 15);
+  ck_assert_str_eq(bson_array_get_string(&shared, 11), "a string longer than sixteen bytes");
+  BsonElementSlot slot;
+  bson_element_slot_initialize(&slot);
+  ck_assert_uint_eq(bson_array_get_element(&shared, 12, &slot)->size, 13 + 5);
+  bson_element_slot_deinitialize(&slot);
+  ck_assert_str_eq(bson_array_get_string(&shared, 13), "short");
+
+  // Bulk and single appends produce the same encoding
+  int64_t longs[] = { INT64_MAX, -1 };
+  bson_boolean bools[] = { BOOLEAN_TRUE, BOOLEAN_FALSE };
+  BsonArray bulk;
+  bson_array_initialize(&bulk, 0);
+  ck_assert(bson_array_add_int64_n(&bulk, longs, 2));
+  ck_assert(bson_array_add_bool_n(&bulk, bools, 2));
+  BsonArray single;
+  bson_array_initialize(&single, 0);
+  ck_assert(bson_array_add_int64(&single, INT64_MAX));
+  ck_assert(bson_array_add_int64(&single, -1));
+  ck_assert(bson_array_add_bool(&single, true));
+  ck_assert(bson_array_add_bool(&single, false));
+  size_t size = bson_array_size(&single);
+  ck_assert_uint_eq(bson_array_size(&bulk), size);
+  uint8_t *bulkBytes = bson_array_to_bytes(&bulk);
+  uint8_t *singleBytes = bson_array_to_bytes(&single);
+  ck_assert_int_eq(memcmp(bulkBytes, singleBytes, size), 0);
+  free(bulkBytes);
+  free(singleBytes);
+
+  bson_array_deinitialize(&array);
+  bson_array_deinitialize(&shared);
+  bson_array_deinitialize(&bulk);
+  bson_array_deinitialize(&single);
+}
+END_TEST
+
+START_TEST(bson_array_splice_and_slice)
+{
+  int32_t ints[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  BsonArray array;
+  bson_array_initialize(&array, 0);
+  ck_assert(bson_array_add_int32_n(&array, ints, 8));
+  BsonArray values;
+  bson_array_initialize(&values, 2);
+  bson_array_add_int32(&values, 100);
+  bson_array_add_int32(&values, 101);
+
+  // Packed values stay packed
+  ck_assert(bson_array_insert(&array, 2, &values));
+  ck_assert(bson_array_remove(&array, 5, 3));
+  ck_assert(!bson_array_remove(&array, 6, 2));
+  ck_assert(!bson_array_insert(&array, 8, &values));
+  ck_assert_uint_eq(array.count, 7);
+  int32_t *packed = bson_array_get_int32_values(&array);
+  ck_assert_ptr_ne(packed, NULL);
+  int32_t expected[] = { 0, 1, 100, 101, 2, 6, 7 };
+  ck_assert_int_eq(memcmp(packed, expected, sizeof(expected)), 0);
+
+  // Slices are encoded like arrays containing only their elements
+  BsonArraySlice slice;
+  ck_assert(!bson_array_slice(&slice, &array, 5, 3));
+  ck_assert(bson_array_slice(&slice, &array, 2, 3));
+  BsonArray page;
+  bson_array_initialize(&page, 3);
+  bson_array_add_int32(&page, 100);
+  bson_array_add_int32(&page, 101);
+  bson_array_add_int32(&page, 2);
+  size_t size = bson_array_size(&page);
+  ck_assert_uint_eq(bson_array_slice_size(&slice), size);
+  uint8_t *pageBytes = bson_array_to_bytes(&page);
+  uint8_t *sliceBytes = bson_array_slice_to_bytes(&slice);
+  ck_assert_int_eq(memcmp(pageBytes, sliceBytes, size), 0);
+  free(pageBytes);
+  free(sliceBytes);
+  bson_array_deinitialize(&page);
+
+  // Inserting values of another type converts the array to separate elements
+  bson_array_deinitialize(&values);
+  bson_array_initialize(&values, 2);
+  bson_array_add_string(&values, "short");
+  bson_array_add_string(&values, "a string longer than sixteen bytes");
+  BsonArray shared;
+  ck_assert(bson_array_share(&shared, &array));
+  ck_assert(bson_array_splice(&shared, 1, 1, &values));
+  ck_assert_uint_eq(array.count, 7);
+  ck_assert_uint_eq(shared.count, 8);
+  ck_assert_ptr_eq(bson_array_get_int32_values(&shared), NULL);
+  ck_assert_str_eq(bson_array_get_string(&shared, 1), "short");
+  ck_assert_str_eq(bson_array_get_string(&shared, 2), "a string longer than sixteen bytes");
+  ck_assert_int_eq(bson_array_get_int32(&shared, 3), 100);
+
+  // Short strings remain valid when elements are moved
+  ck_assert(bson_array_remove(&shared, 0, 1));
+  ck_assert(bson_array_insert(&shared, 3, &shared));
+  ck_assert_uint_eq(shared.count, 14);
+  ck_assert_str_eq(bson_array_get_string(&shared, 0), "short");
+  ck_assert_str_eq(bson_array_get_string(&shared, 3), "short");
+  ck_assert_str_eq(bson_array_get_string(&shared, 4), "a string longer than sixteen bytes");
+  ck_assert_int_eq(bson_array_get_int32(&shared, 10), 101);
+  ck_assert_int_eq(bson_array_get_int32(&shared, 13), 7);
+
+  // Slices of separate elements are renumbered from 0
+  ck_assert(bson_array_slice(&slice, &shared, 3, 2));
+  sliceBytes = bson_array_slice_to_bytes(&slice);
+  BsonArray parsed;
+  ck_assert_uint_eq(bson_array_from_bytes_strict(&parsed, sliceBytes, bson_array_slice_size(&slice)), 
+                    bson_array_slice_size(&slice));
+  free(sliceBytes);
+  ck_assert_uint_eq(parsed.count, 2);
+  ck_assert_str_eq(bson_array_get_string(&parsed, 0), "short");
+  ck_assert_str_eq(bson_array_get_string(&parsed, 1), "a string longer than sixteen bytes");
+  bson_array_deinitialize(&parsed);
+
+  bson_array_deinitialize(&values);
+  bson_array_deinitialize(&shared);
+  bson_array_deinitialize(&array);
+}
+END_TEST
+
+START_TEST(bson_array_columnar_objects)
+{
+  BsonArray rows;
+  bson_array_initialize(&rows, 100);
+  int32_t i = 0;
+  for (i = 0; i < 100; i++) {
+    BsonObject *row = malloc(sizeof(BsonObject));
+    bson_object_initialize_default(row);
+    bson_object_put_int32(row, "id", i);
+    bson_object_put_string(row, "name", (i % 2 == 0) ? "short" : "a string longer than sixteen bytes");
+    bson_object_put_double(row, "score", i * 0.5);
+    bson_object_put_bool(row, "active", (i % 3 == 0) ? BOOLEAN_TRUE : BOOLEAN_FALSE);
+    ck_assert(bson_array_add_object_owned(&rows, row));
+  }
+  ck_assert_ptr_eq(bson_array_get_column(&rows, "id"), NULL);
+  size_t size = bson_array_size(&rows);
+  uint8_t *bytes = bson_array_to_bytes(&rows);
+
+  // Arrays of same-shaped objects are parsed into columns and encoded back unchanged
+  BsonArray parsed;
+  ck_assert_uint_eq(bson_array_from_bytes_len(&parsed, bytes, size), size);
+  ck_assert_uint_eq(parsed.count, 100);
+  BsonArray *ids = bson_array_get_column(&parsed, "id");
+  ck_assert_ptr_ne(ids, NULL);
+  ck_assert_int_eq(bson_array_get_int32_values(ids)[42], 42);
+  ck_assert_str_eq(bson_array_get_string(bson_array_get_column(&parsed, "name"), 1), 
+                   "a string longer than sixteen bytes");
+  ck_assert_ptr_eq(bson_array_get_column(&parsed, "missing"), NULL);
+  ck_assert_int_eq(bson_array_get_int32(&parsed, 0), -1);
+  ck_assert_uint_eq(bson_array_size(&parsed), size);
+  uint8_t *columnBytes = bson_array_to_bytes(&parsed);
+  ck_assert_int_eq(memcmp(bytes, columnBytes, size), 0);
+  free(columnBytes);
+
+  // Slices and shared arrays of columns
+  BsonArraySlice slice;
+  ck_assert(bson_array_slice(&slice, &parsed, 10, 5));
+  uint8_t *sliceBytes = bson_array_slice_to_bytes(&slice);
+  BsonArray page;
+  ck_assert_uint_eq(bson_array_from_bytes_strict(&page, sliceBytes, bson_array_slice_size(&slice)), 
+                    bson_array_slice_size(&slice));
+  free(sliceBytes);
+  ck_assert_int_eq(bson_array_get_int32_values(bson_array_get_column(&page, "id"))[0], 10);
+  bson_array_deinitialize(&page);
+
+  // Objects with the same keys and types are added to the columns
+  BsonArray shared;
+  ck_assert(bson_array_share(&shared, &parsed));
+  BsonObject *row = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(row);
+  bson_object_put_int32(row, "id", 100);
+  bson_object_put_string(row, "name", "new");
+  bson_object_put_double(row, "score", 50.0);
+  bson_object_put_bool(row, "active", BOOLEAN_TRUE);
+  ck_assert(bson_array_add_object_owned(&shared, row));
+  ck_assert_uint_eq(shared.count, 101);
+  ck_assert_uint_eq(parsed.count, 100);
+  ck_assert_int_eq(bson_array_get_int32_values(bson_array_get_column(&shared, "id"))[100], 100);
+  ck_assert_uint_eq(bson_array_get_column(&parsed, "id")->count, 100);
+  BsonObject copied;
+  bson_object_initialize_default(&copied);
+  bson_object_put_int32(&copied, "id", 200);
+  bson_object_put_string(&copied, "name", "copied");
+  bson_object_put_double(&copied, "score", 1.0);
+  bson_object_put_bool(&copied, "active", BOOLEAN_FALSE);
+  BsonArray extended;
+  ck_assert(bson_array_share(&extended, &parsed));
+  ck_assert(bson_array_add_object(&extended, &copied));
+  ck_assert_uint_eq(extended.count, 101);
+  ck_assert_str_eq(bson_array_get_string(bson_array_get_column(&extended, "name"), 100), "copied");
+  bson_array_deinitialize(&extended);
+
+  // Other objects convert the array to separate objects
+  row = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(row);
+  bson_object_put_int32(row, "id", 101);
+  ck_assert(bson_array_add_object_owned(&shared, row));
+  ck_assert_ptr_eq(bson_array_get_column(&shared, "id"), NULL);
+  ck_assert_uint_eq(shared.count, 102);
+  ck_assert_str_eq(bson_object_get_string(bson_array_get_object(&shared, 100), "name"), "new");
+  ck_assert_int_eq(bson_object_get_int32(bson_array_get_object(&shared, 101), "id"), 101);
+  ck_assert(bson_object_get_double(bson_array_get_object(&shared, 7), "score") == 3.5);
+  ck_assert_int_eq(bson_object_get_bool(bson_array_get_object(&shared, 9), "active"), BOOLEAN_TRUE);
+
+  // Printing reads the columns without creating objects
+  char *text = malloc(100 * 128);
+  bson_array_to_string(&parsed, text);
+  ck_assert_ptr_ne(strstr(text, "a string longer than sixteen bytes"), NULL);
+  free(text);
+  ck_assert_ptr_ne(bson_array_get_column(&parsed, "id"), NULL);
+
+  // Reading elements into a slot neither creates objects in the columns nor unshares them
+  ck_assert(bson_array_share(&extended, &parsed));
+  BsonElementSlot slot;
+  bson_element_slot_initialize(&slot);
+  const BsonElement *element = bson_array_get_element(&extended, 3, &slot);
+  ck_assert_int_eq(element->type, TYPE_DOCUMENT);
+  ck_assert_int_eq(bson_object_get_int32((BsonObject *)element->value, "id"), 3);
+  const BsonElement *other = bson_array_get_element(&extended, 4, &slot);
+  ck_assert_int_eq(bson_object_get_int32((BsonObject *)other->value, "id"), 4);
+  ck_assert_uint_eq(extended.columns->detachedCount, 0);
+  ck_assert_ptr_eq(extended.columns, parsed.columns);
+  ck_assert_ptr_ne(bson_array_get_column(&extended, "id"), NULL);
+  bson_element_slot_deinitialize(&slot);
+  bson_array_deinitialize(&extended);
+
+  // Retrieving an object only creates that object, which replaces its values in the columns
+  BsonObject *first = bson_array_get_object(&parsed, 0);
+  ck_assert_ptr_ne(first, NULL);
+  ck_assert_ptr_eq(bson_array_get_object(&parsed, 0), first);
+  ck_assert_ptr_ne(parsed.columns, NULL);
+  ck_assert_ptr_ne(bson_array_get_column(&parsed, "id"), NULL);
+  ck_assert_str_eq(bson_object_get_string(first, "name"), "short");
+  columnBytes = bson_array_to_bytes(&parsed);
+  ck_assert_uint_eq(bson_array_size(&parsed), size);
+  ck_assert_int_eq(memcmp(bytes, columnBytes, size), 0);
+  free(columnBytes);
+  ck_assert(bson_object_put_string(first, "name", "changed"));
+  ck_assert_str_eq(bson_array_get_string(bson_array_get_column(&parsed, "name"), 0), "changed");
+  ck_assert_ptr_eq(bson_array_get_object(&parsed, 0), first);
+  ck_assert(bson_object_put_int32(first, "extra", 1));
+  ck_assert_ptr_eq(bson_array_get_column(&parsed, "name"), NULL);
+  ck_assert_uint_eq(bson_array_size(&parsed), size + (7 - 5) + (ELEMENT_OVERHEAD_BYTES + 6 + SIZE_INT32));
+  columnBytes = bson_array_to_bytes(&parsed);
+  BsonArray reparsed;
+  ck_assert_uint_eq(bson_array_from_bytes_len(&reparsed, columnBytes, bson_array_size(&parsed)), bson_array_size(&parsed));
+  free(columnBytes);
+  ck_assert_ptr_eq(reparsed.columns, NULL);
+  ck_assert_str_eq(bson_object_get_string(bson_array_get_object(&reparsed, 0), "name"), "changed");
+  ck_assert_int_eq(bson_object_get_int32(bson_array_get_object(&reparsed, 0), "extra"), 1);
+  ck_assert_int_eq(bson_object_get_int32(bson_array_get_object(&reparsed, 99), "id"), 99);
+  bson_array_deinitialize(&reparsed);
+  BsonArray copy;
+  ck_assert(bson_array_clone(&copy, &parsed));
+  ck_assert(bson_object_put_int32(bson_array_get_object(&parsed, 0), "extra", 2));
+  ck_assert_int_eq(bson_object_get_int32(bson_array_get_object(&copy, 0), "extra"), 1);
+  ck_assert_int_eq(bson_object_get_int32(bson_array_get_object(&copy, 5), "id"), 5);
+  bson_array_deinitialize(&copy);
+  bson_array_deinitialize(&parsed);
+
+  // Objects with different shapes are parsed separately
+  row = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(row);
+  bson_object_put_string(row, "id", "not a number");
+  ck_assert(bson_array_add_object_owned(&rows, row));
+  free(bytes);
+  size = bson_array_size(&rows);
+  bytes = bson_array_to_bytes(&rows);
+  BsonArray mixed;
+  ck_assert_uint_eq(bson_array_from_bytes_len(&mixed, bytes, size), size);
+  ck_assert_ptr_eq(bson_array_get_column(&mixed, "id"), NULL);
+  ck_assert_uint_eq(mixed.count, 101);
+  ck_assert_str_eq(bson_object_get_string(bson_array_get_object(&mixed, 100), "id"), "not a number");
+  free(bytes);
+
+  // Columnar arrays can also be built directly
+  const char *keys[] = { "id", "name" };
+  element_type types[] = { TYPE_INT32, TYPE_STRING };
+  BsonArray built;
+  ck_assert(!bson_array_initialize_columnar(&built, keys, (element_type[]){ TYPE_INT32, TYPE_ARRAY }, 2, 4));
+  ck_assert(bson_array_initialize_columnar(&built, keys, types, 2, 4));
+  row = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(row);
+  bson_object_put_int32(row, "id", 7);
+  bson_object_put_string(row, "name", "seven");
+  ck_assert(bson_array_add_object_owned(&built, row));
+  ck_assert_uint_eq(bson_array_get_column(&built, "name")->count, 1);
+  BsonArray clone;
+  ck_assert(bson_array_clone(&clone, &built));
+  bytes = bson_array_to_bytes(&clone);
+  ck_assert_uint_eq(bson_array_from_bytes_strict(&parsed, bytes, bson_array_size(&clone)), bson_array_size(&clone));
+  free(bytes);
+  ck_assert_str_eq(bson_array_get_string(bson_array_get_column(&parsed, "name"), 0), "seven");
+
+  bson_array_deinitialize(&rows);
+  bson_array_deinitialize(&shared);
+  bson_array_deinitialize(&mixed);
+  bson_array_deinitialize(&built);
+  bson_array_deinitialize(&clone);
+  bson_array_deinitialize(&parsed);
+}
+END_TEST
+
+START_TEST(bson_array_file_backed_values)
+{
+  BsonArray fileBacked;
+  ck_assert(!bson_array_initialize_file_backed(&fileBacked, TYPE_STRING, 4));
+  ck_assert(bson_array_initialize_file_backed(&fileBacked, TYPE_INT64, 4));
+  BsonArray heap;
+  bson_array_initialize_typed(&heap, TYPE_INT64, 4);
+  int64_t values[1000];
+  int64_t i = 0;
+  for (i = 0; i < 1000; i++) {
+    values[i] = i * 1000003;
+  }
+  for (i = 0; i < 100; i++) {
+    ck_assert(bson_array_add_int64(&fileBacked, -i));
+    ck_assert(bson_array_add_int64(&heap, -i));
+  }
+  for (i = 0; i < 50; i++) {
+    ck_assert(bson_array_add_int64_n(&fileBacked, values, 1000));
+    ck_assert(bson_array_add_int64_n(&heap, values, 1000));
+  }
+  ck_assert(fileBacked.packedFile >= 0);
+  ck_assert_uint_eq(fileBacked.count, 50100);
+  ck_assert_int_eq(bson_array_get_int64(&fileBacked, 99), -99);
+  ck_assert_int_eq(bson_array_get_int64_values(&fileBacked)[50099], 999 * 1000003);
+
+  // File-backed values are encoded like any other packed values
+  size_t size = bson_array_size(&heap);
+  ck_assert_uint_eq(bson_array_size(&fileBacked), size);
+  uint8_t *bytes = bson_array_to_bytes(&heap);
+  uint8_t *fileBytes = bson_array_to_bytes(&fileBacked);
+  ck_assert_int_eq(memcmp(bytes, fileBytes, size), 0);
+  free(bytes);
+  free(fileBytes);
+
+  // Copies have their own file
+  BsonArray shared;
+  ck_assert(bson_array_share(&shared, &fileBacked));
+  ck_assert(bson_array_remove(&shared, 0, 100));
+  ck_assert(shared.packedFile >= 0);
+  ck_assert_int_ne(shared.packedFile, fileBacked.packedFile);
+  ck_assert_int_eq(bson_array_get_int64(&shared, 1), 1000003);
+  ck_assert_int_eq(bson_array_get_int64(&fileBacked, 1), -1);
+
+  // Values of another type move the array to the heap
+  ck_assert(bson_array_add_string(&shared, "end"));
+  ck_assert_int_eq(shared.packedFile, -1);
+  ck_assert_int_eq(bson_array_get_int64(&shared, 49999), 999 * 1000003);
+  ck_assert_str_eq(bson_array_get_string(&shared, 50000), "end");
+
+  bson_array_deinitialize(&shared);
+  bson_array_deinitialize(&fileBacked);
+  bson_array_deinitialize(&heap);
+}
+END_TEST
+
+START_TEST(bson_array_parallel_conversion)
+{
+  BsonArray packed;
+  bson_array_initialize_typed(&packed, TYPE_INT32, 4);
+  BsonArray mixed;
+  bson_array_initialize(&mixed, 4);
+  int32_t i = 0;
+  for (i = 0; i < 40000; i++) {
+    bson_array_add_int32(&packed, i * 7919);
+    if (i % 3 == 0) {
+      bson_array_add_string(&mixed, (i % 2 == 0) ? "short" : "a string too long to be stored inline");
+    }
+    else if (i % 3 == 1) {
+      BsonObject *obj = malloc(sizeof(BsonObject));
+      bson_object_initialize_default(obj);
+      bson_object_put_int32(obj, "index", i);
+      bson_array_add_object_owned(&mixed, obj);
+    }
+    else {
+      bson_array_add_double(&mixed, i * 0.5);
+    }
+  }
+
+  // Chunks are written at their offsets, giving the same bytes as a single thread
+  size_t size = bson_array_size(&packed);
+  uint8_t *bytes = bson_array_to_bytes(&packed);
+  uint8_t *parallelBytes = bson_array_to_bytes_parallel(&packed, 4);
+  ck_assert_int_eq(memcmp(bytes, parallelBytes, size), 0);
+  free(parallelBytes);
+
+  BsonArray parsed;
+  ck_assert_uint_eq(bson_array_from_bytes_parallel(&parsed, bytes, size, 4), size);
+  ck_assert_uint_eq(parsed.count, 40000);
+  ck_assert(parsed.packedSize != 0);
+  ck_assert_int_eq(bson_array_get_int32(&parsed, 39999), 39999 * 7919);
+  parallelBytes = bson_array_to_bytes(&parsed);
+  ck_assert_int_eq(memcmp(bytes, parallelBytes, size), 0);
+  free(parallelBytes);
+  bson_array_deinitialize(&parsed);
+  free(bytes);
+
+  size = bson_array_size(&mixed);
+  bytes = bson_array_to_bytes(&mixed);
+  parallelBytes = bson_array_to_bytes_parallel(&mixed, 3);
+  ck_assert_int_eq(memcmp(bytes, parallelBytes, size), 0);
+  free(parallelBytes);
+
+  ck_assert_uint_eq(bson_array_from_bytes_parallel(&parsed, bytes, size, 3), size);
+  ck_assert_uint_eq(parsed.count, 40000);
+  ck_assert_str_eq(bson_array_get_string(&parsed, 39999), "a string too long to be stored inline");
+  ck_assert_str_eq(bson_array_get_string(&parsed, 39996), "short");
+  ck_assert_int_eq(bson_object_get_int32(bson_array_get_object(&parsed, 39997), "index"), 39997);
+  ck_assert(bson_array_get_double(&parsed, 39998) == 39998 * 0.5);
+  parallelBytes = bson_array_to_bytes(&parsed);
+  ck_assert_int_eq(memcmp(bytes, parallelBytes, size), 0);
+  free(parallelBytes);
+  bson_array_deinitialize(&parsed);
+
+  // Invalid values inside a chunk are still rejected
+  size_t position = size / 2;
+  while (memcmp(&bytes[position], "index", 6) != 0) {
+    position++;
+  }
+  bytes[position - 1] = 0x7F;
+  ck_assert_uint_eq(bson_array_from_bytes_parallel(&parsed, bytes, size, 3), 0);
+  free(bytes);
+
+  // Small arrays are converted by the calling thread alone
+  BsonArray small;
+  bson_array_initialize(&small, 2);
+  bson_array_add_int64(&small, 12);
+  bson_array_add_string(&small, "end");
+  size = bson_array_size(&small);
+  bytes = bson_array_to_bytes_parallel(&small, 8);
+  ck_assert_uint_eq(bson_array_from_bytes_parallel(&parsed, bytes, size, 8), size);
+  ck_assert_int_eq(bson_array_get_int64(&parsed, 0), 12);
+  ck_assert_str_eq(bson_array_get_string(&parsed, 1), "end");
+  free(bytes);
+
+  bson_array_deinitialize(&parsed);
+  bson_array_deinitialize(&small);
+  bson_array_deinitialize(&packed);
+  bson_array_deinitialize(&mixed);
+}
+END_TEST
+
+START_TEST(bson_object_to_buffer_single_pass)
+{
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  bson_object_put_int32(&obj, "id", 42);
+  bson_object_put_string(&obj, "name", "a string too long to be stored inline");
+  BsonObject *sub = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(sub);
+  bson_object_put_bool(sub, "flag", BOOLEAN_TRUE);
+  BsonArray *packed = malloc(sizeof(BsonArray));
+  bson_array_initialize_typed(packed, TYPE_INT64, 4);
+  int64_t packedValues[] = { 1, -2, 3 };
+  bson_array_add_int64_n(packed, packedValues, 3);
+  bson_object_put_array_owned(sub, "packed", packed);
+  BsonArray *values = malloc(sizeof(BsonArray));
+  bson_array_initialize(values, 4);
+  bson_array_add_double(values, 0.5);
+  bson_array_add_string(values, "end");
+  bson_array_add_object_owned(values, sub);
+  bson_object_put_array_owned(&obj, "values", values);
+
+  // The buffer is filled in one pass, leaving room at the start for a transport header
+  size_t size = bson_object_size(&obj);
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  uint8_t buffer[512];
+  size_t written = 0;
+  ck_assert(bson_object_to_buffer(&obj, &buffer[8], sizeof(buffer) - 8, &written));
+  ck_assert_uint_eq(written, size);
+  ck_assert_int_eq(memcmp(&buffer[8], bytes, size), 0);
+  free(bytes);
+
+  // Buffers which are too small report the required size
+  written = 0;
+  ck_assert(!bson_object_to_buffer(&obj, buffer, size - 1, &written));
+  ck_assert_uint_eq(written, size);
+  written = 0;
+  ck_assert(!bson_object_to_buffer(&obj, buffer, 3, &written));
+  ck_assert_uint_eq(written, size);
+
+  size = bson_array_size(values);
+  bytes = bson_array_to_bytes(values);
+  ck_assert(bson_array_to_buffer(values, buffer, size, &written));
+  ck_assert_uint_eq(written, size);
+  ck_assert_int_eq(memcmp(buffer, bytes, size), 0);
+  free(bytes);
+  written = 0;
+  ck_assert(!bson_array_to_buffer(values, buffer, size - 5, &written));
+  ck_assert_uint_eq(written, size);
+  written = 0;
+  ck_assert(!bson_array_to_buffer(packed, buffer, bson_array_size(packed) - 1, &written));
+  ck_assert_uint_eq(written, bson_array_size(packed));
+
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+START_TEST(bson_writer_streaming)
+{
+  BsonWriter writer;
+  ck_assert(bson_writer_initialize(&writer, 8));
+  ck_assert(!bson_writer_append_int32(&writer, "id", 1));
+  ck_assert(bson_writer_begin_document(&writer));
+  ck_assert(bson_writer_append_int32(&writer, "id", 42));
+  ck_assert(bson_writer_append_string_len(&writer, "name", "a\0b", 3));
+  ck_assert(bson_writer_begin_object(&writer, "nested"));
+  ck_assert(bson_writer_append_bool(&writer, "flag", BOOLEAN_TRUE));
+  ck_assert(bson_writer_begin_array(&writer, "values"));
+  ck_assert(bson_writer_append_int64(&writer, NULL, 7));
+  ck_assert(bson_writer_append_string(&writer, "ignored", "two"));
+  ck_assert(bson_writer_append_double(&writer, NULL, 3.5));
+  ck_assert(!bson_writer_end_object(&writer));
+  ck_assert(bson_writer_end_array(&writer));
+  ck_assert(bson_writer_end_object(&writer));
+  BsonObject existing;
+  bson_object_initialize_default(&existing);
+  bson_object_put_string(&existing, "key", "a string too long to be stored inline");
+  ck_assert(bson_writer_append_object(&writer, "existing", &existing));
+  size_t size = 0;
+  ck_assert_ptr_eq(bson_writer_get_bytes(&writer, &size), NULL);
+  ck_assert(bson_writer_end_document(&writer));
+
+  // Length prefixes were filled in when each container was ended
+  const uint8_t *bytes = bson_writer_get_bytes(&writer, &size);
+  BsonObject parsed;
+  ck_assert_uint_eq(bson_object_from_bytes_len(&parsed, bytes, size), size);
+  ck_assert_uint_eq(bson_object_size(&parsed), size);
+  ck_assert_int_eq(bson_object_get_int32(&parsed, "id"), 42);
+  size_t length = 0;
+  ck_assert_int_eq(memcmp(bson_object_get_string_len(&parsed, "name", &length), "a\0b", 3), 0);
+  ck_assert_uint_eq(length, 3);
+  BsonObject *nested = bson_object_get_object(&parsed, "nested");
+  ck_assert_int_eq(bson_object_get_bool(nested, "flag"), BOOLEAN_TRUE);
+  BsonArray *values = bson_object_get_array(nested, "values");
+  ck_assert_uint_eq(values->count, 3);
+  ck_assert_int_eq(bson_array_get_int64(values, 0), 7);
+  ck_assert_str_eq(bson_array_get_string(values, 1), "two");
+  ck_assert(bson_array_get_double(values, 2) == 3.5);
+  ck_assert_str_eq(bson_object_get_string(bson_object_get_object(&parsed, "existing"), "key"), 
+                   "a string too long to be stored inline");
+  bson_object_deinitialize(&parsed);
+
+  // The buffer is reused for the next document, discarding unfinished ones
+  bson_writer_reset(&writer);
+  ck_assert(bson_writer_begin_document(&writer));
+  ck_assert(!bson_writer_begin_document(&writer));
+  ck_assert(bson_writer_begin_array(&writer, "unfinished"));
+  bson_writer_reset(&writer);
+  ck_assert(bson_writer_begin_document(&writer));
+  ck_assert(bson_writer_end_document(&writer));
+  bytes = bson_writer_get_bytes(&writer, &size);
+  ck_assert_uint_eq(size, OBJECT_OVERHEAD_BYTES);
+  ck_assert_int_eq(bytes[0], OBJECT_OVERHEAD_BYTES);
+
+  bson_object_deinitialize(&existing);
+  bson_writer_deinitialize(&writer);
+}
+END_TEST
+
+START_TEST(bson_iovec_references_large_strings)
+{
+  char large[5000];
+  memset(large, 'x', sizeof(large) - 1);
+  large[sizeof(large) - 1] = 0x00;
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  bson_object_put_int32(&obj, "id", 42);
+  bson_object_put_string(&obj, "small", "copied");
+  bson_object_put_string(&obj, "large", large);
+  BsonArray *values = malloc(sizeof(BsonArray));
+  bson_array_initialize(values, 2);
+  bson_array_add_string(values, large);
+  bson_array_add_bool(values, BOOLEAN_FALSE);
+  bson_object_put_array_owned(&obj, "values", values);
+
+  BsonIovec iovec;
+  ck_assert(bson_iovec_initialize(&iovec, 1024));
+  ck_assert(bson_iovec_add_object(&iovec, &obj));
+  size_t count = 0;
+  const struct iovec *vectors = bson_iovec_get_vectors(&iovec, &count);
+  ck_assert_ptr_ne(vectors, NULL);
+
+  // Large strings are referenced in place, the framing in between is copied
+  ck_assert_uint_eq(count, 5);
+  size_t size = bson_object_size(&obj);
+  ck_assert_uint_eq(iovec.size, size);
+  ck_assert_uint_lt(iovec.scratchSize, 100);
+  uint8_t *gathered = malloc(size);
+  size_t position = 0;
+  size_t i = 0;
+  size_t referenced = 0;
+  for (i = 0; i < count; i++) {
+    if (vectors[i].iov_base == bson_object_get_string(&obj, "large") || 
+        vectors[i].iov_base == bson_array_get_string(values, 0)) {
+      referenced++;
+    }
+    memcpy(&gathered[position], vectors[i].iov_base, vectors[i].iov_len);
+    position += vectors[i].iov_len;
+  }
+  ck_assert_uint_eq(referenced, 2);
+  ck_assert_uint_eq(position, size);
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  ck_assert_int_eq(memcmp(gathered, bytes, size), 0);
+  free(bytes);
+  free(gathered);
+
+  // Documents are appended after each other
+  BsonArray packed;
+  bson_array_initialize_typed(&packed, TYPE_INT32, 4);
+  bson_array_add_int32(&packed, 7);
+  ck_assert(bson_iovec_add_array(&iovec, &packed));
+  vectors = bson_iovec_get_vectors(&iovec, &count);
+  ck_assert_uint_eq(count, 5);
+  ck_assert_uint_eq(iovec.size, size + bson_array_size(&packed));
+  bson_iovec_reset(&iovec);
+  ck_assert_uint_eq(iovec.size, 0);
+
+  // Short strings are not moved when their array grows, so they can be referenced as well
+  BsonIovec all;
+  ck_assert(bson_iovec_initialize(&all, 0));
+  BsonArray strings;
+  bson_array_initialize(&strings, 1);
+  bson_array_add_string(&strings, "ab");
+  ck_assert(bson_iovec_add_array(&all, &strings));
+  bson_array_add_string(&strings, "cd");
+  vectors = bson_iovec_get_vectors(&all, &count);
+  ck_assert_uint_eq(count, 3);
+  ck_assert_ptr_eq(vectors[1].iov_base, bson_array_get_string(&strings, 0));
+  bson_array_deinitialize(&strings);
+  bson_iovec_deinitialize(&all);
+
+  bson_array_deinitialize(&packed);
+  bson_iovec_deinitialize(&iovec);
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+//Collects the chunks of a streamed document for bson_object_write_stream_chunks
+struct StreamCapture {
+  uint8_t bytes[8192];
+  size_t size;
+  size_t chunks;
+  size_t chunkSize;
+  bool shortChunk;
+  size_t stopAfter;
+};
+
+static bool capture_chunk(void *context, const uint8_t *data, size_t length) {
+  struct StreamCapture *capture = (struct StreamCapture *)context;
+  //Only the last chunk may be shorter than the chunk size
+  if (capture->shortChunk || length > capture->chunkSize) {
+    return false;
+  }
+  capture->shortChunk = (length < capture->chunkSize);
+  memcpy(&capture->bytes[capture->size], data, length);
+  capture->size += length;
+  capture->chunks++;
+  return capture->chunks != capture->stopAfter;
+}
+
+START_TEST(bson_object_write_stream_chunks)
+{
+  char large[1000];
+  memset(large, 'y', sizeof(large) - 1);
+  large[sizeof(large) - 1] = 0x00;
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  bson_object_put_string(&obj, "large", large);
+  bson_object_put_double(&obj, "ratio", 0.25);
+  BsonArray *packed = malloc(sizeof(BsonArray));
+  bson_array_initialize_typed(packed, TYPE_INT32, 4);
+  int32_t i = 0;
+  for (i = 0; i < 200; i++) {
+    bson_array_add_int32(packed, i * 3);
+  }
+  bson_object_put_array_owned(&obj, "packed", packed);
+  const char *keys[] = { "id", "name" };
+  element_type types[] = { TYPE_INT32, TYPE_STRING };
+  BsonArray *columnar = malloc(sizeof(BsonArray));
+  bson_array_initialize_columnar(columnar, keys, types, 2, 4);
+  for (i = 0; i < 3; i++) {
+    BsonObject *row = malloc(sizeof(BsonObject));
+    bson_object_initialize_default(row);
+    bson_object_put_int32(row, "id", i);
+    bson_object_put_string(row, "name", (i == 1) ? large : "row");
+    bson_array_add_object_owned(columnar, row);
+  }
+  ck_assert_uint_eq(bson_array_get_column(columnar, "id")->count, 3);
+  bson_object_put_array_owned(&obj, "rows", columnar);
+  BsonObject *sub = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(sub);
+  bson_object_put_bool(sub, "flag", BOOLEAN_TRUE);
+  bson_object_put_int64(sub, "count", 1234567890123);
+  bson_object_put_object_owned(&obj, "sub", sub);
+
+  // Chunks of an odd size split keys, values and long strings
+  size_t size = bson_object_size(&obj);
+  ck_assert_uint_lt(size, sizeof(((struct StreamCapture *)NULL)->bytes));
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  struct StreamCapture capture = { { 0 }, 0, 0, 7, false, 0 };
+  ck_assert(bson_object_write_stream(&obj, capture_chunk, &capture, 7));
+  ck_assert_uint_eq(capture.size, size);
+  ck_assert_uint_eq(capture.chunks, (size + 6) / 7);
+  ck_assert_int_eq(memcmp(capture.bytes, bytes, size), 0);
+  free(bytes);
+
+  size = bson_array_size(columnar);
+  bytes = bson_array_to_bytes(columnar);
+  capture = (struct StreamCapture){ { 0 }, 0, 0, 64, false, 0 };
+  ck_assert(bson_array_write_stream(columnar, capture_chunk, &capture, 64));
+  ck_assert_uint_eq(capture.size, size);
+  ck_assert_int_eq(memcmp(capture.bytes, bytes, size), 0);
+  free(bytes);
+
+  // Objects retrieved from the columns are streamed in place of their values
+  ck_assert(bson_object_put_int32(bson_array_get_object(columnar, 1), "extra", 5));
+  size = bson_array_size(columnar);
+  bytes = bson_array_to_bytes(columnar);
+  capture = (struct StreamCapture){ { 0 }, 0, 0, 64, false, 0 };
+  ck_assert(bson_array_write_stream(columnar, capture_chunk, &capture, 64));
+  ck_assert_uint_eq(capture.size, size);
+  ck_assert_int_eq(memcmp(capture.bytes, bytes, size), 0);
+  free(bytes);
+
+  // The callback can stop the stream
+  capture = (struct StreamCapture){ { 0 }, 0, 0, 16, false, 3 };
+  ck_assert(!bson_object_write_stream(&obj, capture_chunk, &capture, 16));
+  ck_assert_uint_eq(capture.chunks, 3);
+
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+/*
+  @brief Find the first occurrence of a sequence of bytes, returning the size of the data if there is none
+*/
+static size_t find_bytes(const uint8_t *data, size_t size, const char *pattern, size_t length) {
+  size_t i = 0;
+  for (i = 0; i + length <= size; i++) {
+    if (memcmp(&data[i], pattern, length) == 0) {
+      return i;
+    }
+  }
+  return size;
+}
+
+/*
+  @brief Fill an object with the same values in a given order, used to compare canonical encodings
+*/
+static void put_canonical_values(BsonObject *obj, bool reverse) {
+  const char *rowKeys[] = { "name", "id" };
+  element_type rowTypes[] = { TYPE_STRING, TYPE_INT32 };
+  const char *reversedKeys[] = { "id", "name" };
+  element_type reversedTypes[] = { TYPE_INT32, TYPE_STRING };
+  BsonObject *sub = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(sub);
+  BsonArray *rows = malloc(sizeof(BsonArray));
+  bson_array_initialize_columnar(rows, reverse ? reversedKeys : rowKeys, reverse ? reversedTypes : rowTypes, 2, 4);
+  BsonArray *list = malloc(sizeof(BsonArray));
+  bson_array_initialize(list, 2);
+  BsonObject *item = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(item);
+  int32_t i = 0;
+  for (i = 0; i < 20; i++) {
+    char key[8];
+    sprintf(key, "k%02i", reverse ? 19 - i : i);
+    bson_object_put_int32(sub, key, reverse ? 19 - i : i);
+  }
+  for (i = 0; i < 3; i++) {
+    BsonObject *row = malloc(sizeof(BsonObject));
+    bson_object_initialize_default(row);
+    bson_object_put_int32(row, "id", i);
+    bson_object_put_string(row, "name", "row");
+    bson_array_add_object_owned(rows, row);
+  }
+  if (reverse) {
+    bson_object_put_bool(item, "y", BOOLEAN_TRUE);
+    bson_object_put_double(item, "x", 0.5);
+    bson_array_add_object_owned(list, item);
+    bson_array_add_int64(list, 42);
+    bson_object_put_array_owned(obj, "rows", rows);
+    bson_object_put_array_owned(obj, "list", list);
+    bson_object_put_object_owned(obj, "sub", sub);
+    bson_object_put_string(obj, "alpha", "first");
+    bson_object_put_int32(obj, "zeta", 1);
+  }
+  else {
+    bson_object_put_double(item, "x", 0.5);
+    bson_object_put_bool(item, "y", BOOLEAN_TRUE);
+    bson_array_add_object_owned(list, item);
+    bson_array_add_int64(list, 42);
+    bson_object_put_int32(obj, "zeta", 1);
+    bson_object_put_string(obj, "alpha", "first");
+    bson_object_put_object_owned(obj, "sub", sub);
+    bson_object_put_array_owned(obj, "list", list);
+    bson_object_put_array_owned(obj, "rows", rows);
+  }
+}
+
+START_TEST(bson_object_canonical_key_order)
+{
+  // Equal objects built in different orders and with different map sizes
+  BsonObject first;
+  bson_object_initialize_default(&first);
+  put_canonical_values(&first, false);
+  BsonObject second;
+  bson_object_initialize(&second, 16, 0.5);
+  put_canonical_values(&second, true);
+
+  size_t size = bson_object_size(&first);
+  ck_assert_uint_eq(bson_object_size(&second), size);
+  uint8_t *firstBytes = bson_object_to_bytes_canonical(&first);
+  uint8_t *secondBytes = bson_object_to_bytes_canonical(&second);
+  ck_assert_ptr_ne(firstBytes, NULL);
+  ck_assert_ptr_ne(secondBytes, NULL);
+  ck_assert_int_eq(memcmp(firstBytes, secondBytes, size), 0);
+  // Keys are sorted bytewise at every level
+  ck_assert_uint_eq(firstBytes[4], TYPE_STRING);
+  ck_assert_str_eq((char *)&firstBytes[5], "alpha");
+  ck_assert_uint_lt(find_bytes(firstBytes, size, "k00", 4), find_bytes(firstBytes, size, "k19", 4));
+  ck_assert_uint_lt(find_bytes(firstBytes, size, "k19", 4), size);
+  ck_assert_uint_lt(find_bytes(firstBytes, size, "x", 2), find_bytes(firstBytes, size, "y", 2));
+  ck_assert_uint_lt(find_bytes(firstBytes, size, "id", 3), find_bytes(firstBytes, size, "name", 5));
+
+  // Canonical bytes parse back into an equal object
+  BsonObject parsed;
+  ck_assert_uint_eq(bson_object_from_bytes_len(&parsed, firstBytes, size), size);
+  ck_assert_int_eq(bson_object_get_int32(&parsed, "zeta"), 1);
+  ck_assert_str_eq(bson_object_get_string(&parsed, "alpha"), "first");
+  bson_object_deinitialize(&parsed);
+
+  // A buffer that is too small reports the required size
+  uint8_t small[16];
+  size_t written = 0;
+  ck_assert(!bson_object_to_buffer_canonical(&first, small, sizeof(small), &written));
+  ck_assert_uint_eq(written, size);
+  ck_assert(bson_object_to_buffer_canonical(&second, secondBytes, size, &written));
+  ck_assert_uint_eq(written, size);
+  ck_assert_int_eq(memcmp(firstBytes, secondBytes, size), 0);
+
+  // Arrays sort the keys of the objects they contain
+  BsonArray *firstRows = bson_object_get_array(&first, "rows");
+  BsonArray *secondRows = bson_object_get_array(&second, "rows");
+  free(firstBytes);
+  free(secondBytes);
+  size = bson_array_size(firstRows);
+  firstBytes = bson_array_to_bytes_canonical(firstRows);
+  secondBytes = bson_array_to_bytes_canonical(secondRows);
+  ck_assert_int_eq(memcmp(firstBytes, secondBytes, size), 0);
+
+  free(firstBytes);
+  free(secondBytes);
+  bson_object_deinitialize(&first);
+  bson_object_deinitialize(&second);
+}
+END_TEST
+
+/*
+  @brief Check that the image kept by an object matches a full encoding of the object
+*/
+static const uint8_t *assert_image_current(BsonObject *obj) {
+  size_t imageSize = 0;
+  const uint8_t *image = bson_object_get_image(obj, &imageSize);
+  ck_assert_ptr_ne(image, NULL);
+  size_t size = bson_object_size(obj);
+  ck_assert_uint_eq(imageSize, size);
+  uint8_t *bytes = malloc(size);
+  size_t written = 0;
+  ck_assert(bson_object_to_buffer(obj, bytes, size, &written));
+  ck_assert_int_eq(memcmp(image, bytes, size), 0);
+  free(bytes);
+  return image;
+}
+
+START_TEST(bson_object_image_incremental_update)
+{
+  BsonObject obj;
+  bson_object_initialize_default(&obj);
+  size_t size = 0;
+  ck_assert_ptr_eq(bson_object_get_image(&obj, &size), NULL);
+  bson_object_put_int32(&obj, "counter", 1);
+  bson_object_put_string(&obj, "status", "ok");
+  bson_object_put_double(&obj, "time", 0.5);
+  BsonObject *info = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(info);
+  bson_object_put_int64(info, "uptime", 100);
+  bson_object_put_object_owned(&obj, "info", info);
+  BsonArray *list = malloc(sizeof(BsonArray));
+  bson_array_initialize(list, 2);
+  bson_array_add_bool(list, BOOLEAN_TRUE);
+  bson_object_put_array_owned(&obj, "list", list);
+  ck_assert(bson_object_keep_image(&obj));
+  const uint8_t *image = assert_image_current(&obj);
+
+  // Values of the same size are patched in place, and unchanged objects are not encoded again
+  bson_object_put_int32(&obj, "counter", 2);
+  bson_object_put_double(&obj, "time", 1.5);
+  ck_assert_ptr_eq(assert_image_current(&obj), image);
+  ck_assert_ptr_eq(assert_image_current(&obj), image);
+
+  // Values of a different size are spliced between the unmodified elements
+  bson_object_put_string(&obj, "status", "degraded");
+  bson_object_put_int64(&obj, "counter", 3);
+  assert_image_current(&obj);
+
+  // Sub-objects and sub-arrays reached through the object are encoded again
+  bson_object_put_int64(bson_object_get_object(&obj, "info"), "uptime", 200);
+  assert_image_current(&obj);
+  bson_array_add_int32(bson_object_get_array(&obj, "list"), 7);
+  assert_image_current(&obj);
+  ck_assert(bson_object_keep_image(bson_object_get_object(&obj, "info")));
+  bson_object_put_string(bson_object_get_object(&obj, "info"), "name", "sub");
+  assert_image_current(&obj);
+  bson_object_put_string(bson_object_get_object(&obj, "info"), "name", "module");
+  assert_image_current(&obj);
+
+  // New keys and sharing cause the object to be encoded in full
+  bson_object_put_bool(&obj, "ready", BOOLEAN_FALSE);
+  assert_image_current(&obj);
+  BsonObject shared;
+  bson_object_share(&shared, &obj);
+  ck_assert_ptr_eq(bson_object_get_image(&shared, &size), NULL);
+  bson_object_put_int32(&shared, "counter", 4);
+  bson_object_put_int32(&obj, "counter", 5);
+  image = assert_image_current(&obj);
+  ck_assert_int_eq(bson_object_get_int32(&shared, "counter"), 4);
+  bson_object_deinitialize(&shared);
+
+  // Copied elements are not part of any image, so a clone keeps its own image up to date
+  BsonObject clone;
+  ck_assert(bson_object_clone(&clone, &obj));
+  ck_assert(bson_object_get(&clone, "counter")->dirty);
+  ck_assert(bson_object_get(&clone, "status")->dirty);
+  ck_assert(bson_object_keep_image(&clone));
+  assert_image_current(&clone);
+  bson_object_put_int32(&clone, "counter", 6);
+  bson_object_put_string(&clone, "status", "restored");
+  assert_image_current(&clone);
+  ck_assert_int_eq(bson_object_get_int32(&obj, "counter"), 5);
+  bson_object_deinitialize(&clone);
+
+  uint8_t *bytes = bson_object_to_bytes(&obj);
+  ck_assert_int_eq(memcmp(bytes, image, bson_object_size(&obj)), 0);
+  free(bytes);
+  bson_object_deinitialize(&obj);
+}
+END_TEST
+
+/*
+  @brief Build a message whose structure matches a template, with the given slot values
+*/
+static BsonObject *build_template_message(int32_t id, char *method, double progress,
+                                          int64_t stamp, bson_boolean done, char *name) {
+  BsonObject *obj = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(obj);
+  bson_object_put_int32(obj, "id", id);
+  bson_object_put_string(obj, "method", method);
+  BsonObject *params = malloc(sizeof(BsonObject));
+  bson_object_initialize_default(params);
+  bson_object_put_double(params, "progress", progress);
+  bson_object_put_int64(params, "stamp", stamp);
+  BsonArray *files = malloc(sizeof(BsonArray));
+  bson_array_initialize(files, 2);
+  bson_array_add_bool(files, done);
+  bson_array_add_string(files, name);
+  bson_object_put_array_owned(params, "files", files);
+  bson_object_put_object_owned(obj, "params", params);
+  bson_object_put_string(obj, "trailer", "end");
+  return obj;
+}
+
+/*
+  @brief Check that the message of a template matches the encoding of an equivalent object
+*/
+static void assert_template_matches(BsonTemplate *tmpl, BsonObject *expected) {
+  size_t size = 0;
+  const uint8_t *bytes = bson_template_get_bytes(tmpl, &size);
+  ck_assert_uint_eq(size, bson_object_size(expected));
+  uint8_t *encoded = bson_object_to_bytes(expected);
+  ck_assert_int_eq(memcmp(bytes, encoded, size), 0);
+  free(encoded);
+  bson_object_deinitialize(expected);
+  free(expected);
+}
+
+START_TEST(bson_template_fill_slots)
+{
+  const char *keys[] = { "id", "method", "params.progress", "params.stamp", "params.files.0", "params.files.1" };
+  BsonObject *obj = build_template_message(0, "", 0.0, 0, BOOLEAN_FALSE, "none");
+  BsonTemplate tmpl;
+  ck_assert(bson_template_initialize(&tmpl, obj, keys, 6));
+  assert_template_matches(&tmpl, obj);
+
+  // Fixed-size values are written in place
+  ck_assert(bson_template_set_int32(&tmpl, 0, 42));
+  ck_assert(bson_template_set_double(&tmpl, 2, 0.75));
+  ck_assert(bson_template_set_int64(&tmpl, 3, 1234567890123));
+  ck_assert(bson_template_set_bool(&tmpl, 4, BOOLEAN_TRUE));
+  assert_template_matches(&tmpl, build_template_message(42, "", 0.75, 1234567890123, BOOLEAN_TRUE, "none"));
+
+  // Strings of another length move the rest of the message and update enclosing lengths
+  ck_assert(bson_template_set_string(&tmpl, 1, "OnProgressUpdate"));
+  ck_assert(bson_template_set_string(&tmpl, 5, "a much longer file name.bin"));
+  assert_template_matches(&tmpl, build_template_message(42, "OnProgressUpdate", 0.75, 1234567890123, BOOLEAN_TRUE, "a much longer file name.bin"));
+  ck_assert(bson_template_set_string(&tmpl, 5, "x"));
+  ck_assert(bson_template_set_string(&tmpl, 1, "Get"));
+  ck_assert(bson_template_set_int64(&tmpl, 3, -1));
+  assert_template_matches(&tmpl, build_template_message(42, "Get", 0.75, -1, BOOLEAN_TRUE, "x"));
+
+  // Slots only accept values of their own type
+  ck_assert(!bson_template_set_int32(&tmpl, 1, 7));
+  ck_assert(!bson_template_set_string(&tmpl, 0, "seven"));
+  ck_assert(!bson_template_set_double(&tmpl, 6, 7.0));
+  bson_template_deinitialize(&tmpl);
+
+  // Keys must exist and designate distinct values of a supported type
+  obj = build_template_message(0, "", 0.0, 0, BOOLEAN_FALSE, "none");
+  const char *missing[] = { "id", "params.missing" };
+  ck_assert(!bson_template_initialize(&tmpl, obj, missing, 2));
+  const char *throughValue[] = { "id.value" };
+  ck_assert(!bson_template_initialize(&tmpl, obj, throughValue, 1));
+  const char *container[] = { "params.files" };
+  ck_assert(!bson_template_initialize(&tmpl, obj, container, 1));
+  const char *duplicate[] = { "method", "params.stamp", "method" };
+  ck_assert(!bson_template_initialize(&tmpl, obj, duplicate, 3));
+  bson_object_deinitialize(obj);
+  free(obj);
+}
+END_TEST
+
+/*
+  @brief Encode an object through a cache and check the result against a full encoding of the object
+*/
+static const uint8_t *assert_cache_encodes(BsonEncodingCache *cache, BsonObject *obj) {
+  size_t size = 0;
+  const uint8_t *bytes = bson_encoding_cache_encode(cache, obj, &size);
+  ck_assert_ptr_ne(bytes, NULL);
+  ck_assert_uint_eq(size, bson_object_size(obj));
+  uint8_t *expected = bson_object_to_bytes(obj);
+  ck_assert_int_eq(memcmp(bytes, expected, size), 0);
+  free(expected);
+  return bytes;
+}
+
+START_TEST(bson_encoding_cache_reuses_bytes)
+{
+  BsonEncodingCache cache;
+  ck_assert(bson_encoding_cache_initialize(&cache, 2));
+  BsonObject *first = build_template_message(1, "Show", 0.5, 10, BOOLEAN_TRUE, "a");
+  BsonObject *second = build_template_message(1, "Show", 0.5, 10, BOOLEAN_TRUE, "a");
+  size_t size = 0;
+
+  // Unmodified objects are only encoded once, objects with the same contents are cached separately
+  const uint8_t *bytes = assert_cache_encodes(&cache, first);
+  ck_assert_ptr_eq(bson_encoding_cache_encode(&cache, first, &size), bytes);
+  ck_assert_uint_eq(size, bson_object_size(first));
+  ck_assert_uint_eq(cache.misses, 1);
+  ck_assert_uint_eq(cache.hits, 1);
+  const uint8_t *secondBytes = assert_cache_encodes(&cache, second);
+  ck_assert_ptr_ne(secondBytes, bytes);
+  ck_assert_uint_eq(cache.misses, 2);
+  ck_assert_uint_eq(cache.count, 2);
+
+  // Modifications are noticed, including those made to sub-objects and sub-arrays
+  bson_object_put_string(second, "method", "Hide");
+  assert_cache_encodes(&cache, second);
+  ck_assert_uint_eq(cache.misses, 3);
+  ck_assert_uint_eq(cache.count, 2);
+  bson_object_put_double(bson_object_get_object(second, "params"), "progress", 0.25);
+  assert_cache_encodes(&cache, second);
+  ck_assert_uint_eq(cache.misses, 4);
+  BsonArray *files = bson_object_get_array(bson_object_get_object(second, "params"), "files");
+  secondBytes = assert_cache_encodes(&cache, second);
+  ck_assert_ptr_eq(bson_encoding_cache_encode(&cache, second, &size), secondBytes);
+  ck_assert_uint_eq(cache.misses, 5);
+  ck_assert_uint_eq(cache.hits, 2);
+
+  // Sub-objects and sub-arrays modified through pointers kept by the caller are noticed
+  ck_assert(bson_array_add_string(files, "b"));
+  assert_cache_encodes(&cache, second);
+  ck_assert_uint_eq(cache.misses, 6);
+  BsonObject *params = bson_object_get_object(second, "params");
+  assert_cache_encodes(&cache, second);
+  ck_assert(bson_object_put_int64(params, "stamp", 20));
+  secondBytes = assert_cache_encodes(&cache, second);
+  ck_assert_uint_eq(cache.misses, 8);
+
+  // Shared objects are modified independently
+  BsonObject shared;
+  ck_assert(bson_object_share(&shared, second));
+  ck_assert(bson_object_put_int32(&shared, "id", 2));
+  ck_assert_ptr_eq(bson_encoding_cache_encode(&cache, second, &size), secondBytes);
+  ck_assert_uint_eq(cache.hits, 3);
+
+  // The least recently used entry is evicted once the cache is full
+  ck_assert_ptr_eq(bson_encoding_cache_encode(&cache, first, &size), bytes);
+  ck_assert_uint_eq(cache.hits, 4);
+  assert_cache_encodes(&cache, &shared);
+  ck_assert_uint_eq(cache.misses, 9);
+  ck_assert_uint_eq(cache.count, 2);
+  ck_assert_ptr_eq(bson_encoding_cache_encode(&cache, first, &size), bytes);
+  assert_cache_encodes(&cache, second);
+  ck_assert_uint_eq(cache.misses, 10);
+
+  bson_encoding_cache_clear(&cache);
+  ck_assert_uint_eq(cache.count, 0);
+  assert_cache_encodes(&cache, first);
+  ck_assert_uint_eq(cache.misses, 11);
+  bson_encoding_cache_deinitialize(&cache);
+  bson_object_deinitialize(&shared);
+  bson_object_deinitialize(first);
+  free(first);
+  bson_object_deinitialize(second);
+  free(second);
+}
+END_TEST
 
 Suite *suite(void) {
   Suite *s = suite_create("bson_object_test");
@@ -295,6 +2065,40 @@ Suite *suite(void) {
   tcase_add_test(tc, bson_object_from_bytes_corrupted_string);
   tcase_add_test(tc, bson_object_from_bytes_corrupted_integer);
   tcase_add_test(tc, bson_object_from_bytes_corrupted_tag);
+  tcase_add_test(tc, bson_object_from_bytes_invalid_string_length);
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("strings");
+  tcase_add_test(tc, bson_object_string_embedded_null);
+  tcase_add_test(tc, bson_object_short_strings);
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("ownership");
+  tcase_add_test(tc, bson_object_put_owned_values);
+  tcase_add_test(tc, bson_array_growth);
+  tcase_add_test(tc, bson_array_packed_values);
+  tcase_add_test(tc, bson_array_packed_bulk_encoding);
+  tcase_add_test(tc, bson_array_add_multiple_values);
+  tcase_add_test(tc, bson_array_from_bytes_strict_keys);
+  tcase_add_test(tc, bson_array_splice_and_slice);
+  tcase_add_test(tc, bson_array_columnar_objects);
+  tcase_add_test(tc, bson_array_file_backed_values);
+  tcase_add_test(tc, bson_array_parallel_conversion);
+  tcase_add_test(tc, bson_object_to_buffer_single_pass);
+  tcase_add_test(tc, bson_writer_streaming);
+  tcase_add_test(tc, bson_iovec_references_large_strings);
+  tcase_add_test(tc, bson_object_write_stream_chunks);
+  tcase_add_test(tc, bson_object_canonical_key_order);
+  tcase_add_test(tc, bson_object_image_incremental_update);
+  tcase_add_test(tc, bson_template_fill_slots);
+  tcase_add_test(tc, bson_encoding_cache_reuses_bytes);
+
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("sharing");
+  tcase_add_test(tc, bson_object_share_copy_on_write);
+  tcase_add_test(tc, bson_array_share_copy_on_write);
+  tcase_add_test(tc, bson_object_clone_deep_copy);
 
   suite_add_tcase(s, tc);
   return s;
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <stdio.h>
 #include "bson_util.h"
 
 START_TEST(read_int32_le_zero)
@@ -190,6 +191,42 @@ START_TEST(read_double_le_negative_min)
 END_TEST
 
 
+START_TEST(store_load_unaligned)
+{
+  uint8_t buf[1 + SIZE_INT32 + SIZE_INT64 + SIZE_DOUBLE] = { 0 };
+  uint8_t *p = store_int32_le(buf + 1, -2);
+  ck_assert_ptr_eq(p, buf + 1 + SIZE_INT32);
+  p = store_int64_le(p, 0x0102030405060708);
+  p = store_double_le(p, -1.5);
+  ck_assert_ptr_eq(p, buf + sizeof(buf));
+
+  uint8_t expected[sizeof(buf)] = {0, 0xFE, 0xFF, 0xFF, 0xFF, 
+                                   0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 
+                                   0, 0, 0, 0, 0, 0, 0xF8, 0xBF};
+  ck_assert_int_eq(memcmp(buf, expected, sizeof(buf)), 0);
+  int32_t int32Value = 0;
+  int64_t int64Value = 0;
+  double doubleValue = 0;
+  const uint8_t *q = load_int32_le(buf + 1, &int32Value);
+  ck_assert_int_eq(int32Value, -2);
+  ck_assert_ptr_eq(q, buf + 1 + SIZE_INT32);
+  q = load_int64_le(q, &int64Value);
+  ck_assert_int_eq(int64Value, 0x0102030405060708);
+  q = load_double_le(q, &doubleValue);
+  ck_assert(doubleValue == -1.5);
+  ck_assert_ptr_eq(q, buf + sizeof(buf));
+
+  // The position-based functions write the same bytes
+  uint8_t positioned[sizeof(buf)] = { 0 };
+  size_t position = 1;
+  write_int32_le(positioned, -2, &position);
+  write_int64_le(positioned, 0x0102030405060708, &position);
+  write_double_le(positioned, -1.5, &position);
+  ck_assert_uint_eq(position, sizeof(buf));
+  ck_assert_int_eq(memcmp(positioned, expected, sizeof(buf)), 0);
+}
+END_TEST
+
 START_TEST(read_string)
 {
   const char *test_string = "ABCDEFGHIJK4567890qwerty";
@@ -279,6 +316,81 @@ START_TEST(read_string_overrun)
 }
 END_TEST
 
+START_TEST(skip_string)
+{
+  const uint8_t buf[] = { '1', '2', 0x00, 'A', 'B', 'C' };
+  const uint8_t *p = buf;
+  size_t size = sizeof(buf);
+
+  size_t ret = skip_string_len(&p, &size);
+  ck_assert_uint_eq(ret, 3);
+  ck_assert_ptr_eq(p, buf + 3);
+  ck_assert_uint_eq(size, 3);
+
+  // no '\0' in the rest of the buffer
+  ret = skip_string_len(&p, &size);
+  ck_assert_uint_eq(ret, 0);
+  ck_assert_ptr_eq(p, buf + 3);
+  ck_assert_uint_eq(size, 3);
+}
+END_TEST
+
+START_TEST(index_key_table)
+{
+  char buffer[INDEX_KEY_BUFFER_SIZE];
+  char expected[INDEX_KEY_BUFFER_SIZE];
+  size_t length = 0;
+  size_t index = 0;
+  for (index = 0; index < INDEX_KEY_TABLE_SIZE + 20; index++) {
+    sprintf(expected, "%u", (unsigned)index);
+    const char *key = index_key(index, buffer, &length);
+    ck_assert_str_eq(key, expected);
+    ck_assert_uint_eq(length, strlen(expected));
+    ck_assert_uint_eq(length, digits(index));
+  }
+}
+END_TEST
+
+START_TEST(index_key_large)
+{
+  char buffer[INDEX_KEY_BUFFER_SIZE];
+  size_t length = 0;
+  const char *key = index_key(4294967295u, buffer, &length);
+  ck_assert_str_eq(key, "4294967295");
+  ck_assert_uint_eq(length, 10);
+  ck_assert(key >= buffer && key + length < buffer + INDEX_KEY_BUFFER_SIZE);
+}
+END_TEST
+
+static bool count_chunk(void *context, const uint8_t *data, size_t length) {
+  size_t *chunks = (size_t *)context;
+  (void)data;
+  chunks[chunks[0] + 1] = length;
+  chunks[0]++;
+  return true;
+}
+
+START_TEST(stream_chunks)
+{
+  size_t chunks[8] = { 0 };
+  BsonStream stream;
+  ck_assert(bson_stream_initialize(&stream, count_chunk, chunks, 4));
+  ck_assert(bson_stream_write(&stream, "abc", 3));
+  ck_assert_uint_eq(chunks[0], 0);
+  ck_assert(bson_stream_write(&stream, "defghij", 7));
+  ck_assert_uint_eq(chunks[0], 2);
+  ck_assert_uint_eq(stream.used, 2);
+  ck_assert_int_eq(memcmp(stream.chunk, "ij", 2), 0);
+  ck_assert(bson_stream_flush(&stream));
+  ck_assert_uint_eq(chunks[0], 3);
+  ck_assert_uint_eq(chunks[3], 2);
+
+  // Flushing an empty chunk does not call the sink
+  ck_assert(bson_stream_flush(&stream));
+  ck_assert_uint_eq(chunks[0], 3);
+  bson_stream_deinitialize(&stream);
+}
+END_TEST
 
 Suite *suite(void) {
   Suite *s = suite_create("bson_util_test");
@@ -304,10 +416,23 @@ Suite *suite(void) {
   tcase_add_test(tc, read_double_le_positive_max);
   tcase_add_test(tc, read_double_le_positive_min);
   tcase_add_test(tc, read_double_le_negative_min);
+  tcase_add_test(tc, store_load_unaligned);
 
   tcase_add_test(tc, read_string);
   tcase_add_test(tc, read_string_twice);
   tcase_add_test(tc, read_string_overrun);
+  tcase_add_test(tc, skip_string);
+
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("index_keys");
+  tcase_add_test(tc, index_key_table);
+  tcase_add_test(tc, index_key_large);
+
+  suite_add_tcase(s, tc);
+
+  tc = tcase_create("streams");
+  tcase_add_test(tc, stream_chunks);
 
   suite_add_tcase(s, tc);
   return s;